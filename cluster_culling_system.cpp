@@ -0,0 +1,228 @@
+#include "cluster_culling_system.hpp"
+
+#include "vse_shader_reflection.hpp"
+#include "vse_swap_chain.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace vse {
+
+// Specialization constant ids declared in cluster_cull.comp
+constexpr uint32_t SPEC_COMPACT = 0;
+constexpr uint32_t WORKGROUP_SIZE = 64;
+
+struct ClusterCullPushConstantData {
+  std::array<glm::vec4, 6> frustumPlanes;
+  glm::vec4 cameraPosition;
+  uint32_t meshletCount;
+  uint32_t firstCommand;
+  uint32_t drawCountIndex;
+  uint32_t objectIndex;
+};
+
+ClusterCullingSystem::ClusterCullingSystem(
+    VseDevice &device, VseDescriptorLayoutCache &descriptorLayoutCache,
+    VsePipelineLayoutCache &pipelineLayoutCache)
+    : vseDevice{device},
+      compact{device.hasDrawIndirectCount() && device.hasMultiDrawIndirect()},
+      frames(VseSwapChain::MAX_FRAMES_IN_FLIGHT) {
+  const std::string compFilepath = "shaders/cluster_cull.comp.spv";
+  auto reflection = std::make_shared<const VseShaderReflection>(
+      VsePipeline::readFile(compFilepath));
+  const auto &pushConstantRange = reflection->getPushConstantRange();
+  if (pushConstantRange.offset != 0 ||
+      pushConstantRange.size != sizeof(ClusterCullPushConstantData)) {
+    throw std::runtime_error(
+        "cluster cull push constants do not match "
+        "ClusterCullPushConstantData!");
+  }
+
+  // The same cached layout the reflection builds set 0 from
+  setLayout = &VseDescriptorSetLayout::Builder(vseDevice)
+                   .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                               VK_SHADER_STAGE_COMPUTE_BIT)
+                   .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                               VK_SHADER_STAGE_COMPUTE_BIT)
+                   .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                               VK_SHADER_STAGE_COMPUTE_BIT)
+                   .build(descriptorLayoutCache);
+  pipelineLayout = reflection->buildPipelineLayout(descriptorLayoutCache,
+                                                   pipelineLayoutCache);
+  pipeline = std::make_unique<VseComputePipeline>(
+      vseDevice, compFilepath, pipelineLayout,
+      std::map<uint32_t, uint32_t>{
+          {SPEC_COMPACT, static_cast<uint32_t>(compact)}});
+}
+
+ClusterCullingSystem::~ClusterCullingSystem() {}
+
+void ClusterCullingSystem::reserve(FrameResources &frame,
+                                   uint32_t commandCount,
+                                   uint32_t objectCount) {
+  // The frame's previous commands have completed, so buffers can be
+  // replaced right away
+  if (!frame.commands || frame.commands->getInstanceCount() < commandCount) {
+    uint32_t capacity = frame.commands
+                            ? frame.commands->getInstanceCount()
+                            : 1024;
+    while (capacity < commandCount) {
+      capacity *= 2;
+    }
+    frame.commands = std::make_unique<VseBuffer>(
+        vseDevice, sizeof(VkDrawIndexedIndirectCommand), capacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  }
+  uint32_t countCapacity = objectCount + 1;
+  if (!frame.counts || frame.counts->getInstanceCount() < countCapacity) {
+    uint32_t capacity = frame.counts ? frame.counts->getInstanceCount() : 64;
+    while (capacity < countCapacity) {
+      capacity *= 2;
+    }
+    frame.counts = std::make_unique<VseBuffer>(
+        vseDevice, sizeof(uint32_t), capacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    frame.counts->map();
+    memset(frame.counts->getMappedMemory(), 0,
+           static_cast<size_t>(frame.counts->getBufferSize()));
+  }
+}
+
+void ClusterCullingSystem::cull(
+    const FrameInfo &frameInfo, const std::vector<VseGameObject> &gameObjects,
+    VseDescriptorAllocator &descriptorAllocator) {
+  frameIndex = frameInfo.frameIndex;
+  auto &frame = frames[frameIndex];
+
+  // The last frame to use these buffers has completed, take its results
+  stats = frame.tested;
+  if (frame.tested.objectsCulled > 0) {
+    stats.trianglesVisible =
+        *static_cast<const uint32_t *>(frame.counts->getMappedMemory());
+  }
+
+  objectDraws.assign(gameObjects.size(), ObjectDraw{});
+  frame.tested = {};
+  uint32_t commandCount = 0;
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    const auto &obj = gameObjects[i];
+    if (obj.model == nullptr || !obj.visible || obj.lodLevel != 0 ||
+        !obj.model->hasMeshlets()) {
+      continue;
+    }
+    auto &draw = objectDraws[i];
+    draw.firstCommand = commandCount;
+    draw.meshletCount = obj.model->getMeshletCount();
+    draw.drawCountIndex = frame.tested.objectsCulled++;
+    commandCount += draw.meshletCount;
+    frame.tested.meshletsTested += draw.meshletCount;
+    frame.tested.trianglesTested += obj.model->getTriangleCount();
+  }
+  if (frame.tested.objectsCulled == 0) {
+    return;
+  }
+
+  reserve(frame, commandCount, frame.tested.objectsCulled);
+  memset(frame.counts->getMappedMemory(), 0,
+         (frame.tested.objectsCulled + 1) * sizeof(uint32_t));
+
+  VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+  pipeline->bind(commandBuffer);
+  const VseCamera &camera = frameInfo.camera;
+  glm::mat4 viewProjection = camera.getProjection() * camera.getView();
+  auto commandsInfo = frame.commands->descriptorInfo();
+  auto countsInfo = frame.counts->descriptorInfo();
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    const auto &draw = objectDraws[i];
+    if (draw.meshletCount == 0) {
+      continue;
+    }
+    const auto &obj = gameObjects[i];
+    auto meshletsInfo = obj.model->meshletDescriptorInfo();
+    VkDescriptorSet descriptorSet;
+    if (!VseDescriptorWriter(*setLayout, descriptorAllocator)
+             .writeBuffer(0, &meshletsInfo)
+             .writeBuffer(1, &commandsInfo)
+             .writeBuffer(2, &countsInfo)
+             .build(descriptorSet)) {
+      throw std::runtime_error(
+          "failed to allocate cluster culling descriptor set!");
+    }
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+    // Culling happens in model space, where the meshlet bounds are. Half
+    // spaces survive any affine transform, normal cone angles only
+    // survive uniform scale.
+    glm::mat4 modelMatrix = obj.interpolatedMat4(frameInfo.interpolationAlpha);
+    float scaleX = glm::length(glm::vec3{modelMatrix[0]});
+    float scaleY = glm::length(glm::vec3{modelMatrix[1]});
+    float scaleZ = glm::length(glm::vec3{modelMatrix[2]});
+    bool uniformScale = std::max({scaleX, scaleY, scaleZ}) <=
+                        std::min({scaleX, scaleY, scaleZ}) * 1.001f;
+
+    ClusterCullPushConstantData push{};
+    push.frustumPlanes = frustumPlanes(viewProjection * modelMatrix);
+    push.cameraPosition = glm::inverse(camera.getView() * modelMatrix)[3];
+    push.cameraPosition.w = uniformScale ? 1.f : 0.f;
+    push.meshletCount = draw.meshletCount;
+    push.firstCommand = draw.firstCommand;
+    push.drawCountIndex = draw.drawCountIndex;
+    push.objectIndex = static_cast<uint32_t>(i);
+    vkCmdPushConstants(commandBuffer, pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(ClusterCullPushConstantData), &push);
+    vkCmdDispatch(commandBuffer,
+                  (draw.meshletCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                  1, 1);
+  }
+
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+}
+
+bool ClusterCullingSystem::draw(VkCommandBuffer commandBuffer,
+                                uint32_t objectIndex) const {
+  if (!isCulled(objectIndex)) {
+    return false;
+  }
+  const auto &draw = objectDraws[objectIndex];
+  const auto &frame = frames[frameIndex];
+  constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  VkDeviceSize offset = static_cast<VkDeviceSize>(draw.firstCommand) * stride;
+  if (compact) {
+    vseDevice.cmdDrawIndexedIndirectCount(
+        commandBuffer, frame.commands->getBuffer(), offset,
+        frame.counts->getBuffer(),
+        (draw.drawCountIndex + 1) * sizeof(uint32_t), draw.meshletCount,
+        stride);
+  } else if (vseDevice.hasMultiDrawIndirect()) {
+    vkCmdDrawIndexedIndirect(commandBuffer, frame.commands->getBuffer(),
+                             offset, draw.meshletCount, stride);
+  } else {
+    for (uint32_t i = 0; i < draw.meshletCount; i++) {
+      vkCmdDrawIndexedIndirect(commandBuffer, frame.commands->getBuffer(),
+                               offset + i * stride, 1, stride);
+    }
+  }
+  return true;
+}
+
+}  // namespace vse
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "vse_buffer.hpp"
+#include "vse_descriptors.hpp"
+#include "vse_device.hpp"
+#include "vse_frame_info.hpp"
+#include "vse_game_object.hpp"
+#include "vse_pipeline.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vse {
+
+// Culls the meshlets of objects drawn at full detail on the GPU, before the
+// scene pass. One compute dispatch per object tests each meshlet's bounding
+// sphere against the view frustum and its normal cone against the camera,
+// and writes indexed indirect draws of the survivors into a per-frame
+// buffer, which SimpleRenderSystem draws instead of the object's whole
+// index range. With VK_KHR_draw_indirect_count the draws are compacted and
+// their count read from a buffer; without it culled meshlets keep their
+// slot and draw no instances.
+class ClusterCullingSystem {
+ public:
+  struct Stats {
+    uint32_t objectsCulled;
+    uint32_t meshletsTested;
+    uint32_t trianglesTested;
+    uint32_t trianglesVisible;
+  };
+
+  ClusterCullingSystem(VseDevice &device,
+                       VseDescriptorLayoutCache &descriptorLayoutCache,
+                       VsePipelineLayoutCache &pipelineLayoutCache);
+  ~ClusterCullingSystem();
+
+  ClusterCullingSystem(const ClusterCullingSystem &) = delete;
+  ClusterCullingSystem &operator=(const ClusterCullingSystem &) = delete;
+
+  // Once per frame after LOD selection and outside of any render pass.
+  // Only objects at level 0 of models with meshlets are culled.
+  void cull(const FrameInfo &frameInfo,
+            const std::vector<VseGameObject> &gameObjects,
+            VseDescriptorAllocator &descriptorAllocator);
+
+  // Whether gameObjects[objectIndex] is drawn through draw() this frame
+  bool isCulled(uint32_t objectIndex) const {
+    return objectIndex < objectDraws.size() &&
+           objectDraws[objectIndex].meshletCount > 0;
+  }
+  // Draws the meshlets of gameObjects[objectIndex] that survived the last
+  // cull with the object's model bound. False when the object wasn't culled
+  // and has to be drawn as usual.
+  bool draw(VkCommandBuffer commandBuffer, uint32_t objectIndex) const;
+
+  // Visible triangles are read back, so these describe the latest frame
+  // that has finished on the GPU
+  const Stats &getStats() const { return stats; }
+  bool isCompacting() const { return compact; }
+
+ private:
+  struct FrameResources {
+    // VkDrawIndexedIndirectCommands, one range per culled object
+    std::unique_ptr<VseBuffer> commands;
+    // Visible triangles followed by each object's draw count, mapped
+    std::unique_ptr<VseBuffer> counts;
+    // What this frame tested, reported along with its visible triangles
+    Stats tested{};
+  };
+
+  struct ObjectDraw {
+    uint32_t firstCommand;
+    // 0 when the object isn't culled
+    uint32_t meshletCount = 0;
+    uint32_t drawCountIndex;
+  };
+
+  void reserve(FrameResources &frame, uint32_t commandCount,
+               uint32_t objectCount);
+
+  VseDevice &vseDevice;
+  VseDescriptorSetLayout *setLayout;
+  VkPipelineLayout pipelineLayout;
+  std::unique_ptr<VseComputePipeline> pipeline;
+  bool compact;
+
+  std::vector<FrameResources> frames;
+  int frameIndex = 0;
+  std::vector<ObjectDraw> objectDraws;
+  Stats stats{};
+};
+
+}  // namespace vse
@@ -1,2 +1,8 @@
 /Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/simple_shader.vert -o shaders/simple_shader.vert.spv
-/Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/simple_shader.frag -o shaders/simple_shader.frag.spv
\ No newline at end of file
+/Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/simple_shader.frag -o shaders/simple_shader.frag.spv
+/Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/simple_shader_bindless.frag -o shaders/simple_shader_bindless.frag.spv
+/Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/cluster_cull.comp -o shaders/cluster_cull.comp.spv
+/Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/depth_pyramid.comp -o shaders/depth_pyramid.comp.spv
+/Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/depth_pyramid_ms.comp -o shaders/depth_pyramid_ms.comp.spv
+/Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/occlusion_cull.comp -o shaders/occlusion_cull.comp.spv
+/Users/danielfernandes/VulkanSDK/1.4.321.0/macOS/bin/glslc shaders/depth_only.vert -o shaders/depth_only.vert.spv
@@ -0,0 +1,48 @@
+#include "lod_system.hpp"
+
+// std
+#include <algorithm>
+
+namespace vse {
+
+void LodSystem::update(const FrameInfo &frameInfo,
+                       std::vector<VseGameObject> &gameObjects,
+                       uint32_t viewportHeight) {
+  const VseCamera &camera = frameInfo.camera;
+  stats = {};
+  for (auto &obj : gameObjects) {
+    if (obj.model == nullptr || !obj.visible) {
+      continue;
+    }
+    const VseModel &model = *obj.model;
+    uint32_t level = 0;
+    float radius = model.getBoundingRadius();
+    if (model.getLodCount() > 1 && radius > 0.f) {
+      glm::mat4 m = obj.interpolatedMat4(frameInfo.interpolationAlpha);
+      float scale = std::max({glm::length(glm::vec3{m[0]}),
+                              glm::length(glm::vec3{m[1]}),
+                              glm::length(glm::vec3{m[2]})});
+      float viewDepth = (camera.getView() * m[3]).z;
+      float sizePixels =
+          camera.projectedSize(radius * scale, viewDepth) * viewportHeight;
+
+      // A level's error is a length in model space, so it covers the same
+      // share of the sphere's projected diameter
+      for (uint32_t i = model.getLodCount() - 1; i > 0; i--) {
+        float errorPixels =
+            model.getLods()[i].error / (2.f * radius) * sizePixels;
+        float threshold =
+            i > obj.lodLevel ? pixelError * (1.f - hysteresis) : pixelError;
+        if (errorPixels <= threshold) {
+          level = i;
+          break;
+        }
+      }
+    }
+    obj.lodLevel = level;
+    stats.trianglesSubmitted += model.getTriangleCount(level);
+    stats.trianglesFullDetail += model.getTriangleCount();
+  }
+}
+
+}  // namespace vse
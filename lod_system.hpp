@@ -0,0 +1,47 @@
+#pragma once
+
+#include "vse_frame_info.hpp"
+#include "vse_game_object.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace vse {
+
+// Picks each object's level of detail from the projected size of its
+// bounding sphere: the coarsest level whose simplification error stays
+// under pixelError pixels on screen. A coarser level is only taken once its
+// error drops below pixelError * (1 - hysteresis), so objects hovering near
+// a threshold don't flicker between levels.
+class LodSystem {
+ public:
+  struct Stats {
+    uint32_t trianglesSubmitted;
+    // What the same objects would submit at full detail
+    uint32_t trianglesFullDetail;
+  };
+
+  LodSystem() = default;
+
+  LodSystem(const LodSystem &) = delete;
+  LodSystem &operator=(const LodSystem &) = delete;
+
+  void setPixelError(float pixels) { pixelError = pixels; }
+  void setHysteresis(float fraction) { hysteresis = fraction; }
+
+  // Once per frame before rendering, with the camera of frameInfo. Objects
+  // that aren't visible keep their level.
+  void update(const FrameInfo &frameInfo,
+              std::vector<VseGameObject> &gameObjects,
+              uint32_t viewportHeight);
+
+  const Stats &getStats() const { return stats; }
+
+ private:
+  float pixelError = 1.f;
+  float hysteresis = .25f;
+  Stats stats{};
+};
+
+}  // namespace vse
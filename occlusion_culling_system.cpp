@@ -0,0 +1,551 @@
+#include "occlusion_culling_system.hpp"
+
+#include "cluster_culling_system.hpp"
+#include "vse_shader_reflection.hpp"
+#include "vse_swap_chain.hpp"
+#include "vse_utils.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace vse {
+
+// Specialization constant ids declared in occlusion_cull.comp and the
+// depth pyramid shaders
+constexpr uint32_t SPEC_REVERSED_Z = 0;
+constexpr uint32_t CULL_WORKGROUP_SIZE = 64;
+constexpr uint32_t PYRAMID_WORKGROUP_SIZE = 8;
+
+struct OcclusionCandidate {
+  // View space bounding sphere
+  glm::vec4 sphere;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  uint32_t objectIndex;
+  uint32_t padding;
+};
+
+struct OcclusionCullPushConstantData {
+  glm::vec4 projection;
+  float near;
+  uint32_t candidateCount;
+  uint32_t late;
+  int32_t pyramidLevels;
+};
+
+struct DepthPyramidPushConstantData {
+  int32_t sourceLevel;
+};
+
+namespace {
+
+VkImageMemoryBarrier pyramidBarrier(VkImage image, uint32_t baseLevel,
+                                    uint32_t levelCount,
+                                    VkImageLayout oldLayout,
+                                    VkAccessFlags srcAccessMask,
+                                    VkAccessFlags dstAccessMask) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = srcAccessMask;
+  barrier.dstAccessMask = dstAccessMask;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, baseLevel,
+                              levelCount, 0, 1};
+  return barrier;
+}
+
+// Pipeline layout reflected from a compute shader, checked against the push
+// constants the host pushes
+VkPipelineLayout reflectPipelineLayout(
+    const std::string &compFilepath, uint32_t pushConstantSize,
+    VseDescriptorLayoutCache &descriptorLayoutCache,
+    VsePipelineLayoutCache &pipelineLayoutCache) {
+  auto reflection = std::make_shared<const VseShaderReflection>(
+      VsePipeline::readFile(compFilepath));
+  const auto &pushConstantRange = reflection->getPushConstantRange();
+  if (pushConstantRange.offset != 0 ||
+      pushConstantRange.size != pushConstantSize) {
+    throw std::runtime_error(compFilepath +
+                             " push constants do not match the host!");
+  }
+  return reflection->buildPipelineLayout(descriptorLayoutCache,
+                                         pipelineLayoutCache);
+}
+
+}  // namespace
+
+OcclusionCullingSystem::OcclusionCullingSystem(
+    VseDevice &device, VseDescriptorLayoutCache &descriptorLayoutCache,
+    VsePipelineLayoutCache &pipelineLayoutCache, VseSamplerCache &samplerCache,
+    RetireFunction retire, bool reversedZ)
+    : vseDevice{device},
+      retire{std::move(retire)},
+      frames(VseSwapChain::MAX_FRAMES_IN_FLIGHT) {
+  // Pyramid texels are only ever fetched, never filtered
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_NEAREST;
+  samplerInfo.minFilter = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  sampler = samplerCache.getSampler(samplerInfo);
+
+  // The same cached layouts the reflection builds set 0 from
+  cullSetLayout = &VseDescriptorSetLayout::Builder(vseDevice)
+                       .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                   VK_SHADER_STAGE_COMPUTE_BIT)
+                       .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                   VK_SHADER_STAGE_COMPUTE_BIT)
+                       .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                   VK_SHADER_STAGE_COMPUTE_BIT)
+                       .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                   VK_SHADER_STAGE_COMPUTE_BIT)
+                       .addBinding(4,
+                                   VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                   VK_SHADER_STAGE_COMPUTE_BIT)
+                       .build(descriptorLayoutCache);
+  pyramidSetLayout =
+      &VseDescriptorSetLayout::Builder(vseDevice)
+           .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                       VK_SHADER_STAGE_COMPUTE_BIT)
+           .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                       VK_SHADER_STAGE_COMPUTE_BIT)
+           .build(descriptorLayoutCache);
+
+  std::map<uint32_t, uint32_t> specializationConstants{
+      {SPEC_REVERSED_Z, static_cast<uint32_t>(reversedZ)}};
+  const std::string cullFilepath = "shaders/occlusion_cull.comp.spv";
+  cullPipelineLayout = reflectPipelineLayout(
+      cullFilepath, sizeof(OcclusionCullPushConstantData),
+      descriptorLayoutCache, pipelineLayoutCache);
+  cullPipeline = std::make_unique<VseComputePipeline>(
+      vseDevice, cullFilepath, cullPipelineLayout, specializationConstants);
+
+  const std::string pyramidFilepath = "shaders/depth_pyramid.comp.spv";
+  pyramidPipelineLayout = reflectPipelineLayout(
+      pyramidFilepath, sizeof(DepthPyramidPushConstantData),
+      descriptorLayoutCache, pipelineLayoutCache);
+  pyramidPipeline = std::make_unique<VseComputePipeline>(
+      vseDevice, pyramidFilepath, pyramidPipelineLayout,
+      specializationConstants);
+
+  const std::string pyramidMsFilepath = "shaders/depth_pyramid_ms.comp.spv";
+  pyramidMsPipelineLayout = reflectPipelineLayout(
+      pyramidMsFilepath, 0, descriptorLayoutCache, pipelineLayoutCache);
+  pyramidMsPipeline = std::make_unique<VseComputePipeline>(
+      vseDevice, pyramidMsFilepath, pyramidMsPipelineLayout,
+      specializationConstants);
+}
+
+OcclusionCullingSystem::~OcclusionCullingSystem() {
+  // Only destroyed once the device is idle
+  VkDevice device = vseDevice.device();
+  for (auto view : pyramidLevelViews) {
+    vkDestroyImageView(device, view, nullptr);
+  }
+  if (pyramid != VK_NULL_HANDLE) {
+    vkDestroyImageView(device, pyramidView, nullptr);
+    vkDestroyImage(device, pyramid, nullptr);
+    vkFreeMemory(device, pyramidMemory, nullptr);
+  }
+}
+
+bool OcclusionCullingSystem::supportsDepthFormat(VseDevice &device,
+                                                 VkFormat format) {
+  // A view of both aspects of a depth stencil image can't be sampled
+  if (!isDepthFormat(format) || hasStencilComponent(format)) {
+    return false;
+  }
+  return device.getFormatProperties(format).optimalTilingFeatures &
+         VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
+
+void OcclusionCullingSystem::reserve(FrameResources &frame,
+                                     uint32_t candidateCount) {
+  // The frame's previous commands have completed, so buffers can be
+  // replaced right away
+  if (!frame.candidates ||
+      frame.candidates->getInstanceCount() < candidateCount) {
+    uint32_t capacity =
+        frame.candidates ? frame.candidates->getInstanceCount() : 256;
+    while (capacity < candidateCount) {
+      capacity *= 2;
+    }
+    frame.candidates = std::make_unique<VseBuffer>(
+        vseDevice, sizeof(OcclusionCandidate), capacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    frame.candidates->map();
+    // Both phases' commands
+    frame.commands = std::make_unique<VseBuffer>(
+        vseDevice, sizeof(VkDrawIndexedIndirectCommand), capacity * 2,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  }
+  if (!frame.counts) {
+    frame.counts = std::make_unique<VseBuffer>(
+        vseDevice, sizeof(uint32_t), 3, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    frame.counts->map();
+  }
+}
+
+void OcclusionCullingSystem::reserveVisibility(uint32_t objectCount) {
+  if (visibility && visibility->getInstanceCount() >= objectCount) {
+    return;
+  }
+  uint32_t capacity = visibility ? visibility->getInstanceCount() : 256;
+  while (capacity < objectCount) {
+    capacity *= 2;
+  }
+  if (visibility) {
+    // Frames in flight still read and write the old flags
+    VseBuffer *old = visibility.release();
+    retire([old]() { delete old; });
+  }
+  visibility = std::make_unique<VseBuffer>(
+      vseDevice, sizeof(uint32_t), capacity,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  visibility->map();
+  // Everything counts as visible at first, so the first frame draws it all
+  // early and occludes with it
+  std::fill_n(static_cast<uint32_t *>(visibility->getMappedMemory()),
+              capacity, 1u);
+}
+
+void OcclusionCullingSystem::createPyramid(VkCommandBuffer commandBuffer,
+                                           VkExtent2D extent) {
+  destroyPyramid();
+  depthExtent = extent;
+  // Halving rounds up and the reduction reads every texel a level texel
+  // overlaps, so each level is a conservative bound of the one below
+  VkExtent2D levelExtent{std::max(1u, (extent.width + 1) / 2),
+                         std::max(1u, (extent.height + 1) / 2)};
+  pyramidLevelExtents.push_back(levelExtent);
+  while (levelExtent.width > 1 || levelExtent.height > 1) {
+    levelExtent = {std::max(1u, (levelExtent.width + 1) / 2),
+                   std::max(1u, (levelExtent.height + 1) / 2)};
+    pyramidLevelExtents.push_back(levelExtent);
+  }
+  uint32_t levelCount = static_cast<uint32_t>(pyramidLevelExtents.size());
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = pyramidLevelExtents[0].width;
+  imageInfo.extent.height = pyramidLevelExtents[0].height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = levelCount;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = VK_FORMAT_R32_SFLOAT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  vseDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                pyramid, pyramidMemory);
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = pyramid;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = VK_FORMAT_R32_SFLOAT;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0,
+                               1};
+  if (vkCreateImageView(vseDevice.device(), &viewInfo, nullptr,
+                        &pyramidView) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create depth pyramid view!");
+  }
+  for (uint32_t level = 0; level < levelCount; level++) {
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+    VkImageView view;
+    if (vkCreateImageView(vseDevice.device(), &viewInfo, nullptr, &view) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid view!");
+    }
+    pyramidLevelViews.push_back(view);
+  }
+
+  auto toGeneral = pyramidBarrier(pyramid, 0, levelCount,
+                                  VK_IMAGE_LAYOUT_UNDEFINED, 0, 0);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &toGeneral);
+}
+
+void OcclusionCullingSystem::destroyPyramid() {
+  if (pyramid == VK_NULL_HANDLE) {
+    return;
+  }
+  VkDevice device = vseDevice.device();
+  retire([device, image = pyramid, memory = pyramidMemory, view = pyramidView,
+          levelViews = pyramidLevelViews]() {
+    for (auto levelView : levelViews) {
+      vkDestroyImageView(device, levelView, nullptr);
+    }
+    vkDestroyImageView(device, view, nullptr);
+    vkDestroyImage(device, image, nullptr);
+    vkFreeMemory(device, memory, nullptr);
+  });
+  pyramid = VK_NULL_HANDLE;
+  pyramidMemory = VK_NULL_HANDLE;
+  pyramidView = VK_NULL_HANDLE;
+  pyramidLevelViews.clear();
+  pyramidLevelExtents.clear();
+}
+
+void OcclusionCullingSystem::cullEarly(
+    const FrameInfo &frameInfo, const std::vector<VseGameObject> &gameObjects,
+    VkExtent2D extent, VseDescriptorAllocator &descriptorAllocator) {
+  frameIndex = frameInfo.frameIndex;
+  auto &frame = frames[frameIndex];
+
+  // The last frame to use these buffers has completed, take its results
+  stats = {};
+  if (frame.candidateCount > 0) {
+    const auto *counts =
+        static_cast<const uint32_t *>(frame.counts->getMappedMemory());
+    stats = {frame.candidateCount, counts[0], counts[1], counts[2]};
+  }
+
+  candidateSlots.assign(gameObjects.size(), INVALID_SLOT);
+  frame.candidateCount = 0;
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    const auto &obj = gameObjects[i];
+    uint32_t objectIndex = static_cast<uint32_t>(i);
+    if (obj.model == nullptr || !obj.visible ||
+        obj.model->getIndexCount() == 0 ||
+        (frameInfo.clusterCulling != nullptr &&
+         frameInfo.clusterCulling->isCulled(objectIndex))) {
+      continue;
+    }
+    candidateSlots[i] = frame.candidateCount++;
+  }
+  if (frame.candidateCount == 0) {
+    return;
+  }
+
+  VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+  if (extent.width != depthExtent.width ||
+      extent.height != depthExtent.height) {
+    createPyramid(commandBuffer, extent);
+  }
+  reserveVisibility(static_cast<uint32_t>(gameObjects.size()));
+  reserve(frame, frame.candidateCount);
+  memset(frame.counts->getMappedMemory(), 0, 3 * sizeof(uint32_t));
+
+  const VseCamera &camera = frameInfo.camera;
+  auto *candidates =
+      static_cast<OcclusionCandidate *>(frame.candidates->getMappedMemory());
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    if (candidateSlots[i] == INVALID_SLOT) {
+      continue;
+    }
+    const auto &obj = gameObjects[i];
+    const VseModel &model = *obj.model;
+    glm::mat4 m = obj.interpolatedMat4(frameInfo.interpolationAlpha);
+    float scale = std::max({glm::length(glm::vec3{m[0]}),
+                            glm::length(glm::vec3{m[1]}),
+                            glm::length(glm::vec3{m[2]})});
+    const auto &lod =
+        model.getLods()[std::min(obj.lodLevel, model.getLodCount() - 1)];
+
+    OcclusionCandidate candidate{};
+    candidate.sphere = glm::vec4{glm::vec3{camera.getView() * m[3]},
+                                 model.getBoundingRadius() * scale};
+    candidate.indexCount = lod.indexCount;
+    candidate.firstIndex = lod.firstIndex;
+    candidate.objectIndex = static_cast<uint32_t>(i);
+    candidates[candidateSlots[i]] = candidate;
+  }
+
+  auto candidatesInfo = frame.candidates->descriptorInfo();
+  auto visibilityInfo = visibility->descriptorInfo();
+  auto commandsInfo = frame.commands->descriptorInfo();
+  auto countsInfo = frame.counts->descriptorInfo();
+  VkDescriptorImageInfo pyramidInfo{sampler, pyramidView,
+                                    VK_IMAGE_LAYOUT_GENERAL};
+  if (!VseDescriptorWriter(*cullSetLayout, descriptorAllocator)
+           .writeBuffer(0, &candidatesInfo)
+           .writeBuffer(1, &visibilityInfo)
+           .writeBuffer(2, &commandsInfo)
+           .writeBuffer(3, &countsInfo)
+           .writeImage(4, &pyramidInfo)
+           .build(frame.descriptorSet)) {
+    throw std::runtime_error(
+        "failed to allocate occlusion culling descriptor set!");
+  }
+
+  // The last frame's late phase wrote the visibility flags
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  const glm::mat4 &p = camera.getProjection();
+  projection = {p[0][0], p[1][1], p[2][2], p[3][2]};
+  nearPlane = camera.getNear();
+  OcclusionCullPushConstantData push{};
+  push.projection = projection;
+  push.near = nearPlane;
+  push.candidateCount = frame.candidateCount;
+  push.late = 0;
+  push.pyramidLevels = static_cast<int32_t>(pyramidLevelViews.size());
+  cullPipeline->bind(commandBuffer);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          cullPipelineLayout, 0, 1, &frame.descriptorSet, 0,
+                          nullptr);
+  vkCmdPushConstants(commandBuffer, cullPipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(OcclusionCullPushConstantData), &push);
+  vkCmdDispatch(commandBuffer,
+                (frame.candidateCount + CULL_WORKGROUP_SIZE - 1) /
+                    CULL_WORKGROUP_SIZE,
+                1, 1);
+
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+}
+
+void OcclusionCullingSystem::cullLate(
+    VkCommandBuffer commandBuffer, VkImageView depthView,
+    VkSampleCountFlagBits depthSamples,
+    VseDescriptorAllocator &descriptorAllocator) {
+  const auto &frame = frames[frameIndex];
+  if (frame.candidateCount == 0) {
+    return;
+  }
+  uint32_t levelCount = static_cast<uint32_t>(pyramidLevelViews.size());
+
+  // Earlier frames' late phases may still be reading the pyramid
+  auto toWrite = pyramidBarrier(pyramid, 0, levelCount,
+                                VK_IMAGE_LAYOUT_GENERAL, 0,
+                                VK_ACCESS_SHADER_WRITE_BIT);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &toWrite);
+
+  for (uint32_t level = 0; level < levelCount; level++) {
+    // The first level reduces the depth buffer, the others the level below
+    VkDescriptorImageInfo sourceInfo{
+        sampler, level == 0 ? depthView : pyramidView,
+        level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                   : VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorImageInfo destinationInfo{
+        VK_NULL_HANDLE, pyramidLevelViews[level], VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorSet descriptorSet;
+    if (!VseDescriptorWriter(*pyramidSetLayout, descriptorAllocator)
+             .writeImage(0, &sourceInfo)
+             .writeImage(1, &destinationInfo)
+             .build(descriptorSet)) {
+      throw std::runtime_error(
+          "failed to allocate depth pyramid descriptor set!");
+    }
+
+    bool multisampled = level == 0 && depthSamples != VK_SAMPLE_COUNT_1_BIT;
+    VkPipelineLayout pipelineLayout =
+        multisampled ? pyramidMsPipelineLayout : pyramidPipelineLayout;
+    (multisampled ? pyramidMsPipeline : pyramidPipeline)->bind(commandBuffer);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    if (!multisampled) {
+      DepthPyramidPushConstantData push{};
+      push.sourceLevel = level == 0 ? 0 : static_cast<int32_t>(level - 1);
+      vkCmdPushConstants(commandBuffer, pipelineLayout,
+                         VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                         sizeof(DepthPyramidPushConstantData), &push);
+    }
+    const VkExtent2D &levelExtent = pyramidLevelExtents[level];
+    vkCmdDispatch(
+        commandBuffer,
+        (levelExtent.width + PYRAMID_WORKGROUP_SIZE - 1) /
+            PYRAMID_WORKGROUP_SIZE,
+        (levelExtent.height + PYRAMID_WORKGROUP_SIZE - 1) /
+            PYRAMID_WORKGROUP_SIZE,
+        1);
+
+    auto toRead = pyramidBarrier(pyramid, level, 1, VK_IMAGE_LAYOUT_GENERAL,
+                                 VK_ACCESS_SHADER_WRITE_BIT,
+                                 VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &toRead);
+  }
+
+  // Same camera and candidates as the early phase
+  OcclusionCullPushConstantData push{};
+  push.projection = projection;
+  push.near = nearPlane;
+  push.candidateCount = frame.candidateCount;
+  push.late = 1;
+  push.pyramidLevels = static_cast<int32_t>(levelCount);
+  cullPipeline->bind(commandBuffer);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          cullPipelineLayout, 0, 1, &frame.descriptorSet, 0,
+                          nullptr);
+  vkCmdPushConstants(commandBuffer, cullPipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(OcclusionCullPushConstantData), &push);
+  vkCmdDispatch(commandBuffer,
+                (frame.candidateCount + CULL_WORKGROUP_SIZE - 1) /
+                    CULL_WORKGROUP_SIZE,
+                1, 1);
+
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  // The counts are read on the host once the frame's fence signals
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr,
+                       0, nullptr);
+}
+
+bool OcclusionCullingSystem::draw(VkCommandBuffer commandBuffer,
+                                  uint32_t objectIndex, Phase phase) const {
+  if (!isTested(objectIndex)) {
+    return false;
+  }
+  const auto &frame = frames[frameIndex];
+  constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  uint32_t command = candidateSlots[objectIndex];
+  if (phase == Phase::Late) {
+    command += frame.candidateCount;
+  }
+  vkCmdDrawIndexedIndirect(commandBuffer, frame.commands->getBuffer(),
+                           static_cast<VkDeviceSize>(command) * stride, 1,
+                           stride);
+  return true;
+}
+
+}  // namespace vse
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "vse_buffer.hpp"
+#include "vse_deletion_queue.hpp"
+#include "vse_descriptors.hpp"
+#include "vse_device.hpp"
+#include "vse_frame_info.hpp"
+#include "vse_game_object.hpp"
+#include "vse_pipeline.hpp"
+#include "vse_texture.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vse {
+
+// Drops the draws of objects hidden behind others, tested on the GPU
+// against a hierarchical depth pyramid. Each frame runs in two phases: the
+// early phase draws the objects found visible at the end of the last
+// frame, the depth they leave behind is reduced into a pyramid of farthest
+// depths, and the late phase tests every object against it, drawing those
+// that became visible and remembering the result for the next frame.
+// Objects are drawn through indirect commands, so no result is read back
+// and nothing pops in a frame late. Objects whose meshlets are culled by
+// ClusterCullingSystem and unindexed models are drawn early as usual.
+class OcclusionCullingSystem {
+ public:
+  enum class Phase { Early, Late };
+
+  struct Stats {
+    uint32_t objectsTested;
+    uint32_t drawnEarly;
+    uint32_t drawnLate;
+    uint32_t occluded;
+  };
+
+  OcclusionCullingSystem(VseDevice &device,
+                         VseDescriptorLayoutCache &descriptorLayoutCache,
+                         VsePipelineLayoutCache &pipelineLayoutCache,
+                         VseSamplerCache &samplerCache, RetireFunction retire,
+                         bool reversedZ);
+  ~OcclusionCullingSystem();
+
+  OcclusionCullingSystem(const OcclusionCullingSystem &) = delete;
+  OcclusionCullingSystem &operator=(const OcclusionCullingSystem &) = delete;
+
+  // The pyramid is built by sampling the depth buffer, which needs a depth
+  // only format the device can sample
+  static bool supportsDepthFormat(VseDevice &device, VkFormat format);
+
+  // Once per frame after cluster culling and outside of any render pass,
+  // with the extent of the depth buffer the scene is drawn into. Records
+  // the early phase's draws.
+  void cullEarly(const FrameInfo &frameInfo,
+                 const std::vector<VseGameObject> &gameObjects,
+                 VkExtent2D depthExtent,
+                 VseDescriptorAllocator &descriptorAllocator);
+  // Between the early and the late scene pass, with the depth the early
+  // pass left in the depth read only layout. Builds the pyramid and records
+  // the late phase's draws.
+  void cullLate(VkCommandBuffer commandBuffer, VkImageView depthView,
+                VkSampleCountFlagBits depthSamples,
+                VseDescriptorAllocator &descriptorAllocator);
+
+  // Whether gameObjects[objectIndex] is drawn through draw() this frame
+  bool isTested(uint32_t objectIndex) const {
+    return objectIndex < candidateSlots.size() &&
+           candidateSlots[objectIndex] != INVALID_SLOT;
+  }
+  // Draws gameObjects[objectIndex] if the phase decided to, with the
+  // object's model bound. False when the object isn't tested and has to be
+  // drawn as usual.
+  bool draw(VkCommandBuffer commandBuffer, uint32_t objectIndex,
+            Phase phase) const;
+
+  // Counts are read back, so these describe the latest frame that has
+  // finished on the GPU
+  const Stats &getStats() const { return stats; }
+
+ private:
+  static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+
+  struct FrameResources {
+    // Candidates, written by the host each frame
+    std::unique_ptr<VseBuffer> candidates;
+    // VkDrawIndexedIndirectCommands of both phases
+    std::unique_ptr<VseBuffer> commands;
+    // Objects drawn early, drawn late and occluded, mapped
+    std::unique_ptr<VseBuffer> counts;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    uint32_t candidateCount = 0;
+  };
+
+  void reserve(FrameResources &frame, uint32_t candidateCount);
+  void reserveVisibility(uint32_t objectCount);
+  void createPyramid(VkCommandBuffer commandBuffer, VkExtent2D depthExtent);
+  void destroyPyramid();
+
+  VseDevice &vseDevice;
+  RetireFunction retire;
+  VkSampler sampler;
+
+  VseDescriptorSetLayout *cullSetLayout;
+  VkPipelineLayout cullPipelineLayout;
+  std::unique_ptr<VseComputePipeline> cullPipeline;
+  VseDescriptorSetLayout *pyramidSetLayout;
+  VkPipelineLayout pyramidPipelineLayout;
+  std::unique_ptr<VseComputePipeline> pyramidPipeline;
+  VkPipelineLayout pyramidMsPipelineLayout;
+  std::unique_ptr<VseComputePipeline> pyramidMsPipeline;
+
+  // Farthest depth per texel, each level half the size of the previous,
+  // the first half the size of the depth buffer. Always in the general
+  // layout.
+  VkExtent2D depthExtent{0, 0};
+  VkImage pyramid = VK_NULL_HANDLE;
+  VkDeviceMemory pyramidMemory = VK_NULL_HANDLE;
+  // All levels, sampled by the cull shader
+  VkImageView pyramidView = VK_NULL_HANDLE;
+  std::vector<VkImageView> pyramidLevelViews;
+  std::vector<VkExtent2D> pyramidLevelExtents;
+
+  // One flag per object, kept across frames
+  std::unique_ptr<VseBuffer> visibility;
+
+  std::vector<FrameResources> frames;
+  int frameIndex = 0;
+  // The projection terms the cull shader needs, kept for the late phase
+  glm::vec4 projection{0.f};
+  float nearPlane = 0.f;
+  // Candidate of each object this frame, INVALID_SLOT when not tested
+  std::vector<uint32_t> candidateSlots;
+  Stats stats{};
+};
+
+}  // namespace vse
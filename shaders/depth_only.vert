@@ -0,0 +1,34 @@
+#version 450
+
+// Only the position is read, see simple_shader.vert for the rest
+layout (location = 0) in vec3 position;
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+    mat4 projection;
+    mat4 view;
+} ubo;
+
+// VseObjectBuffer::ObjectData, found at the draw's instance index
+struct ObjectData {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    vec3 color;
+    uint textureIndex;
+    vec4 positionScale;
+    vec4 positionOffset;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+// The shaded pass tests against this depth, which must match its own
+// bit for bit
+invariant gl_Position;
+
+void main(){
+    ObjectData object = objects[gl_InstanceIndex];
+    vec3 localPosition =
+        position * object.positionScale.xyz + object.positionOffset.xyz;
+    gl_Position = ubo.projection * ubo.view * object.modelMatrix * vec4(localPosition, 1.0);
+}
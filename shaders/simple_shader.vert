@@ -2,15 +2,74 @@
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 color;
+layout (location = 2) in vec3 normal;
 
 layout (location = 0) out vec3 fragColor;
+layout (location = 1) out vec2 fragUv;
+layout (location = 2) flat out uint fragTextureIndex;
 
-layout(push_constant) uniform Push {
-    mat4 transform;
+layout(set = 0, binding = 0) uniform GlobalUbo {
+    mat4 projection;
+    mat4 view;
+} ubo;
+
+// Pipeline variants, see SimpleRenderSystem::createPipelines
+layout(constant_id = 0) const bool USE_OBJECT_COLOR = false;
+layout(constant_id = 1) const int LIGHTING_MODEL = 1;
+// Vertex format, see VseVertexFormat
+layout(constant_id = 2) const bool OCTAHEDRAL_NORMALS = false;
+
+const int LIGHTING_UNLIT = 0;
+const int LIGHTING_LAMBERT = 1;
+
+const vec3 DIRECTION_TO_LIGHT = normalize(vec3(1.0, -3.0, -1.0));
+const float AMBIENT = 0.02;
+
+// VseObjectBuffer::ObjectData, found at the draw's instance index
+struct ObjectData {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
     vec3 color;
-} push;
+    uint textureIndex;
+    // Dequantizes positions, identity for float32 positions
+    vec4 positionScale;
+    vec4 positionOffset;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+// Matches depth_only.vert, whose depth a depth prepass leaves behind
+invariant gl_Position;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
 
 void main(){
-    gl_Position = push.transform * vec4(position, 1.0);
-    fragColor = color;
-}
\ No newline at end of file
+    ObjectData object = objects[gl_InstanceIndex];
+    vec3 localPosition =
+        position * object.positionScale.xyz + object.positionOffset.xyz;
+    gl_Position = ubo.projection * ubo.view * object.modelMatrix * vec4(localPosition, 1.0);
+
+    vec3 baseColor = USE_OBJECT_COLOR ? object.color : color;
+    if (LIGHTING_MODEL == LIGHTING_LAMBERT) {
+        // Octahedral normals arrive as (x, y, 0)
+        vec3 localNormal =
+            OCTAHEDRAL_NORMALS ? octahedralDecode(normal.xy) : normal;
+        vec3 normalWorldSpace = normalize(mat3(object.normalMatrix) * localNormal);
+        float lightIntensity =
+            AMBIENT + max(dot(normalWorldSpace, DIRECTION_TO_LIGHT), 0.0);
+        fragColor = lightIntensity * baseColor;
+    } else {
+        fragColor = baseColor;
+    }
+    // Textures are projected along z onto the unit-sized model space, so
+    // vertices need no texture coordinates of their own
+    fragUv = localPosition.xy + 0.5;
+    fragTextureIndex = object.textureIndex;
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec3 fragColor;
+layout (location = 1) in vec2 fragUv;
+layout (location = 2) flat in uint fragTextureIndex;
+layout (location = 0) out vec4 outColor;
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+const uint INVALID_HANDLE = 0xFFFFFFFFu;
+
+void main() {
+    vec3 color = fragColor;
+    if (fragTextureIndex != INVALID_HANDLE) {
+        color *= texture(textures[nonuniformEXT(fragTextureIndex)], fragUv).rgb;
+    }
+    outColor = vec4(color, 1.0);
+}
@@ -1,87 +1,310 @@
 #include "simple_render_system.hpp"
 
+#include "cluster_culling_system.hpp"
+#include "occlusion_culling_system.hpp"
+#include "vse_object_buffer.hpp"
+#include "vse_shader_reflection.hpp"
+#include "vse_texture_streamer.hpp"
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
 // std
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace vse {
 
-struct SimplePushConstantData {
-  glm::mat4 transform{1.f};
-  alignas(16) glm::vec3 color;
-};
+// Specialization constant ids declared in simple_shader.vert
+constexpr uint32_t SPEC_USE_OBJECT_COLOR = 0;
+constexpr uint32_t SPEC_LIGHTING_MODEL = 1;
+constexpr uint32_t SPEC_OCTAHEDRAL_NORMALS = 2;
 
-SimpleRenderSystem::SimpleRenderSystem(VseDevice& device,
-                                       VkRenderPass renderPass)
-    : vseDevice{device} {
-  createPipelineLayout();
-  createPipeline(renderPass);
+SimpleRenderSystem::SimpleRenderSystem(
+    VseDevice& device, const VseRenderTargetInfo& renderTarget,
+    const VseRenderTargetInfo& depthTarget,
+    VseDescriptorLayoutCache& descriptorLayoutCache,
+    VsePipelineLayoutCache& pipelineLayoutCache,
+    VsePipelineRegistry& pipelineRegistry, bool reversedZ,
+    VkDescriptorSetLayout bindlessSetLayout,
+    const std::vector<VseVertexFormat>& vertexFormats)
+    : vseDevice{device},
+      pipelineRegistry{pipelineRegistry},
+      vertexFormats{vertexFormats},
+      reversedZ{reversedZ},
+      bindless{bindlessSetLayout != VK_NULL_HANDLE},
+      vertFilepath{"shaders/simple_shader.vert.spv"},
+      fragFilepath{bindless ? "shaders/simple_shader_bindless.frag.spv"
+                            : "shaders/simple_shader.frag.spv"},
+      depthVertFilepath{"shaders/depth_only.vert.spv"} {
+  createPipelineLayout(descriptorLayoutCache, pipelineLayoutCache,
+                       bindlessSetLayout);
+  setRenderTarget(renderTarget, depthTarget);
 }
 
-SimpleRenderSystem::~SimpleRenderSystem() {
-  vkDestroyPipelineLayout(vseDevice.device(), pipelineLayout, nullptr);
+SimpleRenderSystem::~SimpleRenderSystem() {}
+
+void SimpleRenderSystem::createPipelineLayout(
+    VseDescriptorLayoutCache& descriptorLayoutCache,
+    VsePipelineLayoutCache& pipelineLayoutCache,
+    VkDescriptorSetLayout bindlessSetLayout) {
+  auto reflection = pipelineRegistry.reflect(vertFilepath, fragFilepath);
+
+  std::unordered_map<uint32_t, VkDescriptorSetLayout> externalLayouts{};
+  if (bindless) {
+    externalLayouts[1] = bindlessSetLayout;
+  }
+  pipelineLayout = reflection.buildPipelineLayout(
+      descriptorLayoutCache, pipelineLayoutCache, externalLayouts);
+
+  // Without the bindless set, which depth only draws don't sample
+  auto depthReflection = pipelineRegistry.reflect(depthVertFilepath, "");
+  depthPipelineLayout = depthReflection.buildPipelineLayout(
+      descriptorLayoutCache, pipelineLayoutCache);
 }
 
-void SimpleRenderSystem::createPipelineLayout() {
-  VkPushConstantRange pushConstantRange{};
-  pushConstantRange.stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-  pushConstantRange.offset = 0;
-  pushConstantRange.size = sizeof(SimplePushConstantData);
-
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 0;
-  pipelineLayoutInfo.pSetLayouts = nullptr;
-  pipelineLayoutInfo.pushConstantRangeCount = 1;
-  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-  if (vkCreatePipelineLayout(vseDevice.device(), &pipelineLayoutInfo, nullptr,
-                             &pipelineLayout) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create pipeline layout!");
+void SimpleRenderSystem::setRenderTarget(
+    const VseRenderTargetInfo& renderTarget,
+    const VseRenderTargetInfo& depthTarget) {
+  assert(renderTarget.samples == depthTarget.samples &&
+         "The prepass must draw into the depth buffer the scene uses");
+  activeSamples = renderTarget.samples;
+  for (const auto& vertexFormat : vertexFormats) {
+    if (variantPipelines.find({activeSamples, vertexFormat.id()}) ==
+        variantPipelines.end()) {
+      createPipelines(renderTarget, depthTarget, vertexFormat);
+    }
   }
 }
 
-void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
+void SimpleRenderSystem::createPipelines(
+    const VseRenderTargetInfo& renderTarget,
+    const VseRenderTargetInfo& depthTarget,
+    const VseVertexFormat& vertexFormat) {
   assert(pipelineLayout != nullptr &&
          "Cannot create pipeline before pipeline layout");
 
-  PipelineConfigInfo pipelineConfig{};
-  VsePipeline::defaultPipelineConfigInfo(pipelineConfig);
+  PipelineDesc pipelineDesc{vertFilepath, fragFilepath};
+  VsePipeline::defaultPipelineConfigInfo(pipelineDesc.config);
+  if (reversedZ) {
+    VsePipeline::enableReversedZ(pipelineDesc.config);
+  }
+  VsePipeline::setRenderTarget(pipelineDesc.config, renderTarget);
+  pipelineDesc.config.pipelineLayout = pipelineLayout;
+  pipelineDesc.config.bindingDescriptions =
+      VseModel::Vertex::getBindingDescriptions(vertexFormat);
+  pipelineDesc.config.attributeDescriptions =
+      VseModel::Vertex::getAttributeDescriptions(vertexFormat);
+  VsePipeline::setSpecializationConstant(pipelineDesc.config,
+                                         SPEC_OCTAHEDRAL_NORMALS,
+                                         vertexFormat.isNormalOctahedral());
+
+  // After a prepass the depth buffer already holds the visible surface;
+  // fragments at exactly its depth pass, nothing is written
+  PipelineDesc afterPrepassDesc = pipelineDesc;
+  auto& depthStencil = afterPrepassDesc.config.depthStencilInfo;
+  depthStencil.depthWriteEnable = VK_FALSE;
+  depthStencil.depthCompareOp = reversedZ ? VK_COMPARE_OP_GREATER_OR_EQUAL
+                                          : VK_COMPARE_OP_LESS_OR_EQUAL;
+
+  // Reads positions only, through the same vertex layout
+  PipelineDesc depthOnlyDesc{depthVertFilepath, ""};
+  VsePipeline::defaultPipelineConfigInfo(depthOnlyDesc.config);
+  if (reversedZ) {
+    VsePipeline::enableReversedZ(depthOnlyDesc.config);
+  }
+  VsePipeline::setRenderTarget(depthOnlyDesc.config, depthTarget);
+  depthOnlyDesc.config.pipelineLayout = depthPipelineLayout;
+  depthOnlyDesc.config.bindingDescriptions =
+      pipelineDesc.config.bindingDescriptions;
+  depthOnlyDesc.config.attributeDescriptions =
+      pipelineDesc.config.attributeDescriptions;
+
+  auto& pipelines =
+      variantPipelines[{renderTarget.samples, vertexFormat.id()}];
+  pipelines.depthOnly = pipelineRegistry.request(depthOnlyDesc);
+
+  // The default material is compiled up front; other variants compile in
+  // the background and draw with it until they are ready
+  for (const PipelineDesc* desc : {&pipelineDesc, &afterPrepassDesc}) {
+    auto& variants =
+        desc == &pipelineDesc ? pipelines.shaded : pipelines.afterPrepass;
+    VsePipelineRegistry::PipelineId defaultPipeline =
+        VsePipelineRegistry::INVALID_PIPELINE;
+    for (bool useObjectColor : {false, true}) {
+      for (auto lighting : {LightingModel::Lambert, LightingModel::Unlit}) {
+        PipelineDesc variantDesc = *desc;
+        VsePipeline::setSpecializationConstant(
+            variantDesc.config, SPEC_USE_OBJECT_COLOR, useObjectColor);
+        VsePipeline::setSpecializationConstant(
+            variantDesc.config, SPEC_LIGHTING_MODEL,
+            static_cast<uint32_t>(lighting));
+
+        size_t variant = static_cast<size_t>(useObjectColor) * 2 +
+                         static_cast<size_t>(lighting);
+        if (defaultPipeline == VsePipelineRegistry::INVALID_PIPELINE) {
+          defaultPipeline = pipelineRegistry.request(variantDesc);
+          variants[variant] = defaultPipeline;
+        } else {
+          variants[variant] =
+              pipelineRegistry.requestAsync(variantDesc, defaultPipeline);
+        }
+      }
+    }
+  }
+}
 
-  pipelineConfig.renderPass = renderPass;
-  pipelineConfig.pipelineLayout = pipelineLayout;
-  vsePipeline = std::make_unique<VsePipeline>(
-      vseDevice, "shaders/simple_shader.vert.spv",
-      "shaders/simple_shader.frag.spv", pipelineConfig);
+const SimpleRenderSystem::VariantPipelines& SimpleRenderSystem::pipelinesFor(
+    const VseVertexFormat& vertexFormat) const {
+  auto it = variantPipelines.find({activeSamples, vertexFormat.id()});
+  if (it == variantPipelines.end()) {
+    throw std::runtime_error("no pipelines for vertex format " +
+                             vertexFormat.name() + "!");
+  }
+  return it->second;
+}
+
+VsePipelineRegistry::PipelineId SimpleRenderSystem::pipelineFor(
+    const MaterialComponent& material,
+    const VseVertexFormat& vertexFormat) const {
+  const auto& pipelines = pipelinesFor(vertexFormat);
+  const auto& variants = depthMode == DepthMode::Prepass
+                             ? pipelines.afterPrepass
+                             : pipelines.shaded;
+  return variants[static_cast<size_t>(material.useObjectColor) * 2 +
+                  static_cast<size_t>(material.lighting)];
+}
+
+void SimpleRenderSystem::renderDepthPrepass(
+    FrameInfo& frameInfo, std::vector<VseGameObject>& gameObjects) {
+  assert(depthMode == DepthMode::Prepass &&
+         "Depth prepass drawn without DepthMode::Prepass");
+  buildQueue(frameInfo, gameObjects);
+  submit(frameInfo, gameObjects, true, OcclusionDraws::Early);
+  prepassRecorded = true;
 }
 
 void SimpleRenderSystem::renderGameObjects(
-    VkCommandBuffer commandBuffer, std::vector<VseGameObject>& gameObjects) {
-  vsePipeline->bind(commandBuffer);
-
-  for (auto& obj : gameObjects) {
-    obj.transform.rotation.y =
-        glm::mod(obj.transform.rotation.y + 0.01f, glm::two_pi<float>());
-    obj.transform.rotation.x =
-        glm::mod(obj.transform.rotation.x + 0.005f, glm::two_pi<float>());
-
-    SimplePushConstantData push{};
-    push.color = obj.color;
-    push.transform = obj.transform.mat4();
-
-    vkCmdPushConstants(
-        commandBuffer, pipelineLayout,
-        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-        sizeof(SimplePushConstantData), &push);
-    obj.model->bind(commandBuffer);
-    obj.model->draw(commandBuffer);
+    FrameInfo& frameInfo, std::vector<VseGameObject>& gameObjects) {
+  if (depthMode != DepthMode::Prepass) {
+    buildQueue(frameInfo, gameObjects);
+    submit(frameInfo, gameObjects, false, OcclusionDraws::Early);
+    return;
+  }
+  assert(prepassRecorded && "Draw the depth prepass first");
+  prepassRecorded = false;
+  // Objects revealed late are in the depth as well by now
+  submit(frameInfo, gameObjects, false, OcclusionDraws::Both);
+}
+
+void SimpleRenderSystem::renderRevealedObjects(
+    FrameInfo& frameInfo, std::vector<VseGameObject>& gameObjects) {
+  assert(frameInfo.occlusionCulling != nullptr &&
+         "Revealed objects need occlusion culling");
+  submit(frameInfo, gameObjects, depthMode == DepthMode::Prepass,
+         OcclusionDraws::Late);
+}
+
+void SimpleRenderSystem::buildQueue(FrameInfo& frameInfo,
+                                    std::vector<VseGameObject>& gameObjects) {
+  const VseCamera& camera = frameInfo.camera;
+  DrawOrder order = depthMode == DepthMode::StateOrder ? DrawOrder::State
+                                                       : DrawOrder::Depth;
+  assert(frameInfo.objectBuffer != nullptr &&
+         "Objects are drawn with the data of the object buffer");
+  renderQueue.clear();
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    auto& obj = gameObjects[i];
+    if (obj.model == nullptr || !obj.visible) {
+      continue;
+    }
+    const glm::mat4& m =
+        frameInfo.objectBuffer->getObjectData(static_cast<uint32_t>(i))
+            .modelMatrix;
+
+    float viewDepth = (camera.getView() * m[3]).z;
+    if (frameInfo.textureStreamer != nullptr &&
+        obj.textureHandle != VseBindlessTable::INVALID_HANDLE) {
+      // Projected diameter of the bounding sphere over the viewport height
+      float scale = std::max({glm::length(glm::vec3{m[0]}),
+                              glm::length(glm::vec3{m[1]}),
+                              glm::length(glm::vec3{m[2]})});
+      float radius = obj.model->getBoundingRadius() * scale;
+      frameInfo.textureStreamer->reportUsage(
+          obj.textureHandle, camera.projectedSize(radius, viewDepth));
+    }
+    // Texture handles are the only per-object material state; the invalid
+    // handle wraps to 0 so untextured objects group together
+    renderQueue.push(
+        VseRenderQueue::makeKey(
+            DrawPass::Opaque,
+            pipelineFor(obj.material, obj.model->getVertexFormat()),
+            obj.textureHandle + 1, obj.model->getId(),
+            VseRenderQueue::depthBucket(viewDepth, camera.getNear(),
+                                        camera.getFar()),
+            order),
+        static_cast<uint32_t>(i));
+  }
+  renderQueue.sort();
+  vertexBytes = 0;
+}
+
+void SimpleRenderSystem::submit(FrameInfo& frameInfo,
+                                std::vector<VseGameObject>& gameObjects,
+                                bool depthOnly,
+                                OcclusionDraws occlusionDraws) {
+  VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+  const OcclusionCullingSystem* occlusion = frameInfo.occlusionCulling;
+  renderQueue.beginSubmit(commandBuffer);
+
+  // Everything the scene samples is reachable from these sets, so they are
+  // bound once for all objects. Depth only draws sample nothing.
+  std::array<VkDescriptorSet, 2> descriptorSets{
+      frameInfo.globalDescriptorSet, frameInfo.bindlessDescriptorSet};
+  assert((!bindless || frameInfo.bindlessDescriptorSet != VK_NULL_HANDLE) &&
+         "Bindless render system needs a bindless descriptor set");
+  VkPipelineLayout layout = depthOnly ? depthPipelineLayout : pipelineLayout;
+  uint32_t setCount = bindless && !depthOnly ? 2 : 1;
+
+  for (const auto& draw : renderQueue.getDraws()) {
+    bool tested = occlusion != nullptr && occlusion->isTested(draw.index);
+    if (occlusionDraws == OcclusionDraws::Late && !tested) {
+      continue;
+    }
+    auto& obj = gameObjects[draw.index];
+    const VseVertexFormat& vertexFormat = obj.model->getVertexFormat();
+    renderQueue.bindPipeline(pipelineRegistry.get(
+        depthOnly ? pipelinesFor(vertexFormat).depthOnly
+                  : pipelineFor(obj.material, vertexFormat)));
+    renderQueue.bindDescriptorSets(layout, 0, setCount,
+                                   descriptorSets.data());
+
+    // Nothing is pushed per draw; the object index the draw carries as its
+    // first instance finds the object's data
+    renderQueue.bindModel(*obj.model);
+    if (tested) {
+      if (occlusionDraws != OcclusionDraws::Late) {
+        occlusion->draw(commandBuffer, draw.index,
+                        OcclusionCullingSystem::Phase::Early);
+      }
+      if (occlusionDraws != OcclusionDraws::Early) {
+        occlusion->draw(commandBuffer, draw.index,
+                        OcclusionCullingSystem::Phase::Late);
+      }
+    } else if (frameInfo.clusterCulling == nullptr ||
+               !frameInfo.clusterCulling->draw(commandBuffer, draw.index)) {
+      obj.model->draw(commandBuffer, obj.lodLevel, draw.index);
+    }
+    // Depth only draws read positions alone, but the other attributes are
+    // interleaved with them and share the cache lines fetched
+    vertexBytes += static_cast<VkDeviceSize>(obj.model->getVertexCount()) *
+                   vertexFormat.stride();
   }
 }
 
-}  // namespace vse
\ No newline at end of file
+}  // namespace vse
@@ -1,34 +1,138 @@
 #pragma once
 
+#include "vse_descriptors.hpp"
 #include "vse_device.hpp"
+#include "vse_frame_info.hpp"
 #include "vse_game_object.hpp"
 #include "vse_pipeline.hpp"
+#include "vse_pipeline_registry.hpp"
+#include "vse_render_queue.hpp"
 
 // std
-#include <memory>
+#include <array>
+#include <map>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace vse {
 
+// How opaque objects fill the depth buffer
+enum class DepthMode {
+  // Draws sorted by state, every fragment that passes the depth test shaded
+  StateOrder,
+  // Draws sorted nearest first, so hidden fragments mostly fail the depth
+  // test before they are shaded
+  FrontToBack,
+  // Depth drawn alone first, front to back, then each pixel shaded once by
+  // the surface that ends up visible
+  Prepass
+};
+
 class SimpleRenderSystem {
  public:
-  SimpleRenderSystem(VseDevice &device, VkRenderPass renderPass);
+  // Layouts are derived from the shaders; set 0 matches the global set
+  // layout built from the same cache, with the frame's VseObjectBuffer at
+  // binding 1. Models drawn must use one of vertexFormats. depthTarget is
+  // what the depth prepass draws into.
+  SimpleRenderSystem(
+      VseDevice &device, const VseRenderTargetInfo &renderTarget,
+      const VseRenderTargetInfo &depthTarget,
+      VseDescriptorLayoutCache &descriptorLayoutCache,
+      VsePipelineLayoutCache &pipelineLayoutCache,
+      VsePipelineRegistry &pipelineRegistry, bool reversedZ = false,
+      VkDescriptorSetLayout bindlessSetLayout = VK_NULL_HANDLE,
+      const std::vector<VseVertexFormat> &vertexFormats = {VseVertexFormat{}});
   ~SimpleRenderSystem();
 
   SimpleRenderSystem(const SimpleRenderSystem &) = delete;
   SimpleRenderSystem &operator=(const SimpleRenderSystem &) = delete;
 
-  void renderGameObjects(VkCommandBuffer commandBuffer,
+  // Switches to pipelines for the target's sample count. Each sample count
+  // gets its own pipelines for every vertex format on first use, which are
+  // kept for switching back.
+  void setRenderTarget(const VseRenderTargetInfo &renderTarget,
+                       const VseRenderTargetInfo &depthTarget);
+
+  void setDepthMode(DepthMode mode) { depthMode = mode; }
+  DepthMode getDepthMode() const { return depthMode; }
+
+  // With DepthMode::Prepass, draws the objects' depth alone in a depth
+  // only pass. renderGameObjects then shades them in a later pass that
+  // keeps the depth.
+  void renderDepthPrepass(FrameInfo &frameInfo,
+                          std::vector<VseGameObject> &gameObjects);
+  void renderGameObjects(FrameInfo &frameInfo,
                          std::vector<VseGameObject> &gameObjects);
+  // Draws the objects occlusion culling revealed after the depth pyramid
+  // was built, in the order of the frame's first render call. Only needed
+  // when frameInfo.occlusionCulling is set. With the prepass this draws
+  // their depth, between the prepass and renderGameObjects.
+  void renderRevealedObjects(FrameInfo &frameInfo,
+                             std::vector<VseGameObject> &gameObjects);
+
+  // Draw and bind counters of the last frame's render calls
+  const VseRenderQueue::Stats &getStats() const {
+    return renderQueue.getStats();
+  }
+  // Estimated vertex buffer bytes the last frame's render calls fetched:
+  // every vertex once per draw at the full stride, ignoring caching
+  VkDeviceSize getVertexBytes() const { return vertexBytes; }
 
  private:
-  void createPipelineLayout();
-  void createPipeline(VkRenderPass renderPass);
+  // Which phases' draws of objects tested for occlusion a submit records
+  enum class OcclusionDraws { Early, Late, Both };
+
+  struct VariantPipelines {
+    // One per material variant, see pipelineFor()
+    std::array<VsePipelineRegistry::PipelineId, 4> shaded;
+    // The same, testing against the prepass depth without writing it
+    std::array<VsePipelineRegistry::PipelineId, 4> afterPrepass;
+    VsePipelineRegistry::PipelineId depthOnly;
+  };
+
+  void createPipelineLayout(VseDescriptorLayoutCache &descriptorLayoutCache,
+                            VsePipelineLayoutCache &pipelineLayoutCache,
+                            VkDescriptorSetLayout bindlessSetLayout);
+  void createPipelines(const VseRenderTargetInfo &renderTarget,
+                       const VseRenderTargetInfo &depthTarget,
+                       const VseVertexFormat &vertexFormat);
+  // Sorts the frame's draws, shared by every submit of the frame
+  void buildQueue(FrameInfo &frameInfo,
+                  std::vector<VseGameObject> &gameObjects);
+  // Records the sorted queue. Late only draws the objects tested for
+  // occlusion.
+  void submit(FrameInfo &frameInfo, std::vector<VseGameObject> &gameObjects,
+              bool depthOnly, OcclusionDraws occlusionDraws);
+  const VariantPipelines &pipelinesFor(
+      const VseVertexFormat &vertexFormat) const;
+  VsePipelineRegistry::PipelineId pipelineFor(
+      const MaterialComponent &material,
+      const VseVertexFormat &vertexFormat) const;
 
   VseDevice &vseDevice;
+  VsePipelineRegistry &pipelineRegistry;
 
-  std::unique_ptr<VsePipeline> vsePipeline;
+  // For every sample count used so far and vertex format, keyed on the
+  // format id
+  std::map<std::pair<VkSampleCountFlagBits, uint32_t>, VariantPipelines>
+      variantPipelines;
+  std::vector<VseVertexFormat> vertexFormats;
+  VkSampleCountFlagBits activeSamples;
+  bool reversedZ;
+  DepthMode depthMode = DepthMode::StateOrder;
   VkPipelineLayout pipelineLayout;
+  VkPipelineLayout depthPipelineLayout;
+  // Set 1 is the bindless table and the fragment shader samples from it
+  bool bindless;
+  std::string vertFilepath;
+  std::string fragFilepath;
+  std::string depthVertFilepath;
+
+  VseRenderQueue renderQueue;
+  // The prepass sorted this frame's draws for renderGameObjects
+  bool prepassRecorded = false;
+  VkDeviceSize vertexBytes = 0;
 };
 
 }  // namespace vse
\ No newline at end of file
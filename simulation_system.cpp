@@ -0,0 +1,22 @@
+#include "simulation_system.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+namespace vse {
+
+void SimulationSystem::update(std::vector<VseGameObject> &gameObjects,
+                              float dt) {
+  for (auto &obj : gameObjects) {
+    obj.previousTransform = obj.transform;
+
+    obj.transform.translation += obj.motion.linearVelocity * dt;
+    obj.transform.rotation =
+        glm::mod(obj.transform.rotation + obj.motion.angularVelocity * dt,
+                 glm::two_pi<float>());
+  }
+}
+
+}  // namespace vse
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "vse_game_object.hpp"
+
+// std
+#include <vector>
+
+namespace vse {
+
+class SimulationSystem {
+ public:
+  SimulationSystem() = default;
+
+  SimulationSystem(const SimulationSystem &) = delete;
+  SimulationSystem &operator=(const SimulationSystem &) = delete;
+
+  // Advances every game object by one fixed step of dt seconds
+  void update(std::vector<VseGameObject> &gameObjects, float dt);
+};
+
+}  // namespace vse
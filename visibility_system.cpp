@@ -0,0 +1,75 @@
+#include "visibility_system.hpp"
+
+#include "vse_camera.hpp"
+
+// std
+#include <algorithm>
+
+namespace vse {
+
+void VisibilitySystem::update(const FrameInfo &frameInfo,
+                              std::vector<VseGameObject> &gameObjects) {
+  bounds.clear();
+  objectIndices.clear();
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    const auto &obj = gameObjects[i];
+    if (obj.model == nullptr) {
+      continue;
+    }
+    // The model's bounding sphere is centered on its origin
+    glm::mat4 m = obj.interpolatedMat4(frameInfo.interpolationAlpha);
+    float scale = std::max({glm::length(glm::vec3{m[0]}),
+                            glm::length(glm::vec3{m[1]}),
+                            glm::length(glm::vec3{m[2]})});
+    bounds.push_back(VseAabb::fromSphere(
+        glm::vec3{m[3]}, obj.model->getBoundingRadius() * scale));
+    objectIndices.push_back(static_cast<uint32_t>(i));
+  }
+
+  stats = {};
+  stats.objects = static_cast<uint32_t>(bounds.size());
+  if (objectIndices != builtObjectIndices) {
+    bvh.build(bounds);
+    builtObjectIndices = objectIndices;
+    stats.rebuilt = true;
+  } else {
+    bvh.refit(bounds);
+    if (bvh.getCostRatio() > rebuildCostRatio) {
+      bvh.build(bounds);
+      stats.rebuilt = true;
+    }
+  }
+  stats.costRatio = bvh.getCostRatio();
+
+  for (auto &obj : gameObjects) {
+    obj.visible = obj.model == nullptr;
+  }
+  const VseCamera &camera = frameInfo.camera;
+  visiblePrimitives.clear();
+  bvh.queryFrustum(frustumPlanes(camera.getProjection() * camera.getView()),
+                   visiblePrimitives);
+  for (uint32_t primitive : visiblePrimitives) {
+    gameObjects[objectIndices[primitive]].visible = true;
+  }
+  stats.visible = static_cast<uint32_t>(visiblePrimitives.size());
+}
+
+VisibilitySystem::PickResult VisibilitySystem::pick(
+    const glm::vec3 &origin, const glm::vec3 &direction) const {
+  auto hit = bvh.raycast(origin, glm::normalize(direction));
+  if (hit.primitive == VseBvh::INVALID_PRIMITIVE) {
+    return {};
+  }
+  return {objectIndices[hit.primitive], hit.distance};
+}
+
+void VisibilitySystem::queryRange(const glm::vec3 &center, float radius,
+                                  std::vector<uint32_t> &objects) const {
+  size_t first = objects.size();
+  bvh.querySphere(center, radius, objects);
+  for (size_t i = first; i < objects.size(); i++) {
+    objects[i] = objectIndices[objects[i]];
+  }
+}
+
+}  // namespace vse
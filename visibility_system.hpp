@@ -0,0 +1,69 @@
+#pragma once
+
+#include "vse_bvh.hpp"
+#include "vse_frame_info.hpp"
+#include "vse_game_object.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace vse {
+
+// Keeps a bounding volume hierarchy over the world bounds of every object
+// with a model and answers scene queries from it: which objects the camera
+// sees, which one a ray picks and which lie within a distance of a point.
+// Moving objects are refitted each frame; the tree is rebuilt when objects
+// come or go, or once refitting has made it too costly to traverse.
+class VisibilitySystem {
+ public:
+  static constexpr uint32_t INVALID_OBJECT = UINT32_MAX;
+
+  struct Stats {
+    uint32_t objects;
+    uint32_t visible;
+    // Whether the last update rebuilt the tree rather than refitting it
+    bool rebuilt;
+    float costRatio;
+  };
+
+  struct PickResult {
+    uint32_t object = INVALID_OBJECT;
+    float distance = 0.f;
+  };
+
+  VisibilitySystem() = default;
+
+  VisibilitySystem(const VisibilitySystem &) = delete;
+  VisibilitySystem &operator=(const VisibilitySystem &) = delete;
+
+  // Traversal cost over the cost right after a build at which the tree is
+  // rebuilt instead of refitted
+  void setRebuildCostRatio(float ratio) { rebuildCostRatio = ratio; }
+
+  // Once per frame before the other systems, with the camera of frameInfo.
+  // Sets each object's visible flag from the view frustum.
+  void update(const FrameInfo &frameInfo,
+              std::vector<VseGameObject> &gameObjects);
+
+  // Index of the object whose bounds the ray enters first, as of the last
+  // update, and how far along the normalized direction
+  PickResult pick(const glm::vec3 &origin, const glm::vec3 &direction) const;
+  // Indices of objects whose bounds reach within radius of center
+  void queryRange(const glm::vec3 &center, float radius,
+                  std::vector<uint32_t> &objects) const;
+
+  const Stats &getStats() const { return stats; }
+
+ private:
+  VseBvh bvh;
+  std::vector<VseAabb> bounds;
+  // Object index of each primitive of the tree
+  std::vector<uint32_t> objectIndices;
+  std::vector<uint32_t> builtObjectIndices;
+  std::vector<uint32_t> visiblePrimitives;
+  float rebuildCostRatio = 1.5f;
+  Stats stats{};
+};
+
+}  // namespace vse
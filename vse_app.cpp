@@ -1,6 +1,17 @@
 #include "vse_app.hpp"
 
+#include "cluster_culling_system.hpp"
+#include "lod_system.hpp"
+#include "occlusion_culling_system.hpp"
 #include "simple_render_system.hpp"
+#include "visibility_system.hpp"
+#include "vse_benchmark.hpp"
+#include "vse_buffer.hpp"
+#include "vse_bvh.hpp"
+#include "vse_camera.hpp"
+#include "vse_mesh_optimizer.hpp"
+#include "vse_object_buffer.hpp"
+#include "simulation_system.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPH_ZERO_TO_ONE
@@ -9,24 +20,816 @@
 
 // std
 #include <array>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <random>
 #include <stdexcept>
+#include <string>
+#include <utility>
 
 namespace vse {
 
-VseApp::VseApp() { loadGameObjects(); }
+namespace {
+
+constexpr std::array<VkPresentModeKHR, 4> PRESENT_MODES{
+    VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+    VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+
+const char *presentModeName(VkPresentModeKHR mode) {
+  switch (mode) {
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "FIFO";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "FIFO relaxed";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "Mailbox";
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "Immediate";
+    default:
+      return "Unknown";
+  }
+}
+
+const char *depthModeName(DepthMode mode) {
+  switch (mode) {
+    case DepthMode::StateOrder:
+      return "state order";
+    case DepthMode::FrontToBack:
+      return "front to back";
+    case DepthMode::Prepass:
+      return "depth prepass";
+    default:
+      return "unknown";
+  }
+}
+
+void printTextureStats(const std::string &name, const VseTexture &texture) {
+  const auto &stats = texture.getStats();
+  std::cout << name << ": " << texture.getExtent().width << "x"
+            << texture.getExtent().height << ", " << texture.getMipLevels()
+            << " mips, " << stats.memoryBytes / 1024 << " KiB VRAM, decode "
+            << stats.decodeMs << " ms, upload " << stats.uploadMs << " ms, "
+            << stats.throughputMBps() << " MB/s" << std::endl;
+}
+
+void printModelStats(const std::string &name, const VseModel &model) {
+  const auto &report = model.getQuantizationReport();
+  std::cout << name << ": " << model.getVertexCount() << " vertices, "
+            << model.getVertexFormat().name() << " "
+            << model.getVertexFormat().stride() << " B per vertex, "
+            << report.vertexBytes * 100 / report.float32Bytes
+            << "% of float32, max error position "
+            << report.maxPositionError << ", normal "
+            << report.maxNormalErrorDegrees << " deg, color "
+            << report.maxColorError << std::endl;
+}
+
+void printMeshOptimizeReport(const std::string &name,
+                             const VseMeshOptimizeReport &report) {
+  std::cout << name << ": ACMR " << report.before.acmr << " -> "
+            << report.after.acmr << ", ATVR " << report.before.atvr << " -> "
+            << report.after.atvr << ", " << report.verticesBefore << " -> "
+            << report.verticesAfter << " vertices" << std::endl;
+}
+
+// Vertex formats compared by the vertex format benchmark
+const std::array<VseVertexFormat, 3> BENCHMARK_FORMATS{
+    VseVertexFormat{},
+    VseVertexFormat{VseVertexFormat::Position::Float16,
+                    VseVertexFormat::Color::Unorm8,
+                    VseVertexFormat::Normal::Octahedral16},
+    VseVertexFormat::compact()};
+constexpr int BENCHMARK_GRID = 4;
+// Layers of spheres behind each other in the depth mode benchmark
+constexpr int BENCHMARK_DEPTH_LAYERS = 8;
+// Cycled through at runtime and compared by the depth mode benchmark
+constexpr std::array<DepthMode, 3> DEPTH_MODES{
+    DepthMode::StateOrder, DepthMode::FrontToBack, DepthMode::Prepass};
+
+// UV sphere of radius 0.5 without index reuse, colored by its normals
+VseModel::Builder createSphereMesh() {
+  constexpr int RINGS = 96;
+  constexpr int SEGMENTS = 192;
+  auto pointAt = [](int ring, int segment) {
+    float theta = glm::pi<float>() * ring / RINGS;
+    float phi = glm::two_pi<float>() * segment / SEGMENTS;
+    return glm::vec3{std::sin(theta) * std::cos(phi), std::cos(theta),
+                     std::sin(theta) * std::sin(phi)};
+  };
+  VseModel::Builder mesh{};
+  mesh.vertices.reserve(RINGS * SEGMENTS * 6);
+  for (int ring = 0; ring < RINGS; ring++) {
+    for (int segment = 0; segment < SEGMENTS; segment++) {
+      for (auto corner : {std::make_pair(0, 0), std::make_pair(1, 0),
+                          std::make_pair(1, 1), std::make_pair(0, 0),
+                          std::make_pair(1, 1), std::make_pair(0, 1)}) {
+        glm::vec3 normal =
+            pointAt(ring + corner.first, segment + corner.second);
+        mesh.vertices.push_back(
+            {normal * .5f, normal * .5f + glm::vec3{.5f}, normal});
+      }
+    }
+  }
+  return mesh;
+}
+
+// Appends a BENCHMARK_GRID x BENCHMARK_GRID grid of spheres centered on the
+// view axis at distance z, returning the index of the first
+size_t spawnSphereGrid(std::vector<VseGameObject> &gameObjects,
+                       const std::shared_ptr<VseModel> &model, float z,
+                       float scale) {
+  size_t begin = gameObjects.size();
+  for (int i = 0; i < BENCHMARK_GRID * BENCHMARK_GRID; i++) {
+    auto sphere = VseGameObject::createGameObject();
+    sphere.model = model;
+    sphere.transform.translation = {
+        (i % BENCHMARK_GRID - (BENCHMARK_GRID - 1) * .5f) * .4f,
+        (i / BENCHMARK_GRID - (BENCHMARK_GRID - 1) * .5f) * .4f, z};
+    sphere.transform.scale = glm::vec3{scale};
+    sphere.previousTransform = sphere.transform;
+    gameObjects.push_back(std::move(sphere));
+  }
+  return begin;
+}
+
+// Times the scene hierarchy against testing every box, for random boxes
+// spread so their density is the same at every count. Runs on the CPU only.
+void runBvhBenchmark() {
+  using Clock = std::chrono::high_resolution_clock;
+  auto msSince = [](Clock::time_point start) {
+    return std::chrono::duration<float, std::chrono::milliseconds::period>(
+               Clock::now() - start)
+        .count();
+  };
+  constexpr int QUERIES = 100;
+  std::mt19937 random{1};
+  for (uint32_t count : {10000u, 100000u, 1000000u}) {
+    float extent = std::cbrt(static_cast<float>(count)) * 2.f;
+    std::uniform_real_distribution<float> position{-extent, extent};
+    std::uniform_real_distribution<float> radius{.1f, 1.f};
+    auto randomPoint = [&]() {
+      return glm::vec3{position(random), position(random), position(random)};
+    };
+    std::vector<VseAabb> bounds(count);
+    for (auto &box : bounds) {
+      box = VseAabb::fromSphere(randomPoint(), radius(random));
+    }
+
+    VseBvh bvh{};
+    auto start = Clock::now();
+    bvh.build(bounds);
+    float buildMs = msSince(start);
+    // Every box moves a little, as animated objects would in a frame
+    for (auto &box : bounds) {
+      glm::vec3 offset = randomPoint() * (.5f / extent);
+      box.min += offset;
+      box.max += offset;
+    }
+    start = Clock::now();
+    bvh.refit(bounds);
+    float refitMs = msSince(start);
+
+    // Index 0 through the hierarchy, 1 by brute force
+    std::array<float, 2> frustumMs{}, rayMs{}, rangeMs{};
+    size_t visible = 0;
+    bool matches = true;
+    VseCamera camera{};
+    camera.setPerspectiveProjection(glm::radians(50.f), 1.f, .1f, extent);
+    std::vector<uint32_t> result;
+    for (int i = 0; i < QUERIES; i++) {
+      glm::vec3 origin = randomPoint();
+      glm::vec3 direction = glm::normalize(randomPoint() - origin);
+      camera.setViewDirection(origin, direction);
+      auto planes = frustumPlanes(camera.getProjection() * camera.getView());
+
+      result.clear();
+      start = Clock::now();
+      bvh.queryFrustum(planes, result);
+      frustumMs[0] += msSince(start);
+      size_t inside = 0;
+      start = Clock::now();
+      for (const auto &box : bounds) {
+        inside += box.overlapsFrustum(planes);
+      }
+      frustumMs[1] += msSince(start);
+      visible += inside;
+      matches = matches && result.size() == inside;
+
+      start = Clock::now();
+      auto hit = bvh.raycast(origin, direction);
+      rayMs[0] += msSince(start);
+      glm::vec3 inverseDirection = 1.f / direction;
+      float nearest = FLT_MAX;
+      start = Clock::now();
+      for (const auto &box : bounds) {
+        nearest = std::min(
+            nearest, box.intersectRay(origin, inverseDirection, nearest));
+      }
+      rayMs[1] += msSince(start);
+      matches = matches && hit.distance == nearest;
+
+      result.clear();
+      start = Clock::now();
+      bvh.querySphere(origin, extent * .1f, result);
+      rangeMs[0] += msSince(start);
+      inside = 0;
+      start = Clock::now();
+      for (const auto &box : bounds) {
+        inside += box.overlapsSphere(origin, extent * .1f);
+      }
+      rangeMs[1] += msSince(start);
+      matches = matches && result.size() == inside;
+    }
+
+    std::cout << "BVH, " << count << " boxes: build " << buildMs
+              << " ms, refit " << refitMs << " ms, "
+              << bvh.getNodes().size() << " nodes, cost after refit x"
+              << bvh.getCostRatio() << std::endl;
+    std::cout << "  per query, BVH vs brute force: frustum "
+              << frustumMs[0] / QUERIES << " vs " << frustumMs[1] / QUERIES
+              << " ms (" << visible / QUERIES << " visible), ray "
+              << rayMs[0] / QUERIES << " vs " << rayMs[1] / QUERIES
+              << " ms, range " << rangeMs[0] / QUERIES << " vs "
+              << rangeMs[1] / QUERIES << " ms"
+              << (matches ? "" : ", RESULTS DIFFER") << std::endl;
+  }
+}
+
+}  // namespace
+
+VseApp::VseApp() {
+  if (USE_BINDLESS && vseDevice.hasDescriptorIndexing()) {
+    bindlessTable = std::make_unique<VseBindlessTable>(vseDevice);
+    if (STREAM_TEXTURES) {
+      textureStreamer = std::make_unique<VseTextureStreamer>(
+          vseDevice, samplerCache, *bindlessTable);
+      auto config = textureStreamer->getConfig();
+      config.memoryBudget = TEXTURE_MEMORY_BUDGET;
+      textureStreamer->setConfig(config);
+    }
+  }
+  if (HOT_RELOAD_SHADERS) {
+    shaderService = std::make_unique<VseShaderService>(jobSystem);
+    shaderService->addListener([this](const std::string &spvPath) {
+      pipelineRegistry.reloadShader(spvPath);
+    });
+  }
+  loadGameObjects();
+}
 
 VseApp::~VseApp() {}
 
 void VseApp::run() {
-  SimpleRenderSystem simpleRenderSystem{vseDevice,
-                                        vseRenderer.getSwapChainRenderPass()};
+  if (BENCHMARK_BVH) {
+    runBvhBenchmark();
+  }
+
+  // One persistently mapped buffer, one aligned slot per frame in flight
+  VseBuffer uboBuffer{
+      vseDevice,
+      sizeof(GlobalUbo),
+      VseSwapChain::MAX_FRAMES_IN_FLIGHT,
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      vseDevice.properties.limits.minUniformBufferOffsetAlignment,
+  };
+  uboBuffer.map();
+
+  auto &globalSetLayout =
+      VseDescriptorSetLayout::Builder(vseDevice)
+          .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                      VK_SHADER_STAGE_VERTEX_BIT)
+          .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                      VK_SHADER_STAGE_VERTEX_BIT)
+          .build(descriptorLayoutCache);
+  VseObjectBuffer objectBuffer{vseDevice};
+
+  std::vector<VkSampleCountFlagBits> sampleCounts{};
+  for (auto samples : {VK_SAMPLE_COUNT_1_BIT, VK_SAMPLE_COUNT_2_BIT,
+                       VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_8_BIT}) {
+    if (vseDevice.getUsableSampleCounts() & samples) {
+      sampleCounts.push_back(samples);
+    }
+  }
+  size_t preferredSampleIndex = 0;
+  for (size_t i = 0; i < sampleCounts.size(); i++) {
+    if (sampleCounts[i] <= MSAA_SAMPLES) {
+      preferredSampleIndex = i;
+    }
+  }
+  size_t sampleIndex = preferredSampleIndex;
+
+  // One sphere model per benchmarked format, drawn by every sphere of the
+  // grid the benchmark appends to the scene
+  std::vector<VseVertexFormat> vertexFormats{VERTEX_FORMAT};
+  std::vector<std::shared_ptr<VseModel>> vertexBenchmarkModels;
+  if (BENCHMARK_VERTEX_FORMATS) {
+    // Unindexed, so every vertex of every triangle is fetched
+    auto sphereMesh = createSphereMesh();
+    for (const auto &format : BENCHMARK_FORMATS) {
+      vertexBenchmarkModels.push_back(
+          std::make_shared<VseModel>(vseDevice, sphereMesh, format));
+      printModelStats("sphere", *vertexBenchmarkModels.back());
+      if (std::find(vertexFormats.begin(), vertexFormats.end(), format) ==
+          vertexFormats.end()) {
+        vertexFormats.push_back(format);
+      }
+    }
+  }
+
+  // Indirect draws carry the object index as their first instance, which
+  // needs drawIndirectFirstInstance, so without it both GPU culling systems
+  // stay off
+  bool gpuCulling = vseDevice.hasDrawIndirectFirstInstance();
+  std::unique_ptr<ClusterCullingSystem> clusterCullingSystem;
+  if (gpuCulling && (CLUSTER_CULLING || BENCHMARK_CLUSTER_CULLING)) {
+    clusterCullingSystem = std::make_unique<ClusterCullingSystem>(
+        vseDevice, descriptorLayoutCache, pipelineLayoutCache);
+  }
+  bool clusterCulling = clusterCullingSystem != nullptr && CLUSTER_CULLING;
+  // Spheres without levels of detail, so every one is culled by cluster
+  std::shared_ptr<VseModel> clusterBenchmarkModel;
+  if (clusterCullingSystem != nullptr && BENCHMARK_CLUSTER_CULLING) {
+    auto sphereMesh = createSphereMesh();
+    VseMeshOptimizeOptions options{};
+    options.buildMeshlets = true;
+    optimizeMesh(sphereMesh, options);
+    clusterBenchmarkModel =
+        std::make_shared<VseModel>(vseDevice, sphereMesh, VERTEX_FORMAT);
+  }
+
+  std::unique_ptr<OcclusionCullingSystem> occlusionCullingSystem;
+  if (gpuCulling && OCCLUSION_CULLING &&
+      OcclusionCullingSystem::supportsDepthFormat(
+          vseDevice, vseRenderer.getSwapChainDepthFormat())) {
+    occlusionCullingSystem = std::make_unique<OcclusionCullingSystem>(
+        vseDevice, descriptorLayoutCache, pipelineLayoutCache, samplerCache,
+        [this](std::function<void()> deleter) {
+          vseRenderer.retire(std::move(deleter));
+        },
+        REVERSED_Z);
+  }
+  bool occlusionCulling = occlusionCullingSystem != nullptr;
+
+  // One model per layer, created far to near, so sorting by state draws the
+  // farthest layer first and shades every layer
+  std::vector<std::shared_ptr<VseModel>> depthBenchmarkModels;
+  if (BENCHMARK_DEPTH_MODES) {
+    auto sphereMesh = createSphereMesh();
+    optimizeMesh(sphereMesh, VseMeshOptimizeOptions{});
+    for (int layer = 0; layer < BENCHMARK_DEPTH_LAYERS; layer++) {
+      depthBenchmarkModels.push_back(
+          std::make_shared<VseModel>(vseDevice, sphereMesh, VERTEX_FORMAT));
+    }
+  }
+
+  SimpleRenderSystem simpleRenderSystem{
+      vseDevice, vseRenderer.getRenderTargetInfo(sampleCounts[sampleIndex]),
+      vseRenderer.getDepthOnlyRenderTargetInfo(sampleCounts[sampleIndex]),
+      descriptorLayoutCache,
+      pipelineLayoutCache, pipelineRegistry,
+      REVERSED_Z,
+      bindlessTable ? bindlessTable->getDescriptorSetLayout()
+                    : VK_NULL_HANDLE,
+      vertexFormats};
+  simpleRenderSystem.setDepthMode(DEPTH_MODE);
+  SimulationSystem simulationSystem{};
+  VisibilitySystem visibilitySystem{};
+  LodSystem lodSystem{};
+
+  VseCamera camera{};
+  camera.setReversedZ(REVERSED_Z);
+  camera.setViewDirection(glm::vec3{0.f}, glm::vec3{0.f, 0.f, 1.f});
+  vseRenderer.setReversedZ(REVERSED_Z);
+
+  vseRenderer.setLowLatency(LOW_LATENCY);
+  auto &framePacer = vseRenderer.getFramePacer();
+  framePacer.setFrameLimit(FRAME_LIMIT);
+  size_t presentModeIndex =
+      std::find(PRESENT_MODES.begin(), PRESENT_MODES.end(), PRESENT_MODE) -
+      PRESENT_MODES.begin();
+  bool presentKeyDown = false;
+  bool msaaKeyDown = false;
+  bool depthKeyDown = false;
+  bool pickButtonDown = false;
+  float latencyLogTime = 0.f;
+
+  auto setSampleIndex = [&](size_t index) {
+    sampleIndex = index;
+    simpleRenderSystem.setRenderTarget(
+        vseRenderer.getRenderTargetInfo(sampleCounts[sampleIndex]),
+        vseRenderer.getDepthOnlyRenderTargetInfo(sampleCounts[sampleIndex]));
+  };
+
+  // Run one after the other before the scene renders normally
+  std::deque<VseBenchmark> benchmarks;
+  if (BENCHMARK_MSAA && sampleCounts.size() > 1) {
+    std::vector<std::string> caseNames{};
+    for (auto samples : sampleCounts) {
+      caseNames.push_back(std::to_string(samples) + "x");
+    }
+    benchmarks.emplace_back("MSAA", caseNames, BENCHMARK_WARMUP,
+                            BENCHMARK_DURATION);
+    benchmarks.back()
+        .onBeginCase([&](size_t caseIndex) { setSampleIndex(caseIndex); })
+        .onFinish([&]() { setSampleIndex(preferredSampleIndex); });
+  }
+
+  std::vector<VkDeviceSize> vertexBenchmarkBytes(BENCHMARK_FORMATS.size());
+  size_t vertexObjectsBegin = 0;
+  if (BENCHMARK_VERTEX_FORMATS) {
+    std::vector<std::string> caseNames{};
+    for (const auto &format : BENCHMARK_FORMATS) {
+      caseNames.push_back(format.name());
+    }
+    benchmarks.emplace_back("Vertex format", caseNames, BENCHMARK_WARMUP,
+                            BENCHMARK_DURATION);
+    benchmarks.back()
+        .onBeginCase([&](size_t caseIndex) {
+          if (caseIndex == 0) {
+            vertexObjectsBegin = spawnSphereGrid(
+                gameObjects, vertexBenchmarkModels[0], 2.f, .35f);
+          }
+          for (size_t i = vertexObjectsBegin; i < gameObjects.size(); i++) {
+            gameObjects[i].model = vertexBenchmarkModels[caseIndex];
+          }
+        })
+        .onMeasureFrame([&](size_t caseIndex) {
+          vertexBenchmarkBytes[caseIndex] = simpleRenderSystem.getVertexBytes();
+        })
+        .onDescribeCase([&](std::ostream &out, size_t caseIndex,
+                            const BenchmarkSample &sample) {
+          VkDeviceSize bytes = vertexBenchmarkBytes[caseIndex];
+          float gpuMs = sample.averageGpuMs();
+          out << ", " << bytes / (1024 * 1024) << " MiB of vertices, "
+              << (gpuMs > 0.f ? bytes / gpuMs / 1e6f : 0.f) << " GB/s";
+        })
+        .onFinish([&]() {
+          // Frames in flight may still draw the spheres
+          gameObjects.erase(gameObjects.begin() + vertexObjectsBegin,
+                            gameObjects.end());
+          vseRenderer.retire([models = vertexBenchmarkModels]() {});
+          vertexBenchmarkModels.clear();
+        });
+  }
+
+  std::array<uint32_t, 2> clusterBenchmarkTriangles{};
+  size_t clusterObjectsBegin = 0;
+  if (clusterBenchmarkModel) {
+    benchmarks.emplace_back("Cluster culling",
+                            std::vector<std::string>{"off", "on"},
+                            BENCHMARK_WARMUP, BENCHMARK_DURATION);
+    benchmarks.back()
+        .onBeginCase([&](size_t caseIndex) {
+          if (caseIndex == 0) {
+            clusterObjectsBegin = spawnSphereGrid(
+                gameObjects, clusterBenchmarkModel, 2.f, .35f);
+          }
+          clusterCulling = caseIndex == 1;
+        })
+        .onMeasureFrame([&](size_t caseIndex) {
+          // Culled triangles are read back, they lag a few frames behind
+          uint32_t triangles = lodSystem.getStats().trianglesSubmitted;
+          if (clusterCulling) {
+            const auto &clusterStats = clusterCullingSystem->getStats();
+            triangles -=
+                clusterStats.trianglesTested - clusterStats.trianglesVisible;
+          }
+          clusterBenchmarkTriangles[caseIndex] = triangles;
+        })
+        .onDescribeCase([&](std::ostream &out, size_t caseIndex,
+                            const BenchmarkSample &sample) {
+          uint32_t triangles = clusterBenchmarkTriangles[caseIndex];
+          float gpuMs = sample.averageGpuMs();
+          out << ", " << triangles << " triangles, "
+              << (gpuMs > 0.f ? triangles / gpuMs / 1e3f : 0.f)
+              << " Mtris/s";
+        })
+        .onFinish([&]() {
+          gameObjects.erase(gameObjects.begin() + clusterObjectsBegin,
+                            gameObjects.end());
+          vseRenderer.retire([model = clusterBenchmarkModel]() {});
+          clusterBenchmarkModel.reset();
+          clusterCulling = CLUSTER_CULLING;
+        });
+  }
+
+  size_t depthObjectsBegin = 0;
+  if (BENCHMARK_DEPTH_MODES) {
+    std::vector<std::string> caseNames{};
+    for (auto mode : DEPTH_MODES) {
+      caseNames.push_back(depthModeName(mode));
+    }
+    benchmarks.emplace_back(
+        "Depth mode (" + std::to_string(BENCHMARK_DEPTH_LAYERS) + " layers)",
+        caseNames, BENCHMARK_WARMUP, BENCHMARK_DURATION);
+    benchmarks.back()
+        .onBeginCase([&](size_t caseIndex) {
+          if (caseIndex == 0) {
+            depthObjectsBegin = gameObjects.size();
+            for (int layer = 0; layer < BENCHMARK_DEPTH_LAYERS; layer++) {
+              spawnSphereGrid(
+                  gameObjects,
+                  depthBenchmarkModels[BENCHMARK_DEPTH_LAYERS - 1 - layer],
+                  1.5f + layer * .5f, .5f + layer * .15f);
+            }
+            // Would drop the hidden layers and leave nothing to compare
+            occlusionCulling = false;
+          }
+          simpleRenderSystem.setDepthMode(DEPTH_MODES[caseIndex]);
+        })
+        .onFinish([&]() {
+          gameObjects.erase(gameObjects.begin() + depthObjectsBegin,
+                            gameObjects.end());
+          vseRenderer.retire([models = depthBenchmarkModels]() {});
+          depthBenchmarkModels.clear();
+          simpleRenderSystem.setDepthMode(DEPTH_MODE);
+          occlusionCulling = occlusionCullingSystem != nullptr;
+        });
+  }
+
+  auto currentTime = std::chrono::high_resolution_clock::now();
   while (!vseWindow.ShouldClose()) {
+    vseRenderer.waitForNextFrame();
     glfwPollEvents();
+    framePacer.markInput();
+
+    bool presentKey =
+        glfwGetKey(vseWindow.getGLFWwindow(), GLFW_KEY_P) == GLFW_PRESS;
+    if (presentKey && !presentKeyDown) {
+      presentModeIndex = (presentModeIndex + 1) % PRESENT_MODES.size();
+      vseRenderer.setPresentMode(PRESENT_MODES[presentModeIndex]);
+    }
+    presentKeyDown = presentKey;
+
+    bool msaaKey =
+        glfwGetKey(vseWindow.getGLFWwindow(), GLFW_KEY_M) == GLFW_PRESS;
+    if (msaaKey && !msaaKeyDown && benchmarks.empty()) {
+      setSampleIndex((sampleIndex + 1) % sampleCounts.size());
+    }
+    msaaKeyDown = msaaKey;
+
+    bool depthKey =
+        glfwGetKey(vseWindow.getGLFWwindow(), GLFW_KEY_D) == GLFW_PRESS;
+    if (depthKey && !depthKeyDown && benchmarks.empty()) {
+      size_t depthModeIndex =
+          std::find(DEPTH_MODES.begin(), DEPTH_MODES.end(),
+                    simpleRenderSystem.getDepthMode()) -
+          DEPTH_MODES.begin();
+      simpleRenderSystem.setDepthMode(
+          DEPTH_MODES[(depthModeIndex + 1) % DEPTH_MODES.size()]);
+    }
+    depthKeyDown = depthKey;
+
+    bool pickButton = glfwGetMouseButton(vseWindow.getGLFWwindow(),
+                                         GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    int windowWidth, windowHeight;
+    glfwGetWindowSize(vseWindow.getGLFWwindow(), &windowWidth, &windowHeight);
+    if (pickButton && !pickButtonDown && windowWidth > 0 && windowHeight > 0) {
+      // Unproject the cursor onto the near and far planes of last frame's
+      // camera, which the scene's bounds were last updated for
+      double cursorX, cursorY;
+      glfwGetCursorPos(vseWindow.getGLFWwindow(), &cursorX, &cursorY);
+      glm::mat4 inverseViewProjection =
+          glm::inverse(camera.getProjection() * camera.getView());
+      auto unproject = [&](float depth) {
+        glm::vec4 point =
+            inverseViewProjection *
+            glm::vec4{static_cast<float>(2.0 * cursorX / windowWidth - 1.0),
+                      static_cast<float>(2.0 * cursorY / windowHeight - 1.0),
+                      depth, 1.f};
+        return glm::vec3{point} / point.w;
+      };
+      glm::vec3 nearPoint = unproject(REVERSED_Z ? 1.f : 0.f);
+      glm::vec3 farPoint = unproject(REVERSED_Z ? 0.f : 1.f);
+      auto picked = visibilitySystem.pick(nearPoint, farPoint - nearPoint);
+      if (picked.object != VisibilitySystem::INVALID_OBJECT) {
+        std::cout << "Picked object " << gameObjects[picked.object].getId()
+                  << " at " << picked.distance << std::endl;
+      }
+    }
+    pickButtonDown = pickButton;
+    pipelineRegistry.update(vseRenderer);
+
+    auto newTime = std::chrono::high_resolution_clock::now();
+    float frameTime =
+        std::chrono::duration<float, std::chrono::seconds::period>(newTime -
+                                                                   currentTime)
+            .count();
+    currentTime = newTime;
+
+    latencyLogTime += frameTime;
+    if (LOG_FRAME_LATENCY && latencyLogTime >= 1.f) {
+      latencyLogTime = 0.f;
+      const auto &stats = framePacer.getStats();
+      std::cout << presentModeName(vseRenderer.getPresentMode()) << ", MSAA "
+                << sampleCounts[sampleIndex] << "x, "
+                << depthModeName(simpleRenderSystem.getDepthMode())
+                << ": input to submit "
+                << stats.inputToSubmitMs << " ms, submit to present "
+                << stats.submitToPresentMs << " ms, limiter wait "
+                << stats.limiterWaitMs << " ms, GPU "
+                << gpuTimer.getLastResultMs() << " ms" << std::endl;
+      const auto &visibilityStats = visibilitySystem.getStats();
+      std::cout << "Visibility: " << visibilityStats.visible << " of "
+                << visibilityStats.objects << " objects in view, BVH cost x"
+                << visibilityStats.costRatio << std::endl;
+      const auto &lodStats = lodSystem.getStats();
+      std::cout << "Triangles: " << lodStats.trianglesSubmitted
+                << " submitted, " << lodStats.trianglesFullDetail
+                << " without LODs" << std::endl;
+      const auto &objectStats = objectBuffer.getStats();
+      std::cout << "Objects: " << objectStats.objectsWritten << " of "
+                << objectStats.objectCount << " written" << std::endl;
+      if (clusterCulling) {
+        const auto &clusterStats = clusterCullingSystem->getStats();
+        std::cout << "Clusters: " << clusterStats.trianglesVisible << " of "
+                  << clusterStats.trianglesTested << " triangles in "
+                  << clusterStats.meshletsTested << " meshlets visible"
+                  << std::endl;
+      }
+      if (occlusionCulling) {
+        const auto &occlusionStats = occlusionCullingSystem->getStats();
+        std::cout << "Occlusion: " << occlusionStats.occluded << " of "
+                  << occlusionStats.objectsTested << " objects occluded, "
+                  << occlusionStats.drawnEarly << " drawn early, "
+                  << occlusionStats.drawnLate << " late" << std::endl;
+      }
+      if (textureStreamer) {
+        const auto &streaming = textureStreamer->getStats();
+        std::cout << "Textures: " << streaming.residentBytes / 1024
+                  << " KiB resident of " << streaming.budgetBytes / 1024
+                  << " KiB budget, " << streaming.uploadBytes / 1024
+                  << " KiB uploaded last frame" << std::endl;
+      }
+    }
+
+    if (!benchmarks.empty()) {
+      benchmarks.front().update(frameTime, gpuTimer.getLastResultMs());
+      if (benchmarks.front().isFinished()) {
+        benchmarks.pop_front();
+      }
+    }
+
+    frameScheduler.tick(frameTime, [&](float dt) {
+      simulationSystem.update(gameObjects, dt);
+    });
+
+    float aspect = vseRenderer.getAspectRatio();
+    camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 10.f);
 
     if (auto commandBuffer = vseRenderer.beginFrame()) {
-      vseRenderer.beginSwapChainRenderPass(commandBuffer);
-      simpleRenderSystem.renderGameObjects(commandBuffer, gameObjects);
-      vseRenderer.endSwapChainRenderPass(commandBuffer);
+      int frameIndex = vseRenderer.getFrameIndex();
+      gpuTimer.begin(commandBuffer, frameIndex);
+      if (bindlessTable) {
+        bindlessTable->nextFrame();
+      }
+      if (textureStreamer) {
+        textureStreamer->update(commandBuffer, frameIndex,
+                                vseRenderer.getSwapChainExtent().height);
+      }
+
+      VkDescriptorSet globalDescriptorSet;
+      auto bufferInfo = uboBuffer.descriptorInfoForIndex(frameIndex);
+      objectBuffer.update(frameIndex, gameObjects,
+                          frameScheduler.getInterpolationAlpha());
+      auto objectInfo = objectBuffer.descriptorInfo();
+      if (!VseDescriptorWriter(globalSetLayout,
+                               vseRenderer.getFrameDescriptorAllocator())
+               .writeBuffer(0, &bufferInfo)
+               .writeBuffer(1, &objectInfo)
+               .build(globalDescriptorSet)) {
+        throw std::runtime_error("failed to allocate global descriptor set!");
+      }
+
+      FrameInfo frameInfo{frameIndex,
+                          frameTime,
+                          commandBuffer,
+                          frameScheduler.getInterpolationAlpha(),
+                          camera,
+                          globalDescriptorSet,
+                          bindlessTable ? bindlessTable->getDescriptorSet()
+                                        : VK_NULL_HANDLE,
+                          textureStreamer.get(),
+                          clusterCulling ? clusterCullingSystem.get()
+                                         : nullptr,
+                          occlusionCulling ? occlusionCullingSystem.get()
+                                           : nullptr,
+                          &objectBuffer};
+
+      // update
+      GlobalUbo ubo{};
+      ubo.projection = camera.getProjection();
+      ubo.view = camera.getView();
+      uboBuffer.writeToIndex(&ubo, frameIndex);
+      visibilitySystem.update(frameInfo, gameObjects);
+      lodSystem.update(frameInfo, gameObjects,
+                       vseRenderer.getSwapChainExtent().height);
+      if (clusterCulling) {
+        clusterCullingSystem->cull(frameInfo, gameObjects,
+                                   vseRenderer.getFrameDescriptorAllocator());
+      }
+      if (occlusionCulling) {
+        occlusionCullingSystem->cullEarly(
+            frameInfo, gameObjects, vseRenderer.getSwapChainExtent(),
+            vseRenderer.getFrameDescriptorAllocator());
+      }
+
+      // render
+      auto& renderGraph = vseRenderer.getRenderGraph();
+      renderGraph.reset();
+      auto backbuffer = vseRenderer.importSwapChainImage();
+      VkSampleCountFlagBits samples = sampleCounts[sampleIndex];
+      auto depth = renderGraph.createImage(
+          "depth", {vseRenderer.getSwapChainDepthFormat(),
+                    vseRenderer.getSwapChainExtent(), samples});
+      // Multisampled color is resolved into the backbuffer within the pass
+      // and never stored, so it lives in transient memory
+      auto color = backbuffer;
+      if (samples != VK_SAMPLE_COUNT_1_BIT) {
+        color = renderGraph.createImage(
+            "msaa color", {vseRenderer.getSwapChainImageFormat(),
+                           vseRenderer.getSwapChainExtent(), samples});
+      }
+      // The prepass, or without it the scene pass, draws what occlusion
+      // culling found visible last frame. The depth it leaves is reduced
+      // into the pyramid, then what that reveals is drawn in the late pass,
+      // which resolves.
+      bool prepass = simpleRenderSystem.getDepthMode() == DepthMode::Prepass;
+      VkClearDepthStencilValue depthClear{REVERSED_Z ? 0.0f : 1.0f, 0};
+      if (prepass) {
+        renderGraph.addPass(
+            "depth prepass",
+            [&](VseRenderGraph::PassBuilder& pass) {
+              pass.clearDepth(depth, depthClear);
+            },
+            [&](VkCommandBuffer) {
+              simpleRenderSystem.renderDepthPrepass(frameInfo, gameObjects);
+            });
+      } else {
+        renderGraph.addPass(
+            "scene",
+            [&](VseRenderGraph::PassBuilder& pass) {
+              pass.clearColor(color, {{0.01f, 0.01f, 0.01f, 1.0f}})
+                  .clearDepth(depth, depthClear);
+              if (color != backbuffer && !occlusionCulling) {
+                pass.resolveColor(color, backbuffer);
+              }
+            },
+            [&](VkCommandBuffer) {
+              simpleRenderSystem.renderGameObjects(frameInfo, gameObjects);
+            });
+      }
+      if (occlusionCulling) {
+        renderGraph.addPass(
+            "depth pyramid",
+            [&](VseRenderGraph::PassBuilder& pass) {
+              pass.readTexture(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+                  .setSideEffects();
+            },
+            [&](VkCommandBuffer commandBuffer) {
+              occlusionCullingSystem->cullLate(
+                  commandBuffer, renderGraph.getImageView(depth), samples,
+                  vseRenderer.getFrameDescriptorAllocator());
+            });
+        renderGraph.addPass(
+            prepass ? "depth prepass late" : "scene late",
+            [&](VseRenderGraph::PassBuilder& pass) {
+              pass.writeDepth(depth);
+              if (!prepass) {
+                pass.writeColor(color);
+                if (color != backbuffer) {
+                  pass.resolveColor(color, backbuffer);
+                }
+              }
+            },
+            [&](VkCommandBuffer) {
+              simpleRenderSystem.renderRevealedObjects(frameInfo,
+                                                       gameObjects);
+            });
+      }
+      if (prepass) {
+        // Shades against the finished depth, without writing it
+        renderGraph.addPass(
+            "scene",
+            [&](VseRenderGraph::PassBuilder& pass) {
+              pass.clearColor(color, {{0.01f, 0.01f, 0.01f, 1.0f}})
+                  .writeDepth(depth);
+              if (color != backbuffer) {
+                pass.resolveColor(color, backbuffer);
+              }
+            },
+            [&](VkCommandBuffer) {
+              simpleRenderSystem.renderGameObjects(frameInfo, gameObjects);
+            });
+      }
+      renderGraph.execute(commandBuffer);
+      gpuTimer.end(commandBuffer, frameIndex);
       vseRenderer.endFrame();
     }
   }
@@ -34,73 +837,119 @@ void VseApp::run() {
   vkDeviceWaitIdle(vseDevice.device());
 }
 
-std::unique_ptr<VseModel> createCubeModel(VseDevice& device, glm::vec3 offset) {
-  std::vector<VseModel::Vertex> vertices{
+VseModel::Builder createCubeMesh(glm::vec3 offset) {
+  VseModel::Builder mesh{};
+  mesh.vertices = {
       // left face (white, x = -0.5)
-      {{-.5f, -.5f, -.5f}, {.9f, .9f, .9f}},
-      {{-.5f, .5f, .5f}, {.9f, .9f, .9f}},
-      {{-.5f, .5f, -.5f}, {.9f, .9f, .9f}},
-      {{-.5f, -.5f, -.5f}, {.9f, .9f, .9f}},
-      {{-.5f, -.5f, .5f}, {.9f, .9f, .9f}},
-      {{-.5f, .5f, .5f}, {.9f, .9f, .9f}},
+      {{-.5f, -.5f, -.5f}, {.9f, .9f, .9f}, {-1.f, .0f, .0f}},
+      {{-.5f, .5f, .5f}, {.9f, .9f, .9f}, {-1.f, .0f, .0f}},
+      {{-.5f, .5f, -.5f}, {.9f, .9f, .9f}, {-1.f, .0f, .0f}},
+      {{-.5f, -.5f, -.5f}, {.9f, .9f, .9f}, {-1.f, .0f, .0f}},
+      {{-.5f, -.5f, .5f}, {.9f, .9f, .9f}, {-1.f, .0f, .0f}},
+      {{-.5f, .5f, .5f}, {.9f, .9f, .9f}, {-1.f, .0f, .0f}},
 
       // right face (yellow, x = +0.5)
-      {{.5f, -.5f, -.5f}, {.8f, .8f, .1f}},
-      {{.5f, .5f, -.5f}, {.8f, .8f, .1f}},
-      {{.5f, .5f, .5f}, {.8f, .8f, .1f}},
-      {{.5f, -.5f, -.5f}, {.8f, .8f, .1f}},
-      {{.5f, .5f, .5f}, {.8f, .8f, .1f}},
-      {{.5f, -.5f, .5f}, {.8f, .8f, .1f}},
+      {{.5f, -.5f, -.5f}, {.8f, .8f, .1f}, {1.f, .0f, .0f}},
+      {{.5f, .5f, -.5f}, {.8f, .8f, .1f}, {1.f, .0f, .0f}},
+      {{.5f, .5f, .5f}, {.8f, .8f, .1f}, {1.f, .0f, .0f}},
+      {{.5f, -.5f, -.5f}, {.8f, .8f, .1f}, {1.f, .0f, .0f}},
+      {{.5f, .5f, .5f}, {.8f, .8f, .1f}, {1.f, .0f, .0f}},
+      {{.5f, -.5f, .5f}, {.8f, .8f, .1f}, {1.f, .0f, .0f}},
 
       // top face (red, y = +0.5)
-      {{-.5f, .5f, -.5f}, {.9f, .6f, .1f}},
-      {{.5f, .5f, .5f}, {.9f, .6f, .1f}},
-      {{.5f, .5f, -.5f}, {.9f, .6f, .1f}},
-      {{-.5f, .5f, -.5f}, {.9f, .6f, .1f}},
-      {{-.5f, .5f, .5f}, {.9f, .6f, .1f}},
-      {{.5f, .5f, .5f}, {.9f, .6f, .1f}},
+      {{-.5f, .5f, -.5f}, {.9f, .6f, .1f}, {.0f, 1.f, .0f}},
+      {{.5f, .5f, .5f}, {.9f, .6f, .1f}, {.0f, 1.f, .0f}},
+      {{.5f, .5f, -.5f}, {.9f, .6f, .1f}, {.0f, 1.f, .0f}},
+      {{-.5f, .5f, -.5f}, {.9f, .6f, .1f}, {.0f, 1.f, .0f}},
+      {{-.5f, .5f, .5f}, {.9f, .6f, .1f}, {.0f, 1.f, .0f}},
+      {{.5f, .5f, .5f}, {.9f, .6f, .1f}, {.0f, 1.f, .0f}},
 
       // bottom face (orange, y = -0.5)
-      {{-.5f, -.5f, -.5f}, {.8f, .1f, .1f}},
-      {{.5f, -.5f, -.5f}, {.8f, .1f, .1f}},
-      {{.5f, -.5f, .5f}, {.8f, .1f, .1f}},
-      {{-.5f, -.5f, -.5f}, {.8f, .1f, .1f}},
-      {{.5f, -.5f, .5f}, {.8f, .1f, .1f}},
-      {{-.5f, -.5f, .5f}, {.8f, .1f, .1f}},
+      {{-.5f, -.5f, -.5f}, {.8f, .1f, .1f}, {.0f, -1.f, .0f}},
+      {{.5f, -.5f, -.5f}, {.8f, .1f, .1f}, {.0f, -1.f, .0f}},
+      {{.5f, -.5f, .5f}, {.8f, .1f, .1f}, {.0f, -1.f, .0f}},
+      {{-.5f, -.5f, -.5f}, {.8f, .1f, .1f}, {.0f, -1.f, .0f}},
+      {{.5f, -.5f, .5f}, {.8f, .1f, .1f}, {.0f, -1.f, .0f}},
+      {{-.5f, -.5f, .5f}, {.8f, .1f, .1f}, {.0f, -1.f, .0f}},
 
       // nose face (blue, z = +0.5)
-      {{-.5f, -.5f, .5f}, {.1f, .1f, .8f}},
-      {{.5f, .5f, .5f}, {.1f, .1f, .8f}},
-      {{.5f, -.5f, .5f}, {.1f, .1f, .8f}},
-      {{-.5f, -.5f, .5f}, {.1f, .1f, .8f}},
-      {{-.5f, .5f, .5f}, {.1f, .1f, .8f}},
-      {{.5f, .5f, .5f}, {.1f, .1f, .8f}},
+      {{-.5f, -.5f, .5f}, {.1f, .1f, .8f}, {.0f, .0f, 1.f}},
+      {{.5f, .5f, .5f}, {.1f, .1f, .8f}, {.0f, .0f, 1.f}},
+      {{.5f, -.5f, .5f}, {.1f, .1f, .8f}, {.0f, .0f, 1.f}},
+      {{-.5f, -.5f, .5f}, {.1f, .1f, .8f}, {.0f, .0f, 1.f}},
+      {{-.5f, .5f, .5f}, {.1f, .1f, .8f}, {.0f, .0f, 1.f}},
+      {{.5f, .5f, .5f}, {.1f, .1f, .8f}, {.0f, .0f, 1.f}},
 
       // tail face (green, z = -0.5)
-      {{-.5f, -.5f, -.5f}, {.1f, .8f, .1f}},
-      {{.5f, -.5f, -.5f}, {.1f, .8f, .1f}},
-      {{.5f, .5f, -.5f}, {.1f, .8f, .1f}},
-      {{-.5f, -.5f, -.5f}, {.1f, .8f, .1f}},
-      {{.5f, .5f, -.5f}, {.1f, .8f, .1f}},
-      {{-.5f, .5f, -.5f}, {.1f, .8f, .1f}},
+      {{-.5f, -.5f, -.5f}, {.1f, .8f, .1f}, {.0f, .0f, -1.f}},
+      {{.5f, -.5f, -.5f}, {.1f, .8f, .1f}, {.0f, .0f, -1.f}},
+      {{.5f, .5f, -.5f}, {.1f, .8f, .1f}, {.0f, .0f, -1.f}},
+      {{-.5f, -.5f, -.5f}, {.1f, .8f, .1f}, {.0f, .0f, -1.f}},
+      {{.5f, .5f, -.5f}, {.1f, .8f, .1f}, {.0f, .0f, -1.f}},
+      {{-.5f, .5f, -.5f}, {.1f, .8f, .1f}, {.0f, .0f, -1.f}},
 
   };
-  for (auto& v : vertices) {
+  for (auto& v : mesh.vertices) {
     v.position += offset;
   }
-  return std::make_unique<VseModel>(device, vertices);
+  return mesh;
 }
 
 void VseApp::loadGameObjects() {
-  std::shared_ptr<VseModel> vseModel =
-      createCubeModel(vseDevice, {.0f, .0f, .0f});
+  std::vector<VseModel::Builder> meshes{createCubeMesh({.0f, .0f, .0f}),
+                                        createSphereMesh()};
+  const char *meshNames[] = {"cube", "sphere"};
+  if (OPTIMIZE_MESHES) {
+    VseMeshOptimizeOptions options{};
+    options.lodCount = LOD_COUNT;
+    options.buildMeshlets = CLUSTER_CULLING;
+    auto reports = optimizeMeshes(jobSystem, meshes, options);
+    for (size_t i = 0; i < meshes.size(); i++) {
+      printMeshOptimizeReport(meshNames[i], reports[i]);
+      std::cout << "  LOD triangles:";
+      for (const auto &lod : meshes[i].lods) {
+        std::cout << " " << lod.indexCount / 3;
+      }
+      std::cout << ", " << meshes[i].meshlets.size() << " meshlets"
+                << std::endl;
+    }
+  }
+  std::vector<std::shared_ptr<VseModel>> models;
+  for (size_t i = 0; i < meshes.size(); i++) {
+    models.push_back(
+        std::make_shared<VseModel>(vseDevice, meshes[i], VERTEX_FORMAT));
+    printModelStats(meshNames[i], *models.back());
+  }
+  std::shared_ptr<VseModel> vseModel = models[0];
 
   auto cube = VseGameObject::createGameObject();
   cube.model = vseModel;
-  cube.transform.translation = {.0f, .0f, .5f};
+  cube.transform.translation = {.0f, .0f, 2.5f};
   cube.transform.scale = {.5f, .5f, .5f};
+  cube.motion.angularVelocity = {.3f, .6f, .0f};
+  cube.previousTransform = cube.transform;
+  if (textureStreamer && std::ifstream{CUBE_TEXTURE}.good()) {
+    cube.textureHandle = textureStreamer->addTexture(CUBE_TEXTURE);
+  } else if (bindlessTable && std::ifstream{CUBE_TEXTURE}.good()) {
+    textures.push_back(VseTexture::createTextureFromFile(
+        vseDevice, samplerCache, CUBE_TEXTURE));
+    cube.textureHandle =
+        bindlessTable->addTexture(textures.back()->descriptorInfo());
+    printTextureStats(CUBE_TEXTURE, *textures.back());
+  }
 
   gameObjects.push_back(std::move(cube));
+
+  // Receding spheres step down through their levels of detail
+  for (int i = 0; i < 4; i++) {
+    auto sphere = VseGameObject::createGameObject();
+    sphere.model = models[1];
+    sphere.transform.translation = {i % 2 == 0 ? -1.f : 1.f, .5f,
+                                    3.f + i * 2.f};
+    sphere.transform.scale = glm::vec3{.5f};
+    sphere.previousTransform = sphere.transform;
+    gameObjects.push_back(std::move(sphere));
+  }
 }
 
 }  // namespace vse
\ No newline at end of file
@@ -1,8 +1,20 @@
 #pragma once
 
+#include "simple_render_system.hpp"
+#include "vse_bindless_table.hpp"
+#include "vse_descriptors.hpp"
 #include "vse_device.hpp"
+#include "vse_frame_scheduler.hpp"
 #include "vse_game_object.hpp"
+#include "vse_gpu_timer.hpp"
+#include "vse_job_system.hpp"
+#include "vse_pipeline.hpp"
+#include "vse_pipeline_registry.hpp"
 #include "vse_renderer.hpp"
+#include "vse_shader_service.hpp"
+#include "vse_texture.hpp"
+#include "vse_texture_streamer.hpp"
+#include "vse_vertex_format.hpp"
 #include "vse_window.hpp"
 
 // std
@@ -15,6 +27,68 @@ class VseApp {
  public:
   static constexpr int WIDTH = 800;
   static constexpr int HEIGHT = 600;
+  static constexpr bool REVERSED_Z = false;
+  // Only takes effect when the device supports descriptor indexing
+  static constexpr bool USE_BINDLESS = true;
+  // Recompile and swap in shaders edited while the app is running
+  static constexpr bool HOT_RELOAD_SHADERS = false;
+  // Render without render pass and framebuffer objects when supported
+  static constexpr bool USE_DYNAMIC_RENDERING = true;
+  // FIFO, FIFO_RELAXED, MAILBOX or IMMEDIATE, falling back to FIFO where the
+  // surface lacks it. P cycles through them at runtime.
+  static constexpr VkPresentModeKHR PRESENT_MODE = VK_PRESENT_MODE_MAILBOX_KHR;
+  // Frames per second, 0 leaves the frame rate uncapped
+  static constexpr float FRAME_LIMIT = 0.f;
+  // Trade throughput for latency by waiting for each present
+  static constexpr bool LOW_LATENCY = false;
+  // Print the present mode, frame latency and the culling, LOD, object and
+  // streaming stats once a second
+  static constexpr bool LOG_FRAME_LATENCY = false;
+  // Preferred MSAA sample count, lowered to what the GPU supports. M cycles
+  // through the supported counts at runtime.
+  static constexpr VkSampleCountFlagBits MSAA_SAMPLES = VK_SAMPLE_COUNT_4_BIT;
+  // Time every supported sample count at startup and print the results,
+  // after a warm-up that lets pipelines compile and timings settle
+  static constexpr bool BENCHMARK_MSAA = false;
+  static constexpr float BENCHMARK_WARMUP = 1.f;
+  static constexpr float BENCHMARK_DURATION = 3.f;
+  // KTX2 or PNG sampled by the cube, skipped when the file is missing or
+  // bindless rendering is unavailable
+  static constexpr const char *CUBE_TEXTURE = "textures/cube.ktx2";
+  // Upload textures' mips as their on-screen size needs them instead of
+  // loading them whole
+  static constexpr bool STREAM_TEXTURES = true;
+  static constexpr VkDeviceSize TEXTURE_MEMORY_BUDGET = 256ull << 20;
+  // GPU vertex layout of the scene's models, VseVertexFormat{} keeps every
+  // attribute float32
+  static constexpr VseVertexFormat VERTEX_FORMAT = VseVertexFormat::compact();
+  // After any MSAA benchmark, draw a grid of dense spheres in each vertex
+  // format and print the GPU time and vertex bytes per frame
+  static constexpr bool BENCHMARK_VERTEX_FORMATS = false;
+  // Index and reorder meshes at load for the post-transform cache, overdraw
+  // and vertex fetch, see optimizeMesh
+  static constexpr bool OPTIMIZE_MESHES = true;
+  // Simplified levels of detail generated per mesh while optimizing
+  static constexpr uint32_t LOD_COUNT = 4;
+  // Split full detail meshes into meshlets and cull them on the GPU against
+  // the view frustum and their normal cones
+  static constexpr bool CLUSTER_CULLING = true;
+  // After the other benchmarks, draw a grid of dense spheres with cluster
+  // culling off and then on, and print the GPU time and triangles per frame
+  static constexpr bool BENCHMARK_CLUSTER_CULLING = false;
+  // Skip objects hidden behind others, tested on the GPU against a depth
+  // pyramid built between an early and a late scene pass
+  static constexpr bool OCCLUSION_CULLING = true;
+  // Order opaque objects by state or nearest first, or draw their depth in
+  // a prepass before shading, see DepthMode. D cycles through the modes at
+  // runtime.
+  static constexpr DepthMode DEPTH_MODE = DepthMode::FrontToBack;
+  // After the other benchmarks, draw layers of spheres hiding each other in
+  // every depth mode with occlusion culling off, and print the GPU time
+  static constexpr bool BENCHMARK_DEPTH_MODES = false;
+  // Before anything is drawn, time building, refitting and querying the
+  // scene hierarchy against brute force for 10k to 1M random boxes
+  static constexpr bool BENCHMARK_BVH = false;
 
   VseApp();
   ~VseApp();
@@ -29,7 +103,23 @@ class VseApp {
 
   VseWindow vseWindow{WIDTH, HEIGHT, "VSE Application"};
   VseDevice vseDevice{vseWindow};
-  VseRenderer vseRenderer{vseWindow, vseDevice};
+  VseRenderer vseRenderer{vseWindow, vseDevice, USE_DYNAMIC_RENDERING,
+                          PRESENT_MODE};
+  VseGpuTimer gpuTimer{vseDevice};
+  VseFrameScheduler frameScheduler{};
+  VseJobSystem jobSystem{};
+
+  VseDescriptorLayoutCache descriptorLayoutCache{vseDevice};
+  VsePipelineLayoutCache pipelineLayoutCache{vseDevice};
+  VsePipelineRegistry pipelineRegistry{vseDevice, jobSystem};
+  // Declared after the registry so its compile jobs stop before the
+  // registry they notify is destroyed
+  std::unique_ptr<VseShaderService> shaderService;
+  std::unique_ptr<VseBindlessTable> bindlessTable;
+  VseSamplerCache samplerCache{vseDevice};
+  // Declared after the sampler cache they take samplers from
+  std::vector<std::unique_ptr<VseTexture>> textures;
+  std::unique_ptr<VseTextureStreamer> textureStreamer;
 
   std::vector<VseGameObject> gameObjects;
 };
@@ -0,0 +1,97 @@
+#include "vse_benchmark.hpp"
+
+// std
+#include <cassert>
+#include <iostream>
+#include <utility>
+
+namespace vse {
+
+VseBenchmark::VseBenchmark(std::string name,
+                           std::vector<std::string> caseNames, float warmup,
+                           float duration)
+    : name{std::move(name)},
+      caseNames{std::move(caseNames)},
+      warmup{warmup},
+      duration{duration},
+      samples(this->caseNames.size()) {
+  assert(!this->caseNames.empty() && "A benchmark needs at least one case");
+}
+
+VseBenchmark &VseBenchmark::onBeginCase(BeginCase callback) {
+  beginCase = std::move(callback);
+  return *this;
+}
+
+VseBenchmark &VseBenchmark::onMeasureFrame(MeasureFrame callback) {
+  measureFrame = std::move(callback);
+  return *this;
+}
+
+VseBenchmark &VseBenchmark::onDescribeCase(DescribeCase callback) {
+  describeCase = std::move(callback);
+  return *this;
+}
+
+VseBenchmark &VseBenchmark::onFinish(Finish callback) {
+  finish = std::move(callback);
+  return *this;
+}
+
+void VseBenchmark::update(float frameTime, float gpuMs) {
+  if (finished) {
+    return;
+  }
+  if (!started) {
+    started = true;
+    if (beginCase) {
+      beginCase(caseIndex);
+    }
+  }
+
+  caseTime += frameTime;
+  if (caseTime > warmup) {
+    auto &sample = samples[caseIndex];
+    sample.cpuMs += frameTime * 1000.f;
+    sample.cpuFrames++;
+    if (gpuMs >= 0.f) {
+      sample.gpuMs += gpuMs;
+      sample.gpuFrames++;
+    }
+    if (measureFrame) {
+      measureFrame(caseIndex);
+    }
+  }
+  if (caseTime < warmup + duration) {
+    return;
+  }
+
+  caseTime = 0.f;
+  caseIndex++;
+  if (caseIndex < samples.size()) {
+    if (beginCase) {
+      beginCase(caseIndex);
+    }
+    return;
+  }
+  finished = true;
+  report(std::cout);
+  if (finish) {
+    finish();
+  }
+}
+
+void VseBenchmark::report(std::ostream &out) const {
+  out << name << " benchmark, average per frame:" << std::endl;
+  for (size_t i = 0; i < samples.size(); i++) {
+    const auto &sample = samples[i];
+    out << "  " << caseNames[i] << ": CPU " << sample.averageCpuMs()
+        << " ms, GPU " << sample.averageGpuMs() << " ms";
+    if (describeCase) {
+      describeCase(out, i, sample);
+    }
+    out << std::endl;
+  }
+}
+
+}  // namespace vse
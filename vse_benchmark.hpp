@@ -0,0 +1,81 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vse {
+
+// Frame times accumulated while one benchmark case was measured
+struct BenchmarkSample {
+  float cpuMs = 0.f;
+  uint32_t cpuFrames = 0;
+  float gpuMs = 0.f;
+  uint32_t gpuFrames = 0;
+
+  float averageCpuMs() const { return cpuMs / std::max(cpuFrames, 1u); }
+  float averageGpuMs() const { return gpuMs / std::max(gpuFrames, 1u); }
+};
+
+// Times a list of cases inside the frame loop, one after the other. Each
+// case runs for a warm-up that lets pipelines compile and timings settle,
+// then its CPU and GPU frame times are accumulated for a fixed duration.
+// Once the last case ran, the average frame times of every case are
+// printed. Callbacks switch the scene between cases and add case specific
+// columns to the report.
+class VseBenchmark {
+ public:
+  // Switches the scene to a case, right before its warm-up
+  using BeginCase = std::function<void(size_t caseIndex)>;
+  // Called for every measured frame, e.g. to record stats of the case
+  using MeasureFrame = std::function<void(size_t caseIndex)>;
+  // Appends a case's own columns to its line of the report
+  using DescribeCase = std::function<void(
+      std::ostream &out, size_t caseIndex, const BenchmarkSample &sample)>;
+  // Restores the scene once the report is printed
+  using Finish = std::function<void()>;
+
+  VseBenchmark(std::string name, std::vector<std::string> caseNames,
+               float warmup, float duration);
+
+  VseBenchmark(const VseBenchmark &) = delete;
+  VseBenchmark &operator=(const VseBenchmark &) = delete;
+
+  VseBenchmark &onBeginCase(BeginCase callback);
+  VseBenchmark &onMeasureFrame(MeasureFrame callback);
+  VseBenchmark &onDescribeCase(DescribeCase callback);
+  VseBenchmark &onFinish(Finish callback);
+
+  // Once per frame, with the frame's CPU time in seconds and the GPU time of
+  // the latest completed frame, negative when unknown. The first call
+  // begins the first case.
+  void update(float frameTime, float gpuMs);
+  bool isFinished() const { return finished; }
+
+  const std::vector<BenchmarkSample> &getSamples() const { return samples; }
+
+ private:
+  void report(std::ostream &out) const;
+
+  std::string name;
+  std::vector<std::string> caseNames;
+  float warmup;
+  float duration;
+
+  BeginCase beginCase;
+  MeasureFrame measureFrame;
+  DescribeCase describeCase;
+  Finish finish;
+
+  std::vector<BenchmarkSample> samples;
+  size_t caseIndex = 0;
+  float caseTime = 0.f;
+  bool started = false;
+  bool finished = false;
+};
+
+}  // namespace vse
@@ -0,0 +1,261 @@
+#include "vse_bindless_table.hpp"
+
+#include "vse_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <stdexcept>
+
+namespace vse {
+
+// *************** Handle Allocator *********************
+
+VseBindlessTable::Handle VseBindlessTable::HandleAllocator::allocate() {
+  if (!freeList.empty()) {
+    Handle handle = freeList.back();
+    freeList.pop_back();
+    return handle;
+  }
+  if (highWater < capacity) {
+    return highWater++;
+  }
+  return INVALID_HANDLE;
+}
+
+void VseBindlessTable::HandleAllocator::release(Handle handle,
+                                                uint64_t frame) {
+  assert(handle < highWater && "Releasing a handle that was never allocated");
+  pendingRelease.emplace_back(handle, frame);
+}
+
+void VseBindlessTable::HandleAllocator::recycle(uint64_t completedFrame) {
+  auto it = std::partition(pendingRelease.begin(), pendingRelease.end(),
+                           [&](const std::pair<Handle, uint64_t> &pending) {
+                             return pending.second > completedFrame;
+                           });
+  for (auto recycled = it; recycled != pendingRelease.end(); ++recycled) {
+    freeList.push_back(recycled->first);
+  }
+  pendingRelease.erase(it, pendingRelease.end());
+}
+
+// *************** Bindless Table *********************
+
+VseBindlessTable::VseBindlessTable(VseDevice &vseDevice, uint32_t maxTextures,
+                                   uint32_t maxBuffers)
+    : vseDevice{vseDevice},
+      descriptorSets(VseSwapChain::MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE),
+      pendingUpdates(VseSwapChain::MAX_FRAMES_IN_FLIGHT) {
+  assert(vseDevice.hasDescriptorIndexing() &&
+         "Bindless table requires descriptor indexing support");
+
+  const auto &limits = vseDevice.getDescriptorIndexingProperties();
+  textureHandles.capacity = std::min(
+      {maxTextures, limits.maxDescriptorSetUpdateAfterBindSampledImages,
+       limits.maxPerStageDescriptorUpdateAfterBindSampledImages});
+  bufferHandles.capacity = std::min(
+      {maxBuffers, limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+       limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+
+  createDescriptorSetLayout();
+  createDescriptorPool();
+  allocateDescriptorSets();
+}
+
+VseBindlessTable::~VseBindlessTable() {
+  vkDestroyDescriptorPool(vseDevice.device(), descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(vseDevice.device(), descriptorSetLayout,
+                               nullptr);
+}
+
+void VseBindlessTable::createDescriptorSetLayout() {
+  std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+  bindings[0].binding = TEXTURE_BINDING;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0].descriptorCount = textureHandles.capacity;
+  bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+
+  bindings[1].binding = BUFFER_BINDING;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[1].descriptorCount = bufferHandles.capacity;
+  bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+  // Slots may be empty, and may be rewritten while earlier frames that do not
+  // read them are still executing
+  VkDescriptorBindingFlags arrayFlags =
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+  std::array<VkDescriptorBindingFlags, 2> bindingFlags{arrayFlags, arrayFlags};
+
+  VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+  bindingFlagsInfo.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+  bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+  bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.pNext = &bindingFlagsInfo;
+  layoutInfo.flags =
+      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(vseDevice.device(), &layoutInfo, nullptr,
+                                  &descriptorSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create bindless set layout!");
+  }
+}
+
+void VseBindlessTable::createDescriptorPool() {
+  uint32_t setCount = static_cast<uint32_t>(descriptorSets.size());
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                  textureHandles.capacity * setCount};
+  poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                  bufferHandles.capacity * setCount};
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  poolInfo.maxSets = setCount;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+
+  if (vkCreateDescriptorPool(vseDevice.device(), &poolInfo, nullptr,
+                             &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create bindless descriptor pool!");
+  }
+}
+
+void VseBindlessTable::allocateDescriptorSets() {
+  std::vector<VkDescriptorSetLayout> layouts(descriptorSets.size(),
+                                             descriptorSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+  allocInfo.pSetLayouts = layouts.data();
+
+  if (vkAllocateDescriptorSets(vseDevice.device(), &allocInfo,
+                               descriptorSets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate bindless descriptor set!");
+  }
+}
+
+VseBindlessTable::Handle VseBindlessTable::addTexture(
+    const VkDescriptorImageInfo &imageInfo) {
+  Handle handle = textureHandles.allocate();
+  if (handle == INVALID_HANDLE) {
+    throw std::runtime_error("bindless texture table is full!");
+  }
+  // New and recycled slots are not read by any pending frame
+  for (auto set : descriptorSets) {
+    writeTexture(set, handle, imageInfo);
+  }
+  return handle;
+}
+
+VseBindlessTable::Handle VseBindlessTable::addBuffer(
+    const VkDescriptorBufferInfo &bufferInfo) {
+  Handle handle = bufferHandles.allocate();
+  if (handle == INVALID_HANDLE) {
+    throw std::runtime_error("bindless buffer table is full!");
+  }
+  for (auto set : descriptorSets) {
+    writeBuffer(set, handle, bufferInfo);
+  }
+  return handle;
+}
+
+void VseBindlessTable::updateTexture(Handle handle,
+                                     const VkDescriptorImageInfo &imageInfo) {
+  assert(handle < textureHandles.highWater && "Invalid texture handle");
+  writeTexture(descriptorSets[currentSet()], handle, imageInfo);
+  for (size_t i = 0; i < descriptorSets.size(); i++) {
+    if (i != currentSet()) {
+      pendingUpdates[i].push_back({handle, true, imageInfo, {}});
+    }
+  }
+}
+
+void VseBindlessTable::updateBuffer(Handle handle,
+                                    const VkDescriptorBufferInfo &bufferInfo) {
+  assert(handle < bufferHandles.highWater && "Invalid buffer handle");
+  writeBuffer(descriptorSets[currentSet()], handle, bufferInfo);
+  for (size_t i = 0; i < descriptorSets.size(); i++) {
+    if (i != currentSet()) {
+      pendingUpdates[i].push_back({handle, false, {}, bufferInfo});
+    }
+  }
+}
+
+void VseBindlessTable::releaseTexture(Handle handle) {
+  textureHandles.release(handle, frameCounter);
+}
+
+void VseBindlessTable::releaseBuffer(Handle handle) {
+  bufferHandles.release(handle, frameCounter);
+}
+
+void VseBindlessTable::nextFrame() {
+  frameCounter++;
+  // The frame that last used this set has completed
+  auto set = descriptorSets[currentSet()];
+  for (const auto &update : pendingUpdates[currentSet()]) {
+    if (update.isTexture) {
+      writeTexture(set, update.handle, update.imageInfo);
+    } else {
+      writeBuffer(set, update.handle, update.bufferInfo);
+    }
+  }
+  pendingUpdates[currentSet()].clear();
+
+  if (frameCounter < VseSwapChain::MAX_FRAMES_IN_FLIGHT) {
+    return;
+  }
+  // Every frame recorded before this one has passed its fence
+  uint64_t completedFrame = frameCounter - VseSwapChain::MAX_FRAMES_IN_FLIGHT;
+  textureHandles.recycle(completedFrame);
+  bufferHandles.recycle(completedFrame);
+}
+
+void VseBindlessTable::bind(VkCommandBuffer commandBuffer,
+                            VkPipelineLayout pipelineLayout, uint32_t setIndex,
+                            VkPipelineBindPoint bindPoint) const {
+  vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, setIndex, 1,
+                          &descriptorSets[currentSet()], 0, nullptr);
+}
+
+void VseBindlessTable::writeTexture(VkDescriptorSet set, Handle handle,
+                                    const VkDescriptorImageInfo &imageInfo) {
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = set;
+  write.dstBinding = TEXTURE_BINDING;
+  write.dstArrayElement = handle;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.descriptorCount = 1;
+  write.pImageInfo = &imageInfo;
+
+  vkUpdateDescriptorSets(vseDevice.device(), 1, &write, 0, nullptr);
+}
+
+void VseBindlessTable::writeBuffer(VkDescriptorSet set, Handle handle,
+                                   const VkDescriptorBufferInfo &bufferInfo) {
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = set;
+  write.dstBinding = BUFFER_BINDING;
+  write.dstArrayElement = handle;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.descriptorCount = 1;
+  write.pBufferInfo = &bufferInfo;
+
+  vkUpdateDescriptorSets(vseDevice.device(), 1, &write, 0, nullptr);
+}
+
+}  // namespace vse
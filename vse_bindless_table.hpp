@@ -0,0 +1,121 @@
+#pragma once
+
+#include "vse_device.hpp"
+
+// std
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vse {
+
+// One descriptor set holding every sampled image and storage buffer in the
+// scene. Resources are addressed by a stable integer handle that shaders use
+// to index the arrays, so a whole scene draws with a single descriptor bind.
+// The set is duplicated per frame in flight so that slots can be rewritten
+// while earlier frames still read them. Requires
+// VseDevice::hasDescriptorIndexing().
+class VseBindlessTable {
+ public:
+  using Handle = uint32_t;
+  static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+  static constexpr uint32_t TEXTURE_BINDING = 0;
+  static constexpr uint32_t BUFFER_BINDING = 1;
+
+  static constexpr uint32_t DEFAULT_MAX_TEXTURES = 4096;
+  static constexpr uint32_t DEFAULT_MAX_BUFFERS = 1024;
+
+  VseBindlessTable(VseDevice &vseDevice,
+                   uint32_t maxTextures = DEFAULT_MAX_TEXTURES,
+                   uint32_t maxBuffers = DEFAULT_MAX_BUFFERS);
+  ~VseBindlessTable();
+
+  VseBindlessTable(const VseBindlessTable &) = delete;
+  VseBindlessTable &operator=(const VseBindlessTable &) = delete;
+
+  Handle addTexture(const VkDescriptorImageInfo &imageInfo);
+  Handle addBuffer(const VkDescriptorBufferInfo &bufferInfo);
+
+  // Rewrites a slot in place, e.g. when a streamed texture gains mip levels.
+  // Takes effect in the current frame's set right away and in each other
+  // set once the frame that last used it has completed; the old resource
+  // must stay alive until then, see VseRenderer::retire().
+  void updateTexture(Handle handle, const VkDescriptorImageInfo &imageInfo);
+  void updateBuffer(Handle handle, const VkDescriptorBufferInfo &bufferInfo);
+
+  // Released handles are only reused once frames that may still read them
+  // have completed, see nextFrame()
+  void releaseTexture(Handle handle);
+  void releaseBuffer(Handle handle);
+
+  // Call once per frame after the frame's fence wait
+  void nextFrame();
+
+  void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout,
+            uint32_t setIndex,
+            VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS)
+      const;
+
+  VkDescriptorSetLayout getDescriptorSetLayout() const {
+    return descriptorSetLayout;
+  }
+  // The current frame's set
+  VkDescriptorSet getDescriptorSet() const {
+    return descriptorSets[currentSet()];
+  }
+
+  uint32_t getMaxTextures() const { return textureHandles.capacity; }
+  uint32_t getMaxBuffers() const { return bufferHandles.capacity; }
+  uint32_t getTextureCount() const { return textureHandles.liveCount(); }
+  uint32_t getBufferCount() const { return bufferHandles.liveCount(); }
+
+ private:
+  struct HandleAllocator {
+    uint32_t capacity = 0;
+    uint32_t highWater = 0;
+    std::vector<Handle> freeList;
+    // handle and the frame it was released on
+    std::vector<std::pair<Handle, uint64_t>> pendingRelease;
+
+    Handle allocate();
+    void release(Handle handle, uint64_t frame);
+    void recycle(uint64_t completedFrame);
+    uint32_t liveCount() const {
+      return highWater - static_cast<uint32_t>(freeList.size()) -
+             static_cast<uint32_t>(pendingRelease.size());
+    }
+  };
+
+  // An update still to be written into a set that was in use when it
+  // was made
+  struct PendingUpdate {
+    Handle handle;
+    bool isTexture;
+    VkDescriptorImageInfo imageInfo;
+    VkDescriptorBufferInfo bufferInfo;
+  };
+
+  void createDescriptorSetLayout();
+  void createDescriptorPool();
+  void allocateDescriptorSets();
+
+  size_t currentSet() const { return frameCounter % descriptorSets.size(); }
+  void writeTexture(VkDescriptorSet set, Handle handle,
+                    const VkDescriptorImageInfo &imageInfo);
+  void writeBuffer(VkDescriptorSet set, Handle handle,
+                   const VkDescriptorBufferInfo &bufferInfo);
+
+  VseDevice &vseDevice;
+  VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> descriptorSets;
+  // Per set, applied when the set comes around again in nextFrame()
+  std::vector<std::vector<PendingUpdate>> pendingUpdates;
+
+  HandleAllocator textureHandles;
+  HandleAllocator bufferHandles;
+  uint64_t frameCounter = 0;
+};
+
+}  // namespace vse
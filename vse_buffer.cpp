@@ -0,0 +1,109 @@
+#include "vse_buffer.hpp"
+
+// std
+#include <cassert>
+#include <cstring>
+
+namespace vse {
+
+// Rounds instanceSize up so every instance starts on a minOffsetAlignment
+// boundary (minOffsetAlignment must be a power of two)
+VkDeviceSize VseBuffer::getAlignment(VkDeviceSize instanceSize,
+                                     VkDeviceSize minOffsetAlignment) {
+  if (minOffsetAlignment > 0) {
+    return (instanceSize + minOffsetAlignment - 1) &
+           ~(minOffsetAlignment - 1);
+  }
+  return instanceSize;
+}
+
+VseBuffer::VseBuffer(VseDevice &device, VkDeviceSize instanceSize,
+                     uint32_t instanceCount, VkBufferUsageFlags usageFlags,
+                     VkMemoryPropertyFlags memoryPropertyFlags,
+                     VkDeviceSize minOffsetAlignment)
+    : vseDevice{device},
+      instanceCount{instanceCount},
+      instanceSize{instanceSize},
+      usageFlags{usageFlags},
+      memoryPropertyFlags{memoryPropertyFlags} {
+  alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
+  bufferSize = alignmentSize * instanceCount;
+  device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer,
+                      memory);
+}
+
+VseBuffer::~VseBuffer() {
+  unmap();
+  vkDestroyBuffer(vseDevice.device(), buffer, nullptr);
+  vkFreeMemory(vseDevice.device(), memory, nullptr);
+}
+
+VkResult VseBuffer::map(VkDeviceSize size, VkDeviceSize offset) {
+  assert(buffer && memory && "Called map on buffer before create");
+  return vkMapMemory(vseDevice.device(), memory, offset, size, 0, &mapped);
+}
+
+void VseBuffer::unmap() {
+  if (mapped) {
+    vkUnmapMemory(vseDevice.device(), memory);
+    mapped = nullptr;
+  }
+}
+
+void VseBuffer::writeToBuffer(const void *data, VkDeviceSize size,
+                              VkDeviceSize offset) {
+  assert(mapped && "Cannot copy to unmapped buffer");
+
+  if (size == VK_WHOLE_SIZE) {
+    memcpy(mapped, data, bufferSize);
+  } else {
+    char *memOffset = static_cast<char *>(mapped);
+    memOffset += offset;
+    memcpy(memOffset, data, size);
+  }
+}
+
+VkResult VseBuffer::flush(VkDeviceSize size, VkDeviceSize offset) {
+  VkMappedMemoryRange mappedRange = {};
+  mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  mappedRange.memory = memory;
+  mappedRange.offset = offset;
+  mappedRange.size = size;
+  return vkFlushMappedMemoryRanges(vseDevice.device(), 1, &mappedRange);
+}
+
+VkResult VseBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
+  VkMappedMemoryRange mappedRange = {};
+  mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  mappedRange.memory = memory;
+  mappedRange.offset = offset;
+  mappedRange.size = size;
+  return vkInvalidateMappedMemoryRanges(vseDevice.device(), 1, &mappedRange);
+}
+
+VkDescriptorBufferInfo VseBuffer::descriptorInfo(VkDeviceSize size,
+                                                 VkDeviceSize offset) {
+  return VkDescriptorBufferInfo{
+      buffer,
+      offset,
+      size,
+  };
+}
+
+void VseBuffer::writeToIndex(const void *data, int index) {
+  writeToBuffer(data, instanceSize, index * alignmentSize);
+}
+
+VkResult VseBuffer::flushIndex(int index) {
+  return flush(alignmentSize, index * alignmentSize);
+}
+
+VkDescriptorBufferInfo VseBuffer::descriptorInfoForIndex(int index) {
+  return descriptorInfo(alignmentSize, index * alignmentSize);
+}
+
+VkResult VseBuffer::invalidateIndex(int index) {
+  return invalidate(alignmentSize, index * alignmentSize);
+}
+
+}  // namespace vse
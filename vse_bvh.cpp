@@ -0,0 +1,389 @@
+#include "vse_bvh.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+
+namespace vse {
+
+namespace {
+
+constexpr uint32_t BIN_COUNT = 16;
+// Leaves are forced below this depth, which bounds the traversal stacks
+constexpr uint32_t MAX_DEPTH = 48;
+constexpr uint32_t STACK_SIZE = 64;
+// Cost of visiting a node relative to testing one primitive
+constexpr float TRAVERSAL_COST = 1.f;
+// Marks stack entries whose node lies entirely inside the frustum
+constexpr uint32_t INSIDE_BIT = 1u << 31;
+
+enum class Containment { Outside, Intersecting, Inside };
+
+Containment classify(const std::array<glm::vec4, 6> &planes,
+                     const glm::vec3 &min, const glm::vec3 &max) {
+  Containment result = Containment::Inside;
+  for (const auto &plane : planes) {
+    glm::vec3 normal{plane};
+    // Corners furthest along and against the plane normal
+    glm::vec3 positive{normal.x >= 0.f ? max.x : min.x,
+                       normal.y >= 0.f ? max.y : min.y,
+                       normal.z >= 0.f ? max.z : min.z};
+    if (glm::dot(normal, positive) + plane.w < 0.f) {
+      return Containment::Outside;
+    }
+    glm::vec3 negative{normal.x >= 0.f ? min.x : max.x,
+                       normal.y >= 0.f ? min.y : max.y,
+                       normal.z >= 0.f ? min.z : max.z};
+    if (glm::dot(normal, negative) + plane.w < 0.f) {
+      result = Containment::Intersecting;
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+// Partitioned in place while building, so each node reads its primitives
+// contiguously instead of gathering them through indices
+struct VseBvh::BuildPrimitive {
+  VseAabb bounds;
+  glm::vec3 centroid;
+  uint32_t index;
+};
+
+void VseBvh::build(const std::vector<VseAabb> &bounds) {
+  assert(bounds.size() < INSIDE_BIT && "Too many primitives");
+  nodes.clear();
+  primitiveIndices.clear();
+  orderedBounds.clear();
+  if (bounds.empty()) {
+    cost = builtCost = 1.f;
+    return;
+  }
+
+  std::vector<BuildPrimitive> primitives(bounds.size());
+  VseAabb rootBounds{};
+  VseAabb centroidBounds{};
+  for (uint32_t i = 0; i < primitives.size(); i++) {
+    primitives[i] = {bounds[i], bounds[i].center(), i};
+    rootBounds.add(bounds[i]);
+    centroidBounds.add(primitives[i].centroid);
+  }
+  // A balanced tree has fewer than two nodes per leaf
+  nodes.reserve(bounds.size() * 2 / maxLeafSize + 1);
+  buildNode(primitives, 0, static_cast<uint32_t>(primitives.size()),
+            rootBounds, centroidBounds, 0);
+
+  primitiveIndices.resize(primitives.size());
+  orderedBounds.resize(primitives.size());
+  for (size_t i = 0; i < primitives.size(); i++) {
+    primitiveIndices[i] = primitives[i].index;
+    orderedBounds[i] = primitives[i].bounds;
+  }
+  builtCost = cost = computeCost();
+}
+
+uint32_t VseBvh::buildNode(std::vector<BuildPrimitive> &primitives,
+                           uint32_t begin, uint32_t end,
+                           const VseAabb &nodeBounds,
+                           const VseAabb &centroidBounds, uint32_t depth) {
+  uint32_t index = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+  uint32_t count = end - begin;
+  if (count <= maxLeafSize || depth >= MAX_DEPTH) {
+    nodes[index] = {nodeBounds.min, begin, nodeBounds.max, count};
+    return index;
+  }
+
+  // Bin centroids along all three axes in one pass; bins also collect the
+  // bounds the children will need, so no node rescans its primitives
+  struct Bin {
+    VseAabb bounds{};
+    VseAabb centroidBounds{};
+    uint32_t count = 0;
+  };
+  std::array<std::array<Bin, BIN_COUNT>, 3> bins{};
+  glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+  glm::vec3 scale{0.f};
+  for (int axis = 0; axis < 3; axis++) {
+    if (extent[axis] > 0.f) {
+      scale[axis] = BIN_COUNT / extent[axis];
+    }
+  }
+  auto binOf = [&](const glm::vec3 &centroid, int axis) {
+    return std::min(BIN_COUNT - 1,
+                    static_cast<uint32_t>(
+                        (centroid[axis] - centroidBounds.min[axis]) *
+                        scale[axis]));
+  };
+  for (uint32_t i = begin; i < end; i++) {
+    const auto &primitive = primitives[i];
+    for (int axis = 0; axis < 3; axis++) {
+      Bin &bin = bins[axis][binOf(primitive.centroid, axis)];
+      bin.bounds.add(primitive.bounds);
+      bin.centroidBounds.add(primitive.centroid);
+      bin.count++;
+    }
+  }
+
+  // The boundary between bins minimizing area times primitives summed over
+  // both sides
+  int bestAxis = -1;
+  uint32_t bestSplit = 0;
+  float bestCost = FLT_MAX;
+  for (int axis = 0; axis < 3; axis++) {
+    if (extent[axis] <= 0.f) {
+      continue;
+    }
+    std::array<float, BIN_COUNT> rightCost{};
+    VseAabb right{};
+    uint32_t rightCount = 0;
+    for (uint32_t b = BIN_COUNT - 1; b > 0; b--) {
+      right.add(bins[axis][b].bounds);
+      rightCount += bins[axis][b].count;
+      rightCost[b] = rightCount > 0 ? right.surfaceArea() * rightCount : 0.f;
+    }
+    VseAabb left{};
+    uint32_t leftCount = 0;
+    for (uint32_t b = 0; b + 1 < BIN_COUNT; b++) {
+      left.add(bins[axis][b].bounds);
+      leftCount += bins[axis][b].count;
+      if (leftCount == 0 || leftCount == count) {
+        continue;
+      }
+      float splitCost = left.surfaceArea() * leftCount + rightCost[b + 1];
+      if (splitCost < bestCost) {
+        bestCost = splitCost;
+        bestAxis = axis;
+        bestSplit = b + 1;
+      }
+    }
+  }
+
+  uint32_t middle;
+  VseAabb leftBounds{}, leftCentroids{}, rightBounds{}, rightCentroids{};
+  if (bestAxis >= 0) {
+    middle = static_cast<uint32_t>(
+        std::partition(primitives.begin() + begin, primitives.begin() + end,
+                       [&](const BuildPrimitive &primitive) {
+                         return binOf(primitive.centroid, bestAxis) <
+                                bestSplit;
+                       }) -
+        primitives.begin());
+    for (uint32_t b = 0; b < BIN_COUNT; b++) {
+      const Bin &bin = bins[bestAxis][b];
+      (b < bestSplit ? leftBounds : rightBounds).add(bin.bounds);
+      (b < bestSplit ? leftCentroids : rightCentroids)
+          .add(bin.centroidBounds);
+    }
+  } else {
+    // Every centroid in one spot, any split is as good as another
+    middle = begin + count / 2;
+    for (uint32_t i = begin; i < end; i++) {
+      (i < middle ? leftBounds : rightBounds).add(primitives[i].bounds);
+      (i < middle ? leftCentroids : rightCentroids)
+          .add(primitives[i].centroid);
+    }
+  }
+
+  uint32_t leftChild = buildNode(primitives, begin, middle, leftBounds,
+                                 leftCentroids, depth + 1);
+  assert(leftChild == index + 1 && "Left child must follow its parent");
+  uint32_t rightChild = buildNode(primitives, middle, end, rightBounds,
+                                  rightCentroids, depth + 1);
+  nodes[index] = {nodeBounds.min, rightChild, nodeBounds.max, 0};
+  return index;
+}
+
+void VseBvh::refit(const std::vector<VseAabb> &bounds) {
+  assert(bounds.size() == orderedBounds.size() &&
+         "Refitting needs the primitives the tree was built with");
+  for (size_t i = 0; i < orderedBounds.size(); i++) {
+    orderedBounds[i] = bounds[primitiveIndices[i]];
+  }
+  // Children always come after their parent
+  for (size_t i = nodes.size(); i-- > 0;) {
+    Node &node = nodes[i];
+    VseAabb nodeBounds{};
+    if (node.count > 0) {
+      for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+        nodeBounds.add(orderedBounds[j]);
+      }
+    } else {
+      const Node &left = nodes[i + 1];
+      const Node &right = nodes[node.offset];
+      nodeBounds.min = glm::min(left.min, right.min);
+      nodeBounds.max = glm::max(left.max, right.max);
+    }
+    node.min = nodeBounds.min;
+    node.max = nodeBounds.max;
+  }
+  if (!nodes.empty()) {
+    cost = computeCost();
+  }
+}
+
+float VseBvh::computeCost() const {
+  float total = 0.f;
+  for (const auto &node : nodes) {
+    float area = VseAabb{node.min, node.max}.surfaceArea();
+    total += node.count > 0 ? area * node.count : area * TRAVERSAL_COST;
+  }
+  float rootArea = VseAabb{nodes[0].min, nodes[0].max}.surfaceArea();
+  return rootArea > 0.f ? total / rootArea : 1.f;
+}
+
+void VseBvh::queryFrustum(const std::array<glm::vec4, 6> &planes,
+                          std::vector<uint32_t> &result) const {
+  if (nodes.empty()) {
+    return;
+  }
+  std::array<uint32_t, STACK_SIZE> stack;
+  uint32_t stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    uint32_t entry = stack[--stackSize];
+    const Node &node = nodes[entry & ~INSIDE_BIT];
+    bool inside = entry & INSIDE_BIT;
+    if (!inside) {
+      Containment containment = classify(planes, node.min, node.max);
+      if (containment == Containment::Outside) {
+        continue;
+      }
+      inside = containment == Containment::Inside;
+    }
+
+    if (node.count > 0) {
+      for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+        if (inside || orderedBounds[j].overlapsFrustum(planes)) {
+          result.push_back(primitiveIndices[j]);
+        }
+      }
+    } else {
+      // Everything below a contained node is contained, skip the tests
+      uint32_t flag = inside ? INSIDE_BIT : 0;
+      stack[stackSize++] = node.offset | flag;
+      stack[stackSize++] = ((entry & ~INSIDE_BIT) + 1) | flag;
+    }
+  }
+}
+
+void VseBvh::queryAabb(const VseAabb &box,
+                       std::vector<uint32_t> &result) const {
+  if (nodes.empty()) {
+    return;
+  }
+  std::array<uint32_t, STACK_SIZE> stack;
+  uint32_t stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    uint32_t index = stack[--stackSize];
+    const Node &node = nodes[index];
+    if (!box.overlaps({node.min, node.max})) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+        if (box.overlaps(orderedBounds[j])) {
+          result.push_back(primitiveIndices[j]);
+        }
+      }
+    } else {
+      stack[stackSize++] = node.offset;
+      stack[stackSize++] = index + 1;
+    }
+  }
+}
+
+void VseBvh::querySphere(const glm::vec3 &center, float radius,
+                         std::vector<uint32_t> &result) const {
+  if (nodes.empty()) {
+    return;
+  }
+  std::array<uint32_t, STACK_SIZE> stack;
+  uint32_t stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    uint32_t index = stack[--stackSize];
+    const Node &node = nodes[index];
+    if (!VseAabb{node.min, node.max}.overlapsSphere(center, radius)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+        if (orderedBounds[j].overlapsSphere(center, radius)) {
+          result.push_back(primitiveIndices[j]);
+        }
+      }
+    } else {
+      stack[stackSize++] = node.offset;
+      stack[stackSize++] = index + 1;
+    }
+  }
+}
+
+VseBvh::RayHit VseBvh::raycast(const glm::vec3 &origin,
+                               const glm::vec3 &direction,
+                               float maxDistance) const {
+  RayHit hit{};
+  hit.distance = maxDistance;
+  if (nodes.empty()) {
+    return {};
+  }
+  glm::vec3 inverseDirection = 1.f / direction;
+
+  // Nearer children are visited first, and nodes entered beyond the best
+  // hit so far are skipped
+  struct Entry {
+    uint32_t index;
+    float enter;
+  };
+  std::array<Entry, STACK_SIZE> stack;
+  uint32_t stackSize = 0;
+  float rootEnter = VseAabb{nodes[0].min, nodes[0].max}.intersectRay(
+      origin, inverseDirection, hit.distance);
+  if (rootEnter == FLT_MAX) {
+    return {};
+  }
+  stack[stackSize++] = {0, rootEnter};
+  while (stackSize > 0) {
+    Entry entry = stack[--stackSize];
+    if (entry.enter > hit.distance) {
+      continue;
+    }
+    const Node &node = nodes[entry.index];
+    if (node.count > 0) {
+      for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+        float enter = orderedBounds[j].intersectRay(origin, inverseDirection,
+                                                    hit.distance);
+        if (enter < hit.distance ||
+            (enter == hit.distance && hit.primitive == INVALID_PRIMITIVE)) {
+          hit = {primitiveIndices[j], enter};
+        }
+      }
+      continue;
+    }
+    uint32_t near = entry.index + 1;
+    uint32_t far = node.offset;
+    float nearEnter = VseAabb{nodes[near].min, nodes[near].max}.intersectRay(
+        origin, inverseDirection, hit.distance);
+    float farEnter = VseAabb{nodes[far].min, nodes[far].max}.intersectRay(
+        origin, inverseDirection, hit.distance);
+    if (farEnter < nearEnter) {
+      std::swap(near, far);
+      std::swap(nearEnter, farEnter);
+    }
+    if (farEnter != FLT_MAX) {
+      stack[stackSize++] = {far, farEnter};
+    }
+    if (nearEnter != FLT_MAX) {
+      stack[stackSize++] = {near, nearEnter};
+    }
+  }
+  if (hit.primitive == INVALID_PRIMITIVE) {
+    return {};
+  }
+  return hit;
+}
+
+}  // namespace vse
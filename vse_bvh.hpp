@@ -0,0 +1,148 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+namespace vse {
+
+struct VseAabb {
+  // Empty until something is added
+  glm::vec3 min{FLT_MAX};
+  glm::vec3 max{-FLT_MAX};
+
+  static VseAabb fromSphere(const glm::vec3 &center, float radius) {
+    return {center - glm::vec3{radius}, center + glm::vec3{radius}};
+  }
+
+  void add(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+  void add(const VseAabb &other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+  glm::vec3 center() const { return (min + max) * .5f; }
+  float surfaceArea() const {
+    glm::vec3 d = glm::max(max - min, glm::vec3{0.f});
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+  bool overlaps(const VseAabb &other) const {
+    return min.x <= other.max.x && max.x >= other.min.x &&
+           min.y <= other.max.y && max.y >= other.min.y &&
+           min.z <= other.max.z && max.z >= other.min.z;
+  }
+  bool overlapsSphere(const glm::vec3 &center, float radius) const {
+    glm::vec3 closest = glm::clamp(center, min, max);
+    glm::vec3 d = closest - center;
+    return glm::dot(d, d) <= radius * radius;
+  }
+  // Planes as from frustumPlanes, positive inside
+  bool overlapsFrustum(const std::array<glm::vec4, 6> &planes) const {
+    for (const auto &plane : planes) {
+      glm::vec3 positive{plane.x >= 0.f ? max.x : min.x,
+                         plane.y >= 0.f ? max.y : min.y,
+                         plane.z >= 0.f ? max.z : min.z};
+      if (glm::dot(glm::vec3{plane}, positive) + plane.w < 0.f) {
+        return false;
+      }
+    }
+    return true;
+  }
+  // Distance along the ray at which it enters the box, 0 from inside and
+  // FLT_MAX when it misses the box within maxDistance
+  float intersectRay(const glm::vec3 &origin,
+                     const glm::vec3 &inverseDirection,
+                     float maxDistance) const {
+    glm::vec3 t0 = (min - origin) * inverseDirection;
+    glm::vec3 t1 = (max - origin) * inverseDirection;
+    glm::vec3 near = glm::min(t0, t1);
+    glm::vec3 far = glm::max(t0, t1);
+    float enter = std::max({near.x, near.y, near.z, 0.f});
+    float exit = std::min({far.x, far.y, far.z, maxDistance});
+    return enter <= exit ? enter : FLT_MAX;
+  }
+};
+
+// Bounding volume hierarchy over a list of boxes, answering which of them
+// lie in a frustum, a box or a sphere and which one a ray hits first.
+// Built top-down with the binned surface area heuristic; nodes are stored
+// depth first in one array, each left child directly after its parent, so
+// traversal walks memory mostly forward. Moving boxes are handled by
+// refitting the node bounds in place, which keeps queries correct but lets
+// them slow down as boxes drift from their original neighbours; the cost
+// ratio measures that so callers can rebuild when it grows.
+class VseBvh {
+ public:
+  static constexpr uint32_t INVALID_PRIMITIVE = UINT32_MAX;
+
+  // 32 bytes, two per cache line
+  struct Node {
+    glm::vec3 min;
+    // Leaves: first entry of primitiveIndices; interior nodes: right child
+    uint32_t offset;
+    glm::vec3 max;
+    // Primitives of a leaf, 0 for interior nodes
+    uint32_t count;
+  };
+
+  struct RayHit {
+    uint32_t primitive = INVALID_PRIMITIVE;
+    float distance = FLT_MAX;
+  };
+
+  VseBvh() = default;
+
+  VseBvh(const VseBvh &) = delete;
+  VseBvh &operator=(const VseBvh &) = delete;
+
+  void setMaxLeafSize(uint32_t size) { maxLeafSize = size; }
+
+  // Primitive i is bounds[i]; queries return these indices
+  void build(const std::vector<VseAabb> &bounds);
+  // Same primitives at new bounds
+  void refit(const std::vector<VseAabb> &bounds);
+
+  // Primitives overlapping the volume, appended to result
+  void queryFrustum(const std::array<glm::vec4, 6> &planes,
+                    std::vector<uint32_t> &result) const;
+  void queryAabb(const VseAabb &box, std::vector<uint32_t> &result) const;
+  void querySphere(const glm::vec3 &center, float radius,
+                   std::vector<uint32_t> &result) const;
+  // Nearest primitive box the ray enters within maxDistance, distances in
+  // units of direction's length
+  RayHit raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+                 float maxDistance = FLT_MAX) const;
+
+  size_t getPrimitiveCount() const { return orderedBounds.size(); }
+  const std::vector<Node> &getNodes() const { return nodes; }
+  // Surface area heuristic cost of the tree now over its cost when built,
+  // 1 right after build
+  float getCostRatio() const { return cost / builtCost; }
+
+ private:
+  struct BuildPrimitive;
+
+  uint32_t buildNode(std::vector<BuildPrimitive> &primitives, uint32_t begin,
+                     uint32_t end, const VseAabb &nodeBounds,
+                     const VseAabb &centroidBounds, uint32_t depth);
+  float computeCost() const;
+
+  uint32_t maxLeafSize = 4;
+  std::vector<Node> nodes;
+  std::vector<uint32_t> primitiveIndices;
+  // Bounds in primitiveIndices order, so leaves read them contiguously
+  std::vector<VseAabb> orderedBounds;
+  float cost = 1.f;
+  float builtCost = 1.f;
+};
+
+}  // namespace vse
@@ -0,0 +1,57 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+
+namespace vse {
+
+class VseCamera {
+ public:
+  void setOrthographicProjection(float left, float right, float top,
+                                 float bottom, float near, float far);
+  void setPerspectiveProjection(float fovy, float aspect, float near,
+                                float far);
+
+  void setViewDirection(glm::vec3 position, glm::vec3 direction,
+                        glm::vec3 up = glm::vec3{0.f, -1.f, 0.f});
+  void setViewTarget(glm::vec3 position, glm::vec3 target,
+                     glm::vec3 up = glm::vec3{0.f, -1.f, 0.f});
+  void setViewYXZ(glm::vec3 position, glm::vec3 rotation);
+
+  // Maps the near plane to depth 1 and the far plane to 0, which spreads
+  // floating point depth precision evenly across the view distance. Pipelines
+  // must use a GREATER compare op and the depth buffer must clear to 0.
+  void setReversedZ(bool reversed) { reversedZ = reversed; }
+  bool isReversedZ() const { return reversedZ; }
+
+  const glm::mat4 &getProjection() const { return projectionMatrix; }
+  const glm::mat4 &getView() const { return viewMatrix; }
+  float getNear() const { return nearPlane; }
+  float getFar() const { return farPlane; }
+
+  // Projected diameter of a sphere at viewDepth as a fraction of the
+  // viewport height, for perspective projections
+  float projectedSize(float radius, float viewDepth) const {
+    return radius * projectionMatrix[1][1] / std::max(viewDepth, nearPlane);
+  }
+
+ private:
+  glm::mat4 projectionMatrix{1.f};
+  glm::mat4 viewMatrix{1.f};
+  float nearPlane{0.f};
+  float farPlane{1.f};
+  bool reversedZ{false};
+};
+
+// Planes of the clip space volume 0 <= z <= w, |x|, |y| <= w pulled back
+// through clip, e.g. projection * view for world space planes. Normalized
+// so that dot(plane.xyz, p) + plane.w is the signed distance of p, positive
+// inside. Reversed depth swaps which plane is near but not the set.
+std::array<glm::vec4, 6> frustumPlanes(const glm::mat4 &clip);
+
+}  // namespace vse
@@ -0,0 +1,50 @@
+#include "vse_deletion_queue.hpp"
+
+// std
+#include <vector>
+
+namespace vse {
+
+void VseDeletionQueue::push(uint64_t frame, std::function<void()> deleter) {
+  std::lock_guard<std::mutex> lock{mutex};
+  entries.push_back({frame, std::move(deleter)});
+}
+
+void VseDeletionQueue::flush(uint64_t completedFrame) {
+  std::vector<std::function<void()>> ready;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    // Entries from other threads may arrive slightly out of order, so scan
+    // everything rather than stopping at the first pending entry
+    for (auto it = entries.begin(); it != entries.end();) {
+      if (it->frame <= completedFrame) {
+        ready.push_back(std::move(it->deleter));
+        it = entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  // Deleters run outside the lock in case they retire further objects
+  for (auto &deleter : ready) {
+    deleter();
+  }
+}
+
+void VseDeletionQueue::flushAll() {
+  std::deque<Entry> pending;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    pending.swap(entries);
+  }
+  for (auto &entry : pending) {
+    entry.deleter();
+  }
+}
+
+size_t VseDeletionQueue::size() {
+  std::lock_guard<std::mutex> lock{mutex};
+  return entries.size();
+}
+
+}  // namespace vse
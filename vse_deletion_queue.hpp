@@ -0,0 +1,46 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace vse {
+
+// Hands a deleter over to run once frames that may use its object have
+// finished, usually by pushing it onto a VseDeletionQueue
+using RetireFunction = std::function<void(std::function<void()>)>;
+
+// Defers destruction of GPU objects until the frames that may still
+// reference them have completed. Entries are tagged with the frame they were
+// retired on and run once that frame is known to be finished.
+class VseDeletionQueue {
+ public:
+  VseDeletionQueue() = default;
+  ~VseDeletionQueue() { flushAll(); }
+
+  VseDeletionQueue(const VseDeletionQueue &) = delete;
+  VseDeletionQueue &operator=(const VseDeletionQueue &) = delete;
+
+  // Safe to call from any thread
+  void push(uint64_t frame, std::function<void()> deleter);
+
+  // Runs every deleter retired on or before completedFrame
+  void flush(uint64_t completedFrame);
+  // Only valid once the device is idle
+  void flushAll();
+
+  size_t size();
+
+ private:
+  struct Entry {
+    uint64_t frame;
+    std::function<void()> deleter;
+  };
+
+  std::mutex mutex;
+  std::deque<Entry> entries;
+};
+
+}  // namespace vse
@@ -0,0 +1,363 @@
+#include "vse_descriptors.hpp"
+
+#include "vse_utils.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace vse {
+
+// *************** Descriptor Set Layout Builder *********************
+
+VseDescriptorSetLayout::Builder &VseDescriptorSetLayout::Builder::addBinding(
+    uint32_t binding, VkDescriptorType descriptorType,
+    VkShaderStageFlags stageFlags, uint32_t count) {
+  assert(bindings.count(binding) == 0 && "Binding already in use");
+  VkDescriptorSetLayoutBinding layoutBinding{};
+  layoutBinding.binding = binding;
+  layoutBinding.descriptorType = descriptorType;
+  layoutBinding.descriptorCount = count;
+  layoutBinding.stageFlags = stageFlags;
+  bindings[binding] = layoutBinding;
+  return *this;
+}
+
+std::unique_ptr<VseDescriptorSetLayout>
+VseDescriptorSetLayout::Builder::build() const {
+  return std::make_unique<VseDescriptorSetLayout>(vseDevice, bindings);
+}
+
+VseDescriptorSetLayout &VseDescriptorSetLayout::Builder::build(
+    VseDescriptorLayoutCache &cache) const {
+  return cache.getLayout(bindings);
+}
+
+// *************** Descriptor Set Layout *********************
+
+VseDescriptorSetLayout::VseDescriptorSetLayout(
+    VseDevice &vseDevice,
+    std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings)
+    : vseDevice{vseDevice}, bindings{bindings} {
+  std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+  for (auto kv : bindings) {
+    setLayoutBindings.push_back(kv.second);
+  }
+
+  VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
+  descriptorSetLayoutInfo.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  descriptorSetLayoutInfo.bindingCount =
+      static_cast<uint32_t>(setLayoutBindings.size());
+  descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
+
+  if (vkCreateDescriptorSetLayout(vseDevice.device(), &descriptorSetLayoutInfo,
+                                  nullptr,
+                                  &descriptorSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor set layout!");
+  }
+}
+
+VseDescriptorSetLayout::~VseDescriptorSetLayout() {
+  vkDestroyDescriptorSetLayout(vseDevice.device(), descriptorSetLayout,
+                               nullptr);
+}
+
+// *************** Descriptor Layout Cache *********************
+
+VseDescriptorSetLayout &VseDescriptorLayoutCache::getLayout(
+    const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding>
+        &bindings) {
+  LayoutKey key{};
+  key.bindings.reserve(bindings.size());
+  for (auto &kv : bindings) {
+    key.bindings.push_back(kv.second);
+  }
+  std::sort(key.bindings.begin(), key.bindings.end(),
+            [](const VkDescriptorSetLayoutBinding &a,
+               const VkDescriptorSetLayoutBinding &b) {
+              return a.binding < b.binding;
+            });
+
+  auto it = layouts.find(key);
+  if (it != layouts.end()) {
+    return *it->second;
+  }
+
+  auto layout = std::make_unique<VseDescriptorSetLayout>(vseDevice, bindings);
+  auto &result = *layout;
+  layouts.emplace(std::move(key), std::move(layout));
+  return result;
+}
+
+bool VseDescriptorLayoutCache::LayoutKey::operator==(
+    const LayoutKey &other) const {
+  if (bindings.size() != other.bindings.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < bindings.size(); i++) {
+    const auto &a = bindings[i];
+    const auto &b = other.bindings[i];
+    if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+        a.descriptorCount != b.descriptorCount ||
+        a.stageFlags != b.stageFlags ||
+        a.pImmutableSamplers != b.pImmutableSamplers) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t VseDescriptorLayoutCache::LayoutKeyHash::operator()(
+    const LayoutKey &key) const {
+  size_t seed = 0;
+  for (const auto &b : key.bindings) {
+    hashCombine(seed, b.binding, static_cast<uint32_t>(b.descriptorType),
+                b.descriptorCount, b.stageFlags);
+  }
+  return seed;
+}
+
+// *************** Descriptor Pool Builder *********************
+
+VseDescriptorPool::Builder &VseDescriptorPool::Builder::addPoolSize(
+    VkDescriptorType descriptorType, uint32_t count) {
+  poolSizes.push_back({descriptorType, count});
+  return *this;
+}
+
+VseDescriptorPool::Builder &VseDescriptorPool::Builder::setPoolFlags(
+    VkDescriptorPoolCreateFlags flags) {
+  poolFlags = flags;
+  return *this;
+}
+VseDescriptorPool::Builder &VseDescriptorPool::Builder::setMaxSets(
+    uint32_t count) {
+  maxSets = count;
+  return *this;
+}
+
+std::unique_ptr<VseDescriptorPool> VseDescriptorPool::Builder::build() const {
+  return std::make_unique<VseDescriptorPool>(vseDevice, maxSets, poolFlags,
+                                             poolSizes);
+}
+
+// *************** Descriptor Pool *********************
+
+VseDescriptorPool::VseDescriptorPool(
+    VseDevice &vseDevice, uint32_t maxSets,
+    VkDescriptorPoolCreateFlags poolFlags,
+    const std::vector<VkDescriptorPoolSize> &poolSizes)
+    : vseDevice{vseDevice} {
+  VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+  descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  descriptorPoolInfo.pPoolSizes = poolSizes.data();
+  descriptorPoolInfo.maxSets = maxSets;
+  descriptorPoolInfo.flags = poolFlags;
+
+  if (vkCreateDescriptorPool(vseDevice.device(), &descriptorPoolInfo, nullptr,
+                             &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor pool!");
+  }
+}
+
+VseDescriptorPool::~VseDescriptorPool() {
+  vkDestroyDescriptorPool(vseDevice.device(), descriptorPool, nullptr);
+}
+
+bool VseDescriptorPool::allocateDescriptor(
+    const VkDescriptorSetLayout descriptorSetLayout,
+    VkDescriptorSet &descriptor) const {
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.pSetLayouts = &descriptorSetLayout;
+  allocInfo.descriptorSetCount = 1;
+
+  if (vkAllocateDescriptorSets(vseDevice.device(), &allocInfo, &descriptor) !=
+      VK_SUCCESS) {
+    return false;
+  }
+  return true;
+}
+
+void VseDescriptorPool::freeDescriptors(
+    std::vector<VkDescriptorSet> &descriptors) const {
+  vkFreeDescriptorSets(vseDevice.device(), descriptorPool,
+                       static_cast<uint32_t>(descriptors.size()),
+                       descriptors.data());
+}
+
+void VseDescriptorPool::resetPool() {
+  vkResetDescriptorPool(vseDevice.device(), descriptorPool, 0);
+}
+
+// *************** Descriptor Allocator *********************
+
+VseDescriptorAllocator::VseDescriptorAllocator(VseDevice &vseDevice,
+                                               uint32_t setsPerPool)
+    : vseDevice{vseDevice},
+      setsPerPool{setsPerPool},
+      poolSizeRatios{{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.f},
+                     {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f},
+                     {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f},
+                     {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f},
+                     {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f}} {}
+
+VseDescriptorAllocator::~VseDescriptorAllocator() {
+  for (auto pool : usedPools) {
+    vkDestroyDescriptorPool(vseDevice.device(), pool, nullptr);
+  }
+  for (auto pool : freePools) {
+    vkDestroyDescriptorPool(vseDevice.device(), pool, nullptr);
+  }
+}
+
+VkDescriptorPool VseDescriptorAllocator::createPool() {
+  std::vector<VkDescriptorPoolSize> poolSizes;
+  poolSizes.reserve(poolSizeRatios.size());
+  for (auto &ratio : poolSizeRatios) {
+    poolSizes.push_back(
+        {ratio.type, static_cast<uint32_t>(ratio.ratio * setsPerPool)});
+  }
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = setsPerPool;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+
+  VkDescriptorPool pool;
+  if (vkCreateDescriptorPool(vseDevice.device(), &poolInfo, nullptr, &pool) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor pool!");
+  }
+  return pool;
+}
+
+VkDescriptorPool VseDescriptorAllocator::grabPool() {
+  if (!freePools.empty()) {
+    VkDescriptorPool pool = freePools.back();
+    freePools.pop_back();
+    return pool;
+  }
+  return createPool();
+}
+
+bool VseDescriptorAllocator::allocate(VkDescriptorSetLayout layout,
+                                      VkDescriptorSet &set) {
+  if (currentPool == VK_NULL_HANDLE) {
+    currentPool = grabPool();
+    usedPools.push_back(currentPool);
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = currentPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  VkResult result =
+      vkAllocateDescriptorSets(vseDevice.device(), &allocInfo, &set);
+  if (result == VK_ERROR_FRAGMENTED_POOL ||
+      result == VK_ERROR_OUT_OF_POOL_MEMORY) {
+    // current pool is exhausted, continue in a fresh one
+    currentPool = grabPool();
+    usedPools.push_back(currentPool);
+    allocInfo.descriptorPool = currentPool;
+    result = vkAllocateDescriptorSets(vseDevice.device(), &allocInfo, &set);
+  }
+
+  if (result != VK_SUCCESS) {
+    return false;
+  }
+  allocationCount++;
+  return true;
+}
+
+void VseDescriptorAllocator::resetPools() {
+  for (auto pool : usedPools) {
+    vkResetDescriptorPool(vseDevice.device(), pool, 0);
+    freePools.push_back(pool);
+  }
+  usedPools.clear();
+  currentPool = VK_NULL_HANDLE;
+  allocationCount = 0;
+}
+
+// *************** Descriptor Writer *********************
+
+VseDescriptorWriter::VseDescriptorWriter(VseDescriptorSetLayout &setLayout,
+                                         VseDescriptorPool &pool)
+    : setLayout{setLayout}, pool{&pool} {}
+
+VseDescriptorWriter::VseDescriptorWriter(VseDescriptorSetLayout &setLayout,
+                                         VseDescriptorAllocator &allocator)
+    : setLayout{setLayout}, allocator{&allocator} {}
+
+VseDescriptorWriter &VseDescriptorWriter::writeBuffer(
+    uint32_t binding, VkDescriptorBufferInfo *bufferInfo) {
+  assert(setLayout.bindings.count(binding) == 1 &&
+         "Layout does not contain specified binding");
+
+  auto &bindingDescription = setLayout.bindings[binding];
+
+  assert(bindingDescription.descriptorCount == 1 &&
+         "Binding single descriptor info, but binding expects multiple");
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.descriptorType = bindingDescription.descriptorType;
+  write.dstBinding = binding;
+  write.pBufferInfo = bufferInfo;
+  write.descriptorCount = 1;
+
+  writes.push_back(write);
+  return *this;
+}
+
+VseDescriptorWriter &VseDescriptorWriter::writeImage(
+    uint32_t binding, VkDescriptorImageInfo *imageInfo) {
+  assert(setLayout.bindings.count(binding) == 1 &&
+         "Layout does not contain specified binding");
+
+  auto &bindingDescription = setLayout.bindings[binding];
+
+  assert(bindingDescription.descriptorCount == 1 &&
+         "Binding single descriptor info, but binding expects multiple");
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.descriptorType = bindingDescription.descriptorType;
+  write.dstBinding = binding;
+  write.pImageInfo = imageInfo;
+  write.descriptorCount = 1;
+
+  writes.push_back(write);
+  return *this;
+}
+
+bool VseDescriptorWriter::build(VkDescriptorSet &set) {
+  bool success =
+      pool != nullptr
+          ? pool->allocateDescriptor(setLayout.getDescriptorSetLayout(), set)
+          : allocator->allocate(setLayout.getDescriptorSetLayout(), set);
+  if (!success) {
+    return false;
+  }
+  overwrite(set);
+  return true;
+}
+
+void VseDescriptorWriter::overwrite(VkDescriptorSet &set) {
+  for (auto &write : writes) {
+    write.dstSet = set;
+  }
+  vkUpdateDescriptorSets(setLayout.vseDevice.device(),
+                         static_cast<uint32_t>(writes.size()),
+                         writes.data(), 0, nullptr);
+}
+
+}  // namespace vse
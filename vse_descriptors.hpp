@@ -0,0 +1,182 @@
+#pragma once
+
+#include "vse_device.hpp"
+
+// std
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace vse {
+
+class VseDescriptorLayoutCache;
+
+class VseDescriptorSetLayout {
+ public:
+  class Builder {
+   public:
+    Builder(VseDevice &vseDevice) : vseDevice{vseDevice} {}
+
+    Builder &addBinding(uint32_t binding, VkDescriptorType descriptorType,
+                        VkShaderStageFlags stageFlags, uint32_t count = 1);
+    std::unique_ptr<VseDescriptorSetLayout> build() const;
+    // Returns a layout shared with every other request for the same bindings
+    VseDescriptorSetLayout &build(VseDescriptorLayoutCache &cache) const;
+
+   private:
+    VseDevice &vseDevice;
+    std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings{};
+  };
+
+  VseDescriptorSetLayout(
+      VseDevice &vseDevice,
+      std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+  ~VseDescriptorSetLayout();
+
+  VseDescriptorSetLayout(const VseDescriptorSetLayout &) = delete;
+  VseDescriptorSetLayout &operator=(const VseDescriptorSetLayout &) = delete;
+
+  VkDescriptorSetLayout getDescriptorSetLayout() const {
+    return descriptorSetLayout;
+  }
+
+ private:
+  VseDevice &vseDevice;
+  VkDescriptorSetLayout descriptorSetLayout;
+  std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings;
+
+  friend class VseDescriptorWriter;
+};
+
+// Deduplicates descriptor set layouts by their bindings so systems that
+// declare identical sets end up with the same VkDescriptorSetLayout.
+class VseDescriptorLayoutCache {
+ public:
+  VseDescriptorLayoutCache(VseDevice &vseDevice) : vseDevice{vseDevice} {}
+
+  VseDescriptorLayoutCache(const VseDescriptorLayoutCache &) = delete;
+  VseDescriptorLayoutCache &operator=(const VseDescriptorLayoutCache &) =
+      delete;
+
+  VseDescriptorSetLayout &getLayout(
+      const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding>
+          &bindings);
+
+  size_t size() const { return layouts.size(); }
+
+ private:
+  struct LayoutKey {
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+
+    bool operator==(const LayoutKey &other) const;
+  };
+  struct LayoutKeyHash {
+    size_t operator()(const LayoutKey &key) const;
+  };
+
+  VseDevice &vseDevice;
+  std::unordered_map<LayoutKey, std::unique_ptr<VseDescriptorSetLayout>,
+                     LayoutKeyHash>
+      layouts;
+};
+
+class VseDescriptorPool {
+ public:
+  class Builder {
+   public:
+    Builder(VseDevice &vseDevice) : vseDevice{vseDevice} {}
+
+    Builder &addPoolSize(VkDescriptorType descriptorType, uint32_t count);
+    Builder &setPoolFlags(VkDescriptorPoolCreateFlags flags);
+    Builder &setMaxSets(uint32_t count);
+    std::unique_ptr<VseDescriptorPool> build() const;
+
+   private:
+    VseDevice &vseDevice;
+    std::vector<VkDescriptorPoolSize> poolSizes{};
+    uint32_t maxSets = 1000;
+    VkDescriptorPoolCreateFlags poolFlags = 0;
+  };
+
+  VseDescriptorPool(VseDevice &vseDevice, uint32_t maxSets,
+                    VkDescriptorPoolCreateFlags poolFlags,
+                    const std::vector<VkDescriptorPoolSize> &poolSizes);
+  ~VseDescriptorPool();
+
+  VseDescriptorPool(const VseDescriptorPool &) = delete;
+  VseDescriptorPool &operator=(const VseDescriptorPool &) = delete;
+
+  bool allocateDescriptor(const VkDescriptorSetLayout descriptorSetLayout,
+                          VkDescriptorSet &descriptor) const;
+
+  void freeDescriptors(std::vector<VkDescriptorSet> &descriptors) const;
+
+  void resetPool();
+
+ private:
+  VseDevice &vseDevice;
+  VkDescriptorPool descriptorPool;
+
+  friend class VseDescriptorWriter;
+};
+
+// Hands out descriptor sets from a growing list of pools. Sets are never
+// freed individually: once the GPU is done with everything allocated since
+// the last reset, resetPools() recycles all pools at once. One allocator per
+// frame in flight makes that point the frame's fence wait.
+class VseDescriptorAllocator {
+ public:
+  // Descriptors of each type reserved per set in a pool
+  struct PoolSizeRatio {
+    VkDescriptorType type;
+    float ratio;
+  };
+
+  VseDescriptorAllocator(VseDevice &vseDevice, uint32_t setsPerPool = 128);
+  ~VseDescriptorAllocator();
+
+  VseDescriptorAllocator(const VseDescriptorAllocator &) = delete;
+  VseDescriptorAllocator &operator=(const VseDescriptorAllocator &) = delete;
+
+  bool allocate(VkDescriptorSetLayout layout, VkDescriptorSet &set);
+  void resetPools();
+
+  size_t getPoolCount() const { return usedPools.size() + freePools.size(); }
+  uint32_t getAllocationCount() const { return allocationCount; }
+
+ private:
+  VkDescriptorPool grabPool();
+  VkDescriptorPool createPool();
+
+  VseDevice &vseDevice;
+  uint32_t setsPerPool;
+  std::vector<PoolSizeRatio> poolSizeRatios;
+  VkDescriptorPool currentPool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorPool> usedPools;
+  std::vector<VkDescriptorPool> freePools;
+  uint32_t allocationCount = 0;
+};
+
+class VseDescriptorWriter {
+ public:
+  VseDescriptorWriter(VseDescriptorSetLayout &setLayout,
+                      VseDescriptorPool &pool);
+  VseDescriptorWriter(VseDescriptorSetLayout &setLayout,
+                      VseDescriptorAllocator &allocator);
+
+  VseDescriptorWriter &writeBuffer(uint32_t binding,
+                                   VkDescriptorBufferInfo *bufferInfo);
+  VseDescriptorWriter &writeImage(uint32_t binding,
+                                  VkDescriptorImageInfo *imageInfo);
+
+  bool build(VkDescriptorSet &set);
+  void overwrite(VkDescriptorSet &set);
+
+ private:
+  VseDescriptorSetLayout &setLayout;
+  VseDescriptorPool *pool = nullptr;
+  VseDescriptorAllocator *allocator = nullptr;
+  std::vector<VkWriteDescriptorSet> writes;
+};
+
+}  // namespace vse
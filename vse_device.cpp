@@ -50,9 +50,11 @@ VseDevice::VseDevice(VseWindow &window) : window{window} {
   pickPhysicalDevice();
   createLogicalDevice();
   createCommandPool();
+  createPipelineCache();
 }
 
 VseDevice::~VseDevice() {
+  vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
@@ -148,11 +150,116 @@ void VseDevice::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  VkPhysicalDeviceFeatures supportedCoreFeatures{};
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedCoreFeatures);
+  multiDrawIndirectEnabled = supportedCoreFeatures.multiDrawIndirect;
+  drawIndirectFirstInstanceEnabled =
+      supportedCoreFeatures.drawIndirectFirstInstance;
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
+  deviceFeatures.multiDrawIndirect = multiDrawIndirectEnabled;
+  deviceFeatures.drawIndirectFirstInstance = drawIndirectFirstInstanceEnabled;
+
+  std::vector<const char *> enabledExtensions = deviceExtensions;
+  // optional feature structs are chained here when the device supports them
+  void *featureChain = nullptr;
+
+  VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+  indexingFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  if (isDeviceExtensionAvailable(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 supportedFeatures{};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &indexingFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+    descriptorIndexingEnabled =
+        indexingFeatures.runtimeDescriptorArray &&
+        indexingFeatures.descriptorBindingPartiallyBound &&
+        indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+        indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind &&
+        indexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+  }
+  if (descriptorIndexingEnabled) {
+    // keep every supported indexing feature on, only chain what we query
+    indexingFeatures.pNext = featureChain;
+    featureChain = &indexingFeatures;
+    if (isDeviceExtensionAvailable(VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+      enabledExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    }
+    enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+    descriptorIndexingProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &descriptorIndexingProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+    descriptorIndexingProperties.pNext = nullptr;
+  }
+
+  // Dynamic rendering depends on the other two extensions on Vulkan 1.1
+  VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+  dynamicRenderingFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+  if (isDeviceExtensionAvailable(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) &&
+      isDeviceExtensionAvailable(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) &&
+      isDeviceExtensionAvailable(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 supportedFeatures{};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &dynamicRenderingFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+    dynamicRenderingEnabled = dynamicRenderingFeatures.dynamicRendering;
+  }
+  if (dynamicRenderingEnabled) {
+    dynamicRenderingFeatures.pNext = featureChain;
+    featureChain = &dynamicRenderingFeatures;
+    enabledExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+    enabledExtensions.push_back(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+    enabledExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+  }
+
+  // Present wait needs present ids to identify what it waits for
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+  presentIdFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+  presentWaitFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  if (isDeviceExtensionAvailable(VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+      isDeviceExtensionAvailable(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    VkPhysicalDeviceFeatures2 supportedFeatures{};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &presentIdFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+    presentWaitEnabled =
+        presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+  }
+  if (presentWaitEnabled) {
+    presentWaitFeatures.pNext = featureChain;
+    featureChain = &presentIdFeatures;
+    enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+    enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+  }
+
+  // Core in Vulkan 1.2, an extension without feature structs before that
+  if (isDeviceExtensionAvailable(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+    drawIndirectCountEnabled = true;
+    enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+  }
+
+  // Only adds a query, there are no features to enable
+  if (isDeviceExtensionAvailable(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+    memoryBudgetEnabled = true;
+    enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  createInfo.pNext = featureChain;
 
   createInfo.queueCreateInfoCount =
       static_cast<uint32_t>(queueCreateInfos.size());
@@ -160,8 +267,8 @@ void VseDevice::createLogicalDevice() {
 
   createInfo.pEnabledFeatures = &deviceFeatures;
   createInfo.enabledExtensionCount =
-      static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+      static_cast<uint32_t>(enabledExtensions.size());
+  createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
   // might not really be necessary anymore because device specific validation
   // layers have been deprecated
@@ -178,6 +285,26 @@ void VseDevice::createLogicalDevice() {
     throw std::runtime_error("failed to create logical device!");
   }
 
+  if (dynamicRenderingEnabled) {
+    beginRenderingKHR = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(
+        vkGetDeviceProcAddr(device_, "vkCmdBeginRenderingKHR"));
+    endRenderingKHR = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(
+        vkGetDeviceProcAddr(device_, "vkCmdEndRenderingKHR"));
+    dynamicRenderingEnabled =
+        beginRenderingKHR != nullptr && endRenderingKHR != nullptr;
+  }
+  if (presentWaitEnabled) {
+    waitForPresentKHR = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+        vkGetDeviceProcAddr(device_, "vkWaitForPresentKHR"));
+    presentWaitEnabled = waitForPresentKHR != nullptr;
+  }
+  if (drawIndirectCountEnabled) {
+    drawIndexedIndirectCountKHR =
+        reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr(device_, "vkCmdDrawIndexedIndirectCountKHR"));
+    drawIndirectCountEnabled = drawIndexedIndirectCountKHR != nullptr;
+  }
+
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
 }
@@ -197,6 +324,16 @@ void VseDevice::createCommandPool() {
   }
 }
 
+void VseDevice::createPipelineCache() {
+  VkPipelineCacheCreateInfo cacheInfo = {};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+  if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache_) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+}
+
 void VseDevice::createSurface() {
   window.createWindowSurface(instance, &surface_);
 }
@@ -332,6 +469,23 @@ bool VseDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+bool VseDevice::isDeviceExtensionAvailable(const char *extensionName) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount,
+                                       nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount,
+                                       availableExtensions.data());
+
+  for (const auto &extension : availableExtensions) {
+    if (strcmp(extension.extensionName, extensionName) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 QueueFamilyIndices VseDevice::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -424,6 +578,19 @@ uint32_t VseDevice::findMemoryType(uint32_t typeFilter,
   throw std::runtime_error("failed to find suitable memory type!");
 }
 
+bool VseDevice::hasMemoryType(uint32_t typeFilter,
+                              VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags &
+                                    properties) == properties) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void VseDevice::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                              VkMemoryPropertyFlags properties, VkBuffer &buffer,
                              VkDeviceMemory &bufferMemory) {
@@ -522,6 +689,33 @@ void VseDevice::copyBufferToImage(VkBuffer buffer, VkImage image,
   endSingleTimeCommands(commandBuffer);
 }
 
+VseDevice::MemoryBudget VseDevice::getDeviceLocalMemoryBudget() {
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+  budgetProperties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2 memProperties{};
+  memProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  if (memoryBudgetEnabled) {
+    memProperties.pNext = &budgetProperties;
+  }
+  vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memProperties);
+
+  MemoryBudget result{0, 0};
+  const auto &heaps = memProperties.memoryProperties;
+  for (uint32_t i = 0; i < heaps.memoryHeapCount; i++) {
+    if (!(heaps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+      continue;
+    }
+    if (memoryBudgetEnabled) {
+      result.budget += budgetProperties.heapBudget[i];
+      result.usage += budgetProperties.heapUsage[i];
+    } else {
+      result.budget += heaps.memoryHeaps[i].size;
+    }
+  }
+  return result;
+}
+
 void VseDevice::createImageWithInfo(const VkImageCreateInfo &imageInfo,
                                     VkMemoryPropertyFlags properties,
                                     VkImage &image,
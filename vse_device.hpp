@@ -46,18 +46,31 @@ class VseDevice {
   VkSurfaceKHR surface() { return surface_; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
+  // Shared by every pipeline creation, including ones on worker threads
+  VkPipelineCache pipelineCache() { return pipelineCache_; }
 
   SwapChainSupportDetails getSwapChainSupport() {
     return querySwapChainSupport(physicalDevice);
   }
   uint32_t findMemoryType(uint32_t typeFilter,
                           VkMemoryPropertyFlags properties);
+  bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
   QueueFamilyIndices findPhysicalQueueFamilies() {
     return findQueueFamilies(physicalDevice);
   }
+  // Sample counts usable for color and depth attachments together
+  VkSampleCountFlags getUsableSampleCounts() const {
+    return properties.limits.framebufferColorSampleCounts &
+           properties.limits.framebufferDepthSampleCounts;
+  }
   VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates,
                                VkImageTiling tiling,
                                VkFormatFeatureFlags features);
+  VkFormatProperties getFormatProperties(VkFormat format) {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+    return props;
+  }
 
   // Buffer Helper Functions
   void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
@@ -73,6 +86,59 @@ class VseDevice {
                            VkMemoryPropertyFlags properties, VkImage &image,
                            VkDeviceMemory &imageMemory);
 
+  // Optional features, enabled at device creation when the GPU supports them
+  bool hasDescriptorIndexing() const { return descriptorIndexingEnabled; }
+  const VkPhysicalDeviceDescriptorIndexingProperties &
+  getDescriptorIndexingProperties() const {
+    return descriptorIndexingProperties;
+  }
+  bool hasDynamicRendering() const { return dynamicRenderingEnabled; }
+
+  // VK_KHR_dynamic_rendering entry points, only valid when supported
+  void cmdBeginRendering(VkCommandBuffer commandBuffer,
+                         const VkRenderingInfoKHR &renderingInfo) {
+    beginRenderingKHR(commandBuffer, &renderingInfo);
+  }
+  void cmdEndRendering(VkCommandBuffer commandBuffer) {
+    endRenderingKHR(commandBuffer);
+  }
+  // Device local memory summed over heaps. With VK_EXT_memory_budget this
+  // is the driver's current budget and the process's usage, which account
+  // for other applications; without it the budget is the heap size and
+  // usage is unknown and reported as 0.
+  struct MemoryBudget {
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+  };
+  bool hasMemoryBudget() const { return memoryBudgetEnabled; }
+  MemoryBudget getDeviceLocalMemoryBudget();
+
+  // Presents can carry an id that the host can wait on
+  bool hasPresentWait() const { return presentWaitEnabled; }
+  // VK_KHR_present_wait entry point, only valid when supported
+  VkResult waitForPresent(VkSwapchainKHR swapChain, uint64_t presentId,
+                          uint64_t timeout) {
+    return waitForPresentKHR(device_, swapChain, presentId, timeout);
+  }
+
+  // Indirect draws of more than one command per call
+  bool hasMultiDrawIndirect() const { return multiDrawIndirectEnabled; }
+  // Indirect draws whose count is read from a buffer
+  bool hasDrawIndirectCount() const { return drawIndirectCountEnabled; }
+  // Indirect commands with a first instance other than 0
+  bool hasDrawIndirectFirstInstance() const {
+    return drawIndirectFirstInstanceEnabled;
+  }
+  // VK_KHR_draw_indirect_count entry point, only valid when supported
+  void cmdDrawIndexedIndirectCount(VkCommandBuffer commandBuffer,
+                                   VkBuffer buffer, VkDeviceSize offset,
+                                   VkBuffer countBuffer,
+                                   VkDeviceSize countBufferOffset,
+                                   uint32_t maxDrawCount, uint32_t stride) {
+    drawIndexedIndirectCountKHR(commandBuffer, buffer, offset, countBuffer,
+                                countBufferOffset, maxDrawCount, stride);
+  }
+
   VkPhysicalDeviceProperties properties;
 
  private:
@@ -82,6 +148,7 @@ class VseDevice {
   void pickPhysicalDevice();
   void createLogicalDevice();
   void createCommandPool();
+  void createPipelineCache();
 
   // helper functions
   bool isDeviceSuitable(VkPhysicalDevice device);
@@ -92,6 +159,7 @@ class VseDevice {
       VkDebugUtilsMessengerCreateInfoEXT &createInfo);
   void hasGflwRequiredInstanceExtensions();
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  bool isDeviceExtensionAvailable(const char *extensionName);
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
   VkInstance instance;
@@ -104,6 +172,20 @@ class VseDevice {
   VkSurfaceKHR surface_;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  VkPipelineCache pipelineCache_;
+
+  bool descriptorIndexingEnabled = false;
+  VkPhysicalDeviceDescriptorIndexingProperties descriptorIndexingProperties{};
+  bool dynamicRenderingEnabled = false;
+  PFN_vkCmdBeginRenderingKHR beginRenderingKHR = nullptr;
+  PFN_vkCmdEndRenderingKHR endRenderingKHR = nullptr;
+  bool presentWaitEnabled = false;
+  PFN_vkWaitForPresentKHR waitForPresentKHR = nullptr;
+  bool memoryBudgetEnabled = false;
+  bool multiDrawIndirectEnabled = false;
+  bool drawIndirectCountEnabled = false;
+  bool drawIndirectFirstInstanceEnabled = false;
+  PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCountKHR = nullptr;
 
   const std::vector<const char *> validationLayers = {
       "VK_LAYER_KHRONOS_validation"};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "vse_camera.hpp"
+
+// lib
+#include <vulkan/vulkan.h>
+
+namespace vse {
+
+class ClusterCullingSystem;
+class OcclusionCullingSystem;
+class VseObjectBuffer;
+class VseTextureStreamer;
+
+struct GlobalUbo {
+  glm::mat4 projection{1.f};
+  glm::mat4 view{1.f};
+};
+
+struct FrameInfo {
+  int frameIndex;
+  float frameTime;
+  VkCommandBuffer commandBuffer;
+  // Fraction of a fixed update step elapsed since the last simulation tick
+  float interpolationAlpha;
+  VseCamera &camera;
+  VkDescriptorSet globalDescriptorSet;
+  // VK_NULL_HANDLE when bindless descriptors are unsupported or disabled
+  VkDescriptorSet bindlessDescriptorSet;
+  // Receives the screen size of textured draws, null when not streaming
+  VseTextureStreamer *textureStreamer;
+  // Holds the culled meshlet draws of full detail objects, null when
+  // cluster culling is off
+  const ClusterCullingSystem *clusterCulling;
+  // Holds the indirect draws of objects tested for occlusion, null when
+  // occlusion culling is off
+  const OcclusionCullingSystem *occlusionCulling;
+  // The data of every game object, already written for this frame and
+  // bound with the global set
+  const VseObjectBuffer *objectBuffer;
+};
+
+}  // namespace vse
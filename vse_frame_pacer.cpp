@@ -0,0 +1,74 @@
+#include "vse_frame_pacer.hpp"
+
+// std
+#include <cassert>
+#include <thread>
+
+namespace vse {
+
+void VseFramePacer::setFrameLimit(float framesPerSecond) {
+  assert(framesPerSecond >= 0.f && "Frame limit must not be negative");
+  frameLimit = framesPerSecond;
+  framePeriod = framesPerSecond > 0.f
+                    ? std::chrono::duration_cast<Clock::duration>(
+                          std::chrono::duration<float>(1.f / framesPerSecond))
+                    : Clock::duration{0};
+  nextFrameTime = Clock::now();
+}
+
+void VseFramePacer::waitForNextFrame() {
+  if (framePeriod == Clock::duration{0}) {
+    stats.limiterWaitMs = 0.f;
+    return;
+  }
+
+  auto start = Clock::now();
+  auto deadline = nextFrameTime;
+  if (start < deadline) {
+    if (deadline - start > SPIN_THRESHOLD) {
+      std::this_thread::sleep_until(deadline - SPIN_THRESHOLD);
+    }
+    while (Clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+  }
+
+  auto now = Clock::now();
+  accumulate(stats.limiterWaitMs, now - start);
+  // Keep the cadence after a slightly late frame, but don't try to catch up
+  // on frames missed during a long stall
+  nextFrameTime = deadline + framePeriod;
+  if (nextFrameTime < now) {
+    nextFrameTime = now;
+  }
+}
+
+void VseFramePacer::markInput() {
+  inputTime = Clock::now();
+  hasInput = true;
+}
+
+void VseFramePacer::markSubmit(uint64_t frameId, Clock::time_point time) {
+  if (hasInput) {
+    accumulate(stats.inputToSubmitMs, time - inputTime);
+    hasInput = false;
+  }
+  pending.push_back({frameId, time});
+  if (pending.size() > MAX_PENDING_FRAMES) {
+    pending.pop_front();
+  }
+}
+
+void VseFramePacer::markPresented(uint64_t frameId, Clock::time_point time) {
+  while (!pending.empty() && pending.front().frameId <= frameId) {
+    accumulate(stats.submitToPresentMs, time - pending.front().submitTime);
+    pending.pop_front();
+  }
+}
+
+void VseFramePacer::accumulate(float &average, Clock::duration sample) {
+  float ms = std::chrono::duration<float, std::milli>(sample).count();
+  average = average == 0.f ? ms : average + SMOOTHING * (ms - average);
+}
+
+}  // namespace vse
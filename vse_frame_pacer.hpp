@@ -0,0 +1,78 @@
+#pragma once
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+namespace vse {
+
+// Caps the frame rate and measures latency. The limiter sleeps through most
+// of the remaining frame time and spins the last stretch, because sleeps
+// overshoot by up to a scheduler tick. Latency is tracked from the moment
+// input is sampled to queue submission, and from submission until the frame
+// is known to be on screen.
+class VseFramePacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // Waits shorter than this are spun instead of slept
+  static constexpr std::chrono::microseconds SPIN_THRESHOLD{2000};
+  // Weight of the newest sample in the moving averages
+  static constexpr float SMOOTHING = 0.1f;
+  // Frames whose presentation is never observed are dropped beyond this
+  static constexpr size_t MAX_PENDING_FRAMES = 16;
+
+  struct Stats {
+    float inputToSubmitMs;
+    float submitToPresentMs;
+    // Time the limiter held the frame back
+    float limiterWaitMs;
+  };
+
+  VseFramePacer() = default;
+
+  VseFramePacer(const VseFramePacer &) = delete;
+  VseFramePacer &operator=(const VseFramePacer &) = delete;
+
+  // 0 disables the limiter
+  void setFrameLimit(float framesPerSecond);
+  float getFrameLimit() const { return frameLimit; }
+
+  // Blocks until the limiter lets the next frame start; call it right
+  // before sampling input
+  void waitForNextFrame();
+
+  void markInput();
+  void markSubmit(uint64_t frameId, Clock::time_point time);
+  // The frame and every frame submitted before it reached the screen
+  void markPresented(uint64_t frameId, Clock::time_point time);
+  // Forgets frames whose presentation can no longer be observed, e.g. after
+  // their swap chain was replaced
+  void discardPending() { pending.clear(); }
+
+  bool hasPendingFrames() const { return !pending.empty(); }
+  uint64_t getOldestPendingFrame() const { return pending.front().frameId; }
+  uint64_t getNewestPendingFrame() const { return pending.back().frameId; }
+
+  const Stats &getStats() const { return stats; }
+
+ private:
+  struct PendingFrame {
+    uint64_t frameId;
+    Clock::time_point submitTime;
+  };
+
+  static void accumulate(float &average, Clock::duration sample);
+
+  float frameLimit = 0.f;
+  Clock::duration framePeriod{0};
+  Clock::time_point nextFrameTime{};
+
+  bool hasInput = false;
+  Clock::time_point inputTime{};
+  std::deque<PendingFrame> pending;
+
+  Stats stats{};
+};
+
+}  // namespace vse
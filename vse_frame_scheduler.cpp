@@ -0,0 +1,43 @@
+#include "vse_frame_scheduler.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace vse {
+
+VseFrameScheduler::VseFrameScheduler(float updateRate, int maxUpdatesPerFrame)
+    : maxUpdatesPerFrame{maxUpdatesPerFrame} {
+  setUpdateRate(updateRate);
+}
+
+void VseFrameScheduler::setUpdateRate(float updateRate) {
+  assert(updateRate > 0.f && "Update rate must be positive");
+  fixedDelta = 1.f / updateRate;
+  accumulator = std::min(accumulator, fixedDelta);
+}
+
+int VseFrameScheduler::tick(float frameTime,
+                            const std::function<void(float)> &update) {
+  // long stalls (debugger, window drag) should not trigger a burst of updates
+  accumulator += std::min(frameTime, MAX_FRAME_TIME);
+
+  int updates = 0;
+  while (accumulator >= fixedDelta && updates < maxUpdatesPerFrame) {
+    update(fixedDelta);
+    accumulator -= fixedDelta;
+    updates++;
+  }
+
+  // Over budget: let simulation fall behind wall time instead of spiralling
+  if (accumulator >= fixedDelta) {
+    float excess = accumulator - std::fmod(accumulator, fixedDelta);
+    droppedTime += excess;
+    accumulator -= excess;
+  }
+
+  return updates;
+}
+
+}  // namespace vse
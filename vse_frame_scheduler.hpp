@@ -0,0 +1,41 @@
+#pragma once
+
+// std
+#include <functional>
+
+namespace vse {
+
+// Drives simulation at a fixed rate independent of how often frames are
+// rendered. Leftover time is exposed as an interpolation factor so rendering
+// can blend between the previous and current simulation states.
+class VseFrameScheduler {
+ public:
+  static constexpr float DEFAULT_UPDATE_RATE = 60.f;
+  static constexpr int DEFAULT_MAX_UPDATES_PER_FRAME = 5;
+  static constexpr float MAX_FRAME_TIME = 0.25f;
+
+  VseFrameScheduler(float updateRate = DEFAULT_UPDATE_RATE,
+                    int maxUpdatesPerFrame = DEFAULT_MAX_UPDATES_PER_FRAME);
+
+  // Accumulates frameTime and invokes update once per elapsed fixed step.
+  // Returns the number of updates that ran this frame.
+  int tick(float frameTime, const std::function<void(float)> &update);
+
+  void setUpdateRate(float updateRate);
+  void setMaxUpdatesPerFrame(int maxUpdates) { maxUpdatesPerFrame = maxUpdates; }
+
+  float getUpdateRate() const { return 1.f / fixedDelta; }
+  float getFixedDelta() const { return fixedDelta; }
+  // 0 = previous simulation state, 1 = current simulation state
+  float getInterpolationAlpha() const { return accumulator / fixedDelta; }
+  // Simulation time discarded because the update budget was exceeded
+  float getDroppedTime() const { return droppedTime; }
+
+ private:
+  float fixedDelta;
+  int maxUpdatesPerFrame;
+  float accumulator{0.f};
+  float droppedTime{0.f};
+};
+
+}  // namespace vse
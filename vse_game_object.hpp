@@ -2,8 +2,10 @@
 
 #include "vse_model.hpp"
 // libs
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 // std
+#include <cstdint>
 #include <memory>
 
 namespace vse {
@@ -43,6 +45,37 @@ struct TransformComponent {
                      },
                      {translation.x, translation.y, translation.z, 1.0f}};
   }
+
+  // Blends two simulation states; rotations take the shortest arc so angles
+  // wrapped into [0, 2pi) don't spin backwards across the seam.
+  static TransformComponent interpolate(const TransformComponent &from,
+                                        const TransformComponent &to,
+                                        float alpha) {
+    TransformComponent result{};
+    result.translation = glm::mix(from.translation, to.translation, alpha);
+    result.scale = glm::mix(from.scale, to.scale, alpha);
+    for (int i = 0; i < 3; i++) {
+      float delta = to.rotation[i] - from.rotation[i];
+      delta = glm::mod(delta + glm::pi<float>(), glm::two_pi<float>()) -
+              glm::pi<float>();
+      result.rotation[i] = from.rotation[i] + delta * alpha;
+    }
+    return result;
+  }
+};
+
+enum class LightingModel : uint32_t { Unlit = 0, Lambert = 1 };
+
+// Selects a specialized pipeline variant rather than branching in shaders
+struct MaterialComponent {
+  // Use VseGameObject::color instead of the per-vertex colors
+  bool useObjectColor = false;
+  LightingModel lighting = LightingModel::Lambert;
+};
+
+struct MotionComponent {
+  glm::vec3 linearVelocity{};
+  glm::vec3 angularVelocity{};
 };
 
 class VseGameObject {
@@ -61,9 +94,25 @@ class VseGameObject {
 
   id_t getId() { return id; }
 
+  // Transform to render with, alpha being the fixed-timestep remainder
+  glm::mat4 interpolatedMat4(float alpha) const {
+    return TransformComponent::interpolate(previousTransform, transform, alpha)
+        .mat4();
+  }
+
   std::shared_ptr<VseModel> model{};
   glm::vec3 color{};
+  // Slot in the bindless texture table, UINT32_MAX when untextured
+  uint32_t textureHandle{UINT32_MAX};
   TransformComponent transform{};
+  // State at the start of the latest simulation step
+  TransformComponent previousTransform{};
+  MotionComponent motion{};
+  MaterialComponent material{};
+  // Level of detail of model to draw, chosen by LodSystem
+  uint32_t lodLevel{0};
+  // False when VisibilitySystem found the object outside the view frustum
+  bool visible{true};
 
  private:
   VseGameObject(id_t objId) : id{objId} {}
@@ -0,0 +1,68 @@
+#include "vse_gpu_timer.hpp"
+
+// std
+#include <cassert>
+#include <stdexcept>
+
+namespace vse {
+
+VseGpuTimer::VseGpuTimer(VseDevice &device, uint32_t frameCount)
+    : vseDevice{device}, recorded(frameCount, false) {
+  if (!device.properties.limits.timestampComputeAndGraphics) {
+    return;
+  }
+
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = frameCount * 2;
+  if (vkCreateQueryPool(device.device(), &poolInfo, nullptr, &queryPool) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create timestamp query pool!");
+  }
+}
+
+VseGpuTimer::~VseGpuTimer() {
+  if (queryPool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(vseDevice.device(), queryPool, nullptr);
+  }
+}
+
+void VseGpuTimer::begin(VkCommandBuffer commandBuffer, int frameIndex) {
+  assert(frameIndex >= 0 &&
+         static_cast<size_t>(frameIndex) < recorded.size() &&
+         "Frame index out of range");
+  if (!isSupported()) {
+    return;
+  }
+
+  uint32_t first = static_cast<uint32_t>(frameIndex) * 2;
+  if (recorded[frameIndex]) {
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(vseDevice.device(), queryPool, first, 2,
+                              sizeof(timestamps), timestamps,
+                              sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      lastResultMs = static_cast<float>(timestamps[1] - timestamps[0]) *
+                     vseDevice.properties.limits.timestampPeriod * 1e-6f;
+    }
+  }
+
+  vkCmdResetQueryPool(commandBuffer, queryPool, first, 2);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      queryPool, first);
+}
+
+void VseGpuTimer::end(VkCommandBuffer commandBuffer, int frameIndex) {
+  assert(frameIndex >= 0 &&
+         static_cast<size_t>(frameIndex) < recorded.size() &&
+         "Frame index out of range");
+  if (!isSupported()) {
+    return;
+  }
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      queryPool, static_cast<uint32_t>(frameIndex) * 2 + 1);
+  recorded[frameIndex] = true;
+}
+
+}  // namespace vse
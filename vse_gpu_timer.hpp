@@ -0,0 +1,42 @@
+#pragma once
+
+#include "vse_device.hpp"
+#include "vse_swap_chain.hpp"
+
+// std
+#include <vector>
+
+namespace vse {
+
+// Measures GPU time spent between begin and end in a frame's command buffer
+// with timestamp queries. Each frame index has its own pair of queries, read
+// back the next time the index comes around, when the frame's fence has
+// already signaled, so reading the result never stalls.
+class VseGpuTimer {
+ public:
+  VseGpuTimer(VseDevice &device,
+              uint32_t frameCount = VseSwapChain::MAX_FRAMES_IN_FLIGHT);
+  ~VseGpuTimer();
+
+  VseGpuTimer(const VseGpuTimer &) = delete;
+  VseGpuTimer &operator=(const VseGpuTimer &) = delete;
+
+  // False when the graphics queue can't write timestamps
+  bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+
+  // Must be recorded outside of any render pass
+  void begin(VkCommandBuffer commandBuffer, int frameIndex);
+  void end(VkCommandBuffer commandBuffer, int frameIndex);
+
+  // GPU milliseconds of the most recently completed frame, negative until
+  // one has completed
+  float getLastResultMs() const { return lastResultMs; }
+
+ private:
+  VseDevice &vseDevice;
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+  std::vector<bool> recorded;
+  float lastResultMs = -1.f;
+};
+
+}  // namespace vse
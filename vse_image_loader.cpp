@@ -0,0 +1,727 @@
+#include "vse_image_loader.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+namespace vse {
+
+namespace {
+
+constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER{
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+constexpr std::array<uint8_t, 8> PNG_SIGNATURE{
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+bool hasSignature(const std::vector<uint8_t> &file, const uint8_t *signature,
+                  size_t size) {
+  return file.size() >= size && memcmp(file.data(), signature, size) == 0;
+}
+
+uint32_t readLE32(const uint8_t *bytes) {
+  return bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+         static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+uint64_t readLE64(const uint8_t *bytes) {
+  return readLE32(bytes) | static_cast<uint64_t>(readLE32(bytes + 4)) << 32;
+}
+
+uint32_t readBE32(const uint8_t *bytes) {
+  return static_cast<uint32_t>(bytes[0]) << 24 | bytes[1] << 16 |
+         bytes[2] << 8 | bytes[3];
+}
+
+size_t alignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Minimal inflate (RFC 1950/1951) for PNG image data. Codes up to
+// FAST_BITS long are decoded with one table lookup, longer ones a bit at a
+// time from the canonical code counts.
+class Inflater {
+ public:
+  Inflater(const uint8_t *data, size_t size) : data{data}, size{size} {}
+
+  void inflateZlib(std::vector<uint8_t> &out) {
+    uint32_t cmf = bits(8);
+    uint32_t flg = bits(8);
+    if ((cmf & 0x0F) != 8 || (cmf << 8 | flg) % 31 != 0 || (flg & 0x20)) {
+      throw std::runtime_error("invalid zlib stream!");
+    }
+
+    bool last = false;
+    while (!last) {
+      last = bits(1);
+      switch (bits(2)) {
+        case 0:
+          storedBlock(out);
+          break;
+        case 1:
+          fixedBlock(out);
+          break;
+        case 2:
+          dynamicBlock(out);
+          break;
+        default:
+          throw std::runtime_error("invalid deflate block type!");
+      }
+    }
+  }
+
+ private:
+  static constexpr int MAX_BITS = 15;
+  static constexpr int FAST_BITS = 9;
+
+  struct Huffman {
+    std::array<uint16_t, MAX_BITS + 1> counts{};
+    std::array<uint16_t, 288> symbols{};
+    // Code length << 9 | symbol, indexed by the next FAST_BITS input bits;
+    // 0 where the code is longer
+    std::array<uint16_t, 1 << FAST_BITS> fast{};
+
+    void build(const uint8_t *lengths, size_t count) {
+      counts.fill(0);
+      for (size_t i = 0; i < count; i++) {
+        counts[lengths[i]]++;
+      }
+      counts[0] = 0;
+      std::array<uint16_t, MAX_BITS + 2> offsets{};
+      std::array<uint32_t, MAX_BITS + 1> nextCode{};
+      uint32_t code = 0;
+      for (int len = 1; len <= MAX_BITS; len++) {
+        offsets[len + 1] = offsets[len] + counts[len];
+        code = (code + counts[len - 1]) << 1;
+        nextCode[len] = code;
+      }
+      fast.fill(0);
+      for (size_t i = 0; i < count; i++) {
+        uint32_t len = lengths[i];
+        if (len == 0) {
+          continue;
+        }
+        symbols[offsets[len]++] = static_cast<uint16_t>(i);
+        if (len > FAST_BITS) {
+          continue;
+        }
+        // Deflate packs codes most significant bit first, so the table is
+        // indexed by the reversed code
+        uint32_t reversed = 0;
+        for (uint32_t c = nextCode[len]++, b = 0; b < len; b++, c >>= 1) {
+          reversed = reversed << 1 | (c & 1);
+        }
+        for (uint32_t j = reversed; j < fast.size(); j += 1u << len) {
+          fast[j] = static_cast<uint16_t>(len << 9 | i);
+        }
+      }
+    }
+  };
+
+  void refill(int count) {
+    while (bitCount < count && position < size) {
+      bitBuffer |= static_cast<uint32_t>(data[position++]) << bitCount;
+      bitCount += 8;
+    }
+  }
+
+  uint32_t bits(int count) {
+    refill(count);
+    if (bitCount < count) {
+      throw std::runtime_error("truncated deflate stream!");
+    }
+    uint32_t value = bitBuffer & ((1u << count) - 1);
+    bitBuffer >>= count;
+    bitCount -= count;
+    return value;
+  }
+
+  int decode(const Huffman &huffman) {
+    // Near the end of the stream fewer than FAST_BITS may be left, the
+    // missing bits read as zero and the length check catches overruns
+    refill(FAST_BITS);
+    uint16_t entry = huffman.fast[bitBuffer & ((1u << FAST_BITS) - 1)];
+    if (entry != 0) {
+      int len = entry >> 9;
+      if (len > bitCount) {
+        throw std::runtime_error("truncated deflate stream!");
+      }
+      bitBuffer >>= len;
+      bitCount -= len;
+      return entry & 0x1FF;
+    }
+
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+      code |= static_cast<int>(bits(1));
+      int count = huffman.counts[len];
+      if (code - count < first) {
+        return huffman.symbols[index + (code - first)];
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+    throw std::runtime_error("invalid huffman code!");
+  }
+
+  void storedBlock(std::vector<uint8_t> &out) {
+    // Stored blocks start on a byte boundary; return whole bytes the fast
+    // path read ahead to the input
+    position -= bitCount / 8;
+    bitBuffer = 0;
+    bitCount = 0;
+    if (position + 4 > size) {
+      throw std::runtime_error("truncated deflate stream!");
+    }
+    uint32_t length = data[position] | data[position + 1] << 8;
+    uint32_t inverse = data[position + 2] | data[position + 3] << 8;
+    position += 4;
+    if (length != (~inverse & 0xFFFF) || position + length > size) {
+      throw std::runtime_error("invalid stored deflate block!");
+    }
+    out.insert(out.end(), data + position, data + position + length);
+    position += length;
+  }
+
+  void fixedBlock(std::vector<uint8_t> &out) {
+    std::array<uint8_t, 288 + 30> lengths{};
+    std::fill(lengths.begin(), lengths.begin() + 144, 8);
+    std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+    std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+    std::fill(lengths.begin() + 280, lengths.begin() + 288, 8);
+    std::fill(lengths.begin() + 288, lengths.end(), 5);
+    Huffman literals;
+    Huffman distances;
+    literals.build(lengths.data(), 288);
+    distances.build(lengths.data() + 288, 30);
+    codes(out, literals, distances);
+  }
+
+  void dynamicBlock(std::vector<uint8_t> &out) {
+    static constexpr std::array<uint8_t, 19> ORDER{
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    uint32_t literalCount = bits(5) + 257;
+    uint32_t distanceCount = bits(5) + 1;
+    uint32_t codeLengthCount = bits(4) + 4;
+    if (literalCount > 286 || distanceCount > 30) {
+      throw std::runtime_error("invalid dynamic deflate block!");
+    }
+
+    std::array<uint8_t, 19> codeLengthLengths{};
+    for (uint32_t i = 0; i < codeLengthCount; i++) {
+      codeLengthLengths[ORDER[i]] = static_cast<uint8_t>(bits(3));
+    }
+    Huffman codeLengths;
+    codeLengths.build(codeLengthLengths.data(), codeLengthLengths.size());
+
+    std::array<uint8_t, 286 + 30> lengths{};
+    uint32_t total = literalCount + distanceCount;
+    uint32_t i = 0;
+    while (i < total) {
+      int symbol = decode(codeLengths);
+      if (symbol < 16) {
+        lengths[i++] = static_cast<uint8_t>(symbol);
+        continue;
+      }
+      uint8_t value = 0;
+      uint32_t repeat;
+      if (symbol == 16) {
+        if (i == 0) {
+          throw std::runtime_error("invalid dynamic deflate block!");
+        }
+        value = lengths[i - 1];
+        repeat = 3 + bits(2);
+      } else if (symbol == 17) {
+        repeat = 3 + bits(3);
+      } else {
+        repeat = 11 + bits(7);
+      }
+      if (i + repeat > total) {
+        throw std::runtime_error("invalid dynamic deflate block!");
+      }
+      std::fill_n(lengths.begin() + i, repeat, value);
+      i += repeat;
+    }
+
+    Huffman literals;
+    Huffman distances;
+    literals.build(lengths.data(), literalCount);
+    distances.build(lengths.data() + literalCount, distanceCount);
+    codes(out, literals, distances);
+  }
+
+  void codes(std::vector<uint8_t> &out, const Huffman &literals,
+             const Huffman &distances) {
+    static constexpr std::array<uint16_t, 29> LENGTH_BASE{
+        3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static constexpr std::array<uint8_t, 29> LENGTH_EXTRA{
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static constexpr std::array<uint16_t, 30> DISTANCE_BASE{
+        1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+        33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+    static constexpr std::array<uint8_t, 30> DISTANCE_EXTRA{
+        0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    while (true) {
+      int symbol = decode(literals);
+      if (symbol < 256) {
+        out.push_back(static_cast<uint8_t>(symbol));
+        continue;
+      }
+      if (symbol == 256) {
+        return;
+      }
+      symbol -= 257;
+      if (symbol >= 29) {
+        throw std::runtime_error("invalid deflate length code!");
+      }
+      size_t length = LENGTH_BASE[symbol] + bits(LENGTH_EXTRA[symbol]);
+      int distanceSymbol = decode(distances);
+      if (distanceSymbol >= 30) {
+        throw std::runtime_error("invalid deflate distance code!");
+      }
+      size_t distance = DISTANCE_BASE[distanceSymbol] +
+                        bits(DISTANCE_EXTRA[distanceSymbol]);
+      if (distance > out.size()) {
+        throw std::runtime_error("invalid deflate distance!");
+      }
+      // Copies may overlap their own output, so go byte by byte
+      size_t from = out.size() - distance;
+      for (size_t i = 0; i < length; i++) {
+        out.push_back(out[from + i]);
+      }
+    }
+  }
+
+  const uint8_t *data;
+  size_t size;
+  size_t position = 0;
+  uint32_t bitBuffer = 0;
+  int bitCount = 0;
+};
+
+uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+// Reverses the per-row PNG filters in place, dropping the filter bytes
+void unfilterPng(std::vector<uint8_t> &data, uint32_t height, size_t rowSize,
+                 size_t pixelSize) {
+  std::vector<uint8_t> zeroRow(rowSize, 0);
+  for (uint32_t y = 0; y < height; y++) {
+    uint8_t filter = data[y * (rowSize + 1)];
+    uint8_t *row = &data[y * (rowSize + 1) + 1];
+    const uint8_t *prior = y == 0 ? zeroRow.data() : row - (rowSize + 1);
+    for (size_t x = 0; x < rowSize; x++) {
+      uint8_t a = x >= pixelSize ? row[x - pixelSize] : 0;
+      uint8_t b = prior[x];
+      uint8_t c = x >= pixelSize ? prior[x - pixelSize] : 0;
+      switch (filter) {
+        case 0:
+          break;
+        case 1:
+          row[x] += a;
+          break;
+        case 2:
+          row[x] += b;
+          break;
+        case 3:
+          row[x] += static_cast<uint8_t>((a + b) / 2);
+          break;
+        case 4:
+          row[x] += paeth(a, b, c);
+          break;
+        default:
+          throw std::runtime_error("invalid PNG filter type!");
+      }
+    }
+  }
+  // Compact the rows now that prior rows are no longer needed
+  for (uint32_t y = 0; y < height; y++) {
+    memmove(&data[y * rowSize], &data[y * (rowSize + 1) + 1], rowSize);
+  }
+  data.resize(height * rowSize);
+}
+
+float srgbToLinear(uint8_t value) {
+  float c = value / 255.f;
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+uint8_t linearToSrgb(float value) {
+  float c = value <= 0.0031308f
+                ? value * 12.92f
+                : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(std::clamp(c, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+}  // namespace
+
+VseFormatBlock formatBlock(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_SRGB:
+      return {1, 1, 1};
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R8G8_SRGB:
+    case VK_FORMAT_R16_UNORM:
+    case VK_FORMAT_R16_SFLOAT:
+      return {2, 1, 1};
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+    case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+    case VK_FORMAT_R16G16_UNORM:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+      return {4, 1, 1};
+    case VK_FORMAT_R16G16B16A16_UNORM:
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+      return {8, 1, 1};
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+      return {16, 1, 1};
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+    case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+      return {8, 4, 4};
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+    case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+      return {16, 4, 4};
+    default:
+      throw std::runtime_error("unsupported texture format!");
+  }
+}
+
+VseImageData loadImageFile(const std::string &filepath, bool srgb) {
+  std::ifstream file{filepath, std::ios::ate | std::ios::binary};
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open image: " + filepath);
+  }
+  std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+
+  if (hasSignature(bytes, KTX2_IDENTIFIER.data(), KTX2_IDENTIFIER.size())) {
+    return decodeKtx2(bytes);
+  }
+  if (hasSignature(bytes, PNG_SIGNATURE.data(), PNG_SIGNATURE.size())) {
+    return decodePng(bytes, srgb);
+  }
+  throw std::runtime_error("unrecognized image format: " + filepath);
+}
+
+bool buildMipChain(VseImageData &image) {
+  bool srgb;
+  switch (image.format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+      srgb = false;
+      break;
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+      srgb = true;
+      break;
+    default:
+      return false;
+  }
+  if (image.levels.size() != 1) {
+    return false;
+  }
+
+  std::array<float, 256> toLinear{};
+  for (int i = 0; i < 256; i++) {
+    toLinear[i] = srgb ? srgbToLinear(static_cast<uint8_t>(i)) : i / 255.f;
+  }
+
+  while (image.levels.back().width > 1 || image.levels.back().height > 1) {
+    VseImageData::Level source = image.levels.back();
+    VseImageData::Level level{};
+    level.width = std::max(source.width / 2, 1u);
+    level.height = std::max(source.height / 2, 1u);
+    level.offset = alignUp(source.offset + source.size, 16);
+    level.size = static_cast<size_t>(level.width) * level.height * 4;
+    image.pixels.resize(level.offset + level.size);
+
+    const uint8_t *src = image.pixels.data() + source.offset;
+    uint8_t *dst = image.pixels.data() + level.offset;
+    for (uint32_t y = 0; y < level.height; y++) {
+      // Odd sizes fold the last row or column into the previous texel
+      uint32_t y0 = std::min(y * 2, source.height - 1);
+      uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+      for (uint32_t x = 0; x < level.width; x++) {
+        uint32_t x0 = std::min(x * 2, source.width - 1);
+        uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+        const uint8_t *texels[4] = {
+            src + (static_cast<size_t>(y0) * source.width + x0) * 4,
+            src + (static_cast<size_t>(y0) * source.width + x1) * 4,
+            src + (static_cast<size_t>(y1) * source.width + x0) * 4,
+            src + (static_cast<size_t>(y1) * source.width + x1) * 4};
+        uint8_t *out = dst + (static_cast<size_t>(y) * level.width + x) * 4;
+        for (int c = 0; c < 3; c++) {
+          float sum = 0.f;
+          for (const uint8_t *texel : texels) {
+            sum += toLinear[texel[c]];
+          }
+          out[c] = srgb ? linearToSrgb(sum * .25f)
+                        : static_cast<uint8_t>(sum * .25f * 255.f + .5f);
+        }
+        // Alpha is linear in every format
+        out[3] = static_cast<uint8_t>(
+            (texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) /
+            4);
+      }
+    }
+    image.levels.push_back(level);
+  }
+  return true;
+}
+
+VseImageData decodeKtx2(const std::vector<uint8_t> &file) {
+  // Identifier, 9 header words, then the index of the data format
+  // descriptor, key/value and supercompression sections
+  constexpr size_t HEADER_SIZE = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+  constexpr size_t LEVEL_INDEX_ENTRY_SIZE = 3 * 8;
+  if (!hasSignature(file, KTX2_IDENTIFIER.data(), KTX2_IDENTIFIER.size()) ||
+      file.size() < HEADER_SIZE) {
+    throw std::runtime_error("invalid KTX2 file!");
+  }
+
+  const uint8_t *header = file.data() + 12;
+  auto vkFormat = static_cast<VkFormat>(readLE32(header));
+  uint32_t pixelWidth = readLE32(header + 8);
+  uint32_t pixelHeight = readLE32(header + 12);
+  uint32_t pixelDepth = readLE32(header + 16);
+  uint32_t layerCount = readLE32(header + 20);
+  uint32_t faceCount = readLE32(header + 24);
+  uint32_t levelCount = readLE32(header + 28);
+  uint32_t supercompressionScheme = readLE32(header + 32);
+
+  if (vkFormat == VK_FORMAT_UNDEFINED) {
+    throw std::runtime_error("KTX2 files needing transcoding are unsupported!");
+  }
+  if (supercompressionScheme != 0) {
+    throw std::runtime_error("supercompressed KTX2 files are unsupported!");
+  }
+  if (pixelWidth == 0 || pixelHeight == 0 || pixelDepth > 1 ||
+      layerCount > 1 || faceCount != 1) {
+    throw std::runtime_error("only 2D KTX2 textures are supported!");
+  }
+
+  VseImageData image{};
+  image.format = vkFormat;
+  image.fileSize = file.size();
+  VseFormatBlock block = formatBlock(vkFormat);
+  // Copies from a buffer need offsets aligned to the block size and to 4
+  size_t alignment = std::lcm<size_t>(block.size, 4);
+
+  // A level count of 0 asks the loader to generate the mip chain
+  uint32_t storedLevels = std::max(levelCount, 1u);
+  if (file.size() < HEADER_SIZE + storedLevels * LEVEL_INDEX_ENTRY_SIZE) {
+    throw std::runtime_error("invalid KTX2 file!");
+  }
+  for (uint32_t i = 0; i < storedLevels; i++) {
+    const uint8_t *entry =
+        file.data() + HEADER_SIZE + i * LEVEL_INDEX_ENTRY_SIZE;
+    uint64_t byteOffset = readLE64(entry);
+    uint64_t byteLength = readLE64(entry + 8);
+
+    uint32_t width = std::max(pixelWidth >> i, 1u);
+    uint32_t height = std::max(pixelHeight >> i, 1u);
+    size_t expected = static_cast<size_t>(
+        (width + block.width - 1) / block.width *
+        ((height + block.height - 1) / block.height) * block.size);
+    if (byteLength < expected || byteOffset > file.size() ||
+        byteLength > file.size() - byteOffset) {
+      throw std::runtime_error("invalid KTX2 level data!");
+    }
+
+    size_t offset = alignUp(image.pixels.size(), alignment);
+    image.pixels.resize(offset + expected);
+    memcpy(image.pixels.data() + offset, file.data() + byteOffset, expected);
+    image.levels.push_back({offset, expected, width, height});
+  }
+  return image;
+}
+
+VseImageData decodePng(const std::vector<uint8_t> &file, bool srgb) {
+  if (!hasSignature(file, PNG_SIGNATURE.data(), PNG_SIGNATURE.size())) {
+    throw std::runtime_error("invalid PNG file!");
+  }
+
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint8_t bitDepth = 0;
+  uint8_t colorType = 0;
+  std::vector<uint8_t> palette{};
+  std::vector<uint8_t> paletteAlpha{};
+  std::vector<uint8_t> compressed{};
+
+  size_t position = PNG_SIGNATURE.size();
+  while (position + 12 <= file.size()) {
+    uint32_t length = readBE32(&file[position]);
+    const uint8_t *type = &file[position + 4];
+    const uint8_t *data = &file[position + 8];
+    if (length > file.size() - position - 12) {
+      throw std::runtime_error("truncated PNG chunk!");
+    }
+    // Chunk CRCs are not verified
+    position += 12 + length;
+
+    if (memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+      width = readBE32(data);
+      height = readBE32(data + 4);
+      bitDepth = data[8];
+      colorType = data[9];
+      if (data[10] != 0 || data[11] != 0 || data[12] != 0) {
+        throw std::runtime_error("interlaced PNG files are unsupported!");
+      }
+    } else if (memcmp(type, "PLTE", 4) == 0) {
+      palette.assign(data, data + length);
+    } else if (memcmp(type, "tRNS", 4) == 0) {
+      paletteAlpha.assign(data, data + length);
+    } else if (memcmp(type, "IDAT", 4) == 0) {
+      compressed.insert(compressed.end(), data, data + length);
+    } else if (memcmp(type, "IEND", 4) == 0) {
+      break;
+    }
+  }
+
+  uint32_t channels;
+  switch (colorType) {
+    case 0:
+    case 3:
+      channels = 1;
+      break;
+    case 4:
+      channels = 2;
+      break;
+    case 2:
+      channels = 3;
+      break;
+    case 6:
+      channels = 4;
+      break;
+    default:
+      throw std::runtime_error("invalid PNG color type!");
+  }
+  bool validDepth = colorType == 3 ? bitDepth <= 8 : bitDepth >= 8;
+  if (width == 0 || height == 0 || !validDepth ||
+      (bitDepth & (bitDepth - 1)) != 0 || bitDepth > 16 ||
+      (colorType == 3 && palette.empty())) {
+    throw std::runtime_error("unsupported PNG file!");
+  }
+
+  size_t rowSize = (static_cast<size_t>(width) * channels * bitDepth + 7) / 8;
+  size_t pixelSize = std::max<size_t>(channels * bitDepth / 8, 1);
+  std::vector<uint8_t> filtered{};
+  filtered.reserve(height * (rowSize + 1));
+  Inflater{compressed.data(), compressed.size()}.inflateZlib(filtered);
+  if (filtered.size() < height * (rowSize + 1)) {
+    throw std::runtime_error("truncated PNG image data!");
+  }
+  unfilterPng(filtered, height, rowSize, pixelSize);
+
+  VseImageData image{};
+  image.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  image.fileSize = file.size();
+  image.levels.push_back({0, static_cast<size_t>(width) * height * 4, width,
+                          height});
+  image.pixels.resize(image.levels[0].size);
+
+  // 16 bit samples keep their high byte, palette indices and gray below
+  // 8 bits are packed most significant bit first
+  uint32_t maxSample = (1u << std::min<uint32_t>(bitDepth, 8)) - 1;
+  auto sample = [&](const uint8_t *row, size_t index) -> uint32_t {
+    if (bitDepth == 8) {
+      return row[index];
+    }
+    if (bitDepth == 16) {
+      return row[index * 2];
+    }
+    size_t bit = index * bitDepth;
+    return (row[bit / 8] >> (8 - bitDepth - bit % 8)) & maxSample;
+  };
+
+  for (uint32_t y = 0; y < height; y++) {
+    const uint8_t *row = &filtered[y * rowSize];
+    uint8_t *out = &image.pixels[static_cast<size_t>(y) * width * 4];
+    for (uint32_t x = 0; x < width; x++, out += 4) {
+      size_t first = static_cast<size_t>(x) * channels;
+      switch (colorType) {
+        case 0:
+          out[0] = out[1] = out[2] =
+              static_cast<uint8_t>(sample(row, first) * 255 / maxSample);
+          out[3] = 255;
+          break;
+        case 3: {
+          uint32_t index = sample(row, first);
+          if (index * 3 + 2 >= palette.size()) {
+            throw std::runtime_error("invalid PNG palette index!");
+          }
+          out[0] = palette[index * 3];
+          out[1] = palette[index * 3 + 1];
+          out[2] = palette[index * 3 + 2];
+          out[3] = index < paletteAlpha.size() ? paletteAlpha[index] : 255;
+          break;
+        }
+        case 4:
+          out[0] = out[1] = out[2] = static_cast<uint8_t>(sample(row, first));
+          out[3] = static_cast<uint8_t>(sample(row, first + 1));
+          break;
+        default:
+          for (uint32_t c = 0; c < 4; c++) {
+            out[c] = c < channels ? static_cast<uint8_t>(sample(row, first + c))
+                                  : 255;
+          }
+          break;
+      }
+    }
+  }
+  return image;
+}
+
+}  // namespace vse
@@ -0,0 +1,64 @@
+#pragma once
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vse {
+
+// Decoded 2D image, laid out the way it is copied into a VkImage: every mip
+// level present in the file, largest first, packed into one allocation with
+// offsets aligned for vkCmdCopyBufferToImage
+struct VseImageData {
+  struct Level {
+    size_t offset;
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  std::vector<Level> levels{};
+  std::vector<uint8_t> pixels{};
+  // Bytes read from disk, compressed or not
+  size_t fileSize = 0;
+
+  uint32_t width() const { return levels.front().width; }
+  uint32_t height() const { return levels.front().height; }
+};
+
+// Size of one texel block; uncompressed formats have 1x1 blocks
+struct VseFormatBlock {
+  uint32_t size;
+  uint32_t width;
+  uint32_t height;
+
+  bool isCompressed() const { return width > 1 || height > 1; }
+};
+
+// Formats textures may use, others throw
+VseFormatBlock formatBlock(VkFormat format);
+
+// Picks the decoder from the file's signature. KTX2 files keep their own
+// format and mip chain, PNG files become a single RGBA8 level that is sRGB
+// or UNORM depending on srgb.
+VseImageData loadImageFile(const std::string &filepath, bool srgb = true);
+
+// Appends the missing mip levels down to 1x1 by averaging 2x2 texels, in
+// linear space for sRGB formats. Streaming needs every level in memory, so
+// this runs on the CPU instead of blitting on the GPU. Only single level
+// 8 bit RGBA and BGRA images are supported, false leaves others unchanged.
+bool buildMipChain(VseImageData &image);
+
+// Supercompressed (Basis, zstd), array, cube and 3D files are rejected
+VseImageData decodeKtx2(const std::vector<uint8_t> &file);
+// 8 and 16 bit gray, gray-alpha, RGB and RGBA, 1 to 8 bit palette images,
+// not interlaced
+VseImageData decodePng(const std::vector<uint8_t> &file, bool srgb);
+
+}  // namespace vse
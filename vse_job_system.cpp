@@ -0,0 +1,69 @@
+#include "vse_job_system.hpp"
+
+// std
+#include <algorithm>
+
+namespace vse {
+
+VseJobSystem::VseJobSystem(unsigned int workerCount) {
+  if (workerCount == 0) {
+    workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+  }
+  workers.reserve(workerCount);
+  for (unsigned int i = 0; i < workerCount; i++) {
+    workers.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+VseJobSystem::~VseJobSystem() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void VseJobSystem::enqueue(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    jobs.push_back(std::move(job));
+  }
+  jobAvailable.notify_one();
+}
+
+void VseJobSystem::waitIdle() {
+  std::unique_lock<std::mutex> lock{mutex};
+  idle.wait(lock, [this]() { return jobs.empty() && activeJobs == 0; });
+}
+
+void VseJobSystem::workerLoop() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      // Queued jobs are drained before shutting down so no future is broken
+      if (jobs.empty()) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+      activeJobs++;
+    }
+
+    job();
+
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      activeJobs--;
+      if (jobs.empty() && activeJobs == 0) {
+        idle.notify_all();
+      }
+    }
+  }
+}
+
+}  // namespace vse
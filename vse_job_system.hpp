@@ -0,0 +1,55 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace vse {
+
+// Fixed pool of worker threads for background work such as shader compiles
+// and pipeline creation. Results come back through std::future.
+class VseJobSystem {
+ public:
+  // 0 picks one worker per hardware thread, minus one for the main thread
+  explicit VseJobSystem(unsigned int workerCount = 0);
+  ~VseJobSystem();
+
+  VseJobSystem(const VseJobSystem &) = delete;
+  VseJobSystem &operator=(const VseJobSystem &) = delete;
+
+  template <typename F>
+  auto submit(F &&job) -> std::future<std::invoke_result_t<F>> {
+    using Result = std::invoke_result_t<F>;
+    auto task =
+        std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+    std::future<Result> result = task->get_future();
+    enqueue([task]() { (*task)(); });
+    return result;
+  }
+
+  // Blocks until every submitted job has finished
+  void waitIdle();
+
+  size_t getWorkerCount() const { return workers.size(); }
+
+ private:
+  void enqueue(std::function<void()> job);
+  void workerLoop();
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable jobAvailable;
+  std::condition_variable idle;
+  size_t activeJobs = 0;
+  bool stopping = false;
+};
+
+}  // namespace vse
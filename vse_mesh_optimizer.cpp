@@ -0,0 +1,936 @@
+#include "vse_mesh_optimizer.hpp"
+
+#include "vse_utils.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <numeric>
+#include <unordered_map>
+
+namespace vse {
+
+namespace {
+
+// Forsyth's scoring parameters, from "Linear-Speed Vertex Cache
+// Optimisation"
+constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = .75f;
+constexpr float VALENCE_BOOST_SCALE = 2.f;
+constexpr float VALENCE_BOOST_POWER = .5f;
+
+float vertexScore(int cachePosition, uint32_t remainingTriangles) {
+  if (remainingTriangles == 0) {
+    return -1.f;
+  }
+  float score = 0.f;
+  if (cachePosition >= 0) {
+    // The last triangle's vertices score the same so the next triangle
+    // doesn't favour one of its edges
+    score = cachePosition < 3
+                ? LAST_TRIANGLE_SCORE
+                : std::pow(1.f - static_cast<float>(cachePosition - 3) /
+                                     (FORSYTH_CACHE_SIZE - 3),
+                           CACHE_DECAY_POWER);
+  }
+  // Vertices with few triangles left are finished off first
+  return score + VALENCE_BOOST_SCALE *
+                     std::pow(static_cast<float>(remainingTriangles),
+                              -VALENCE_BOOST_POWER);
+}
+
+// FIFO cache simulation in the style of VseMeshCacheStats: a vertex is
+// cached while fewer than CACHE_SIZE misses happened since it was loaded
+class CacheSimulator {
+ public:
+  explicit CacheSimulator(size_t vertexCount) : timestamps(vertexCount, 0) {}
+
+  void reset() { time += VseMeshCacheStats::CACHE_SIZE + 1; }
+
+  // Returns whether index missed
+  bool access(uint32_t index) {
+    if (time - timestamps[index] <= VseMeshCacheStats::CACHE_SIZE) {
+      return false;
+    }
+    timestamps[index] = time++;
+    return true;
+  }
+
+ private:
+  std::vector<uint32_t> timestamps;
+  uint32_t time = VseMeshCacheStats::CACHE_SIZE + 1;
+};
+
+uint32_t triangleMisses(CacheSimulator &cache, const uint32_t *triangle) {
+  return cache.access(triangle[0]) + cache.access(triangle[1]) +
+         cache.access(triangle[2]);
+}
+
+// Symmetric 4x4 matrix summing squared distances to area weighted planes
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+  double a11 = 0, a12 = 0, a13 = 0;
+  double a22 = 0, a23 = 0;
+  double a33 = 0;
+  double weight = 0;
+
+  static Quadric fromPlane(const glm::vec3 &normal, float distance,
+                           float weight) {
+    double a = normal.x, b = normal.y, c = normal.z, d = distance;
+    double w = weight;
+    return {w * a * a, w * a * b, w * a * c, w * a * d, w * b * b,
+            w * b * c, w * b * d, w * c * c, w * c * d, w * d * d, w};
+  }
+
+  Quadric &operator+=(const Quadric &q) {
+    a00 += q.a00, a01 += q.a01, a02 += q.a02, a03 += q.a03;
+    a11 += q.a11, a12 += q.a12, a13 += q.a13;
+    a22 += q.a22, a23 += q.a23, a33 += q.a33;
+    weight += q.weight;
+    return *this;
+  }
+
+  // Mean squared distance of p to the planes
+  double error(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double sum = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z +
+                 2 * a03 * x + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+                 a22 * z * z + 2 * a23 * z + a33;
+    return weight > 0 ? std::max(sum, 0.0) / weight : 0.0;
+  }
+};
+
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  double error;
+};
+
+struct VertexHash {
+  size_t operator()(const VseModel::Vertex &vertex) const {
+    return static_cast<size_t>(fnv1a64(&vertex, sizeof(vertex)));
+  }
+};
+
+// Bitwise, so only exact duplicates merge
+struct VertexEqual {
+  bool operator()(const VseModel::Vertex &a,
+                  const VseModel::Vertex &b) const {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+  }
+};
+
+// Bounding sphere and normal cone of the triangles, in the style of
+// meshoptimizer's meshopt_computeClusterBounds
+void computeMeshletBounds(const std::vector<VseModel::Vertex> &vertices,
+                          const uint32_t *indices,
+                          VseModel::Meshlet &meshlet) {
+  size_t triangleCount = meshlet.indexCount / 3;
+  glm::vec3 minPosition = vertices[indices[0]].position;
+  glm::vec3 maxPosition = minPosition;
+  for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+    minPosition = glm::min(minPosition, vertices[indices[i]].position);
+    maxPosition = glm::max(maxPosition, vertices[indices[i]].position);
+  }
+  meshlet.center = (minPosition + maxPosition) * .5f;
+  meshlet.radius = 0.f;
+  for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+    meshlet.radius =
+        std::max(meshlet.radius,
+                 glm::distance(vertices[indices[i]].position, meshlet.center));
+  }
+
+  // Geometric normals, flipped to the side the vertex normals face since
+  // winding isn't consistent across meshes; zero for degenerate triangles
+  std::vector<glm::vec3> normals(triangleCount, glm::vec3{0.f});
+  glm::vec3 normalSum{0.f};
+  for (size_t t = 0; t < triangleCount; t++) {
+    const auto &a = vertices[indices[t * 3]];
+    const auto &b = vertices[indices[t * 3 + 1]];
+    const auto &c = vertices[indices[t * 3 + 2]];
+    glm::vec3 normal =
+        glm::cross(b.position - a.position, c.position - a.position);
+    float length = glm::length(normal);
+    if (length == 0.f) {
+      continue;
+    }
+    normal /= length;
+    if (glm::dot(normal, a.normal + b.normal + c.normal) < 0.f) {
+      normal = -normal;
+    }
+    normals[t] = normal;
+    normalSum += normal;
+  }
+
+  meshlet.coneAxis = glm::vec3{0.f, 0.f, 1.f};
+  meshlet.coneApex = meshlet.center;
+  meshlet.coneCutoff = 2.f;
+  float axisLength = glm::length(normalSum);
+  if (axisLength == 0.f) {
+    return;
+  }
+  glm::vec3 axis = normalSum / axisLength;
+  float minDot = 1.f;
+  for (const auto &normal : normals) {
+    if (normal != glm::vec3{0.f}) {
+      minDot = std::min(minDot, glm::dot(normal, axis));
+    }
+  }
+  // Past about 84 degrees the cone would hardly ever cull
+  if (minDot <= .1f) {
+    return;
+  }
+
+  // Move the apex back along the axis until every triangle's plane passes
+  // in front of it, so the test holds for cameras close to the meshlet
+  float maxT = 0.f;
+  for (size_t t = 0; t < triangleCount; t++) {
+    const glm::vec3 &normal = normals[t];
+    if (normal == glm::vec3{0.f}) {
+      continue;
+    }
+    const glm::vec3 &corner = vertices[indices[t * 3]].position;
+    maxT = std::max(maxT, glm::dot(meshlet.center - corner, normal) /
+                              glm::dot(axis, normal));
+  }
+  meshlet.coneAxis = axis;
+  meshlet.coneApex = meshlet.center - axis * maxT;
+  // The normals span minDot around the axis; cameras see none of the
+  // fronts when their direction is within 90 degrees minus that angle
+  meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+}
+
+}  // namespace
+
+VseMeshCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                     size_t vertexCount) {
+  VseMeshCacheStats stats{};
+  if (indices.empty()) {
+    return stats;
+  }
+  CacheSimulator cache{vertexCount};
+  std::vector<bool> referenced(vertexCount, false);
+  size_t misses = 0;
+  size_t uniqueVertices = 0;
+  for (uint32_t index : indices) {
+    misses += cache.access(index);
+    if (!referenced[index]) {
+      referenced[index] = true;
+      uniqueVertices++;
+    }
+  }
+  stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<float>(misses) / uniqueVertices;
+  return stats;
+}
+
+void indexMesh(VseModel::Builder &mesh) {
+  if (!mesh.indices.empty()) {
+    return;
+  }
+  std::unordered_map<VseModel::Vertex, uint32_t, VertexHash, VertexEqual>
+      uniqueVertices;
+  std::vector<VseModel::Vertex> vertices;
+  mesh.indices.reserve(mesh.vertices.size());
+  for (const auto &vertex : mesh.vertices) {
+    auto it = uniqueVertices.emplace(vertex,
+                                     static_cast<uint32_t>(vertices.size()));
+    if (it.second) {
+      vertices.push_back(vertex);
+    }
+    mesh.indices.push_back(it.first->second);
+  }
+  mesh.vertices.swap(vertices);
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // Triangles using each vertex, packed per vertex. The first
+  // remaining[v] entries of a vertex are the triangles not emitted yet.
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (uint32_t index : indices) {
+    remaining[index]++;
+  }
+  std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++) {
+    firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+  for (size_t i = 0; i < indices.size(); i++) {
+    adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    vertexScores[v] = vertexScore(-1, remaining[v]);
+  }
+  std::vector<float> triangleScores(triangleCount);
+  for (size_t t = 0; t < triangleCount; t++) {
+    triangleScores[t] = vertexScores[indices[t * 3]] +
+                        vertexScores[indices[t * 3 + 1]] +
+                        vertexScores[indices[t * 3 + 2]];
+  }
+  std::vector<bool> emitted(triangleCount, false);
+
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> nextCache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+  size_t scanCursor = 0;
+
+  int64_t best = std::max_element(triangleScores.begin(),
+                                  triangleScores.end()) -
+                 triangleScores.begin();
+  while (best >= 0) {
+    const uint32_t *triangle = &indices[best * 3];
+    emitted[best] = true;
+    output.insert(output.end(), triangle, triangle + 3);
+
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = triangle[k];
+      uint32_t *begin = &adjacency[firstTriangle[v]];
+      uint32_t *end = begin + remaining[v];
+      std::iter_swap(std::find(begin, end, static_cast<uint32_t>(best)),
+                     end - 1);
+      remaining[v]--;
+    }
+
+    // The triangle's vertices move to the front, the rest shift back and
+    // may fall out
+    nextCache.assign(triangle, triangle + 3);
+    for (uint32_t v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        nextCache.push_back(v);
+      }
+    }
+    for (size_t i = 0; i < nextCache.size(); i++) {
+      uint32_t v = nextCache[i];
+      cachePosition[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+      vertexScores[v] = vertexScore(cachePosition[v], remaining[v]);
+    }
+    for (uint32_t v : nextCache) {
+      for (uint32_t i = 0; i < remaining[v]; i++) {
+        uint32_t t = adjacency[firstTriangle[v] + i];
+        triangleScores[t] = vertexScores[indices[t * 3]] +
+                            vertexScores[indices[t * 3 + 1]] +
+                            vertexScores[indices[t * 3 + 2]];
+      }
+    }
+    nextCache.resize(std::min<size_t>(nextCache.size(), FORSYTH_CACHE_SIZE));
+    cache.swap(nextCache);
+
+    // Only triangles touching the cache changed score; when none are left
+    // the next unemitted triangle starts a new strip
+    best = -1;
+    float bestScore = -1.f;
+    for (uint32_t v : cache) {
+      for (uint32_t i = 0; i < remaining[v]; i++) {
+        uint32_t t = adjacency[firstTriangle[v] + i];
+        if (triangleScores[t] > bestScore) {
+          bestScore = triangleScores[t];
+          best = t;
+        }
+      }
+    }
+    if (best < 0) {
+      while (scanCursor < triangleCount && emitted[scanCursor]) {
+        scanCursor++;
+      }
+      if (scanCursor < triangleCount) {
+        best = static_cast<int64_t>(scanCursor);
+      }
+    }
+  }
+  indices.swap(output);
+}
+
+void optimizeOverdraw(VseModel::Builder &mesh, float threshold) {
+  auto &indices = mesh.indices;
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+  float acmrBefore = analyzeVertexCache(indices, mesh.vertices.size()).acmr;
+
+  // Hard boundaries are where the cache order restarts, a triangle missing
+  // all of its vertices. Clusters between them are split further wherever
+  // the part so far is already as cache friendly as the whole, so that
+  // reordering costs little locality (Sander et al., "Fast Triangle
+  // Reordering for Vertex Locality and Reduced Overdraw").
+  std::vector<size_t> hardBoundaries{0};
+  CacheSimulator cache{mesh.vertices.size()};
+  for (size_t t = 0; t < triangleCount; t++) {
+    if (triangleMisses(cache, &indices[t * 3]) == 3 && t > 0) {
+      hardBoundaries.push_back(t);
+    }
+  }
+  hardBoundaries.push_back(triangleCount);
+
+  std::vector<size_t> clusters;
+  for (size_t h = 0; h + 1 < hardBoundaries.size(); h++) {
+    size_t begin = hardBoundaries[h];
+    size_t end = hardBoundaries[h + 1];
+    cache.reset();
+    uint32_t misses = 0;
+    for (size_t t = begin; t < end; t++) {
+      misses += triangleMisses(cache, &indices[t * 3]);
+    }
+    float clusterThreshold =
+        static_cast<float>(misses) / (end - begin) * threshold;
+
+    cache.reset();
+    clusters.push_back(begin);
+    misses = 0;
+    size_t start = begin;
+    for (size_t t = begin; t < end; t++) {
+      misses += triangleMisses(cache, &indices[t * 3]);
+      if (t + 1 < end &&
+          static_cast<float>(misses) / (t + 1 - start) <= clusterThreshold) {
+        clusters.push_back(t + 1);
+        start = t + 1;
+        misses = 0;
+        cache.reset();
+      }
+    }
+  }
+  if (clusters.size() < 2) {
+    return;
+  }
+  clusters.push_back(triangleCount);
+
+  // Clusters facing away from the mesh center are drawn first, they are
+  // the ones most likely to occlude the rest
+  size_t clusterCount = clusters.size() - 1;
+  std::vector<glm::vec3> centroids(clusterCount, glm::vec3{0.f});
+  std::vector<glm::vec3> normals(clusterCount, glm::vec3{0.f});
+  std::vector<float> areas(clusterCount, 0.f);
+  glm::vec3 meshCentroid{0.f};
+  float meshArea = 0.f;
+  for (size_t c = 0; c < clusterCount; c++) {
+    for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      const glm::vec3 &p0 = mesh.vertices[indices[t * 3]].position;
+      const glm::vec3 &p1 = mesh.vertices[indices[t * 3 + 1]].position;
+      const glm::vec3 &p2 = mesh.vertices[indices[t * 3 + 2]].position;
+      glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      float area = glm::length(normal);
+      centroids[c] += (p0 + p1 + p2) * (area / 3.f);
+      normals[c] += normal;
+      areas[c] += area;
+    }
+    meshCentroid += centroids[c];
+    meshArea += areas[c];
+    if (areas[c] > 0.f) {
+      centroids[c] /= areas[c];
+    }
+  }
+  if (meshArea > 0.f) {
+    meshCentroid /= meshArea;
+  }
+
+  std::vector<float> sortKeys(clusterCount);
+  for (size_t c = 0; c < clusterCount; c++) {
+    float normalLength = glm::length(normals[c]);
+    sortKeys[c] = normalLength > 0.f
+                      ? glm::dot(centroids[c] - meshCentroid, normals[c]) /
+                            normalLength
+                      : 0.f;
+  }
+  std::vector<size_t> order(clusterCount);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sortKeys[a] > sortKeys[b];
+  });
+
+  std::vector<uint32_t> reordered;
+  reordered.reserve(indices.size());
+  for (size_t c : order) {
+    reordered.insert(reordered.end(), indices.begin() + clusters[c] * 3,
+                     indices.begin() + clusters[c + 1] * 3);
+  }
+  if (analyzeVertexCache(reordered, mesh.vertices.size()).acmr <=
+      acmrBefore * threshold) {
+    indices.swap(reordered);
+  }
+}
+
+void optimizeVertexFetch(VseModel::Builder &mesh) {
+  std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+  std::vector<VseModel::Vertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+  for (uint32_t &index : mesh.indices) {
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = static_cast<uint32_t>(vertices.size());
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+  mesh.vertices.swap(vertices);
+}
+
+std::vector<uint32_t> simplifyMesh(
+    const std::vector<VseModel::Vertex> &vertices,
+    const std::vector<uint32_t> &indices, size_t targetIndexCount,
+    float targetError, float &resultError) {
+  resultError = 0.f;
+  size_t vertexCount = vertices.size();
+  std::vector<uint32_t> result = indices;
+
+  // Vertices sharing a position are attribute seams; they are locked along
+  // with vertices on open edges, which keeps the outline and seams intact
+  std::unordered_map<uint64_t, uint32_t> positionIds;
+  std::vector<uint32_t> positionId(vertexCount);
+  std::vector<uint32_t> wedgeCount;
+  for (size_t v = 0; v < vertexCount; v++) {
+    const glm::vec3 &p = vertices[v].position;
+    uint64_t key = fnv1a64(&p, sizeof(p));
+    auto it = positionIds.emplace(key,
+                                  static_cast<uint32_t>(wedgeCount.size()));
+    if (it.second) {
+      wedgeCount.push_back(0);
+    }
+    positionId[v] = it.first->second;
+    wedgeCount[it.first->second]++;
+  }
+  std::unordered_map<uint64_t, uint32_t> edgeUses;
+  auto edgeKey = [&](uint32_t a, uint32_t b) {
+    uint64_t pa = positionId[a], pb = positionId[b];
+    return pa < pb ? pa << 32 | pb : pb << 32 | pa;
+  };
+  for (size_t i = 0; i < result.size(); i += 3) {
+    for (int k = 0; k < 3; k++) {
+      edgeUses[edgeKey(result[i + k], result[i + (k + 1) % 3])]++;
+    }
+  }
+  std::vector<bool> locked(vertexCount, false);
+  for (size_t v = 0; v < vertexCount; v++) {
+    locked[v] = wedgeCount[positionId[v]] > 1;
+  }
+  for (size_t i = 0; i < result.size(); i += 3) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t a = result[i + k];
+      uint32_t b = result[i + (k + 1) % 3];
+      if (edgeUses[edgeKey(a, b)] == 1) {
+        locked[a] = true;
+        locked[b] = true;
+      }
+    }
+  }
+
+  std::vector<Quadric> quadrics(vertexCount);
+  for (size_t i = 0; i < result.size(); i += 3) {
+    const glm::vec3 &p0 = vertices[result[i]].position;
+    const glm::vec3 &p1 = vertices[result[i + 1]].position;
+    const glm::vec3 &p2 = vertices[result[i + 2]].position;
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float area = glm::length(normal);
+    if (area <= 0.f) {
+      continue;
+    }
+    normal /= area;
+    Quadric plane =
+        Quadric::fromPlane(normal, -glm::dot(normal, p0), area * .5f);
+    for (int k = 0; k < 3; k++) {
+      quadrics[result[i + k]] += plane;
+    }
+  }
+
+  double maxError = static_cast<double>(targetError) * targetError;
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<bool> touched(vertexCount);
+  std::vector<uint32_t> firstTriangle(vertexCount + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<Collapse> collapses;
+  std::unordered_map<uint64_t, size_t> edgeCollapse;
+
+  // Each pass collapses the cheapest edges whose neighbourhoods don't
+  // overlap, then rebuilds the triangles
+  while (result.size() > targetIndexCount) {
+    size_t triangleCount = result.size() / 3;
+    std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+    for (uint32_t index : result) {
+      firstTriangle[index + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+      firstTriangle[v + 1] += firstTriangle[v];
+    }
+    adjacency.resize(result.size());
+    std::vector<uint32_t> fill(firstTriangle.begin(),
+                               firstTriangle.end() - 1);
+    for (size_t i = 0; i < result.size(); i++) {
+      adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // The cheaper direction of every edge with an unlocked end
+    collapses.clear();
+    edgeCollapse.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int k = 0; k < 3; k++) {
+        uint32_t a = result[i + k];
+        uint32_t b = result[i + (k + 1) % 3];
+        for (auto edge : {std::make_pair(a, b), std::make_pair(b, a)}) {
+          uint32_t from = edge.first;
+          uint32_t to = edge.second;
+          if (locked[from]) {
+            continue;
+          }
+          Quadric q = quadrics[from];
+          q += quadrics[to];
+          double error = q.error(vertices[to].position);
+          uint64_t key = static_cast<uint64_t>(std::min(a, b)) << 32 |
+                         std::max(a, b);
+          auto it = edgeCollapse.emplace(key, collapses.size());
+          if (it.second) {
+            collapses.push_back({from, to, error});
+          } else if (error < collapses[it.first->second].error) {
+            collapses[it.first->second] = {from, to, error};
+          }
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &a, const Collapse &b) {
+                return a.error < b.error;
+              });
+
+    std::iota(remap.begin(), remap.end(), 0);
+    std::fill(touched.begin(), touched.end(), false);
+    size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+    // Each collapse removes about two triangles; stopping halfway leaves
+    // later passes to pick from updated costs
+    size_t removeThisPass = std::max<size_t>(trianglesToRemove / 2, 1);
+    size_t removed = 0;
+    for (const auto &collapse : collapses) {
+      if (removed >= removeThisPass || collapse.error > maxError) {
+        break;
+      }
+      uint32_t from = collapse.from;
+      uint32_t to = collapse.to;
+      if (touched[from] || touched[to]) {
+        continue;
+      }
+
+      // Reject collapses that flip a remaining triangle
+      const glm::vec3 &target = vertices[to].position;
+      bool flips = false;
+      uint32_t collapsedTriangles = 0;
+      for (uint32_t i = firstTriangle[from]; i < firstTriangle[from + 1];
+           i++) {
+        const uint32_t *triangle = &result[adjacency[i] * 3];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+          collapsedTriangles++;
+          continue;
+        }
+        glm::vec3 p[3];
+        glm::vec3 moved[3];
+        for (int k = 0; k < 3; k++) {
+          p[k] = vertices[triangle[k]].position;
+          moved[k] = triangle[k] == from ? target : p[k];
+        }
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+        if (glm::dot(before, after) <= 0.f) {
+          flips = true;
+          break;
+        }
+      }
+      if (flips) {
+        continue;
+      }
+
+      remap[from] = to;
+      quadrics[to] += quadrics[from];
+      for (uint32_t i = firstTriangle[from]; i < firstTriangle[from + 1];
+           i++) {
+        const uint32_t *triangle = &result[adjacency[i] * 3];
+        for (int k = 0; k < 3; k++) {
+          touched[triangle[k]] = true;
+        }
+      }
+      removed += collapsedTriangles;
+      resultError = std::max(resultError,
+                             static_cast<float>(std::sqrt(collapse.error)));
+    }
+    if (removed == 0) {
+      break;
+    }
+
+    std::vector<uint32_t> next;
+    next.reserve(result.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+      uint32_t a = remap[result[t * 3]];
+      uint32_t b = remap[result[t * 3 + 1]];
+      uint32_t c = remap[result[t * 3 + 2]];
+      if (a != b && b != c && a != c) {
+        next.insert(next.end(), {a, b, c});
+      }
+    }
+    result.swap(next);
+  }
+  return result;
+}
+
+void generateLods(VseModel::Builder &mesh,
+                  const VseMeshOptimizeOptions &options) {
+  if (mesh.indices.empty()) {
+    return;
+  }
+  if (mesh.lods.empty()) {
+    mesh.lods.push_back(
+        {0, static_cast<uint32_t>(mesh.indices.size()), 0.f});
+  }
+
+  glm::vec3 minPosition = mesh.vertices[0].position;
+  glm::vec3 maxPosition = minPosition;
+  for (const auto &vertex : mesh.vertices) {
+    minPosition = glm::min(minPosition, vertex.position);
+    maxPosition = glm::max(maxPosition, vertex.position);
+  }
+  float maxError =
+      glm::length(maxPosition - minPosition) * .5f * options.maxLodError;
+
+  for (uint32_t level = 0; level < options.lodCount; level++) {
+    const VseModel::Lod previous = mesh.lods.back();
+    std::vector<uint32_t> source(
+        mesh.indices.begin() + previous.firstIndex,
+        mesh.indices.begin() + previous.firstIndex + previous.indexCount);
+    size_t target = static_cast<size_t>(previous.indexCount / 3 *
+                                        options.lodReduction) *
+                    3;
+    // Errors of successive levels add up, each starts from the last
+    float error = 0.f;
+    auto simplified = simplifyMesh(mesh.vertices, source, target,
+                                   maxError - previous.error, error);
+    if (simplified.empty() ||
+        simplified.size() > previous.indexCount * 9 / 10) {
+      break;
+    }
+    optimizeVertexCache(simplified, mesh.vertices.size());
+    mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()),
+                         static_cast<uint32_t>(simplified.size()),
+                         previous.error + error});
+    mesh.indices.insert(mesh.indices.end(), simplified.begin(),
+                        simplified.end());
+  }
+}
+
+void buildMeshlets(VseModel::Builder &mesh, uint32_t maxVertices,
+                   uint32_t maxTriangles) {
+  assert(!mesh.indices.empty() && "Meshlets need an index buffer");
+  assert(maxVertices >= 3 && maxTriangles >= 1 &&
+         "Meshlets must hold at least one triangle");
+  if (mesh.lods.empty()) {
+    mesh.lods.push_back(
+        {0, static_cast<uint32_t>(mesh.indices.size()), 0.f});
+  }
+  const VseModel::Lod level = mesh.lods[0];
+  const uint32_t *indices = mesh.indices.data() + level.firstIndex;
+  size_t triangleCount = level.indexCount / 3;
+  size_t vertexCount = mesh.vertices.size();
+
+  // Triangles using each vertex
+  std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+  for (uint32_t i = 0; i < level.indexCount; i++) {
+    adjacencyOffsets[indices[i] + 1]++;
+  }
+  std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(),
+                   adjacencyOffsets.begin());
+  std::vector<uint32_t> adjacency(level.indexCount);
+  std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+                             adjacencyOffsets.end() - 1);
+  for (uint32_t i = 0; i < level.indexCount; i++) {
+    adjacency[fill[indices[i]]++] = i / 3;
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+  // Meshlet that last took each vertex, to count the ones a triangle adds
+  std::vector<uint32_t> vertexMeshlet(vertexCount, UINT32_MAX);
+  std::vector<uint32_t> reordered;
+  reordered.reserve(level.indexCount);
+  std::vector<uint32_t> meshletVertices;
+  mesh.meshlets.clear();
+
+  // Unemitted triangles left around each vertex
+  std::vector<uint32_t> liveTriangles(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+  }
+  auto liveScore = [&](size_t t) {
+    return liveTriangles[indices[t * 3]] + liveTriangles[indices[t * 3 + 1]] +
+           liveTriangles[indices[t * 3 + 2]];
+  };
+
+  size_t scanSeed = 0;
+  while (true) {
+    // Continue next to the last meshlet from its most enclosed neighbour,
+    // so no isolated triangles are left behind to form tiny meshlets
+    size_t seed = triangleCount;
+    uint32_t seedScore = UINT32_MAX;
+    for (uint32_t v : meshletVertices) {
+      for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1];
+           a++) {
+        uint32_t t = adjacency[a];
+        if (!emitted[t] && liveScore(t) < seedScore) {
+          seed = t;
+          seedScore = liveScore(t);
+        }
+      }
+    }
+    if (seed == triangleCount) {
+      while (scanSeed < triangleCount && emitted[scanSeed]) {
+        scanSeed++;
+      }
+      if (scanSeed == triangleCount) {
+        break;
+      }
+      seed = scanSeed;
+    }
+    uint32_t meshletId = static_cast<uint32_t>(mesh.meshlets.size());
+    VseModel::Meshlet meshlet{};
+    meshlet.firstIndex =
+        level.firstIndex + static_cast<uint32_t>(reordered.size());
+    meshletVertices.clear();
+    glm::vec3 positionSum{0.f};
+
+    auto newVertices = [&](size_t t) {
+      uint32_t count = 0;
+      for (int k = 0; k < 3; k++) {
+        count += vertexMeshlet[indices[t * 3 + k]] != meshletId;
+      }
+      return count;
+    };
+    auto triangleCenter = [&](size_t t) {
+      return (mesh.vertices[indices[t * 3]].position +
+              mesh.vertices[indices[t * 3 + 1]].position +
+              mesh.vertices[indices[t * 3 + 2]].position) /
+             3.f;
+    };
+    auto add = [&](size_t t) {
+      emitted[t] = true;
+      for (int k = 0; k < 3; k++) {
+        uint32_t v = indices[t * 3 + k];
+        liveTriangles[v]--;
+        reordered.push_back(v);
+        if (vertexMeshlet[v] != meshletId) {
+          vertexMeshlet[v] = meshletId;
+          meshletVertices.push_back(v);
+          positionSum += mesh.vertices[v].position;
+        }
+      }
+      meshlet.indexCount += 3;
+    };
+
+    add(seed);
+    while (meshlet.indexCount / 3 < maxTriangles) {
+      glm::vec3 centroid =
+          positionSum / static_cast<float>(meshletVertices.size());
+      size_t best = triangleCount;
+      uint32_t bestNew = 4;
+      uint32_t bestLive = 0;
+      float bestDistance = 0.f;
+      for (uint32_t v : meshletVertices) {
+        for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1];
+             a++) {
+          uint32_t t = adjacency[a];
+          if (emitted[t]) {
+            continue;
+          }
+          uint32_t added = newVertices(t);
+          if (meshletVertices.size() + added > maxVertices ||
+              added > bestNew) {
+            continue;
+          }
+          uint32_t live = liveScore(t);
+          float distance = glm::distance(triangleCenter(t), centroid);
+          if (added < bestNew || live < bestLive ||
+              (live == bestLive && distance < bestDistance)) {
+            best = t;
+            bestNew = added;
+            bestLive = live;
+            bestDistance = distance;
+          }
+        }
+      }
+      // Nothing adjacent fits, the meshlet ends here
+      if (best == triangleCount) {
+        break;
+      }
+      add(best);
+    }
+
+    meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+    computeMeshletBounds(
+        mesh.vertices,
+        reordered.data() + (meshlet.firstIndex - level.firstIndex), meshlet);
+    mesh.meshlets.push_back(meshlet);
+  }
+
+  std::copy(reordered.begin(), reordered.end(),
+            mesh.indices.begin() + level.firstIndex);
+}
+
+VseMeshOptimizeReport optimizeMesh(VseModel::Builder &mesh,
+                                   const VseMeshOptimizeOptions &options) {
+  assert(mesh.lods.empty() && "Meshes are optimized before adding levels");
+  VseMeshOptimizeReport report{};
+  report.verticesBefore = mesh.vertices.size();
+  if (mesh.indices.empty()) {
+    // Unindexed draws shade every vertex of every triangle
+    std::vector<uint32_t> identity(mesh.vertices.size());
+    std::iota(identity.begin(), identity.end(), 0);
+    report.before = analyzeVertexCache(identity, mesh.vertices.size());
+  } else {
+    report.before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+  }
+
+  indexMesh(mesh);
+  optimizeVertexCache(mesh.indices, mesh.vertices.size());
+  if (options.optimizeOverdraw) {
+    optimizeOverdraw(mesh, options.overdrawThreshold);
+  }
+  optimizeVertexFetch(mesh);
+  generateLods(mesh, options);
+  if (options.buildMeshlets && !mesh.indices.empty()) {
+    buildMeshlets(mesh, options.maxMeshletVertices,
+                  options.maxMeshletTriangles);
+  }
+
+  // Of the full detail level
+  size_t fullDetailCount =
+      mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+  std::vector<uint32_t> fullDetail(mesh.indices.begin(),
+                                   mesh.indices.begin() + fullDetailCount);
+  report.after = analyzeVertexCache(fullDetail, mesh.vertices.size());
+  report.verticesAfter = mesh.vertices.size();
+  return report;
+}
+
+std::vector<VseMeshOptimizeReport> optimizeMeshes(
+    VseJobSystem &jobSystem, std::vector<VseModel::Builder> &meshes,
+    const VseMeshOptimizeOptions &options) {
+  std::vector<std::future<VseMeshOptimizeReport>> pending;
+  pending.reserve(meshes.size());
+  for (auto &mesh : meshes) {
+    pending.push_back(jobSystem.submit(
+        [&mesh, options]() { return optimizeMesh(mesh, options); }));
+  }
+  std::vector<VseMeshOptimizeReport> reports;
+  reports.reserve(meshes.size());
+  for (auto &result : pending) {
+    reports.push_back(result.get());
+  }
+  return reports;
+}
+
+}  // namespace vse
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "vse_job_system.hpp"
+#include "vse_model.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace vse {
+
+// Post-transform cache efficiency of an index buffer, simulated with a FIFO
+// cache of VseMeshCacheStats::CACHE_SIZE entries
+struct VseMeshCacheStats {
+  static constexpr uint32_t CACHE_SIZE = 16;
+
+  // Vertex shader invocations per triangle: 0.5 is the ideal for large
+  // grids, 3 means no reuse at all
+  float acmr = 0.f;
+  // Invocations per vertex referenced, 1 is ideal
+  float atvr = 0.f;
+};
+
+VseMeshCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                     size_t vertexCount);
+
+struct VseMeshOptimizeOptions {
+  // Reorder clusters of triangles so outward facing ones draw first
+  bool optimizeOverdraw = true;
+  // Overdraw ordering is dropped when it raises the ACMR beyond this factor
+  float overdrawThreshold = 1.05f;
+  // Coarser levels of detail appended after the optimized mesh, each aiming
+  // for lodReduction times the triangles of the previous level. Levels stop
+  // early once the error would exceed maxLodError times the mesh radius or
+  // a level barely simplifies.
+  uint32_t lodCount = 0;
+  float lodReduction = .5f;
+  float maxLodError = .05f;
+  // Split the full detail level into meshlets for cluster culling
+  bool buildMeshlets = false;
+  uint32_t maxMeshletVertices = 64;
+  uint32_t maxMeshletTriangles = 124;
+};
+
+struct VseMeshOptimizeReport {
+  VseMeshCacheStats before;
+  VseMeshCacheStats after;
+  size_t verticesBefore;
+  size_t verticesAfter;
+};
+
+// Rewrites mesh for the GPU, in order:
+//   1. builds an index buffer for unindexed meshes, merging equal vertices
+//   2. orders triangles for the post-transform cache (Forsyth)
+//   3. optionally reorders triangle clusters against overdraw
+//   4. orders vertices by first use for fetch locality, dropping unused ones
+//   5. generates the levels of detail options ask for, see generateLods
+//   6. optionally groups the full detail triangles into meshlets
+// The triangles drawn at full detail are unchanged.
+VseMeshOptimizeReport optimizeMesh(VseModel::Builder &mesh,
+                                   const VseMeshOptimizeOptions &options = {});
+
+// optimizeMesh on every mesh, one job per mesh; blocks until all are done
+std::vector<VseMeshOptimizeReport> optimizeMeshes(
+    VseJobSystem &jobSystem, std::vector<VseModel::Builder> &meshes,
+    const VseMeshOptimizeOptions &options = {});
+
+// The individual steps, for meshes that need only some of them
+void indexMesh(VseModel::Builder &mesh);
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount);
+void optimizeOverdraw(VseModel::Builder &mesh, float threshold);
+void optimizeVertexFetch(VseModel::Builder &mesh);
+
+// Quadric error metric edge collapse (Garland and Heckbert). Vertices
+// collapse onto a neighbour, so the result indexes the same vertices.
+// Stops at targetIndexCount or before a collapse would move the surface
+// further than targetError, and returns the largest error reached in
+// resultError. Vertices on borders and attribute seams stay in place.
+std::vector<uint32_t> simplifyMesh(
+    const std::vector<VseModel::Vertex> &vertices,
+    const std::vector<uint32_t> &indices, size_t targetIndexCount,
+    float targetError, float &resultError);
+// Simplifies the last level of mesh into up to options.lodCount coarser
+// ones, appending their indices and filling mesh.lods
+void generateLods(VseModel::Builder &mesh,
+                  const VseMeshOptimizeOptions &options);
+
+// Partitions the first level of detail into meshlets of at most maxVertices
+// distinct vertices and maxTriangles triangles, reordering its indices so
+// each meshlet is a contiguous range. Meshlets grow by the adjacent
+// triangle adding the fewest new vertices, then the one whose vertices have
+// the fewest triangles left, then the nearest, so they stay compact, their
+// normal cones narrow, and no stragglers are left for tiny meshlets.
+void buildMeshlets(VseModel::Builder &mesh, uint32_t maxVertices = 64,
+                   uint32_t maxTriangles = 124);
+
+}  // namespace vse
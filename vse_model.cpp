@@ -1,25 +1,160 @@
 #include "vse_model.hpp"
 
+// libs
+#include <glm/gtc/packing.hpp>
+
 // std
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cfloat>
+#include <cmath>
 #include <cstring>
 
 namespace vse {
 
-VseModel::VseModel(VseDevice &device, const std::vector<Vertex> &vertices)
-    : vseDevice{device} {
+namespace {
+std::atomic<uint32_t> nextModelId{0};
+
+// Writes one position in [-1, 1] (float32: model space), returns what the
+// GPU will read back
+glm::vec3 packPosition(VseVertexFormat::Position format,
+                       const glm::vec3 &position, uint8_t *out) {
+  glm::vec3 decoded = position;
+  uint16_t packed[4]{};
+  switch (format) {
+    case VseVertexFormat::Position::Float32:
+      memcpy(out, &position, sizeof(position));
+      return position;
+    case VseVertexFormat::Position::Float16:
+      for (int i = 0; i < 3; i++) {
+        packed[i] = glm::packHalf1x16(position[i]);
+        decoded[i] = glm::unpackHalf1x16(packed[i]);
+      }
+      break;
+    case VseVertexFormat::Position::Snorm16:
+      for (int i = 0; i < 3; i++) {
+        packed[i] = glm::packSnorm1x16(position[i]);
+        decoded[i] = glm::unpackSnorm1x16(packed[i]);
+      }
+      break;
+  }
+  memcpy(out, packed, sizeof(packed));
+  return decoded;
+}
+
+glm::vec3 packColor(VseVertexFormat::Color format, const glm::vec3 &color,
+                    uint8_t *out) {
+  if (format == VseVertexFormat::Color::Float32) {
+    memcpy(out, &color, sizeof(color));
+    return color;
+  }
+  uint8_t packed[4]{0, 0, 0, 255};
+  glm::vec3 decoded;
+  for (int i = 0; i < 3; i++) {
+    packed[i] = glm::packUnorm1x8(color[i]);
+    decoded[i] = glm::unpackUnorm1x8(packed[i]);
+  }
+  memcpy(out, packed, sizeof(packed));
+  return decoded;
+}
+
+glm::vec3 packNormal(VseVertexFormat::Normal format, const glm::vec3 &normal,
+                     uint8_t *out) {
+  if (format == VseVertexFormat::Normal::Float32) {
+    memcpy(out, &normal, sizeof(normal));
+    return normal;
+  }
+  int16_t packed[2];
+  octahedralEncode16(normal, packed);
+  memcpy(out, packed, sizeof(packed));
+  return octahedralDecode({std::max(packed[0] / 32767.f, -1.f),
+                           std::max(packed[1] / 32767.f, -1.f)});
+}
+
+}  // namespace
+
+VseModel::VseModel(VseDevice &device, const std::vector<Vertex> &vertices,
+                   const VseVertexFormat &format)
+    : vseDevice{device}, id{nextModelId++}, format{format} {
   createVertexBuffers(vertices);
 }
 
+VseModel::VseModel(VseDevice &device, const Builder &builder,
+                   const VseVertexFormat &format)
+    : vseDevice{device}, id{nextModelId++}, format{format} {
+  createVertexBuffers(builder.vertices);
+  createIndexBuffers(builder.indices, builder.lods);
+  createMeshletBuffers(builder.meshlets);
+}
+
 VseModel::~VseModel() {
   vkDestroyBuffer(vseDevice.device(), vertexBuffer, nullptr);
   vkFreeMemory(vseDevice.device(), vertexBufferMemory, nullptr);
+  if (hasIndexBuffer) {
+    vkDestroyBuffer(vseDevice.device(), indexBuffer, nullptr);
+    vkFreeMemory(vseDevice.device(), indexBufferMemory, nullptr);
+  }
+  if (hasMeshlets()) {
+    vkDestroyBuffer(vseDevice.device(), meshletBuffer, nullptr);
+    vkFreeMemory(vseDevice.device(), meshletBufferMemory, nullptr);
+  }
 }
 
 void VseModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
   vertexCount = static_cast<u_int32_t>(vertices.size());
   assert(vertexCount >= 3 && "Vertex count must be at least 3");
-  VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
+  uint32_t stride = format.stride();
+  VkDeviceSize bufferSize = stride * vertexCount;
+
+  glm::vec3 minPosition{FLT_MAX};
+  glm::vec3 maxPosition{-FLT_MAX};
+  for (const auto &vertex : vertices) {
+    boundingRadius = std::max(boundingRadius, glm::length(vertex.position));
+    minPosition = glm::min(minPosition, vertex.position);
+    maxPosition = glm::max(maxPosition, vertex.position);
+  }
+  if (format.isPositionQuantized()) {
+    // Fit the bounds to [-1, 1]; flat axes keep a non-zero scale
+    positionOffset = (minPosition + maxPosition) * .5f;
+    positionScale =
+        glm::max((maxPosition - minPosition) * .5f, glm::vec3{FLT_MIN});
+  }
+
+  // Convert on the CPU, measuring how far each attribute moved
+  std::vector<uint8_t> packed(static_cast<size_t>(bufferSize));
+  quantizationReport = {bufferSize, sizeof(Vertex) * vertexCount, 0.f, 0.f,
+                        0.f};
+  for (uint32_t i = 0; i < vertexCount; i++) {
+    const auto &vertex = vertices[i];
+    uint8_t *out = packed.data() + static_cast<size_t>(i) * stride;
+
+    glm::vec3 position =
+        packPosition(format.position,
+                     (vertex.position - positionOffset) / positionScale, out);
+    position = position * positionScale + positionOffset;
+    quantizationReport.maxPositionError =
+        std::max(quantizationReport.maxPositionError,
+                 glm::distance(position, vertex.position));
+    out += format.positionSize();
+
+    glm::vec3 color = packColor(format.color, vertex.color, out);
+    glm::vec3 colorError = glm::abs(color - vertex.color);
+    quantizationReport.maxColorError =
+        std::max({quantizationReport.maxColorError, colorError.x,
+                  colorError.y, colorError.z});
+    out += format.colorSize();
+
+    float normalLength = glm::length(vertex.normal);
+    glm::vec3 normal = normalLength > 0.f ? vertex.normal / normalLength
+                                          : glm::vec3{0.f, 0.f, 1.f};
+    glm::vec3 decodedNormal = packNormal(format.normal, normal, out);
+    float cosAngle = std::clamp(
+        glm::dot(glm::normalize(decodedNormal), normal), -1.f, 1.f);
+    quantizationReport.maxNormalErrorDegrees =
+        std::max(quantizationReport.maxNormalErrorDegrees,
+                 glm::degrees(std::acos(cosAngle)));
+  }
 
   vseDevice.createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
@@ -28,42 +163,115 @@ void VseModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
 
   void *data;
   vkMapMemory(vseDevice.device(), vertexBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
+  memcpy(data, packed.data(), static_cast<size_t>(bufferSize));
   vkUnmapMemory(vseDevice.device(), vertexBufferMemory);
 }
 
-void VseModel::draw(VkCommandBuffer commandBuffer) {
-  vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+void VseModel::createIndexBuffers(const std::vector<uint32_t> &indices,
+                                  const std::vector<Lod> &lods) {
+  indexCount = static_cast<uint32_t>(indices.size());
+  hasIndexBuffer = indexCount > 0;
+  if (!hasIndexBuffer) {
+    assert(lods.empty() && "Levels of detail need indices");
+    return;
+  }
+  assert(indexCount % 3 == 0 && "Index count must be a multiple of 3");
+  this->lods = lods;
+  if (this->lods.empty()) {
+    this->lods.push_back({0, indexCount, 0.f});
+  }
+  for (const auto &lod : this->lods) {
+    assert(lod.firstIndex + lod.indexCount <= indexCount &&
+           "Level of detail exceeds the index buffer");
+  }
+  VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
+
+  vseDevice.createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                         indexBuffer, indexBufferMemory);
+
+  void *data;
+  vkMapMemory(vseDevice.device(), indexBufferMemory, 0, bufferSize, 0, &data);
+  memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
+  vkUnmapMemory(vseDevice.device(), indexBufferMemory);
+}
+
+void VseModel::createMeshletBuffers(const std::vector<Meshlet> &meshlets) {
+  if (meshlets.empty()) {
+    return;
+  }
+  static_assert(sizeof(Meshlet) == 64, "Meshlet must match the std430 struct");
+  for (const auto &meshlet : meshlets) {
+    assert(meshlet.firstIndex >= lods[0].firstIndex &&
+           meshlet.firstIndex + meshlet.indexCount <=
+               lods[0].firstIndex + lods[0].indexCount &&
+           "Meshlet exceeds the first level of detail");
+  }
+  this->meshlets = meshlets;
+  VkDeviceSize bufferSize = sizeof(meshlets[0]) * meshlets.size();
+
+  vseDevice.createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                         meshletBuffer, meshletBufferMemory);
+
+  void *data;
+  vkMapMemory(vseDevice.device(), meshletBufferMemory, 0, bufferSize, 0,
+              &data);
+  memcpy(data, meshlets.data(), static_cast<size_t>(bufferSize));
+  vkUnmapMemory(vseDevice.device(), meshletBufferMemory);
+}
+
+void VseModel::draw(VkCommandBuffer commandBuffer, uint32_t lod,
+                    uint32_t firstInstance) {
+  if (hasIndexBuffer) {
+    const Lod &range = lods[std::min(lod, getLodCount() - 1)];
+    vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, range.firstIndex, 0,
+                     firstInstance);
+  } else {
+    vkCmdDraw(commandBuffer, vertexCount, 1, 0, firstInstance);
+  }
 }
 
 void VseModel::bind(VkCommandBuffer commandBuffer) {
   VkBuffer buffers[] = {vertexBuffer};
   VkDeviceSize offsets[] = {0};
   vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+
+  if (hasIndexBuffer) {
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+  }
 }
 
 std::vector<VkVertexInputBindingDescription>
-VseModel::Vertex::getBindingDescriptions() {
+VseModel::Vertex::getBindingDescriptions(const VseVertexFormat &format) {
   std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
   bindingDescriptions[0].binding = 0;
-  bindingDescriptions[0].stride = sizeof(Vertex);
+  bindingDescriptions[0].stride = format.stride();
   bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
   return bindingDescriptions;
 }
 
 std::vector<VkVertexInputAttributeDescription>
-VseModel::Vertex::getAttributeDescriptions() {
-  std::vector<VkVertexInputAttributeDescription> attributeDescriptions(2);
+VseModel::Vertex::getAttributeDescriptions(const VseVertexFormat &format) {
+  // Attributes are packed in declaration order
+  std::vector<VkVertexInputAttributeDescription> attributeDescriptions(3);
   attributeDescriptions[0].binding = 0;
   attributeDescriptions[0].location = 0;
-  attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[0].offset = offsetof(Vertex, position);
+  attributeDescriptions[0].format = format.positionFormat();
+  attributeDescriptions[0].offset = 0;
 
   attributeDescriptions[1].binding = 0;
   attributeDescriptions[1].location = 1;
-  attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[1].offset = offsetof(Vertex, color);
+  attributeDescriptions[1].format = format.colorFormat();
+  attributeDescriptions[1].offset = format.positionSize();
+
+  attributeDescriptions[2].binding = 0;
+  attributeDescriptions[2].location = 2;
+  attributeDescriptions[2].format = format.normalFormat();
+  attributeDescriptions[2].offset = format.positionSize() + format.colorSize();
 
   return attributeDescriptions;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vse_device.hpp"
+#include "vse_vertex_format.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPH_ZERO_TO_ONE
@@ -16,28 +17,135 @@ class VseModel {
   struct Vertex {
     glm::vec3 position;
     glm::vec3 color;
+    glm::vec3 normal;
 
+    // Layout of the vertex buffer of models created with format
     static std::vector<VkVertexInputBindingDescription>
-    getBindingDescriptions();
+    getBindingDescriptions(const VseVertexFormat &format = {});
     static std::vector<VkVertexInputAttributeDescription>
-    getAttributeDescriptions();
+    getAttributeDescriptions(const VseVertexFormat &format = {});
   };
 
-  VseModel(VseDevice &device, const std::vector<Vertex> &vertices);
+  // Range of the index buffer drawing one level of detail
+  struct Lod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Largest distance between the level's surface and the full detail
+    // mesh the simplifier estimated, in model space units
+    float error;
+  };
+
+  // Cluster of triangles of the first level of detail, drawn as a range of
+  // the index buffer. Laid out as the std430 struct the cluster culling
+  // shader reads, positions in model space.
+  struct alignas(16) Meshlet {
+    // Bounding sphere
+    glm::vec3 center;
+    float radius;
+    // Every triangle faces away from cameras inside the cone with this apex
+    // and axis whose half angle has the cosine coneCutoff; a cutoff above 1
+    // means the triangles face too many ways for the cone to ever apply
+    glm::vec3 coneApex;
+    float coneCutoff;
+    glm::vec3 coneAxis;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t vertexCount;
+  };
+
+  // Vertices and, when not empty, indices listing every triangle's
+  // vertices; without indices every three vertices form a triangle. Lods
+  // split the indices into levels of detail sharing the vertices, finest
+  // first; when empty all indices are one level. Meshlets, when not empty,
+  // partition the first level, see buildMeshlets.
+  struct Builder {
+    std::vector<Vertex> vertices{};
+    std::vector<uint32_t> indices{};
+    std::vector<Lod> lods{};
+    std::vector<Meshlet> meshlets{};
+  };
+
+  // Largest round trip error of any vertex after conversion to the model's
+  // vertex format, and what the format saves
+  struct QuantizationReport {
+    VkDeviceSize vertexBytes;
+    VkDeviceSize float32Bytes;
+    // In model space units
+    float maxPositionError;
+    float maxNormalErrorDegrees;
+    float maxColorError;
+  };
+
+  VseModel(VseDevice &device, const std::vector<Vertex> &vertices,
+           const VseVertexFormat &format = {});
+  VseModel(VseDevice &device, const Builder &builder,
+           const VseVertexFormat &format = {});
   ~VseModel();
 
   VseModel(VseModel &&) = delete;
   VseModel &operator=(VseModel &&) = delete;
 
   void bind(VkCommandBuffer commandBuffer);
-  void draw(VkCommandBuffer commandBuffer);
+  // One instance numbered firstInstance, which shaders see as
+  // gl_InstanceIndex
+  void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0,
+            uint32_t firstInstance = 0);
+
+  // Unique per model, used to group draws of the same mesh
+  uint32_t getId() const { return id; }
+  // Of a sphere around the model space origin enclosing every vertex
+  float getBoundingRadius() const { return boundingRadius; }
+
+  const VseVertexFormat &getVertexFormat() const { return format; }
+  uint32_t getVertexCount() const { return vertexCount; }
+  // 0 for models drawn without an index buffer
+  uint32_t getIndexCount() const { return indexCount; }
+  // Unindexed models have a single level with no indices
+  const std::vector<Lod> &getLods() const { return lods; }
+  uint32_t getLodCount() const { return static_cast<uint32_t>(lods.size()); }
+  uint32_t getTriangleCount(uint32_t lod = 0) const {
+    return hasIndexBuffer ? lods[lod].indexCount / 3 : vertexCount / 3;
+  }
+  // Meshlets are only read by shaders, through this storage buffer
+  bool hasMeshlets() const { return !meshlets.empty(); }
+  const std::vector<Meshlet> &getMeshlets() const { return meshlets; }
+  uint32_t getMeshletCount() const {
+    return static_cast<uint32_t>(meshlets.size());
+  }
+  VkDescriptorBufferInfo meshletDescriptorInfo() const {
+    return {meshletBuffer, 0, VK_WHOLE_SIZE};
+  }
+  // Quantized positions map to model space as stored * scale + offset,
+  // float32 positions have a scale of 1 and no offset
+  glm::vec3 getPositionScale() const { return positionScale; }
+  glm::vec3 getPositionOffset() const { return positionOffset; }
+  const QuantizationReport &getQuantizationReport() const {
+    return quantizationReport;
+  }
 
  private:
   VseDevice &vseDevice;
+  uint32_t id;
   VkBuffer vertexBuffer;
   VkDeviceMemory vertexBufferMemory;
   uint32_t vertexCount;
+  bool hasIndexBuffer = false;
+  VkBuffer indexBuffer;
+  VkDeviceMemory indexBufferMemory;
+  uint32_t indexCount = 0;
+  std::vector<Lod> lods{{0, 0, 0.f}};
+  std::vector<Meshlet> meshlets{};
+  VkBuffer meshletBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory meshletBufferMemory = VK_NULL_HANDLE;
+  float boundingRadius = 0.f;
+  VseVertexFormat format;
+  glm::vec3 positionScale{1.f};
+  glm::vec3 positionOffset{0.f};
+  QuantizationReport quantizationReport{};
 
   void createVertexBuffers(const std::vector<Vertex> &vertices);
+  void createIndexBuffers(const std::vector<uint32_t> &indices,
+                          const std::vector<Lod> &lods);
+  void createMeshletBuffers(const std::vector<Meshlet> &meshlets);
 };
 }  // namespace vse
@@ -0,0 +1,74 @@
+#include "vse_object_buffer.hpp"
+
+#include "vse_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+
+namespace vse {
+
+// Matches the shaders' std430 array stride without any padding, so
+// comparing whole structs compares only data
+static_assert(sizeof(VseObjectBuffer::ObjectData) == 176,
+              "ObjectData must match the shaders' layout");
+
+VseObjectBuffer::VseObjectBuffer(VseDevice &device)
+    : vseDevice{device}, frames(VseSwapChain::MAX_FRAMES_IN_FLIGHT) {}
+
+VseObjectBuffer::~VseObjectBuffer() {}
+
+void VseObjectBuffer::update(int frameIndex,
+                             const std::vector<VseGameObject> &gameObjects,
+                             float interpolationAlpha) {
+  this->frameIndex = frameIndex;
+  auto &frame = frames[frameIndex];
+  uint32_t objectCount = static_cast<uint32_t>(gameObjects.size());
+
+  // The frame's previous draws have completed, so the buffer can be
+  // replaced right away
+  if (!frame.buffer || frame.buffer->getInstanceCount() < objectCount) {
+    uint32_t capacity = frame.buffer ? frame.buffer->getInstanceCount() : 256;
+    while (capacity < objectCount) {
+      capacity *= 2;
+    }
+    frame.buffer = std::make_unique<VseBuffer>(
+        vseDevice, sizeof(ObjectData), capacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    frame.buffer->map();
+    frame.written.clear();
+  }
+
+  // Objects past the end of the last write have never been written
+  size_t known = std::min(frame.written.size(), gameObjects.size());
+  frame.written.resize(objectCount);
+  auto *mapped = static_cast<ObjectData *>(frame.buffer->getMappedMemory());
+  stats = {objectCount, 0};
+  for (uint32_t i = 0; i < objectCount; i++) {
+    const auto &obj = gameObjects[i];
+    ObjectData data{};
+    data.modelMatrix = obj.interpolatedMat4(interpolationAlpha);
+    data.normalMatrix = glm::transpose(glm::inverse(data.modelMatrix));
+    data.color = obj.color;
+    data.textureIndex = obj.textureHandle;
+    if (obj.model != nullptr) {
+      data.positionScale = glm::vec4{obj.model->getPositionScale(), 0.f};
+      data.positionOffset = glm::vec4{obj.model->getPositionOffset(), 0.f};
+    }
+
+    if (i < known && memcmp(&data, &frame.written[i], sizeof(data)) == 0) {
+      continue;
+    }
+    frame.written[i] = data;
+    mapped[i] = data;
+    stats.objectsWritten++;
+  }
+}
+
+VkDescriptorBufferInfo VseObjectBuffer::descriptorInfo() const {
+  return frames[frameIndex].buffer->descriptorInfo();
+}
+
+}  // namespace vse
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "vse_buffer.hpp"
+#include "vse_device.hpp"
+#include "vse_game_object.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vse {
+
+// Per object data the scene's shaders read, written into a storage buffer
+// once per frame instead of being pushed with every draw. Each frame in
+// flight has its own persistently mapped buffer, written while earlier
+// frames still draw from theirs. An object's data sits at its index in the
+// scene's object list, which draws pass as their first instance so shaders
+// find it at gl_InstanceIndex. Each buffer remembers what it was last
+// written with and objects that haven't changed since, static ones in
+// particular, are not written again.
+class VseObjectBuffer {
+ public:
+  // ObjectData in simple_shader.vert and depth_only.vert, std430
+  struct ObjectData {
+    glm::mat4 modelMatrix{1.f};
+    // Inverse transpose of modelMatrix, keeps normals perpendicular to
+    // surfaces under non-uniform scale
+    glm::mat4 normalMatrix{1.f};
+    glm::vec3 color{};
+    // Bindless texture handle, VseBindlessTable::INVALID_HANDLE for none
+    uint32_t textureIndex;
+    // Dequantizes positions, see VseModel::getPositionScale()
+    glm::vec4 positionScale{1.f};
+    glm::vec4 positionOffset{0.f};
+  };
+
+  struct Stats {
+    uint32_t objectCount;
+    // Objects whose data changed since the frame's buffer was last written
+    uint32_t objectsWritten;
+  };
+
+  VseObjectBuffer(VseDevice &device);
+  ~VseObjectBuffer();
+
+  VseObjectBuffer(const VseObjectBuffer &) = delete;
+  VseObjectBuffer &operator=(const VseObjectBuffer &) = delete;
+
+  // Once per frame, before anything drawing the objects is recorded
+  void update(int frameIndex, const std::vector<VseGameObject> &gameObjects,
+              float interpolationAlpha);
+
+  // The buffer of the frame last updated
+  VkDescriptorBufferInfo descriptorInfo() const;
+  // What gameObjects[objectIndex] is drawn with this frame
+  const ObjectData &getObjectData(uint32_t objectIndex) const {
+    return frames[frameIndex].written[objectIndex];
+  }
+  const Stats &getStats() const { return stats; }
+
+ private:
+  struct FrameResources {
+    std::unique_ptr<VseBuffer> buffer;
+    // What the buffer holds, compared against instead of reading the
+    // mapped memory back
+    std::vector<ObjectData> written;
+  };
+
+  VseDevice &vseDevice;
+  std::vector<FrameResources> frames;
+  int frameIndex = 0;
+  Stats stats{};
+};
+
+}  // namespace vse
@@ -1,14 +1,121 @@
 #include "vse_pipeline.hpp"
 
 #include "vse_model.hpp"
+#include "vse_shader_reflection.hpp"
+#include "vse_utils.hpp"
 
 // std
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 
 namespace vse {
 
+namespace {
+
+// Map entries and data for one stage, kept alive until pipeline creation
+struct StageSpecialization {
+  std::vector<VkSpecializationMapEntry> mapEntries;
+  std::vector<uint32_t> data;
+  VkSpecializationInfo info{};
+
+  // Returns nullptr when the stage declares none of the configured constants
+  const VkSpecializationInfo *build(
+      const VseShaderReflection &reflection,
+      const std::map<uint32_t, uint32_t> &constants) {
+    for (const auto &kv : constants) {
+      const auto *declared = reflection.findSpecConstant(kv.first);
+      if (declared == nullptr) {
+        continue;
+      }
+      if (declared->size != sizeof(uint32_t)) {
+        throw std::runtime_error("specialization constant " +
+                                 std::to_string(kv.first) +
+                                 " is not a 32-bit scalar");
+      }
+      VkSpecializationMapEntry entry{};
+      entry.constantID = kv.first;
+      entry.offset = static_cast<uint32_t>(data.size() * sizeof(uint32_t));
+      entry.size = sizeof(uint32_t);
+      mapEntries.push_back(entry);
+      data.push_back(kv.second);
+    }
+    if (mapEntries.empty()) {
+      return nullptr;
+    }
+    info.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+    info.pMapEntries = mapEntries.data();
+    info.dataSize = data.size() * sizeof(uint32_t);
+    info.pData = data.data();
+    return &info;
+  }
+};
+
+}  // namespace
+
+VsePipelineLayoutCache::~VsePipelineLayoutCache() {
+  for (auto &kv : layouts) {
+    vkDestroyPipelineLayout(vseDevice.device(), kv.second, nullptr);
+  }
+}
+
+VkPipelineLayout VsePipelineLayoutCache::getLayout(
+    const std::vector<VkDescriptorSetLayout> &setLayouts,
+    const std::vector<VkPushConstantRange> &pushConstantRanges) {
+  LayoutKey key{setLayouts, pushConstantRanges};
+  auto it = layouts.find(key);
+  if (it != layouts.end()) {
+    return it->second;
+  }
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+  pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+  pipelineLayoutInfo.pushConstantRangeCount =
+      static_cast<uint32_t>(pushConstantRanges.size());
+  pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+  VkPipelineLayout pipelineLayout;
+  if (vkCreatePipelineLayout(vseDevice.device(), &pipelineLayoutInfo, nullptr,
+                             &pipelineLayout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline layout!");
+  }
+  layouts.emplace(std::move(key), pipelineLayout);
+  return pipelineLayout;
+}
+
+bool VsePipelineLayoutCache::LayoutKey::operator==(
+    const LayoutKey &other) const {
+  if (setLayouts != other.setLayouts ||
+      pushConstantRanges.size() != other.pushConstantRanges.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < pushConstantRanges.size(); i++) {
+    const auto &a = pushConstantRanges[i];
+    const auto &b = other.pushConstantRanges[i];
+    if (a.stageFlags != b.stageFlags || a.offset != b.offset ||
+        a.size != b.size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t VsePipelineLayoutCache::LayoutKeyHash::operator()(
+    const LayoutKey &key) const {
+  size_t seed = 0;
+  for (auto setLayout : key.setLayouts) {
+    hashCombine(seed, setLayout);
+  }
+  for (const auto &range : key.pushConstantRanges) {
+    hashCombine(seed, range.stageFlags, range.offset, range.size);
+  }
+  return seed;
+}
+
 VsePipeline::VsePipeline(VseDevice &device, const std::string &vertFilepath,
                          const std::string &fragFilepath,
                          const PipelineConfigInfo &configInfo)
@@ -17,8 +124,7 @@ VsePipeline::VsePipeline(VseDevice &device, const std::string &vertFilepath,
 }
 
 VsePipeline::~VsePipeline() {
-  vkDestroyShaderModule(vseDevice.device(), vertShaderModule, nullptr);
-  vkDestroyShaderModule(vseDevice.device(), fragShaderModule, nullptr);
+  destroyShaderModules();
   vkDestroyPipeline(vseDevice.device(), graphicsPipeline, nullptr);
 }
 
@@ -45,34 +151,61 @@ void VsePipeline::createGraphicsPipeline(const std::string &vertFilepath,
                                          const PipelineConfigInfo &configInfo) {
   assert(configInfo.pipelineLayout != VK_NULL_HANDLE &&
          "Cannot create graphics pipeline:: no pipelineLayout provided");
-  assert(configInfo.renderPass != VK_NULL_HANDLE &&
-         "Cannot create graphics pipeline:: no renderPass provided");
-
+  assert((configInfo.renderPass != VK_NULL_HANDLE ||
+          !configInfo.colorAttachmentFormats.empty() ||
+          configInfo.depthAttachmentFormat != VK_FORMAT_UNDEFINED) &&
+         "Cannot create graphics pipeline:: no renderPass or attachment "
+         "formats provided");
+
+  // Depth only pipelines have no fragment stage
+  bool hasFragmentStage = !fragFilepath.empty();
   auto vertCode = readFile(vertFilepath);
-  auto fragCode = readFile(fragFilepath);
-
-  createShaderModule(vertCode, &vertShaderModule);
-  createShaderModule(fragCode, &fragShaderModule);
+  // Parsed from the code being compiled, never a cached older version
+  auto vertReflection = std::make_shared<const VseShaderReflection>(vertCode);
+  std::vector<char> fragCode;
+  std::shared_ptr<const VseShaderReflection> fragReflection;
+  if (hasFragmentStage) {
+    fragCode = readFile(fragFilepath);
+    fragReflection = std::make_shared<const VseShaderReflection>(fragCode);
+  }
+  for (const auto &kv : configInfo.specializationConstants) {
+    if (vertReflection->findSpecConstant(kv.first) == nullptr &&
+        (!hasFragmentStage ||
+         fragReflection->findSpecConstant(kv.first) == nullptr)) {
+      throw std::runtime_error("specialization constant " +
+                               std::to_string(kv.first) +
+                               " is not declared by either shader");
+    }
+  }
+  StageSpecialization vertSpecialization{};
+  StageSpecialization fragSpecialization{};
 
   VkPipelineShaderStageCreateInfo shaderStages[2];
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = vertShaderModule;
+  shaderStages[0].module = VK_NULL_HANDLE;
   shaderStages[0].pName = "main";
   shaderStages[0].flags = 0;
   shaderStages[0].pNext = nullptr;
-  shaderStages[0].pSpecializationInfo = nullptr;
+  shaderStages[0].pSpecializationInfo = vertSpecialization.build(
+      *vertReflection, configInfo.specializationConstants);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = fragShaderModule;
+  shaderStages[1].module = VK_NULL_HANDLE;
   shaderStages[1].pName = "main";
   shaderStages[1].flags = 0;
   shaderStages[1].pNext = nullptr;
-  shaderStages[1].pSpecializationInfo = nullptr;
+  if (hasFragmentStage) {
+    shaderStages[1].pSpecializationInfo = fragSpecialization.build(
+        *fragReflection, configInfo.specializationConstants);
+  }
 
-  auto attributeDescriptions = VseModel::Vertex::getAttributeDescriptions();
-  auto bindingDescriptions = VseModel::Vertex::getBindingDescriptions();
+  // Attributes the vertex shader doesn't read are dropped, so one vertex
+  // layout serves pipelines consuming any subset of it
+  auto attributeDescriptions =
+      vertReflection->matchVertexAttributes(configInfo.attributeDescriptions);
+  const auto &bindingDescriptions = configInfo.bindingDescriptions;
 
   VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
   vertexInputInfo.sType =
@@ -84,33 +217,77 @@ void VsePipeline::createGraphicsPipeline(const std::string &vertFilepath,
   vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
   vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 
+  auto colorBlendInfo = configInfo.colorBlendInfo;
+  colorBlendInfo.pAttachments = &configInfo.colorBlendAttachment;
+  auto dynamicStateInfo = configInfo.dynamicStateInfo;
+  dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
+  dynamicStateInfo.dynamicStateCount =
+      static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
+
   VkGraphicsPipelineCreateInfo pipelineInfo{};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipelineInfo.stageCount = 2;
+  pipelineInfo.stageCount = hasFragmentStage ? 2 : 1;
   pipelineInfo.pStages = shaderStages;
   pipelineInfo.pVertexInputState = &vertexInputInfo;
   pipelineInfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
   pipelineInfo.pViewportState = &configInfo.viewportInfo;
   pipelineInfo.pRasterizationState = &configInfo.rasterizationInfo;
   pipelineInfo.pMultisampleState = &configInfo.multisampleInfo;
-  pipelineInfo.pColorBlendState = &configInfo.colorBlendInfo;
+  pipelineInfo.pColorBlendState = &colorBlendInfo;
   pipelineInfo.pDepthStencilState = &configInfo.depthStencilInfo;
-  pipelineInfo.pDynamicState = &configInfo.dynamicStateInfo;
+  pipelineInfo.pDynamicState = &dynamicStateInfo;
 
   pipelineInfo.layout = configInfo.pipelineLayout;
   pipelineInfo.renderPass = configInfo.renderPass;
   pipelineInfo.subpass = configInfo.subpass;
 
+  VkPipelineRenderingCreateInfoKHR renderingInfo{};
+  if (configInfo.renderPass == VK_NULL_HANDLE) {
+    VkFormat depthFormat = configInfo.depthAttachmentFormat;
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    renderingInfo.colorAttachmentCount =
+        static_cast<uint32_t>(configInfo.colorAttachmentFormats.size());
+    renderingInfo.pColorAttachmentFormats =
+        configInfo.colorAttachmentFormats.data();
+    renderingInfo.depthAttachmentFormat = depthFormat;
+    renderingInfo.stencilAttachmentFormat = hasStencilComponent(depthFormat)
+                                                ? depthFormat
+                                                : VK_FORMAT_UNDEFINED;
+    pipelineInfo.pNext = &renderingInfo;
+  }
+
   pipelineInfo.basePipelineIndex = -1;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-  if (vkCreateGraphicsPipelines(vseDevice.device(), VK_NULL_HANDLE, 1,
-                                &pipelineInfo, nullptr,
+  // Modules are created last, once nothing above can throw, and destroyed
+  // again when the pipeline can't be created
+  createShaderModule(vertCode, &vertShaderModule);
+  shaderStages[0].module = vertShaderModule;
+  if (hasFragmentStage) {
+    try {
+      createShaderModule(fragCode, &fragShaderModule);
+    } catch (...) {
+      destroyShaderModules();
+      throw;
+    }
+    shaderStages[1].module = fragShaderModule;
+  }
+
+  if (vkCreateGraphicsPipelines(vseDevice.device(), vseDevice.pipelineCache(),
+                                1, &pipelineInfo, nullptr,
                                 &graphicsPipeline) != VK_SUCCESS) {
+    destroyShaderModules();
     throw std::runtime_error("failed to create graphics pipeline");
   }
 }
 
+void VsePipeline::destroyShaderModules() {
+  vkDestroyShaderModule(vseDevice.device(), vertShaderModule, nullptr);
+  vkDestroyShaderModule(vseDevice.device(), fragShaderModule, nullptr);
+  vertShaderModule = VK_NULL_HANDLE;
+  fragShaderModule = VK_NULL_HANDLE;
+}
+
 void VsePipeline::createShaderModule(const std::vector<char> &code,
                                      VkShaderModule *shaderModule) {
   VkShaderModuleCreateInfo createInfo{};
@@ -129,7 +306,79 @@ void VsePipeline::bind(VkCommandBuffer commandBuffer) {
                     graphicsPipeline);
 }
 
+VseComputePipeline::VseComputePipeline(
+    VseDevice &device, const std::string &compFilepath,
+    VkPipelineLayout pipelineLayout,
+    const std::map<uint32_t, uint32_t> &specializationConstants)
+    : vseDevice{device} {
+  assert(pipelineLayout != VK_NULL_HANDLE &&
+         "Cannot create compute pipeline:: no pipelineLayout provided");
+  auto compCode = VsePipeline::readFile(compFilepath);
+
+  auto reflection = std::make_shared<const VseShaderReflection>(compCode);
+  for (const auto &kv : specializationConstants) {
+    if (reflection->findSpecConstant(kv.first) == nullptr) {
+      throw std::runtime_error("specialization constant " +
+                               std::to_string(kv.first) +
+                               " is not declared by the shader");
+    }
+  }
+  StageSpecialization specialization{};
+  auto *specializationInfo =
+      specialization.build(*reflection, specializationConstants);
+
+  // Created once nothing above can throw, so a rejected shader can't leak it
+  VkShaderModuleCreateInfo moduleInfo{};
+  moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  moduleInfo.codeSize = compCode.size();
+  moduleInfo.pCode = reinterpret_cast<const uint32_t *>(compCode.data());
+  if (vkCreateShaderModule(vseDevice.device(), &moduleInfo, nullptr,
+                           &compShaderModule) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create shader module");
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = compShaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.stage.pSpecializationInfo = specializationInfo;
+  pipelineInfo.layout = pipelineLayout;
+  pipelineInfo.basePipelineIndex = -1;
+
+  if (vkCreateComputePipelines(vseDevice.device(), vseDevice.pipelineCache(),
+                               1, &pipelineInfo, nullptr,
+                               &computePipeline) != VK_SUCCESS) {
+    vkDestroyShaderModule(vseDevice.device(), compShaderModule, nullptr);
+    throw std::runtime_error("failed to create compute pipeline");
+  }
+}
+
+VseComputePipeline::~VseComputePipeline() {
+  vkDestroyShaderModule(vseDevice.device(), compShaderModule, nullptr);
+  vkDestroyPipeline(vseDevice.device(), computePipeline, nullptr);
+}
+
+void VseComputePipeline::bind(VkCommandBuffer commandBuffer) {
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    computePipeline);
+}
+
 void VsePipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo) {
+  configInfo.bindingDescriptions = VseModel::Vertex::getBindingDescriptions();
+  configInfo.attributeDescriptions =
+      VseModel::Vertex::getAttributeDescriptions();
+
+  // Viewport and scissor are dynamic, only their counts are baked in
+  configInfo.viewportInfo.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  configInfo.viewportInfo.viewportCount = 1;
+  configInfo.viewportInfo.pViewports = nullptr;
+  configInfo.viewportInfo.scissorCount = 1;
+  configInfo.viewportInfo.pScissors = nullptr;
+
   configInfo.inputAssemblyInfo.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
   configInfo.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -206,4 +455,46 @@ void VsePipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo) {
   configInfo.dynamicStateInfo.flags = 0;
 }
 
+void VsePipeline::enableReversedZ(PipelineConfigInfo &configInfo) {
+  configInfo.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_GREATER;
+}
+
+void VsePipeline::setRenderTarget(PipelineConfigInfo &configInfo,
+                                  const VseRenderTargetInfo &renderTarget) {
+  configInfo.renderPass = renderTarget.renderPass;
+  configInfo.subpass = 0;
+  configInfo.colorAttachmentFormats = renderTarget.colorFormats;
+  configInfo.depthAttachmentFormat = renderTarget.depthFormat;
+  configInfo.multisampleInfo.rasterizationSamples = renderTarget.samples;
+  // Depth only targets have no color attachment to blend into
+  configInfo.colorBlendInfo.attachmentCount =
+      renderTarget.colorFormats.empty() ? 0 : 1;
+}
+
+void VsePipeline::setSpecializationConstant(PipelineConfigInfo &configInfo,
+                                            uint32_t constantId,
+                                            uint32_t value) {
+  configInfo.specializationConstants[constantId] = value;
+}
+
+void VsePipeline::setSpecializationConstant(PipelineConfigInfo &configInfo,
+                                            uint32_t constantId,
+                                            int32_t value) {
+  setSpecializationConstant(configInfo, constantId,
+                            static_cast<uint32_t>(value));
+}
+
+void VsePipeline::setSpecializationConstant(PipelineConfigInfo &configInfo,
+                                            uint32_t constantId, float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  setSpecializationConstant(configInfo, constantId, bits);
+}
+
+void VsePipeline::setSpecializationConstant(PipelineConfigInfo &configInfo,
+                                            uint32_t constantId, bool value) {
+  setSpecializationConstant(configInfo, constantId,
+                            static_cast<uint32_t>(value ? VK_TRUE : VK_FALSE));
+}
+
 }  // namespace vse
\ No newline at end of file
@@ -3,12 +3,29 @@
 #include "vse_device.hpp"
 
 // std
+#include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace vse {
 
+class VseShaderReflection;
+
+// What pipelines render into. With dynamic rendering there is no render
+// pass and pipelines are created against the attachment formats alone.
+struct VseRenderTargetInfo {
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  std::vector<VkFormat> colorFormats{};
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+// Safe to copy: pointers between members are re-established when the
+// pipeline is created, so variants can start from a shared base config
 struct PipelineConfigInfo {
+  std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+  std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
   VkPipelineViewportStateCreateInfo viewportInfo;
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
   VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -19,10 +36,53 @@ struct PipelineConfigInfo {
   std::vector<VkDynamicState> dynamicStateEnables;
   VkPipelineDynamicStateCreateInfo dynamicStateInfo;
   VkPipelineLayout pipelineLayout = nullptr;
+  // Null for dynamic rendering, the attachment formats below are then
+  // required
   VkRenderPass renderPass = nullptr;
   uint32_t subpass = 0;
+  // Formats the render pass was created with. When set, the pipeline
+  // registry keys on these instead of the renderPass handle, since any
+  // compatible render pass (e.g. one recreated with the swap chain) can use
+  // the same pipeline
+  std::vector<VkFormat> colorAttachmentFormats{};
+  VkFormat depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+  // constant_id -> raw 32-bit value, applied to each stage declaring the id
+  std::map<uint32_t, uint32_t> specializationConstants{};
+};
+
+// Shares VkPipelineLayouts between pipelines declaring the same descriptor
+// set layouts and push constant ranges. Layouts live as long as the cache.
+class VsePipelineLayoutCache {
+ public:
+  VsePipelineLayoutCache(VseDevice &device) : vseDevice{device} {}
+  ~VsePipelineLayoutCache();
+
+  VsePipelineLayoutCache(const VsePipelineLayoutCache &) = delete;
+  VsePipelineLayoutCache &operator=(const VsePipelineLayoutCache &) = delete;
+
+  VkPipelineLayout getLayout(
+      const std::vector<VkDescriptorSetLayout> &setLayouts,
+      const std::vector<VkPushConstantRange> &pushConstantRanges);
+
+  size_t size() const { return layouts.size(); }
+
+ private:
+  struct LayoutKey {
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    std::vector<VkPushConstantRange> pushConstantRanges;
+
+    bool operator==(const LayoutKey &other) const;
+  };
+  struct LayoutKeyHash {
+    size_t operator()(const LayoutKey &key) const;
+  };
+
+  VseDevice &vseDevice;
+  std::unordered_map<LayoutKey, VkPipelineLayout, LayoutKeyHash> layouts;
 };
 
+// An empty fragFilepath leaves out the fragment stage, for depth only
+// passes
 class VsePipeline {
  public:
   VsePipeline(VseDevice &device, const std::string &vertFilepath,
@@ -35,20 +95,55 @@ class VsePipeline {
 
   void bind(VkCommandBuffer commandBuffer);
   static void defaultPipelineConfigInfo(PipelineConfigInfo &configInfo);
+  static void enableReversedZ(PipelineConfigInfo &configInfo);
+  static void setRenderTarget(PipelineConfigInfo &configInfo,
+                              const VseRenderTargetInfo &renderTarget);
+
+  // Values are stored as the 32-bit words the shader reads, bools as VkBool32
+  static void setSpecializationConstant(PipelineConfigInfo &configInfo,
+                                        uint32_t constantId, uint32_t value);
+  static void setSpecializationConstant(PipelineConfigInfo &configInfo,
+                                        uint32_t constantId, int32_t value);
+  static void setSpecializationConstant(PipelineConfigInfo &configInfo,
+                                        uint32_t constantId, float value);
+  static void setSpecializationConstant(PipelineConfigInfo &configInfo,
+                                        uint32_t constantId, bool value);
 
- private:
   static std::vector<char> readFile(const std::string &filepath);
 
+ private:
   void createGraphicsPipeline(const std::string &vertFilepath,
                               const std::string &fragFilepath,
                               const PipelineConfigInfo &configInfo);
 
   void createShaderModule(const std::vector<char> &code,
                           VkShaderModule *shaderModule);
+  void destroyShaderModules();
 
   VseDevice &vseDevice;
   VkPipeline graphicsPipeline;
-  VkShaderModule vertShaderModule;
-  VkShaderModule fragShaderModule;
+  VkShaderModule vertShaderModule = VK_NULL_HANDLE;
+  VkShaderModule fragShaderModule = VK_NULL_HANDLE;
+};
+
+// A single compute shader. The layout is usually built from the shader's
+// own reflection, see VseShaderReflection::buildPipelineLayout.
+class VseComputePipeline {
+ public:
+  VseComputePipeline(
+      VseDevice &device, const std::string &compFilepath,
+      VkPipelineLayout pipelineLayout,
+      const std::map<uint32_t, uint32_t> &specializationConstants = {});
+  ~VseComputePipeline();
+
+  VseComputePipeline(const VseComputePipeline &) = delete;
+  VseComputePipeline &operator=(const VseComputePipeline &) = delete;
+
+  void bind(VkCommandBuffer commandBuffer);
+
+ private:
+  VseDevice &vseDevice;
+  VkPipeline computePipeline;
+  VkShaderModule compShaderModule;
 };
 }  // namespace vse
\ No newline at end of file
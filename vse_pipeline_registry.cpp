@@ -0,0 +1,384 @@
+#include "vse_pipeline_registry.hpp"
+
+#include "vse_shader_reflection.hpp"
+#include "vse_utils.hpp"
+
+// std
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace vse {
+
+namespace {
+
+// Appends pipeline state to a key as 32-bit words
+class KeyWriter {
+ public:
+  explicit KeyWriter(std::vector<uint32_t> &key) : key{key} {}
+
+  KeyWriter &add(uint32_t value) {
+    key.push_back(value);
+    return *this;
+  }
+  KeyWriter &add(int32_t value) { return add(static_cast<uint32_t>(value)); }
+  KeyWriter &add(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return add(bits);
+  }
+  KeyWriter &add(uint64_t value) {
+    add(static_cast<uint32_t>(value));
+    return add(static_cast<uint32_t>(value >> 32));
+  }
+  template <typename Handle>
+  KeyWriter &addHandle(Handle handle) {
+    uint64_t value = 0;
+    std::memcpy(&value, &handle, sizeof(handle));
+    return add(value);
+  }
+  KeyWriter &add(const VkStencilOpState &state) {
+    return add(state.failOp)
+        .add(state.passOp)
+        .add(state.depthFailOp)
+        .add(state.compareOp)
+        .add(state.compareMask)
+        .add(state.writeMask)
+        .add(state.reference);
+  }
+
+ private:
+  std::vector<uint32_t> &key;
+};
+
+std::string normalizePath(const std::string &path) {
+  return std::filesystem::path{path}.lexically_normal().string();
+}
+
+}  // namespace
+
+VsePipelineRegistry::VsePipelineRegistry(VseDevice &device,
+                                         VseJobSystem &jobSystem)
+    : vseDevice{device}, jobSystem{jobSystem} {}
+
+VsePipelineRegistry::~VsePipelineRegistry() {
+  // Compiles in flight create pipelines on the device, let them finish
+  for (auto &entry : entries) {
+    if (entry->pending.valid()) {
+      entry->pending.wait();
+    }
+  }
+}
+
+size_t VsePipelineRegistry::KeyHash::operator()(
+    const std::vector<uint32_t> &key) const {
+  return static_cast<size_t>(
+      fnv1a64(key.data(), key.size() * sizeof(uint32_t)));
+}
+
+std::vector<uint32_t> VsePipelineRegistry::buildKey(const PipelineDesc &desc) {
+  std::vector<uint32_t> key{};
+  key.reserve(128);
+  KeyWriter writer{key};
+  const auto &config = desc.config;
+
+  for (const auto *path : {&desc.vertFilepath, &desc.fragFilepath}) {
+    if (path->empty()) {
+      writer.add(uint64_t{0});
+      continue;
+    }
+    writer.add(codeHash(*path));
+  }
+
+  writer.add(static_cast<uint32_t>(config.bindingDescriptions.size()));
+  for (const auto &binding : config.bindingDescriptions) {
+    writer.add(binding.binding).add(binding.stride).add(binding.inputRate);
+  }
+  writer.add(static_cast<uint32_t>(config.attributeDescriptions.size()));
+  for (const auto &attribute : config.attributeDescriptions) {
+    writer.add(attribute.location)
+        .add(attribute.binding)
+        .add(attribute.format)
+        .add(attribute.offset);
+  }
+
+  writer.add(config.viewportInfo.viewportCount)
+      .add(config.viewportInfo.scissorCount);
+
+  writer.add(config.inputAssemblyInfo.topology)
+      .add(config.inputAssemblyInfo.primitiveRestartEnable);
+
+  const auto &raster = config.rasterizationInfo;
+  writer.add(raster.depthClampEnable)
+      .add(raster.rasterizerDiscardEnable)
+      .add(raster.polygonMode)
+      .add(raster.cullMode)
+      .add(raster.frontFace)
+      .add(raster.depthBiasEnable)
+      .add(raster.depthBiasConstantFactor)
+      .add(raster.depthBiasClamp)
+      .add(raster.depthBiasSlopeFactor)
+      .add(raster.lineWidth);
+
+  const auto &multisample = config.multisampleInfo;
+  writer.add(multisample.rasterizationSamples)
+      .add(multisample.sampleShadingEnable)
+      .add(multisample.minSampleShading)
+      .add(multisample.alphaToCoverageEnable)
+      .add(multisample.alphaToOneEnable)
+      .add(multisample.pSampleMask != nullptr ? *multisample.pSampleMask
+                                              : UINT32_MAX);
+
+  const auto &blend = config.colorBlendAttachment;
+  writer.add(blend.blendEnable)
+      .add(blend.srcColorBlendFactor)
+      .add(blend.dstColorBlendFactor)
+      .add(blend.colorBlendOp)
+      .add(blend.srcAlphaBlendFactor)
+      .add(blend.dstAlphaBlendFactor)
+      .add(blend.alphaBlendOp)
+      .add(blend.colorWriteMask);
+  writer.add(config.colorBlendInfo.logicOpEnable)
+      .add(config.colorBlendInfo.logicOp)
+      .add(config.colorBlendInfo.attachmentCount);
+  for (float constant : config.colorBlendInfo.blendConstants) {
+    writer.add(constant);
+  }
+
+  const auto &depth = config.depthStencilInfo;
+  writer.add(depth.depthTestEnable)
+      .add(depth.depthWriteEnable)
+      .add(depth.depthCompareOp)
+      .add(depth.depthBoundsTestEnable)
+      .add(depth.minDepthBounds)
+      .add(depth.maxDepthBounds)
+      .add(depth.stencilTestEnable)
+      .add(depth.front)
+      .add(depth.back);
+
+  writer.add(static_cast<uint32_t>(config.dynamicStateEnables.size()));
+  for (auto state : config.dynamicStateEnables) {
+    writer.add(state);
+  }
+
+  writer.addHandle(config.pipelineLayout);
+  if (!config.colorAttachmentFormats.empty() ||
+      config.depthAttachmentFormat != VK_FORMAT_UNDEFINED) {
+    writer.add(static_cast<uint32_t>(config.colorAttachmentFormats.size()));
+    for (auto format : config.colorAttachmentFormats) {
+      writer.add(format);
+    }
+    writer.add(config.depthAttachmentFormat);
+  } else {
+    writer.add(UINT32_MAX).addHandle(config.renderPass);
+  }
+  writer.add(config.subpass);
+
+  writer.add(static_cast<uint32_t>(config.specializationConstants.size()));
+  for (const auto &kv : config.specializationConstants) {
+    writer.add(kv.first).add(kv.second);
+  }
+  return key;
+}
+
+VsePipelineRegistry::PipelineId VsePipelineRegistry::request(
+    const PipelineDesc &desc) {
+  return findOrCreate(desc, false, INVALID_PIPELINE);
+}
+
+VsePipelineRegistry::PipelineId VsePipelineRegistry::requestAsync(
+    const PipelineDesc &desc, PipelineId fallback) {
+  assert(fallback != INVALID_PIPELINE && "Async requests need a fallback");
+  return findOrCreate(desc, true, fallback);
+}
+
+VsePipelineRegistry::PipelineId VsePipelineRegistry::findOrCreate(
+    const PipelineDesc &desc, bool async, PipelineId fallback) {
+  auto key = buildKey(desc);
+
+  std::unique_lock<std::mutex> lock{mutex};
+  auto it = lookup.find(key);
+  if (it != lookup.end()) {
+    cacheHits++;
+    return it->second;
+  }
+  cacheMisses++;
+
+  auto entry = std::make_unique<Entry>();
+  entry->desc = desc;
+  entry->desc.vertFilepath = normalizePath(desc.vertFilepath);
+  entry->desc.fragFilepath = normalizePath(desc.fragFilepath);
+  entry->key = key;
+  entry->fallback = fallback;
+
+  PipelineId id = static_cast<PipelineId>(entries.size());
+  Entry &created = *entry;
+  entries.push_back(std::move(entry));
+  lookup.emplace(std::move(key), id);
+
+  try {
+    created.pushConstantRange =
+        reflect(desc.vertFilepath, desc.fragFilepath).getPushConstantRange();
+    if (async) {
+      startCompile(created);
+    } else {
+      // Compiling under the lock keeps concurrent requests for the same
+      // state from racing to build duplicates
+      created.pipeline = std::make_unique<VsePipeline>(
+          vseDevice, desc.vertFilepath, desc.fragFilepath, desc.config);
+    }
+  } catch (...) {
+    // Nobody has the id yet, so the entry can go and a later request
+    // starts over
+    lookup.erase(created.key);
+    entries.pop_back();
+    throw;
+  }
+  return id;
+}
+
+void VsePipelineRegistry::startCompile(Entry &entry) {
+  entry.pending = jobSystem.submit(
+      [&device = vseDevice, &reflectionCache = reflectionCache,
+       desc = entry.desc,
+       pushConstantRange =
+           entry.pushConstantRange]() -> std::unique_ptr<VsePipeline> {
+        try {
+          auto reflection =
+              reflectionCache.reflect(desc.vertFilepath, desc.fragFilepath);
+          const auto &range = reflection.getPushConstantRange();
+          if (range.offset != pushConstantRange.offset ||
+              range.size != pushConstantRange.size) {
+            throw std::runtime_error(
+                "push constant block changed, restart to apply");
+          }
+          return std::make_unique<VsePipeline>(device, desc.vertFilepath,
+                                               desc.fragFilepath, desc.config);
+        } catch (const std::exception &e) {
+          std::cerr << "failed to compile pipeline (" << desc.vertFilepath
+                    << ", " << desc.fragFilepath << "): " << e.what()
+                    << std::endl;
+          return nullptr;
+        }
+      });
+}
+
+VsePipeline &VsePipelineRegistry::get(PipelineId id) {
+  std::lock_guard<std::mutex> lock{mutex};
+  assert(id < entries.size() && "Unknown pipeline id");
+  // Follow fallbacks until one has a compiled pipeline
+  for (PipelineId current = id; current != INVALID_PIPELINE;
+       current = entries[current]->fallback) {
+    if (entries[current]->pipeline) {
+      return *entries[current]->pipeline;
+    }
+  }
+  throw std::runtime_error("pipeline and its fallbacks are not compiled!");
+}
+
+bool VsePipelineRegistry::hasFailed(PipelineId id) {
+  std::lock_guard<std::mutex> lock{mutex};
+  assert(id < entries.size() && "Unknown pipeline id");
+  return entries[id]->failed;
+}
+
+bool VsePipelineRegistry::isReady(PipelineId id) {
+  std::lock_guard<std::mutex> lock{mutex};
+  assert(id < entries.size() && "Unknown pipeline id");
+  return entries[id]->pipeline != nullptr;
+}
+
+void VsePipelineRegistry::update(VseRenderer &renderer) {
+  assert(!renderer.isFrameInProgress() &&
+         "Pipelines can only be swapped between frames");
+
+  std::lock_guard<std::mutex> lock{mutex};
+  for (auto &entry : entries) {
+    if (!entry->pending.valid() ||
+        entry->pending.wait_for(std::chrono::seconds{0}) !=
+            std::future_status::ready) {
+      continue;
+    }
+
+    auto pipeline = entry->pending.get();
+    entry->failed = pipeline == nullptr;
+    if (pipeline) {
+      if (entry->pipeline) {
+        // Frames already submitted may still reference the old pipeline
+        std::shared_ptr<VsePipeline> retired = std::move(entry->pipeline);
+        renderer.retire([retired]() mutable { retired.reset(); });
+      }
+      entry->pipeline = std::move(pipeline);
+    }
+
+    if (entry->stale) {
+      entry->stale = false;
+      startCompile(*entry);
+    }
+  }
+}
+
+uint64_t VsePipelineRegistry::codeHash(const std::string &spvPath) {
+  std::string path = normalizePath(spvPath);
+  // Read under the lock so a reload can't be overwritten by an older read
+  std::lock_guard<std::mutex> lock{codeHashMutex};
+  auto it = codeHashes.find(path);
+  if (it != codeHashes.end()) {
+    return it->second;
+  }
+  auto code = VsePipeline::readFile(path);
+  uint64_t hash = fnv1a64(code.data(), code.size());
+  codeHashes.emplace(std::move(path), hash);
+  return hash;
+}
+
+void VsePipelineRegistry::reloadShader(const std::string &spvPath) {
+  std::string path = normalizePath(spvPath);
+  reflectionCache.invalidate(path);
+  {
+    std::lock_guard<std::mutex> lock{codeHashMutex};
+    codeHashes.erase(path);
+  }
+
+  std::lock_guard<std::mutex> lock{mutex};
+  for (size_t id = 0; id < entries.size(); id++) {
+    Entry &entry = *entries[id];
+    if (entry.desc.vertFilepath != path && entry.desc.fragFilepath != path) {
+      continue;
+    }
+
+    // The key embeds the code hash; re-key so new requests find this entry
+    lookup.erase(entry.key);
+    entry.key = buildKey(entry.desc);
+    lookup[entry.key] = static_cast<PipelineId>(id);
+
+    if (entry.pending.valid()) {
+      entry.stale = true;
+    } else {
+      startCompile(entry);
+    }
+  }
+}
+
+VseShaderReflection VsePipelineRegistry::reflect(
+    const std::string &vertFilepath, const std::string &fragFilepath) {
+  return reflectionCache.reflect(normalizePath(vertFilepath),
+                                 normalizePath(fragFilepath));
+}
+
+VsePipelineRegistry::Stats VsePipelineRegistry::getStats() {
+  std::lock_guard<std::mutex> lock{mutex};
+  Stats stats{};
+  stats.pipelineCount = static_cast<uint32_t>(entries.size());
+  for (auto &entry : entries) {
+    stats.pendingCompiles += entry->pending.valid() ? 1 : 0;
+  }
+  stats.cacheHits = cacheHits;
+  stats.cacheMisses = cacheMisses;
+  return stats;
+}
+
+}  // namespace vse
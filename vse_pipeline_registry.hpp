@@ -0,0 +1,119 @@
+#pragma once
+
+#include "vse_device.hpp"
+#include "vse_job_system.hpp"
+#include "vse_pipeline.hpp"
+#include "vse_renderer.hpp"
+#include "vse_shader_reflection.hpp"
+
+// std
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vse {
+
+struct PipelineDesc {
+  std::string vertFilepath;
+  std::string fragFilepath;
+  PipelineConfigInfo config{};
+};
+
+// Owns every graphics pipeline. Requests are keyed on the full pipeline
+// state including specialization constants, the shader code hashes, the
+// vertex layout and the render pass compatibility, so identical requests
+// from different systems share one VkPipeline. New variants can compile on
+// worker threads while callers keep drawing with a compatible fallback.
+class VsePipelineRegistry {
+ public:
+  using PipelineId = uint32_t;
+  static constexpr PipelineId INVALID_PIPELINE = UINT32_MAX;
+
+  struct Stats {
+    uint32_t pipelineCount;
+    uint32_t pendingCompiles;
+    uint32_t cacheHits;
+    uint32_t cacheMisses;
+  };
+
+  VsePipelineRegistry(VseDevice &device, VseJobSystem &jobSystem);
+  ~VsePipelineRegistry();
+
+  VsePipelineRegistry(const VsePipelineRegistry &) = delete;
+  VsePipelineRegistry &operator=(const VsePipelineRegistry &) = delete;
+
+  // Returns the pipeline for desc, compiling it now if it doesn't exist.
+  // Throws if it fails to compile, without keeping the failed request.
+  PipelineId request(const PipelineDesc &desc);
+  // Compiles on a worker if needed; until it is ready, get() returns the
+  // fallback, which must be compatible with the same pipeline layout
+  PipelineId requestAsync(const PipelineDesc &desc, PipelineId fallback);
+
+  // Pipeline to bind this frame
+  VsePipeline &get(PipelineId id);
+  bool isReady(PipelineId id);
+  // The last compile on a worker failed; get() keeps returning the previous
+  // pipeline or the fallback until a reload compiles
+  bool hasFailed(PipelineId id);
+
+  // Call between frames: publishes finished compiles and retires any
+  // pipelines they replace through the renderer
+  void update(VseRenderer &renderer);
+
+  // Recompiles every pipeline built from spvPath, keeping the current one
+  // bound until the new one is ready. Safe to call from any thread.
+  void reloadShader(const std::string &spvPath);
+
+  Stats getStats();
+
+  // Merged interface of both stages, used to build pipeline layouts. Cached
+  // until reloadShader is told the file changed.
+  VseShaderReflection reflect(const std::string &vertFilepath,
+                              const std::string &fragFilepath);
+
+ private:
+  struct Entry {
+    PipelineDesc desc;
+    std::vector<uint32_t> key;
+    // Push constant range the pipeline was first built with; reloads that
+    // change it would no longer match the pipeline layout
+    VkPushConstantRange pushConstantRange;
+    std::unique_ptr<VsePipeline> pipeline;
+    std::future<std::unique_ptr<VsePipeline>> pending;
+    PipelineId fallback = INVALID_PIPELINE;
+    // Shader code changed again while a compile was running
+    bool stale = false;
+    // The last finished compile failed, see hasFailed()
+    bool failed = false;
+  };
+
+  struct KeyHash {
+    size_t operator()(const std::vector<uint32_t> &key) const;
+  };
+
+  PipelineId findOrCreate(const PipelineDesc &desc, bool async,
+                          PipelineId fallback);
+  void startCompile(Entry &entry);
+  std::vector<uint32_t> buildKey(const PipelineDesc &desc);
+  // Hash of a shader's code, read once until reloadShader() drops it
+  uint64_t codeHash(const std::string &spvPath);
+
+  VseDevice &vseDevice;
+  VseJobSystem &jobSystem;
+  VseShaderReflectionCache reflectionCache;
+
+  std::mutex codeHashMutex;
+  std::unordered_map<std::string, uint64_t> codeHashes;
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<Entry>> entries;
+  std::unordered_map<std::vector<uint32_t>, PipelineId, KeyHash> lookup;
+  uint32_t cacheHits = 0;
+  uint32_t cacheMisses = 0;
+};
+
+}  // namespace vse
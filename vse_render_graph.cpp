@@ -0,0 +1,944 @@
+#include "vse_render_graph.hpp"
+
+#include "vse_utils.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+namespace vse {
+
+namespace {
+
+template <typename Handle>
+uint64_t handleBits(Handle handle) {
+  uint64_t bits = 0;
+  std::memcpy(&bits, &handle, sizeof(handle));
+  return bits;
+}
+
+}  // namespace
+
+VseRenderGraph::PassBuilder &VseRenderGraph::PassBuilder::writeColor(
+    ResourceId resource) {
+  assert(resource < graph.resources.size() && "Unknown render graph resource");
+  graph.resources[resource].usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  graph.passes[passIndex].uses.push_back(
+      {resource, Usage::ColorWrite,
+       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT});
+  return *this;
+}
+
+VseRenderGraph::PassBuilder &VseRenderGraph::PassBuilder::clearColor(
+    ResourceId resource, VkClearColorValue value) {
+  writeColor(resource);
+  auto &use = graph.passes[passIndex].uses.back();
+  use.clear = true;
+  use.clearValue.color = value;
+  return *this;
+}
+
+VseRenderGraph::PassBuilder &VseRenderGraph::PassBuilder::writeDepth(
+    ResourceId resource) {
+  assert(resource < graph.resources.size() && "Unknown render graph resource");
+  assert(isDepthFormat(graph.resources[resource].desc.format) &&
+         "Depth attachment needs a depth format");
+  graph.resources[resource].usage |=
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  graph.passes[passIndex].uses.push_back(
+      {resource, Usage::DepthWrite,
+       VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+           VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT});
+  return *this;
+}
+
+VseRenderGraph::PassBuilder &VseRenderGraph::PassBuilder::clearDepth(
+    ResourceId resource, VkClearDepthStencilValue value) {
+  writeDepth(resource);
+  auto &use = graph.passes[passIndex].uses.back();
+  use.clear = true;
+  use.clearValue.depthStencil = value;
+  return *this;
+}
+
+VseRenderGraph::PassBuilder &VseRenderGraph::PassBuilder::resolveColor(
+    ResourceId source, ResourceId destination) {
+  assert(source < graph.resources.size() &&
+         destination < graph.resources.size() &&
+         "Unknown render graph resource");
+  assert(graph.resources[source].desc.samples != VK_SAMPLE_COUNT_1_BIT &&
+         "Resolve source must be multisampled");
+  assert(graph.resources[destination].desc.samples == VK_SAMPLE_COUNT_1_BIT &&
+         "Resolve destination must be single sampled");
+  assert(graph.resources[source].desc.format ==
+             graph.resources[destination].desc.format &&
+         "Resolve source and destination formats must match");
+  graph.resources[destination].usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  ResourceUse use{destination, Usage::Resolve,
+                  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  use.clear = true;
+  use.resolveSource = source;
+  graph.passes[passIndex].uses.push_back(use);
+  return *this;
+}
+
+VseRenderGraph::PassBuilder &VseRenderGraph::PassBuilder::readTexture(
+    ResourceId resource, VkPipelineStageFlags stages) {
+  assert(resource < graph.resources.size() && "Unknown render graph resource");
+  graph.resources[resource].usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+  graph.passes[passIndex].uses.push_back({resource, Usage::Sampled, stages});
+  return *this;
+}
+
+VseRenderGraph::PassBuilder &VseRenderGraph::PassBuilder::setSideEffects() {
+  graph.passes[passIndex].sideEffects = true;
+  return *this;
+}
+
+VseRenderGraph::VseRenderGraph(VseDevice &device, RetireFunction retire,
+                               bool dynamicRendering)
+    : vseDevice{device},
+      retire{std::move(retire)},
+      dynamicRendering{dynamicRendering} {
+  assert((!dynamicRendering || device.hasDynamicRendering()) &&
+         "Device does not support dynamic rendering");
+}
+
+VseRenderGraph::~VseRenderGraph() {
+  // The owner waits for the device to go idle, nothing is in use anymore
+  VkDevice device = vseDevice.device();
+  for (auto &kv : framebuffers) {
+    vkDestroyFramebuffer(device, kv.second, nullptr);
+  }
+  for (auto &kv : renderPasses) {
+    vkDestroyRenderPass(device, kv.second, nullptr);
+  }
+  for (auto &image : physicalImages) {
+    vkDestroyImageView(device, image.view, nullptr);
+    vkDestroyImage(device, image.image, nullptr);
+  }
+  for (auto &block : memoryBlocks) {
+    vkFreeMemory(device, block.memory, nullptr);
+  }
+}
+
+void VseRenderGraph::reset() {
+  assert(!executing && "Cannot reset the render graph while it executes");
+  passes.clear();
+  resources.clear();
+}
+
+VseRenderGraph::ResourceId VseRenderGraph::createImage(
+    const std::string &name, const ImageDesc &desc) {
+  Resource resource{};
+  resource.name = name;
+  resource.desc = desc;
+  resources.push_back(resource);
+  return static_cast<ResourceId>(resources.size() - 1);
+}
+
+VseRenderGraph::ResourceId VseRenderGraph::importImage(
+    const std::string &name, const ImportedImage &image) {
+  Resource resource{};
+  resource.name = name;
+  resource.desc = image.desc;
+  resource.imported = true;
+  resource.import = image;
+  resources.push_back(resource);
+  return static_cast<ResourceId>(resources.size() - 1);
+}
+
+void VseRenderGraph::addPass(const std::string &name,
+                             const SetupFunction &setup,
+                             ExecuteFunction execute) {
+  Pass pass{};
+  pass.name = name;
+  pass.execute = std::move(execute);
+  passes.push_back(std::move(pass));
+
+  PassBuilder builder{*this, static_cast<uint32_t>(passes.size() - 1)};
+  setup(builder);
+}
+
+std::vector<uint32_t> VseRenderGraph::cullPasses() {
+  // Walk backwards tracking which resources still have their contents
+  // needed; a pass survives if it writes one of them. Imported images are
+  // observed outside the graph, so their contents are always needed.
+  std::vector<bool> needed(resources.size(), false);
+  for (size_t i = 0; i < resources.size(); i++) {
+    needed[i] = resources[i].imported;
+  }
+
+  std::vector<uint32_t> order{};
+  for (size_t i = passes.size(); i-- > 0;) {
+    const Pass &pass = passes[i];
+    bool keep = pass.sideEffects;
+    for (const auto &use : pass.uses) {
+      keep |= use.usage != Usage::Sampled && needed[use.resource];
+    }
+    if (!keep) {
+      continue;
+    }
+
+    order.push_back(static_cast<uint32_t>(i));
+    for (const auto &use : pass.uses) {
+      if (use.clear && !resources[use.resource].imported) {
+        needed[use.resource] = false;
+      }
+    }
+    for (const auto &use : pass.uses) {
+      // Drawing on top of an attachment reads its previous contents
+      if (use.usage == Usage::Sampled || !use.clear) {
+        needed[use.resource] = true;
+      }
+    }
+  }
+
+  // Passes can only read what earlier passes wrote, so declaration order is
+  // already a valid execution order
+  std::reverse(order.begin(), order.end());
+  stats.passCount = static_cast<uint32_t>(order.size());
+  stats.culledPasses = static_cast<uint32_t>(passes.size() - order.size());
+  return order;
+}
+
+void VseRenderGraph::computeLifetimes(const std::vector<uint32_t> &order) {
+  for (uint32_t k = 0; k < order.size(); k++) {
+    for (const auto &use : passes[order[k]].uses) {
+      Resource &resource = resources[use.resource];
+      resource.firstUse = std::min(resource.firstUse, k);
+      resource.lastUse = std::max(resource.lastUse, k);
+    }
+  }
+}
+
+void VseRenderGraph::allocateTransients() {
+  std::vector<ResourceId> transients{};
+  std::vector<uint64_t> signature{};
+  for (ResourceId id = 0; id < resources.size(); id++) {
+    const Resource &resource = resources[id];
+    if (resource.imported || resource.firstUse == UINT32_MAX) {
+      continue;
+    }
+    transients.push_back(id);
+    signature.insert(signature.end(),
+                     {static_cast<uint64_t>(resource.desc.format),
+                      resource.desc.extent.width, resource.desc.extent.height,
+                      static_cast<uint64_t>(resource.desc.samples),
+                      resource.usage, resource.firstUse, resource.lastUse});
+  }
+
+  if (signature != transientSignature) {
+    destroyTransients();
+    transientSignature = signature;
+
+    VkDevice device = vseDevice.device();
+    std::vector<VkMemoryRequirements> requirements(transients.size());
+    for (size_t i = 0; i < transients.size(); i++) {
+      const Resource &resource = resources[transients[i]];
+      VkImageCreateInfo imageInfo{};
+      imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      imageInfo.imageType = VK_IMAGE_TYPE_2D;
+      imageInfo.extent = {resource.desc.extent.width,
+                          resource.desc.extent.height, 1};
+      imageInfo.mipLevels = 1;
+      imageInfo.arrayLayers = 1;
+      imageInfo.format = resource.desc.format;
+      imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+      imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      imageInfo.usage = resource.usage;
+      // Images only ever used as attachments of a single pass never need
+      // their contents outside it and can live in lazily allocated memory
+      if ((resource.usage & ~(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) ==
+              0 &&
+          resource.firstUse == resource.lastUse) {
+        imageInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+      }
+      imageInfo.samples = resource.desc.samples;
+      imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+      PhysicalImage physical{};
+      physical.desc = resource.desc;
+      physical.usage = imageInfo.usage;
+      if (vkCreateImage(device, &imageInfo, nullptr, &physical.image) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to create render graph image!");
+      }
+      vkGetImageMemoryRequirements(device, physical.image, &requirements[i]);
+      physicalImages.push_back(physical);
+    }
+
+    // Greedy interval packing: largest images first, each goes into the
+    // first block none of whose images are alive at the same time
+    std::vector<size_t> bySize(transients.size());
+    std::iota(bySize.begin(), bySize.end(), 0);
+    std::stable_sort(bySize.begin(), bySize.end(), [&](size_t a, size_t b) {
+      return requirements[a].size > requirements[b].size;
+    });
+
+    std::vector<std::vector<size_t>> blockImages{};
+    std::vector<uint32_t> blockTypeBits{};
+    for (size_t i : bySize) {
+      const Resource &resource = resources[transients[i]];
+      uint32_t block = 0;
+      for (; block < blockImages.size(); block++) {
+        if ((blockTypeBits[block] & requirements[i].memoryTypeBits) == 0) {
+          continue;
+        }
+        bool overlaps = false;
+        for (size_t other : blockImages[block]) {
+          const Resource &placed = resources[transients[other]];
+          overlaps |= resource.firstUse <= placed.lastUse &&
+                      placed.firstUse <= resource.lastUse;
+        }
+        if (!overlaps) {
+          break;
+        }
+      }
+      if (block == blockImages.size()) {
+        blockImages.emplace_back();
+        blockTypeBits.push_back(requirements[i].memoryTypeBits);
+        memoryBlocks.emplace_back();
+      }
+      blockImages[block].push_back(i);
+      blockTypeBits[block] &= requirements[i].memoryTypeBits;
+      memoryBlocks[block].size =
+          std::max(memoryBlocks[block].size, requirements[i].size);
+      physicalImages[i].block = block;
+    }
+
+    stats.transientBytes = 0;
+    stats.allocatedBytes = 0;
+    for (const auto &requirement : requirements) {
+      stats.transientBytes += requirement.size;
+    }
+    for (size_t block = 0; block < memoryBlocks.size(); block++) {
+      VkMemoryAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocInfo.allocationSize = memoryBlocks[block].size;
+      // Only blocks holding nothing but transient attachments can offer a
+      // lazily allocated memory type
+      VkMemoryPropertyFlags properties =
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+          VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+      if (!vseDevice.hasMemoryType(blockTypeBits[block], properties)) {
+        properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+      }
+      allocInfo.memoryTypeIndex =
+          vseDevice.findMemoryType(blockTypeBits[block], properties);
+      if (vkAllocateMemory(device, &allocInfo, nullptr,
+                           &memoryBlocks[block].memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate render graph memory!");
+      }
+      stats.allocatedBytes += memoryBlocks[block].size;
+    }
+
+    // Every image starts at offset 0 of its block, which satisfies any
+    // alignment requirement
+    for (auto &physical : physicalImages) {
+      if (vkBindImageMemory(device, physical.image,
+                            memoryBlocks[physical.block].memory,
+                            0) != VK_SUCCESS) {
+        throw std::runtime_error("failed to bind render graph image memory!");
+      }
+
+      VkImageViewCreateInfo viewInfo{};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.image = physical.image;
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = physical.desc.format;
+      viewInfo.subresourceRange.aspectMask =
+          formatAspectMask(physical.desc.format);
+      viewInfo.subresourceRange.levelCount = 1;
+      viewInfo.subresourceRange.layerCount = 1;
+      if (vkCreateImageView(device, &viewInfo, nullptr, &physical.view) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to create render graph image view!");
+      }
+    }
+  }
+
+  for (size_t i = 0; i < transients.size(); i++) {
+    resources[transients[i]].physical = static_cast<uint32_t>(i);
+  }
+  stats.transientImages = static_cast<uint32_t>(physicalImages.size());
+  stats.memoryBlocks = static_cast<uint32_t>(memoryBlocks.size());
+}
+
+void VseRenderGraph::destroyTransients() {
+  if (physicalImages.empty() && memoryBlocks.empty()) {
+    return;
+  }
+  // Framebuffers reference the views about to go away
+  invalidateFramebuffers();
+
+  VkDevice device = vseDevice.device();
+  retire([device, images = std::move(physicalImages),
+          blocks = std::move(memoryBlocks)]() {
+    for (const auto &image : images) {
+      vkDestroyImageView(device, image.view, nullptr);
+      vkDestroyImage(device, image.image, nullptr);
+    }
+    for (const auto &block : blocks) {
+      vkFreeMemory(device, block.memory, nullptr);
+    }
+  });
+  physicalImages.clear();
+  memoryBlocks.clear();
+  transientSignature.clear();
+}
+
+void VseRenderGraph::invalidateFramebuffers() {
+  if (framebuffers.empty()) {
+    return;
+  }
+  VkDevice device = vseDevice.device();
+  std::vector<VkFramebuffer> retired{};
+  for (auto &kv : framebuffers) {
+    retired.push_back(kv.second);
+  }
+  framebuffers.clear();
+  retire([device, retired]() {
+    for (auto framebuffer : retired) {
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    }
+  });
+}
+
+void VseRenderGraph::execute(VkCommandBuffer commandBuffer) {
+  assert(!executing && "Render graph is already executing");
+  stats.barriers = 0;
+
+  auto order = cullPasses();
+  computeLifetimes(order);
+  allocateTransients();
+
+  states.assign(resources.size(), ImageState{});
+  for (ResourceId id = 0; id < resources.size(); id++) {
+    const Resource &resource = resources[id];
+    if (resource.imported) {
+      states[id].layout = resource.import.initialLayout;
+      states[id].writeStages = resource.import.availableStage;
+    }
+  }
+
+  executing = true;
+  for (uint32_t k = 0; k < order.size(); k++) {
+    const Pass &pass = passes[order[k]];
+    for (const auto &use : pass.uses) {
+      Resource &resource = resources[use.resource];
+      if (!resource.imported && resource.firstUse == k) {
+        // Wait for whatever used the memory last, possibly an aliased
+        // image or the previous frame
+        const auto &block =
+            memoryBlocks[physicalImages[resource.physical].block];
+        states[use.resource] = block.lastUse;
+        states[use.resource].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+      }
+    }
+
+    // Attachments whose contents must survive the pass
+    std::vector<bool> store(pass.uses.size(), false);
+    for (size_t u = 0; u < pass.uses.size(); u++) {
+      ResourceId id = pass.uses[u].resource;
+      store[u] = resources[id].imported;
+      for (uint32_t next = k + 1; next <= resources[id].lastUse; next++) {
+        const auto *later = findUse(passes[order[next]], id);
+        if (later != nullptr) {
+          store[u] = store[u] || later->usage == Usage::Sampled ||
+                     !later->clear;
+          break;
+        }
+      }
+    }
+    recordPass(commandBuffer, pass, store);
+
+    for (const auto &use : pass.uses) {
+      const Resource &resource = resources[use.resource];
+      if (!resource.imported) {
+        memoryBlocks[physicalImages[resource.physical].block].lastUse =
+            states[use.resource];
+      }
+    }
+  }
+
+  // Hand imported images back in the layout their owner expects
+  std::vector<VkImageMemoryBarrier> barriers{};
+  VkPipelineStageFlags srcStages = 0;
+  for (ResourceId id = 0; id < resources.size(); id++) {
+    const Resource &resource = resources[id];
+    const ImageState &state = states[id];
+    if (!resource.imported || resource.firstUse == UINT32_MAX ||
+        state.layout == resource.import.finalLayout) {
+      continue;
+    }
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = state.writeAccess;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = state.layout;
+    barrier.newLayout = resource.import.finalLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = resource.import.image;
+    barrier.subresourceRange = {formatAspectMask(resource.desc.format), 0, 1,
+                                0, 1};
+    barriers.push_back(barrier);
+    srcStages |= state.writeStages | state.readStages;
+  }
+  if (!barriers.empty()) {
+    vkCmdPipelineBarrier(commandBuffer, srcStages,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                         0, nullptr, static_cast<uint32_t>(barriers.size()),
+                         barriers.data());
+    stats.barriers += static_cast<uint32_t>(barriers.size());
+  }
+  executing = false;
+}
+
+void VseRenderGraph::recordPass(VkCommandBuffer commandBuffer,
+                                const Pass &pass,
+                                const std::vector<bool> &store) {
+  std::vector<VkImageMemoryBarrier> barriers{};
+  VkPipelineStageFlags srcStages = 0;
+  VkPipelineStageFlags dstStages = 0;
+
+  std::vector<Attachment> attachments{};
+  ResourceId depthResource = INVALID_RESOURCE;
+  for (size_t u = 0; u < pass.uses.size(); u++) {
+    const auto &use = pass.uses[u];
+    const Resource &resource = resources[use.resource];
+    if (use.usage == Usage::Sampled || use.usage == Usage::Resolve) {
+      continue;
+    }
+
+    Attachment attachment{};
+    attachment.resource = use.resource;
+    attachment.depth = use.usage == Usage::DepthWrite;
+    // Contents are only worth loading if something wrote them before
+    if (use.clear) {
+      attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    } else if (states[use.resource].layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+      attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    } else {
+      attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    }
+    attachment.storeOp = store[u] ? VK_ATTACHMENT_STORE_OP_STORE
+                                  : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.format = resource.desc.format;
+    attachment.samples = resource.desc.samples;
+    attachment.clearValue = use.clearValue;
+
+    if (attachment.depth) {
+      assert(depthResource == INVALID_RESOURCE &&
+             "A pass can write at most one depth attachment");
+      depthResource = use.resource;
+    }
+    attachments.push_back(attachment);
+  }
+
+  for (size_t u = 0; u < pass.uses.size(); u++) {
+    const auto &use = pass.uses[u];
+    if (use.usage != Usage::Resolve) {
+      continue;
+    }
+    auto source = std::find_if(
+        attachments.begin(), attachments.end(),
+        [&](const Attachment &attachment) {
+          return attachment.resource == use.resolveSource && !attachment.depth;
+        });
+    if (source == attachments.end() || source->resolve) {
+      throw std::runtime_error("render graph pass " + pass.name +
+                               " resolves an image it does not draw to!");
+    }
+    source->resolve = true;
+    source->resolveTarget = use.resource;
+    source->resolveStoreOp = store[u] ? VK_ATTACHMENT_STORE_OP_STORE
+                                      : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  }
+
+  // Color attachments come first, matching the swap chain render pass
+  std::stable_partition(
+      attachments.begin(), attachments.end(),
+      [](const Attachment &attachment) { return !attachment.depth; });
+  std::vector<VkClearValue> clearValues{};
+  for (const auto &attachment : attachments) {
+    clearValues.push_back(attachment.clearValue);
+  }
+
+  for (const auto &use : pass.uses) {
+    transition(use, barriers, srcStages, dstStages);
+  }
+  if (!barriers.empty()) {
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0,
+                         nullptr, static_cast<uint32_t>(barriers.size()),
+                         barriers.data());
+    stats.barriers += static_cast<uint32_t>(barriers.size());
+  }
+
+  if (attachments.empty()) {
+    pass.execute(commandBuffer);
+    return;
+  }
+
+  VkExtent2D extent = resources[attachments[0].resource].desc.extent;
+  for (const auto &use : pass.uses) {
+    if (use.usage == Usage::Sampled) {
+      continue;
+    }
+    const auto &other = resources[use.resource].desc.extent;
+    if (other.width != extent.width || other.height != extent.height) {
+      throw std::runtime_error("render graph pass " + pass.name +
+                               " has attachments of different sizes!");
+    }
+  }
+
+  if (dynamicRendering) {
+    beginRendering(commandBuffer, attachments, extent);
+  } else {
+    VkRenderPass renderPass = getRenderPass(attachments);
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer =
+        getFramebuffer(attachments, renderPass, extent);
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = extent;
+    renderPassInfo.clearValueCount =
+        static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+  }
+
+  VkViewport viewport{};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = static_cast<float>(extent.width);
+  viewport.height = static_cast<float>(extent.height);
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  VkRect2D scissor{{0, 0}, extent};
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  pass.execute(commandBuffer);
+  if (dynamicRendering) {
+    vseDevice.cmdEndRendering(commandBuffer);
+  } else {
+    vkCmdEndRenderPass(commandBuffer);
+  }
+}
+
+void VseRenderGraph::beginRendering(
+    VkCommandBuffer commandBuffer, const std::vector<Attachment> &attachments,
+    VkExtent2D extent) {
+  std::vector<VkRenderingAttachmentInfoKHR> colorInfos{};
+  VkRenderingAttachmentInfoKHR depthInfo{};
+  bool hasDepth = false;
+  bool hasStencil = false;
+  for (const auto &attachment : attachments) {
+    VkRenderingAttachmentInfoKHR info{};
+    info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    info.imageView = getImageView(attachment.resource);
+    info.imageLayout = attachment.depth
+                           ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                           : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    info.loadOp = attachment.loadOp;
+    info.storeOp = attachment.storeOp;
+    info.clearValue = attachment.clearValue;
+    if (attachment.resolve) {
+      info.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT_KHR;
+      info.resolveImageView = getImageView(attachment.resolveTarget);
+      info.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+    if (attachment.depth) {
+      depthInfo = info;
+      hasDepth = true;
+      hasStencil = hasStencilComponent(attachment.format);
+    } else {
+      colorInfos.push_back(info);
+    }
+  }
+
+  VkRenderingInfoKHR renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+  renderingInfo.renderArea = {{0, 0}, extent};
+  renderingInfo.layerCount = 1;
+  renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorInfos.size());
+  renderingInfo.pColorAttachments = colorInfos.data();
+  renderingInfo.pDepthAttachment = hasDepth ? &depthInfo : nullptr;
+  renderingInfo.pStencilAttachment = hasStencil ? &depthInfo : nullptr;
+  vseDevice.cmdBeginRendering(commandBuffer, renderingInfo);
+}
+
+void VseRenderGraph::transition(const ResourceUse &use,
+                                std::vector<VkImageMemoryBarrier> &barriers,
+                                VkPipelineStageFlags &srcStages,
+                                VkPipelineStageFlags &dstStages) {
+  const Resource &resource = resources[use.resource];
+  ImageState &state = states[use.resource];
+
+  VkImageLayout layout;
+  VkAccessFlags access;
+  bool write = use.usage != Usage::Sampled;
+  switch (use.usage) {
+    case Usage::ColorWrite:
+    case Usage::Resolve:
+      layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+      access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+               (use.clear ? 0 : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT);
+      break;
+    case Usage::DepthWrite:
+      layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+      access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+      break;
+    default:
+      layout = isDepthFormat(resource.desc.format)
+                   ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                   : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      access = VK_ACCESS_SHADER_READ_BIT;
+      break;
+  }
+
+  bool layoutChange = state.layout != layout;
+  // Reads of the same layout only need a barrier if the last write has not
+  // been made visible to these stages yet
+  bool visible = state.writeAccess == 0 ||
+                 (state.readStages & use.stages) == use.stages;
+  if (!write && !layoutChange && visible) {
+    state.readStages |= use.stages;
+    return;
+  }
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = state.writeAccess;
+  barrier.dstAccessMask = access;
+  // Cleared attachments don't need their old contents transitioned
+  barrier.oldLayout = use.clear ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+  barrier.newLayout = layout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = resource.imported
+                      ? resource.import.image
+                      : physicalImages[resource.physical].image;
+  barrier.subresourceRange = {formatAspectMask(resource.desc.format), 0, 1, 0,
+                              1};
+  barriers.push_back(barrier);
+
+  // Writes and layout transitions must also wait for earlier reads
+  srcStages |= state.writeStages;
+  if (write || layoutChange) {
+    srcStages |= state.readStages;
+  }
+  dstStages |= use.stages;
+
+  if (write) {
+    state.writeStages = use.stages;
+    state.writeAccess = access & ~(VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT);
+    state.readStages = 0;
+  } else {
+    state.readStages =
+        layoutChange ? use.stages : state.readStages | use.stages;
+  }
+  state.layout = layout;
+}
+
+VkRenderPass VseRenderGraph::getRenderPass(
+    const std::vector<Attachment> &attachments) {
+  std::vector<uint64_t> key{};
+  for (const auto &attachment : attachments) {
+    key.insert(key.end(), {static_cast<uint64_t>(attachment.format),
+                           static_cast<uint64_t>(attachment.samples),
+                           static_cast<uint64_t>(attachment.loadOp),
+                           static_cast<uint64_t>(attachment.storeOp),
+                           static_cast<uint64_t>(attachment.depth),
+                           static_cast<uint64_t>(attachment.resolve),
+                           static_cast<uint64_t>(attachment.resolveStoreOp)});
+  }
+  auto it = renderPasses.find(key);
+  if (it != renderPasses.end()) {
+    return it->second;
+  }
+
+  // Barriers recorded before the pass perform every layout transition, so
+  // attachments stay in their attachment layout throughout
+  std::vector<VkAttachmentDescription> descriptions{};
+  std::vector<VkAttachmentReference> colorRefs{};
+  std::vector<VkAttachmentReference> resolveRefs{};
+  VkAttachmentReference depthRef{};
+  bool hasDepth = false;
+  bool hasResolve = false;
+  for (uint32_t i = 0; i < attachments.size(); i++) {
+    const auto &attachment = attachments[i];
+    VkImageLayout layout =
+        attachment.depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                         : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    bool stencil = attachment.depth && hasStencilComponent(attachment.format);
+
+    VkAttachmentDescription description{};
+    description.format = attachment.format;
+    description.samples = attachment.samples;
+    description.loadOp = attachment.loadOp;
+    description.storeOp = attachment.storeOp;
+    description.stencilLoadOp =
+        stencil ? attachment.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    description.stencilStoreOp =
+        stencil ? attachment.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    description.initialLayout = layout;
+    description.finalLayout = layout;
+    descriptions.push_back(description);
+
+    if (attachment.depth) {
+      depthRef = {i, layout};
+      hasDepth = true;
+    } else {
+      colorRefs.push_back({i, layout});
+    }
+  }
+
+  // Resolve targets follow the attachments, in color attachment order
+  for (const auto &attachment : attachments) {
+    if (attachment.depth) {
+      continue;
+    }
+    if (!attachment.resolve) {
+      resolveRefs.push_back(
+          {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+      continue;
+    }
+    VkAttachmentDescription description{};
+    description.format = attachment.format;
+    description.samples = VK_SAMPLE_COUNT_1_BIT;
+    description.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    description.storeOp = attachment.resolveStoreOp;
+    description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    description.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    description.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    resolveRefs.push_back({static_cast<uint32_t>(descriptions.size()),
+                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+    descriptions.push_back(description);
+    hasResolve = true;
+  }
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+  subpass.pColorAttachments = colorRefs.data();
+  subpass.pResolveAttachments = hasResolve ? resolveRefs.data() : nullptr;
+  subpass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+  renderPassInfo.pAttachments = descriptions.data();
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+
+  VkRenderPass renderPass;
+  if (vkCreateRenderPass(vseDevice.device(), &renderPassInfo, nullptr,
+                         &renderPass) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create render graph render pass!");
+  }
+  renderPasses.emplace(std::move(key), renderPass);
+  return renderPass;
+}
+
+VkFramebuffer VseRenderGraph::getFramebuffer(
+    const std::vector<Attachment> &attachments, VkRenderPass renderPass,
+    VkExtent2D extent) {
+  std::vector<VkImageView> views{};
+  std::vector<uint64_t> key{handleBits(renderPass), extent.width,
+                            extent.height};
+  for (const auto &attachment : attachments) {
+    views.push_back(getImageView(attachment.resource));
+    key.push_back(handleBits(views.back()));
+  }
+  for (const auto &attachment : attachments) {
+    if (attachment.resolve) {
+      views.push_back(getImageView(attachment.resolveTarget));
+      key.push_back(handleBits(views.back()));
+    }
+  }
+  auto it = framebuffers.find(key);
+  if (it != framebuffers.end()) {
+    return it->second;
+  }
+
+  VkFramebufferCreateInfo framebufferInfo{};
+  framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebufferInfo.renderPass = renderPass;
+  framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+  framebufferInfo.pAttachments = views.data();
+  framebufferInfo.width = extent.width;
+  framebufferInfo.height = extent.height;
+  framebufferInfo.layers = 1;
+
+  VkFramebuffer framebuffer;
+  if (vkCreateFramebuffer(vseDevice.device(), &framebufferInfo, nullptr,
+                          &framebuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create render graph framebuffer!");
+  }
+  framebuffers.emplace(std::move(key), framebuffer);
+  return framebuffer;
+}
+
+VkRenderPass VseRenderGraph::getCompatibleRenderPass(
+    const std::vector<VkFormat> &colorFormats, VkFormat depthFormat,
+    VkSampleCountFlagBits samples) {
+  assert(!dynamicRendering && "Dynamic rendering uses no render passes");
+  // Load and store ops don't affect compatibility
+  std::vector<Attachment> attachments{};
+  for (VkFormat format : colorFormats) {
+    Attachment attachment{};
+    attachment.format = format;
+    attachment.samples = samples;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.depth = false;
+    attachment.resolve = samples != VK_SAMPLE_COUNT_1_BIT;
+    attachment.resolveStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments.push_back(attachment);
+  }
+  if (depthFormat != VK_FORMAT_UNDEFINED) {
+    Attachment attachment{};
+    attachment.format = depthFormat;
+    attachment.samples = samples;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.depth = true;
+    attachments.push_back(attachment);
+  }
+  return getRenderPass(attachments);
+}
+
+const VseRenderGraph::ResourceUse *VseRenderGraph::findUse(
+    const Pass &pass, ResourceId resource) {
+  for (const auto &use : pass.uses) {
+    if (use.resource == resource) {
+      return &use;
+    }
+  }
+  return nullptr;
+}
+
+VkImageView VseRenderGraph::getImageView(ResourceId resource) const {
+  assert(executing && "Render graph image views exist only while executing");
+  assert(resource < resources.size() && "Unknown render graph resource");
+  const Resource &entry = resources[resource];
+  if (entry.imported) {
+    return entry.import.view;
+  }
+  assert(entry.physical != UINT32_MAX && "Resource is not used by any pass");
+  return physicalImages[entry.physical].view;
+}
+
+}  // namespace vse
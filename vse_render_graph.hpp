@@ -0,0 +1,235 @@
+#pragma once
+
+#include "vse_deletion_queue.hpp"
+#include "vse_device.hpp"
+
+// std
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace vse {
+
+// Describes one frame as a list of passes and the images they read and
+// write. The graph is rebuilt every frame; compiling it culls passes whose
+// output nothing uses, inserts the barriers and layout transitions between
+// passes and places transient images whose lifetimes don't overlap in the
+// same memory. Physical images, render passes and framebuffers are cached
+// and only recreated when the frame's shape changes. With dynamic rendering
+// passes begin rendering directly and no render passes or framebuffers
+// exist at all.
+class VseRenderGraph {
+ public:
+  using ResourceId = uint32_t;
+  static constexpr ResourceId INVALID_RESOURCE = UINT32_MAX;
+
+  struct ImageDesc {
+    VkFormat format;
+    VkExtent2D extent;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+  };
+
+  // An image owned outside the graph, e.g. the acquired swap chain image
+  struct ImportedImage {
+    VkImage image;
+    VkImageView view;
+    ImageDesc desc;
+    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // The graph leaves the image in this layout after its last use
+    VkImageLayout finalLayout;
+    // Stage the image becomes available at, e.g. the stage that waits on
+    // the acquire semaphore
+    VkPipelineStageFlags availableStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  };
+
+  class PassBuilder {
+   public:
+    // Draws into the attachment on top of its current contents
+    PassBuilder &writeColor(ResourceId resource);
+    PassBuilder &clearColor(ResourceId resource, VkClearColorValue value);
+    PassBuilder &writeDepth(ResourceId resource);
+    PassBuilder &clearDepth(ResourceId resource,
+                            VkClearDepthStencilValue value);
+    // Averages the multisampled color attachment source, written by this
+    // pass, into destination when the pass ends
+    PassBuilder &resolveColor(ResourceId source, ResourceId destination);
+    // Sampled by shaders in the given stages
+    PassBuilder &readTexture(
+        ResourceId resource,
+        VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    // Keeps the pass even when nothing reads its output
+    PassBuilder &setSideEffects();
+
+   private:
+    friend class VseRenderGraph;
+    PassBuilder(VseRenderGraph &graph, uint32_t passIndex)
+        : graph{graph}, passIndex{passIndex} {}
+
+    VseRenderGraph &graph;
+    uint32_t passIndex;
+  };
+
+  using SetupFunction = std::function<void(PassBuilder &)>;
+  using ExecuteFunction = std::function<void(VkCommandBuffer)>;
+
+  struct Stats {
+    uint32_t passCount;
+    uint32_t culledPasses;
+    uint32_t barriers;
+    uint32_t transientImages;
+    uint32_t memoryBlocks;
+    // Memory the transient images would need without aliasing
+    VkDeviceSize transientBytes;
+    VkDeviceSize allocatedBytes;
+  };
+
+  VseRenderGraph(VseDevice &device, RetireFunction retire,
+                 bool dynamicRendering = false);
+  ~VseRenderGraph();
+
+  VseRenderGraph(const VseRenderGraph &) = delete;
+  VseRenderGraph &operator=(const VseRenderGraph &) = delete;
+
+  // Starts describing a new frame
+  void reset();
+
+  ResourceId createImage(const std::string &name, const ImageDesc &desc);
+  ResourceId importImage(const std::string &name, const ImportedImage &image);
+  void addPass(const std::string &name, const SetupFunction &setup,
+               ExecuteFunction execute);
+
+  // Compiles the graph and records every pass that survives culling
+  void execute(VkCommandBuffer commandBuffer);
+
+  // Only valid while the graph is executing
+  VkImageView getImageView(ResourceId resource) const;
+
+  // Imported views are about to be destroyed, drop framebuffers using them
+  void invalidateFramebuffers();
+
+  // A render pass compatible with the ones recorded for passes with these
+  // attachments, to create pipelines against when dynamic rendering is off.
+  // Multisampled color attachments are expected to be resolved.
+  VkRenderPass getCompatibleRenderPass(
+      const std::vector<VkFormat> &colorFormats, VkFormat depthFormat,
+      VkSampleCountFlagBits samples);
+
+  const Stats &getStats() const { return stats; }
+
+ private:
+  enum class Usage { ColorWrite, DepthWrite, Resolve, Sampled };
+
+  struct ResourceUse {
+    ResourceId resource;
+    Usage usage;
+    VkPipelineStageFlags stages;
+    // Set for resolves too, which overwrite the whole image
+    bool clear = false;
+    VkClearValue clearValue{};
+    // The multisampled attachment a resolve reads
+    ResourceId resolveSource = INVALID_RESOURCE;
+  };
+
+  struct Pass {
+    std::string name;
+    ExecuteFunction execute;
+    std::vector<ResourceUse> uses;
+    bool sideEffects = false;
+  };
+
+  struct Resource {
+    std::string name;
+    ImageDesc desc;
+    bool imported = false;
+    ImportedImage import{};
+    VkImageUsageFlags usage = 0;
+    // Index into physicalImages for transient images
+    uint32_t physical = UINT32_MAX;
+    uint32_t firstUse = UINT32_MAX;
+    uint32_t lastUse = 0;
+  };
+
+  struct Attachment {
+    ResourceId resource;
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    VkAttachmentLoadOp loadOp;
+    VkAttachmentStoreOp storeOp;
+    VkClearValue clearValue;
+    bool depth;
+    // Single sampled image the attachment resolves into at the end
+    bool resolve = false;
+    ResourceId resolveTarget = INVALID_RESOURCE;
+    VkAttachmentStoreOp resolveStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  };
+
+  // Synchronization state of an image while recording
+  struct ImageState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Stages and access of the last write, still pending if access is set
+    VkPipelineStageFlags writeStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags writeAccess = 0;
+    // Stages that read the image since the last write
+    VkPipelineStageFlags readStages = 0;
+  };
+
+  struct PhysicalImage {
+    ImageDesc desc;
+    VkImageUsageFlags usage;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    uint32_t block;
+  };
+
+  struct MemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    // Last use of any image in the block, the next image to take over the
+    // memory waits for it, including across frames
+    ImageState lastUse{};
+  };
+
+  std::vector<uint32_t> cullPasses();
+  void computeLifetimes(const std::vector<uint32_t> &order);
+  void allocateTransients();
+  void destroyTransients();
+
+  void recordPass(VkCommandBuffer commandBuffer, const Pass &pass,
+                  const std::vector<bool> &store);
+  void transition(const ResourceUse &use,
+                  std::vector<VkImageMemoryBarrier> &barriers,
+                  VkPipelineStageFlags &srcStages,
+                  VkPipelineStageFlags &dstStages);
+  void beginRendering(VkCommandBuffer commandBuffer,
+                      const std::vector<Attachment> &attachments,
+                      VkExtent2D extent);
+  VkRenderPass getRenderPass(const std::vector<Attachment> &attachments);
+  VkFramebuffer getFramebuffer(const std::vector<Attachment> &attachments,
+                               VkRenderPass renderPass, VkExtent2D extent);
+
+  static const ResourceUse *findUse(const Pass &pass, ResourceId resource);
+
+  VseDevice &vseDevice;
+  RetireFunction retire;
+  bool dynamicRendering;
+
+  std::vector<Pass> passes;
+  std::vector<Resource> resources;
+  std::vector<ImageState> states;
+  bool executing = false;
+
+  // Transient images survive between frames while the graph keeps the
+  // same shape, identified by this signature
+  std::vector<uint64_t> transientSignature;
+  std::vector<PhysicalImage> physicalImages;
+  std::vector<MemoryBlock> memoryBlocks;
+
+  std::map<std::vector<uint64_t>, VkRenderPass> renderPasses;
+  std::map<std::vector<uint64_t>, VkFramebuffer> framebuffers;
+
+  Stats stats{};
+};
+
+}  // namespace vse
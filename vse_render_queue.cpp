@@ -0,0 +1,162 @@
+#include "vse_render_queue.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+
+namespace vse {
+
+namespace {
+
+constexpr uint64_t PASS_BITS = 4;
+constexpr uint64_t PIPELINE_BITS = 12;
+constexpr uint64_t MATERIAL_BITS = 16;
+constexpr uint64_t MESH_BITS = 16;
+constexpr uint64_t DEPTH_BITS = 16;
+static_assert(PASS_BITS + PIPELINE_BITS + MATERIAL_BITS + MESH_BITS +
+                      DEPTH_BITS ==
+                  64,
+              "sort key fields must fill 64 bits");
+
+constexpr uint64_t MESH_SHIFT = DEPTH_BITS;
+constexpr uint64_t MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+constexpr uint64_t PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+constexpr uint64_t PASS_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+
+// Depth order keeps the high bits of the depth above the state fields
+constexpr uint64_t DEPTH_LOW_BITS = 8;
+constexpr uint64_t DEPTH_HIGH_SHIFT =
+    PASS_SHIFT - (DEPTH_BITS - DEPTH_LOW_BITS);
+
+constexpr uint64_t mask(uint64_t bits) { return (uint64_t{1} << bits) - 1; }
+
+}  // namespace
+
+uint64_t VseRenderQueue::makeKey(DrawPass pass, uint32_t pipeline,
+                                 uint32_t material, uint32_t mesh,
+                                 uint32_t depth, DrawOrder order) {
+  uint64_t depthField = depth & mask(DEPTH_BITS);
+  if (pass == DrawPass::Transparent) {
+    depthField = mask(DEPTH_BITS) - depthField;
+  }
+  uint64_t state = ((pipeline & mask(PIPELINE_BITS)) << PIPELINE_SHIFT) |
+                   ((material & mask(MATERIAL_BITS)) << MATERIAL_SHIFT) |
+                   ((mesh & mask(MESH_BITS)) << MESH_SHIFT);
+  if (order == DrawOrder::Depth) {
+    // The state fields move down to make room for the coarse depth
+    state = (state >> DEPTH_LOW_BITS) |
+            ((depthField >> DEPTH_LOW_BITS) << DEPTH_HIGH_SHIFT);
+    depthField &= mask(DEPTH_LOW_BITS);
+  }
+  return ((static_cast<uint64_t>(pass) & mask(PASS_BITS)) << PASS_SHIFT) |
+         state | depthField;
+}
+
+uint32_t VseRenderQueue::depthBucket(float viewDepth, float near, float far) {
+  assert(far > near && "Depth range must not be empty");
+  float t = std::clamp((viewDepth - near) / (far - near), 0.f, 1.f);
+  return static_cast<uint32_t>(t * static_cast<float>(mask(DEPTH_BITS)));
+}
+
+void VseRenderQueue::clear() {
+  draws.clear();
+  stats = Stats{};
+}
+
+void VseRenderQueue::push(uint64_t key, uint32_t index) {
+  draws.push_back({key, index});
+}
+
+void VseRenderQueue::sort() {
+  stats.drawCount = static_cast<uint32_t>(draws.size());
+  if (draws.size() < 2) {
+    return;
+  }
+
+  // Histogram every byte in one pass over the keys
+  std::array<std::array<uint32_t, 256>, 8> counts{};
+  for (const auto &draw : draws) {
+    for (size_t byte = 0; byte < 8; byte++) {
+      counts[byte][(draw.key >> (byte * 8)) & 0xff]++;
+    }
+  }
+
+  sortScratch.resize(draws.size());
+  for (size_t byte = 0; byte < 8; byte++) {
+    auto &count = counts[byte];
+    // A byte that is equal in every key would leave the order unchanged
+    if (count[(draws[0].key >> (byte * 8)) & 0xff] == draws.size()) {
+      continue;
+    }
+
+    uint32_t offset = 0;
+    for (auto &bucket : count) {
+      uint32_t bucketSize = bucket;
+      bucket = offset;
+      offset += bucketSize;
+    }
+    for (const auto &draw : draws) {
+      sortScratch[count[(draw.key >> (byte * 8)) & 0xff]++] = draw;
+    }
+    draws.swap(sortScratch);
+  }
+}
+
+void VseRenderQueue::beginSubmit(VkCommandBuffer commandBuffer) {
+  this->commandBuffer = commandBuffer;
+  boundPipeline = nullptr;
+  boundLayout = VK_NULL_HANDLE;
+  boundSets.fill(VK_NULL_HANDLE);
+  boundModel = nullptr;
+}
+
+void VseRenderQueue::bindPipeline(VsePipeline &pipeline) {
+  assert(commandBuffer != VK_NULL_HANDLE && "Call beginSubmit before binding");
+  if (boundPipeline == &pipeline) {
+    stats.pipelineBindsSkipped++;
+    return;
+  }
+  pipeline.bind(commandBuffer);
+  boundPipeline = &pipeline;
+  stats.pipelineBinds++;
+}
+
+void VseRenderQueue::bindDescriptorSets(VkPipelineLayout layout,
+                                        uint32_t firstSet, uint32_t setCount,
+                                        const VkDescriptorSet *sets) {
+  assert(commandBuffer != VK_NULL_HANDLE && "Call beginSubmit before binding");
+  if (layout != boundLayout) {
+    // Conservatively treat sets bound with another layout as disturbed
+    boundSets.fill(VK_NULL_HANDLE);
+    boundLayout = layout;
+  }
+
+  bool redundant = firstSet + setCount <= MAX_TRACKED_SETS;
+  for (uint32_t i = 0; redundant && i < setCount; i++) {
+    redundant = boundSets[firstSet + i] == sets[i];
+  }
+  if (redundant) {
+    stats.descriptorBindsSkipped++;
+    return;
+  }
+
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          layout, firstSet, setCount, sets, 0, nullptr);
+  for (uint32_t i = 0; i < setCount && firstSet + i < MAX_TRACKED_SETS; i++) {
+    boundSets[firstSet + i] = sets[i];
+  }
+  stats.descriptorBinds++;
+}
+
+void VseRenderQueue::bindModel(VseModel &model) {
+  assert(commandBuffer != VK_NULL_HANDLE && "Call beginSubmit before binding");
+  if (boundModel == &model) {
+    stats.vertexBufferBindsSkipped++;
+    return;
+  }
+  model.bind(commandBuffer);
+  boundModel = &model;
+  stats.vertexBufferBinds++;
+}
+
+}  // namespace vse
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "vse_model.hpp"
+#include "vse_pipeline.hpp"
+
+// std
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace vse {
+
+enum class DrawPass : uint32_t { Opaque = 0, Transparent = 1 };
+
+// What draws within a pass are sorted by first
+enum class DrawOrder {
+  // Fewest state changes, depth only orders draws sharing all state
+  State,
+  // Depth first, so nearer surfaces reject the fragments they hide before
+  // those are shaded. State still groups draws in the same depth bucket.
+  Depth
+};
+
+// Collects draws as 64-bit sort keys, sorts them so draws sharing state are
+// adjacent and filters out binds that would not change any state.
+//
+// Key layout, most significant first:
+//   pass (4) | pipeline (12) | material (16) | mesh (16) | depth (16)
+// or in depth order, with the depth split in two:
+//   pass (4) | depth high (8) | pipeline (12) | material (16) | mesh (16) |
+//   depth low (8)
+// Fields wider than their slot are truncated, which only weakens grouping.
+class VseRenderQueue {
+ public:
+  static constexpr uint32_t MAX_TRACKED_SETS = 4;
+
+  struct Draw {
+    uint64_t key;
+    // Index into the caller's object list
+    uint32_t index;
+  };
+
+  struct Stats {
+    uint32_t drawCount;
+    uint32_t pipelineBinds;
+    uint32_t pipelineBindsSkipped;
+    uint32_t descriptorBinds;
+    uint32_t descriptorBindsSkipped;
+    uint32_t vertexBufferBinds;
+    uint32_t vertexBufferBindsSkipped;
+  };
+
+  VseRenderQueue() = default;
+
+  VseRenderQueue(const VseRenderQueue &) = delete;
+  VseRenderQueue &operator=(const VseRenderQueue &) = delete;
+
+  // Opaque draws sort front to back, transparent ones back to front
+  static uint64_t makeKey(DrawPass pass, uint32_t pipeline, uint32_t material,
+                          uint32_t mesh, uint32_t depth,
+                          DrawOrder order = DrawOrder::State);
+  // Quantizes a view space depth to the key's 16 bit depth field
+  static uint32_t depthBucket(float viewDepth, float near, float far);
+
+  // Starts a new frame, dropping the previous draws and counters
+  void clear();
+  void push(uint64_t key, uint32_t index);
+  // LSD radix sort on the keys, stable for equal keys
+  void sort();
+  const std::vector<Draw> &getDraws() const { return draws; }
+
+  // Forgets bound state, command buffers start with nothing bound
+  void beginSubmit(VkCommandBuffer commandBuffer);
+  void bindPipeline(VsePipeline &pipeline);
+  void bindDescriptorSets(VkPipelineLayout layout, uint32_t firstSet,
+                          uint32_t setCount, const VkDescriptorSet *sets);
+  void bindModel(VseModel &model);
+
+  const Stats &getStats() const { return stats; }
+
+ private:
+  std::vector<Draw> draws;
+  std::vector<Draw> sortScratch;
+
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  VsePipeline *boundPipeline = nullptr;
+  VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+  std::array<VkDescriptorSet, MAX_TRACKED_SETS> boundSets{};
+  VseModel *boundModel = nullptr;
+
+  Stats stats{};
+};
+
+}  // namespace vse
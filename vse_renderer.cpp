@@ -1,18 +1,32 @@
 #include "vse_renderer.hpp"
 
 // std
-#include <array>
 #include <stdexcept>
 
 namespace vse {
 
-VseRenderer::VseRenderer(VseWindow &window, VseDevice &device)
-    : vseWindow{window}, vseDevice{device} {
+VseRenderer::VseRenderer(VseWindow &window, VseDevice &device,
+                         bool dynamicRendering, VkPresentModeKHR presentMode)
+    : vseWindow{window},
+      vseDevice{device},
+      renderGraph{device,
+                  [this](std::function<void()> deleter) {
+                    retire(std::move(deleter));
+                  },
+                  dynamicRendering && device.hasDynamicRendering()},
+      dynamicRendering{dynamicRendering && device.hasDynamicRendering()},
+      presentMode{presentMode} {
   recreateSwapChain();
   createCommandBuffers();
+  createFrameDescriptorAllocators();
 }
 
-VseRenderer::~VseRenderer() { freeCommandBuffers(); }
+VseRenderer::~VseRenderer() {
+  // The last frames' command buffers may still be executing
+  vkDeviceWaitIdle(vseDevice.device());
+  freeCommandBuffers();
+  deletionQueue.flushAll();
+}
 
 void VseRenderer::recreateSwapChain() {
   auto extent = vseWindow.getExtent();
@@ -20,18 +34,64 @@ void VseRenderer::recreateSwapChain() {
     extent = vseWindow.getExtent();
     glfwWaitEvents();
   }
-  vseSwapChain = nullptr;
-  vkDeviceWaitIdle(vseDevice.device());
+  presentModeChanged = false;
+  // Present ids belong to the old swap chain
+  framePacer.discardPending();
   if (vseSwapChain == nullptr) {
-    vseSwapChain = std::make_unique<VseSwapChain>(vseDevice, extent);
+    vseSwapChain = std::make_unique<VseSwapChain>(
+        vseDevice, extent, presentMode);
   } else {
     std::shared_ptr<VseSwapChain> oldSwapChain = std::move(vseSwapChain);
-    vseSwapChain =
-        std::make_unique<VseSwapChain>(vseDevice, extent, oldSwapChain);
+    vseSwapChain = std::make_unique<VseSwapChain>(
+        vseDevice, extent, oldSwapChain, presentMode);
 
     if (!oldSwapChain->compareSwapChainFormats(*vseSwapChain.get())) {
       throw std::runtime_error("Swap chain image(or depth) format has changed");
     }
+
+    // Frames still in flight may use the old images, views and framebuffers,
+    // so they are destroyed once those frames finish instead of waiting for
+    // the device to go idle
+    renderGraph.invalidateFramebuffers();
+    retire([oldSwapChain]() mutable { oldSwapChain.reset(); });
+  }
+}
+
+void VseRenderer::setPresentMode(VkPresentModeKHR mode) {
+  if (mode != presentMode) {
+    presentMode = mode;
+    presentModeChanged = true;
+  }
+}
+
+void VseRenderer::waitForNextFrame() {
+  assert(!isFrameStarted && "Can't wait for the next frame during a frame");
+  if (lowLatency && vseDevice.hasPresentWait() &&
+      framePacer.hasPendingFrames()) {
+    uint64_t presentId = framePacer.getNewestPendingFrame();
+    if (vseSwapChain->waitForPresent(presentId, PRESENT_WAIT_TIMEOUT) ==
+        VK_SUCCESS) {
+      framePacer.markPresented(presentId, VseFramePacer::Clock::now());
+    }
+  }
+  framePacer.waitForNextFrame();
+}
+
+void VseRenderer::collectPresentTimes() {
+  auto now = VseFramePacer::Clock::now();
+  if (vseDevice.hasPresentWait()) {
+    // Polled without blocking, so the time is an upper bound that is at
+    // most a frame late; low latency mode observes presents exactly
+    while (framePacer.hasPendingFrames() &&
+           vseSwapChain->waitForPresent(framePacer.getOldestPendingFrame(),
+                                        0) == VK_SUCCESS) {
+      framePacer.markPresented(framePacer.getOldestPendingFrame(), now);
+    }
+  } else if (frameCount >= VseSwapChain::MAX_FRAMES_IN_FLIGHT) {
+    // Without present ids the GPU finishing the frame, seen when its fence
+    // was waited on in acquireNextImage, stands in for presentation
+    framePacer.markPresented(frameCount - VseSwapChain::MAX_FRAMES_IN_FLIGHT,
+                             now);
   }
 }
 
@@ -50,6 +110,13 @@ void VseRenderer::createCommandBuffers() {
   }
 }
 
+void VseRenderer::createFrameDescriptorAllocators() {
+  frameDescriptorAllocators.resize(VseSwapChain::MAX_FRAMES_IN_FLIGHT);
+  for (auto &allocator : frameDescriptorAllocators) {
+    allocator = std::make_unique<VseDescriptorAllocator>(vseDevice);
+  }
+}
+
 void VseRenderer::freeCommandBuffers() {
   vkFreeCommandBuffers(vseDevice.device(), vseDevice.getCommandPool(),
                        static_cast<float>(commandBuffers.size()),
@@ -71,6 +138,16 @@ VkCommandBuffer VseRenderer::beginFrame() {
     throw std::runtime_error("Failed to acquire swap chain image!");
   }
 
+  collectPresentTimes();
+
+  // acquireNextImage waited on this frame's fence, so every set handed out
+  // the last time this frame index was recorded is no longer in use
+  frameDescriptorAllocators[currentFrameIndex]->resetPools();
+  // ...and every frame up to MAX_FRAMES_IN_FLIGHT ago has completed
+  if (frameCount >= VseSwapChain::MAX_FRAMES_IN_FLIGHT) {
+    deletionQueue.flush(frameCount - VseSwapChain::MAX_FRAMES_IN_FLIGHT);
+  }
+
   isFrameStarted = true;
 
   auto commandBuffer = getCurrentCommandBuffer();
@@ -93,10 +170,15 @@ void VseRenderer::endFrame() {
     throw std::runtime_error("Failed to record command buffer");
   }
 
+  auto submitTime = VseFramePacer::Clock::now();
   auto result =
       vseSwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+  framePacer.markSubmit(vseDevice.hasPresentWait()
+                            ? vseSwapChain->getLastPresentId()
+                            : frameCount,
+                        submitTime);
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
-      vseWindow.wasWindowResized()) {
+      vseWindow.wasWindowResized() || presentModeChanged) {
     vseWindow.resetWindowResizedFlag();
     recreateSwapChain();
   } else if (result != VK_SUCCESS) {
@@ -104,56 +186,50 @@ void VseRenderer::endFrame() {
   }
 
   isFrameStarted = false;
+  frameCount++;
   currentFrameIndex =
       (currentFrameIndex + 1) % VseSwapChain::MAX_FRAMES_IN_FLIGHT;
 }
-void VseRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
-  assert(isFrameStarted &&
-         "Can't call beginSwapChainRenderPass while frame is not in progress");
-  assert(commandBuffer == getCurrentCommandBuffer() &&
-         "Can't begin render pass on command buffer from a different frame");
-
-  VkRenderPassBeginInfo renderPassInfo{};
-  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderPassInfo.renderPass = vseSwapChain->getRenderPass();
-  renderPassInfo.framebuffer = vseSwapChain->getFrameBuffer(currentImageIndex);
-
-  renderPassInfo.renderArea.offset = {0, 0};
-  renderPassInfo.renderArea.extent = vseSwapChain->getSwapChainExtent();
-
-  std::array<VkClearValue, 2> clearValues{};
-  clearValues[0].color = {
-      0.01f,
-      0.01f,
-      0.01f,
-      1.0f,
-  };
-  clearValues[1].depthStencil = {1.0f, 0};
-  renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-  renderPassInfo.pClearValues = clearValues.data();
-
-  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
-
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = static_cast<float>(vseSwapChain->getSwapChainExtent().width);
-  viewport.height =
-      static_cast<float>(vseSwapChain->getSwapChainExtent().height);
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-  VkRect2D scissor{{0, 0}, vseSwapChain->getSwapChainExtent()};
-  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+VseRenderTargetInfo VseRenderer::getRenderTargetInfo(
+    VkSampleCountFlagBits samples) {
+  VseRenderTargetInfo info{};
+  info.colorFormats = {vseSwapChain->getSwapChainImageFormat()};
+  info.depthFormat = vseSwapChain->getSwapChainDepthFormat();
+  info.samples = samples;
+  if (!dynamicRendering) {
+    info.renderPass = renderGraph.getCompatibleRenderPass(
+        info.colorFormats, info.depthFormat, samples);
+  }
+  return info;
 }
-void VseRenderer::endSwapChainRenderPass(VkCommandBuffer commandBuffer) {
-  assert(isFrameStarted &&
-         "Can't call endSwapChainRenderPass while frame is not in progress");
-  assert(commandBuffer == getCurrentCommandBuffer() &&
-         "Can't end render pass on command buffer from a different frame");
 
-  vkCmdEndRenderPass(commandBuffer);
+VseRenderTargetInfo VseRenderer::getDepthOnlyRenderTargetInfo(
+    VkSampleCountFlagBits samples) {
+  VseRenderTargetInfo info{};
+  info.depthFormat = vseSwapChain->getSwapChainDepthFormat();
+  info.samples = samples;
+  if (!dynamicRendering) {
+    info.renderPass =
+        renderGraph.getCompatibleRenderPass({}, info.depthFormat, samples);
+  }
+  return info;
+}
+
+VseRenderGraph::ResourceId VseRenderer::importSwapChainImage() {
+  assert(isFrameStarted &&
+         "Can't import the swap chain image while frame is not in progress");
+
+  VseRenderGraph::ImportedImage image{};
+  image.image = vseSwapChain->getImage(currentImageIndex);
+  image.view = vseSwapChain->getImageView(currentImageIndex);
+  image.desc.format = vseSwapChain->getSwapChainImageFormat();
+  image.desc.extent = vseSwapChain->getSwapChainExtent();
+  image.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  image.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // Submission waits on the acquire semaphore at this stage
+  image.availableStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  return renderGraph.importImage("swapchain", image);
 }
 
-}  // namespace vse
\ No newline at end of file
+}  // namespace vse
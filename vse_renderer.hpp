@@ -1,11 +1,18 @@
 #pragma once
 
+#include "vse_deletion_queue.hpp"
+#include "vse_descriptors.hpp"
 #include "vse_device.hpp"
+#include "vse_frame_pacer.hpp"
+#include "vse_pipeline.hpp"
+#include "vse_render_graph.hpp"
 #include "vse_swap_chain.hpp"
 #include "vse_window.hpp"
 
 // std
 #include <cassert>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -13,17 +20,63 @@ namespace vse {
 
 class VseRenderer {
  public:
-  VseRenderer(VseWindow &window, VseDevice &device);
+  // Bounds low latency waits so a swap chain that stopped presenting, e.g.
+  // of a hidden window, can't stall the loop
+  static constexpr uint64_t PRESENT_WAIT_TIMEOUT = 100'000'000;
+
+  // Dynamic rendering is only used when the device supports it
+  VseRenderer(VseWindow &window, VseDevice &device,
+              bool dynamicRendering = false,
+              VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR);
   ~VseRenderer();
 
   VseRenderer(const VseRenderer &) = delete;
   VseRenderer &operator=(const VseRenderer &) = delete;
 
-  VkRenderPass getSwapChainRenderPass() const {
-    return vseSwapChain->getRenderPass();
+  // What pipelines drawing to the swap chain are created against. With
+  // more than one sample they draw to a multisampled target the render
+  // graph resolves into the swap chain image.
+  VseRenderTargetInfo getRenderTargetInfo(
+      VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+  // The same depth buffer without any color attachment, for depth only
+  // passes
+  VseRenderTargetInfo getDepthOnlyRenderTargetInfo(
+      VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+  bool usesDynamicRendering() const { return dynamicRendering; }
+  float getAspectRatio() const { return vseSwapChain->extentAspectRatio(); }
+  VkExtent2D getSwapChainExtent() const {
+    return vseSwapChain->getSwapChainExtent();
+  }
+  VkFormat getSwapChainImageFormat() const {
+    return vseSwapChain->getSwapChainImageFormat();
+  }
+  VkFormat getSwapChainDepthFormat() const {
+    return vseSwapChain->getSwapChainDepthFormat();
   }
   bool isFrameInProgress() const { return isFrameStarted; }
 
+  // Takes effect by recreating the swap chain at the end of the frame
+  void setPresentMode(VkPresentModeKHR mode);
+  // The mode in use, FIFO when the requested one is unsupported
+  VkPresentModeKHR getPresentMode() const {
+    return vseSwapChain->getPresentMode();
+  }
+
+  // With present wait, waitForNextFrame also blocks until the previous
+  // frame is on screen, so input is sampled as late as possible and
+  // presentation times are observed exactly. Costs throughput.
+  void setLowLatency(bool enabled) { lowLatency = enabled; }
+  bool isLowLatency() const { return lowLatency; }
+
+  // Applies the frame limiter and low latency wait; call it right before
+  // sampling input, then mark the input on the frame pacer
+  void waitForNextFrame();
+  VseFramePacer &getFramePacer() { return framePacer; }
+
+  // Reversed-Z clears depth to 0 so the GREATER compare op keeps near samples
+  void setReversedZ(bool reversed) { reversedZ = reversed; }
+  bool isReversedZ() const { return reversedZ; }
+
   VkCommandBuffer getCurrentCommandBuffer() const {
     assert(isFrameStarted &&
            "Cannot get command buffer when frame not in progress");
@@ -36,24 +89,60 @@ class VseRenderer {
     return currentFrameIndex;
   }
 
+  // Sets allocated here are only valid for the current frame; the allocator
+  // is reset once the frame's fence has signaled on its next use.
+  VseDescriptorAllocator &getFrameDescriptorAllocator() const {
+    assert(isFrameStarted &&
+           "Cannot get frame descriptor allocator when frame not in progress");
+    return *frameDescriptorAllocators[currentFrameIndex];
+  }
+
+  // Monotonic count of frames begun, unlike the wrapping frame index
+  uint64_t getFrameCount() const { return frameCount; }
+
+  // Runs deleter once every frame that may reference the object has
+  // finished on the GPU
+  void retire(std::function<void()> deleter) {
+    deletionQueue.push(frameCount, std::move(deleter));
+  }
+
+  // Describes the frame's passes; reset and execute it once per frame
+  VseRenderGraph &getRenderGraph() { return renderGraph; }
+  // Imports the acquired swap chain image, which the graph leaves ready
+  // for presentation
+  VseRenderGraph::ResourceId importSwapChainImage();
+
   VkCommandBuffer beginFrame();
   void endFrame();
-  void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
-  void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
  private:
   void createCommandBuffers();
   void freeCommandBuffers();
+  void createFrameDescriptorAllocators();
   void recreateSwapChain();
+  // Feeds the frame pacer presentation times observed since the last frame
+  void collectPresentTimes();
 
   VseWindow &vseWindow;
   VseDevice &vseDevice;
   std::unique_ptr<VseSwapChain> vseSwapChain;
   std::vector<VkCommandBuffer> commandBuffers;
+  std::vector<std::unique_ptr<VseDescriptorAllocator>>
+      frameDescriptorAllocators;
+  VseDeletionQueue deletionQueue;
+  // Declared after the deletion queue, which may still hold its objects
+  VseRenderGraph renderGraph;
 
   uint32_t currentImageIndex{0};
   int currentFrameIndex{0};
+  uint64_t frameCount{0};
   bool isFrameStarted{false};
+  bool reversedZ{false};
+  bool dynamicRendering;
+  VkPresentModeKHR presentMode;
+  bool presentModeChanged{false};
+  bool lowLatency{false};
+  VseFramePacer framePacer;
 };
 
 }  // namespace vse
\ No newline at end of file
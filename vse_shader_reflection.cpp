@@ -0,0 +1,707 @@
+#include "vse_shader_reflection.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+namespace vse {
+
+namespace {
+
+// Subset of the SPIR-V specification needed to read a module's interface
+namespace spv {
+constexpr uint32_t MAGIC_NUMBER = 0x07230203;
+constexpr uint32_t HEADER_WORDS = 5;
+
+constexpr uint32_t OP_NAME = 5;
+constexpr uint32_t OP_ENTRY_POINT = 15;
+constexpr uint32_t OP_TYPE_BOOL = 20;
+constexpr uint32_t OP_TYPE_INT = 21;
+constexpr uint32_t OP_TYPE_FLOAT = 22;
+constexpr uint32_t OP_TYPE_VECTOR = 23;
+constexpr uint32_t OP_TYPE_MATRIX = 24;
+constexpr uint32_t OP_TYPE_IMAGE = 25;
+constexpr uint32_t OP_TYPE_SAMPLER = 26;
+constexpr uint32_t OP_TYPE_SAMPLED_IMAGE = 27;
+constexpr uint32_t OP_TYPE_ARRAY = 28;
+constexpr uint32_t OP_TYPE_RUNTIME_ARRAY = 29;
+constexpr uint32_t OP_TYPE_STRUCT = 30;
+constexpr uint32_t OP_TYPE_POINTER = 32;
+constexpr uint32_t OP_CONSTANT = 43;
+constexpr uint32_t OP_SPEC_CONSTANT_TRUE = 48;
+constexpr uint32_t OP_SPEC_CONSTANT_FALSE = 49;
+constexpr uint32_t OP_SPEC_CONSTANT = 50;
+constexpr uint32_t OP_VARIABLE = 59;
+constexpr uint32_t OP_DECORATE = 71;
+constexpr uint32_t OP_MEMBER_DECORATE = 72;
+constexpr uint32_t OP_TYPE_ACCELERATION_STRUCTURE = 5341;
+
+constexpr uint32_t DECORATION_SPEC_ID = 1;
+constexpr uint32_t DECORATION_BUFFER_BLOCK = 3;
+constexpr uint32_t DECORATION_ARRAY_STRIDE = 6;
+constexpr uint32_t DECORATION_MATRIX_STRIDE = 7;
+constexpr uint32_t DECORATION_BUILT_IN = 11;
+constexpr uint32_t DECORATION_LOCATION = 30;
+constexpr uint32_t DECORATION_BINDING = 33;
+constexpr uint32_t DECORATION_DESCRIPTOR_SET = 34;
+constexpr uint32_t DECORATION_OFFSET = 35;
+
+constexpr uint32_t STORAGE_UNIFORM_CONSTANT = 0;
+constexpr uint32_t STORAGE_INPUT = 1;
+constexpr uint32_t STORAGE_UNIFORM = 2;
+constexpr uint32_t STORAGE_PUSH_CONSTANT = 9;
+constexpr uint32_t STORAGE_STORAGE_BUFFER = 12;
+
+constexpr uint32_t DIM_BUFFER = 5;
+constexpr uint32_t DIM_SUBPASS_DATA = 6;
+}  // namespace spv
+
+struct SpirvType {
+  uint32_t opcode = 0;
+  // Words following the result id
+  std::vector<uint32_t> operands;
+};
+
+using Decorations = std::unordered_map<uint32_t, uint32_t>;
+
+// Id-indexed tables gathered in a single pass over the module
+struct SpirvModule {
+  VkShaderStageFlags stage = 0;
+  std::string entryPoint;
+  std::vector<uint32_t> interfaceIds;
+  std::unordered_map<uint32_t, std::string> names;
+  std::unordered_map<uint32_t, SpirvType> types;
+  std::unordered_map<uint32_t, uint32_t> constants;
+  std::unordered_map<uint32_t, Decorations> decorations;
+  std::unordered_map<uint32_t, std::vector<Decorations>> memberDecorations;
+
+  struct Variable {
+    uint32_t id;
+    uint32_t pointerType;
+    uint32_t storageClass;
+  };
+  std::vector<Variable> variables;
+
+  struct SpecConstant {
+    uint32_t id;
+    uint32_t type;
+    uint32_t value;
+  };
+  std::vector<SpecConstant> specConstants;
+
+  const Decorations *findDecorations(uint32_t id) const {
+    auto it = decorations.find(id);
+    return it == decorations.end() ? nullptr : &it->second;
+  }
+
+  bool hasDecoration(uint32_t id, uint32_t decoration) const {
+    auto decos = findDecorations(id);
+    return decos != nullptr && decos->count(decoration) > 0;
+  }
+
+  uint32_t decoration(uint32_t id, uint32_t decoration,
+                      uint32_t fallback = 0) const {
+    auto decos = findDecorations(id);
+    if (decos == nullptr) return fallback;
+    auto it = decos->find(decoration);
+    return it == decos->end() ? fallback : it->second;
+  }
+
+  uint32_t memberDecoration(uint32_t id, uint32_t member, uint32_t decoration,
+                            uint32_t fallback = 0) const {
+    auto it = memberDecorations.find(id);
+    if (it == memberDecorations.end() || member >= it->second.size()) {
+      return fallback;
+    }
+    auto deco = it->second[member].find(decoration);
+    return deco == it->second[member].end() ? fallback : deco->second;
+  }
+
+  const SpirvType &type(uint32_t id) const {
+    auto it = types.find(id);
+    if (it == types.end()) {
+      throw std::runtime_error("failed to reflect shader: unknown type id!");
+    }
+    return it->second;
+  }
+};
+
+std::string readString(const uint32_t *words, uint32_t wordCount) {
+  const char *chars = reinterpret_cast<const char *>(words);
+  return std::string{chars, strnlen(chars, wordCount * sizeof(uint32_t))};
+}
+
+uint32_t stringWordCount(const uint32_t *words, uint32_t wordCount) {
+  return static_cast<uint32_t>(readString(words, wordCount).size()) /
+             sizeof(uint32_t) +
+         1;
+}
+
+VkShaderStageFlags stageFromExecutionModel(uint32_t executionModel) {
+  switch (executionModel) {
+    case 0:
+      return VK_SHADER_STAGE_VERTEX_BIT;
+    case 1:
+      return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case 2:
+      return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case 3:
+      return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case 4:
+      return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case 5:
+      return VK_SHADER_STAGE_COMPUTE_BIT;
+    default:
+      throw std::runtime_error("failed to reflect shader: unsupported stage!");
+  }
+}
+
+SpirvModule parseModule(const std::vector<char> &code) {
+  if (code.size() % sizeof(uint32_t) != 0 ||
+      code.size() < spv::HEADER_WORDS * sizeof(uint32_t)) {
+    throw std::runtime_error("failed to reflect shader: invalid SPIR-V size!");
+  }
+  std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+  std::memcpy(words.data(), code.data(), code.size());
+  if (words[0] != spv::MAGIC_NUMBER) {
+    throw std::runtime_error("failed to reflect shader: bad SPIR-V magic!");
+  }
+
+  SpirvModule module{};
+  bool foundEntryPoint = false;
+  size_t offset = spv::HEADER_WORDS;
+  while (offset < words.size()) {
+    uint32_t opcode = words[offset] & 0xFFFF;
+    uint32_t wordCount = words[offset] >> 16;
+    if (wordCount == 0 || offset + wordCount > words.size()) {
+      throw std::runtime_error(
+          "failed to reflect shader: truncated instruction!");
+    }
+    const uint32_t *op = &words[offset + 1];
+    uint32_t operandCount = wordCount - 1;
+
+    switch (opcode) {
+      case spv::OP_ENTRY_POINT: {
+        // Only the first entry point is reflected, as VsePipeline uses "main"
+        if (foundEntryPoint) break;
+        foundEntryPoint = true;
+        module.stage = stageFromExecutionModel(op[0]);
+        module.entryPoint = readString(op + 2, operandCount - 2);
+        uint32_t nameWords = stringWordCount(op + 2, operandCount - 2);
+        module.interfaceIds.assign(op + 2 + nameWords, op + operandCount);
+        break;
+      }
+      case spv::OP_NAME:
+        module.names[op[0]] = readString(op + 1, operandCount - 1);
+        break;
+      case spv::OP_DECORATE:
+        module.decorations[op[0]][op[1]] = operandCount > 2 ? op[2] : 1;
+        break;
+      case spv::OP_MEMBER_DECORATE: {
+        auto &members = module.memberDecorations[op[0]];
+        if (members.size() <= op[1]) members.resize(op[1] + 1);
+        members[op[1]][op[2]] = operandCount > 3 ? op[3] : 1;
+        break;
+      }
+      case spv::OP_TYPE_BOOL:
+      case spv::OP_TYPE_INT:
+      case spv::OP_TYPE_FLOAT:
+      case spv::OP_TYPE_VECTOR:
+      case spv::OP_TYPE_MATRIX:
+      case spv::OP_TYPE_IMAGE:
+      case spv::OP_TYPE_SAMPLER:
+      case spv::OP_TYPE_SAMPLED_IMAGE:
+      case spv::OP_TYPE_ARRAY:
+      case spv::OP_TYPE_RUNTIME_ARRAY:
+      case spv::OP_TYPE_STRUCT:
+      case spv::OP_TYPE_POINTER:
+      case spv::OP_TYPE_ACCELERATION_STRUCTURE:
+        module.types[op[0]] = {opcode, {op + 1, op + operandCount}};
+        break;
+      case spv::OP_CONSTANT:
+        module.constants[op[1]] = op[2];
+        break;
+      case spv::OP_SPEC_CONSTANT_TRUE:
+      case spv::OP_SPEC_CONSTANT_FALSE:
+        module.specConstants.push_back(
+            {op[1], op[0], opcode == spv::OP_SPEC_CONSTANT_TRUE ? 1u : 0u});
+        break;
+      case spv::OP_SPEC_CONSTANT:
+        module.specConstants.push_back({op[1], op[0], op[2]});
+        break;
+      case spv::OP_VARIABLE:
+        module.variables.push_back({op[1], op[0], op[2]});
+        break;
+      default:
+        break;
+    }
+    offset += wordCount;
+  }
+
+  if (!foundEntryPoint) {
+    throw std::runtime_error("failed to reflect shader: no entry point!");
+  }
+  return module;
+}
+
+ShaderBaseType baseTypeOf(const SpirvModule &module, uint32_t typeId) {
+  const auto &type = module.type(typeId);
+  switch (type.opcode) {
+    case spv::OP_TYPE_BOOL:
+      return ShaderBaseType::Bool;
+    case spv::OP_TYPE_INT:
+      return type.operands[1] ? ShaderBaseType::SInt : ShaderBaseType::UInt;
+    case spv::OP_TYPE_FLOAT:
+      return ShaderBaseType::Float;
+    case spv::OP_TYPE_VECTOR:
+    case spv::OP_TYPE_MATRIX:
+    case spv::OP_TYPE_ARRAY:
+      return baseTypeOf(module, type.operands[0]);
+    default:
+      throw std::runtime_error("failed to reflect shader: non-numeric type!");
+  }
+}
+
+uint32_t typeSize(const SpirvModule &module, uint32_t typeId,
+                  uint32_t matrixStride = 0) {
+  const auto &type = module.type(typeId);
+  switch (type.opcode) {
+    case spv::OP_TYPE_BOOL:
+      return 4;
+    case spv::OP_TYPE_INT:
+    case spv::OP_TYPE_FLOAT:
+      return type.operands[0] / 8;
+    case spv::OP_TYPE_VECTOR:
+      return type.operands[1] * typeSize(module, type.operands[0]);
+    case spv::OP_TYPE_MATRIX: {
+      uint32_t columnSize = matrixStride != 0
+                                ? matrixStride
+                                : typeSize(module, type.operands[0]);
+      return type.operands[1] * columnSize;
+    }
+    case spv::OP_TYPE_ARRAY: {
+      uint32_t length = module.constants.at(type.operands[1]);
+      uint32_t stride = module.decoration(typeId, spv::DECORATION_ARRAY_STRIDE);
+      if (stride == 0) {
+        stride = typeSize(module, type.operands[0], matrixStride);
+      }
+      return length * stride;
+    }
+    case spv::OP_TYPE_RUNTIME_ARRAY:
+      return 0;
+    case spv::OP_TYPE_STRUCT: {
+      uint32_t size = 0;
+      for (uint32_t member = 0; member < type.operands.size(); member++) {
+        uint32_t memberOffset = module.memberDecoration(
+            typeId, member, spv::DECORATION_OFFSET);
+        uint32_t memberStride = module.memberDecoration(
+            typeId, member, spv::DECORATION_MATRIX_STRIDE);
+        size = std::max(
+            size, memberOffset + typeSize(module, type.operands[member],
+                                          memberStride));
+      }
+      return size;
+    }
+    default:
+      throw std::runtime_error("failed to reflect shader: unsized type!");
+  }
+}
+
+VkFormat vertexFormat(ShaderBaseType baseType, uint32_t width,
+                      uint32_t componentCount) {
+  static const VkFormat float32[] = {
+      VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+      VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+  static const VkFormat float64[] = {
+      VK_FORMAT_R64_SFLOAT, VK_FORMAT_R64G64_SFLOAT,
+      VK_FORMAT_R64G64B64_SFLOAT, VK_FORMAT_R64G64B64A64_SFLOAT};
+  static const VkFormat sint32[] = {
+      VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT,
+      VK_FORMAT_R32G32B32A32_SINT};
+  static const VkFormat uint32[] = {
+      VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT,
+      VK_FORMAT_R32G32B32A32_UINT};
+
+  uint32_t index = componentCount - 1;
+  switch (baseType) {
+    case ShaderBaseType::Float:
+      return width == 64 ? float64[index] : float32[index];
+    case ShaderBaseType::SInt:
+      return sint32[index];
+    case ShaderBaseType::UInt:
+      return uint32[index];
+    default:
+      return VK_FORMAT_UNDEFINED;
+  }
+}
+
+// Shader-visible numeric type an attribute format is read as
+ShaderBaseType formatBaseType(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R8_UINT:
+    case VK_FORMAT_R8G8_UINT:
+    case VK_FORMAT_R8G8B8_UINT:
+    case VK_FORMAT_R8G8B8A8_UINT:
+    case VK_FORMAT_R16_UINT:
+    case VK_FORMAT_R16G16_UINT:
+    case VK_FORMAT_R16G16B16_UINT:
+    case VK_FORMAT_R16G16B16A16_UINT:
+    case VK_FORMAT_R32_UINT:
+    case VK_FORMAT_R32G32_UINT:
+    case VK_FORMAT_R32G32B32_UINT:
+    case VK_FORMAT_R32G32B32A32_UINT:
+    case VK_FORMAT_A2B10G10R10_UINT_PACK32:
+      return ShaderBaseType::UInt;
+    case VK_FORMAT_R8_SINT:
+    case VK_FORMAT_R8G8_SINT:
+    case VK_FORMAT_R8G8B8_SINT:
+    case VK_FORMAT_R8G8B8A8_SINT:
+    case VK_FORMAT_R16_SINT:
+    case VK_FORMAT_R16G16_SINT:
+    case VK_FORMAT_R16G16B16_SINT:
+    case VK_FORMAT_R16G16B16A16_SINT:
+    case VK_FORMAT_R32_SINT:
+    case VK_FORMAT_R32G32_SINT:
+    case VK_FORMAT_R32G32B32_SINT:
+    case VK_FORMAT_R32G32B32A32_SINT:
+      return ShaderBaseType::SInt;
+    default:
+      // UNORM, SNORM, SCALED and SFLOAT formats all read as floats
+      return ShaderBaseType::Float;
+  }
+}
+
+VkDescriptorType descriptorTypeOf(const SpirvModule &module, uint32_t typeId,
+                                  uint32_t storageClass) {
+  const auto &type = module.type(typeId);
+  switch (type.opcode) {
+    case spv::OP_TYPE_SAMPLED_IMAGE:
+      return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    case spv::OP_TYPE_SAMPLER:
+      return VK_DESCRIPTOR_TYPE_SAMPLER;
+    case spv::OP_TYPE_IMAGE: {
+      uint32_t dim = type.operands[1];
+      bool storage = type.operands[5] == 2;
+      if (dim == spv::DIM_SUBPASS_DATA) {
+        return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      }
+      if (dim == spv::DIM_BUFFER) {
+        return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+                       : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      }
+      return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+                     : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    }
+    case spv::OP_TYPE_ACCELERATION_STRUCTURE:
+      return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+    case spv::OP_TYPE_STRUCT:
+      if (storageClass == spv::STORAGE_STORAGE_BUFFER ||
+          module.hasDecoration(typeId, spv::DECORATION_BUFFER_BLOCK)) {
+        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      }
+      return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    default:
+      throw std::runtime_error(
+          "failed to reflect shader: unsupported descriptor type!");
+  }
+}
+
+std::string nameOf(const SpirvModule &module, uint32_t id) {
+  auto it = module.names.find(id);
+  return it == module.names.end() ? std::string{} : it->second;
+}
+
+}  // namespace
+
+VseShaderReflection::VseShaderReflection(const std::vector<char> &code) {
+  SpirvModule module = parseModule(code);
+  stageFlags = module.stage;
+  entryPoint = module.entryPoint;
+
+  for (const auto &variable : module.variables) {
+    const auto &pointer = module.type(variable.pointerType);
+    uint32_t typeId = pointer.operands[1];
+
+    switch (variable.storageClass) {
+      case spv::STORAGE_PUSH_CONSTANT: {
+        const auto &block = module.type(typeId);
+        if (block.operands.empty()) break;
+        uint32_t begin = UINT32_MAX;
+        for (uint32_t member = 0; member < block.operands.size(); member++) {
+          begin = std::min(begin, module.memberDecoration(
+                                      typeId, member, spv::DECORATION_OFFSET));
+        }
+        pushConstantRange.stageFlags = stageFlags;
+        pushConstantRange.offset = begin;
+        pushConstantRange.size = typeSize(module, typeId) - begin;
+        break;
+      }
+      case spv::STORAGE_UNIFORM_CONSTANT:
+      case spv::STORAGE_UNIFORM:
+      case spv::STORAGE_STORAGE_BUFFER: {
+        if (!module.hasDecoration(variable.id, spv::DECORATION_BINDING)) {
+          break;
+        }
+        uint32_t count = 1;
+        const auto *type = &module.type(typeId);
+        while (type->opcode == spv::OP_TYPE_ARRAY ||
+               type->opcode == spv::OP_TYPE_RUNTIME_ARRAY) {
+          // Unsized arrays report 0, their size comes from an external layout
+          count = type->opcode == spv::OP_TYPE_ARRAY
+                      ? count * module.constants.at(type->operands[1])
+                      : 0;
+          typeId = type->operands[0];
+          type = &module.type(typeId);
+        }
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding =
+            module.decoration(variable.id, spv::DECORATION_BINDING);
+        binding.descriptorType =
+            descriptorTypeOf(module, typeId, variable.storageClass);
+        binding.descriptorCount = count;
+        binding.stageFlags = stageFlags;
+        uint32_t set =
+            module.decoration(variable.id, spv::DECORATION_DESCRIPTOR_SET);
+        descriptorSets[set][binding.binding] = binding;
+        break;
+      }
+      case spv::STORAGE_INPUT: {
+        if (stageFlags != VK_SHADER_STAGE_VERTEX_BIT ||
+            module.hasDecoration(variable.id, spv::DECORATION_BUILT_IN) ||
+            std::find(module.interfaceIds.begin(), module.interfaceIds.end(),
+                      variable.id) == module.interfaceIds.end()) {
+          break;
+        }
+        const auto *type = &module.type(typeId);
+        uint32_t locations = 1;
+        if (type->opcode == spv::OP_TYPE_MATRIX) {
+          // Matrix inputs take one location per column
+          locations = type->operands[1];
+          typeId = type->operands[0];
+          type = &module.type(typeId);
+        }
+        uint32_t componentCount = 1;
+        uint32_t scalarId = typeId;
+        if (type->opcode == spv::OP_TYPE_VECTOR) {
+          componentCount = type->operands[1];
+          scalarId = type->operands[0];
+        }
+        ShaderBaseType baseType = baseTypeOf(module, scalarId);
+        uint32_t width = module.type(scalarId).operands[0];
+
+        uint32_t location =
+            module.decoration(variable.id, spv::DECORATION_LOCATION);
+        for (uint32_t i = 0; i < locations; i++) {
+          vertexInputs.push_back(
+              {location + i, vertexFormat(baseType, width, componentCount),
+               baseType, componentCount, nameOf(module, variable.id)});
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  std::sort(vertexInputs.begin(), vertexInputs.end(),
+            [](const ReflectedVertexInput &a, const ReflectedVertexInput &b) {
+              return a.location < b.location;
+            });
+
+  for (const auto &constant : module.specConstants) {
+    if (!module.hasDecoration(constant.id, spv::DECORATION_SPEC_ID)) {
+      continue;
+    }
+    ReflectedSpecConstant specConstant{};
+    specConstant.constantId =
+        module.decoration(constant.id, spv::DECORATION_SPEC_ID);
+    specConstant.size = typeSize(module, constant.type);
+    specConstant.baseType = baseTypeOf(module, constant.type);
+    specConstant.defaultValue = constant.value;
+    specConstant.stageFlags = stageFlags;
+    specConstant.name = nameOf(module, constant.id);
+    specConstants.push_back(specConstant);
+  }
+}
+
+void VseShaderReflection::merge(const VseShaderReflection &other) {
+  stageFlags |= other.stageFlags;
+
+  if (other.hasPushConstants()) {
+    if (!hasPushConstants()) {
+      pushConstantRange = other.pushConstantRange;
+    } else {
+      uint32_t begin =
+          std::min(pushConstantRange.offset, other.pushConstantRange.offset);
+      uint32_t end = std::max(
+          pushConstantRange.offset + pushConstantRange.size,
+          other.pushConstantRange.offset + other.pushConstantRange.size);
+      pushConstantRange.stageFlags |= other.pushConstantRange.stageFlags;
+      pushConstantRange.offset = begin;
+      pushConstantRange.size = end - begin;
+    }
+  }
+
+  for (const auto &set : other.descriptorSets) {
+    for (const auto &kv : set.second) {
+      auto &bindings = descriptorSets[set.first];
+      auto it = bindings.find(kv.first);
+      if (it == bindings.end()) {
+        bindings[kv.first] = kv.second;
+        continue;
+      }
+      if (it->second.descriptorType != kv.second.descriptorType) {
+        throw std::runtime_error(
+            "descriptor type mismatch between shader stages at set " +
+            std::to_string(set.first) + " binding " +
+            std::to_string(kv.first) + "!");
+      }
+      it->second.stageFlags |= kv.second.stageFlags;
+      it->second.descriptorCount =
+          std::max(it->second.descriptorCount, kv.second.descriptorCount);
+    }
+  }
+
+  if (other.stageFlags & VK_SHADER_STAGE_VERTEX_BIT) {
+    vertexInputs = other.vertexInputs;
+  }
+
+  for (const auto &constant : other.specConstants) {
+    auto it = std::find_if(specConstants.begin(), specConstants.end(),
+                           [&](const ReflectedSpecConstant &existing) {
+                             return existing.constantId == constant.constantId;
+                           });
+    if (it == specConstants.end()) {
+      specConstants.push_back(constant);
+      continue;
+    }
+    if (it->size != constant.size) {
+      throw std::runtime_error(
+          "specialization constant " + std::to_string(constant.constantId) +
+          " has different types between shader stages!");
+    }
+    it->stageFlags |= constant.stageFlags;
+  }
+}
+
+const ReflectedSpecConstant *VseShaderReflection::findSpecConstant(
+    uint32_t constantId) const {
+  for (const auto &constant : specConstants) {
+    if (constant.constantId == constantId) {
+      return &constant;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<VkDescriptorSetLayout> VseShaderReflection::buildSetLayouts(
+    VseDescriptorLayoutCache &descriptorLayoutCache,
+    const std::unordered_map<uint32_t, VkDescriptorSetLayout> &externalLayouts)
+    const {
+  uint32_t setCount = 0;
+  if (!descriptorSets.empty()) {
+    setCount = descriptorSets.rbegin()->first + 1;
+  }
+  for (const auto &kv : externalLayouts) {
+    setCount = std::max(setCount, kv.first + 1);
+  }
+
+  std::vector<VkDescriptorSetLayout> setLayouts(setCount);
+  for (uint32_t set = 0; set < setCount; set++) {
+    auto external = externalLayouts.find(set);
+    if (external != externalLayouts.end()) {
+      setLayouts[set] = external->second;
+      continue;
+    }
+
+    std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings{};
+    auto reflected = descriptorSets.find(set);
+    if (reflected != descriptorSets.end()) {
+      for (const auto &kv : reflected->second) {
+        if (kv.second.descriptorCount == 0) {
+          throw std::runtime_error(
+              "unsized descriptor array at set " + std::to_string(set) +
+              " binding " + std::to_string(kv.first) +
+              " needs an external layout!");
+        }
+        bindings[kv.first] = kv.second;
+      }
+    }
+    setLayouts[set] =
+        descriptorLayoutCache.getLayout(bindings).getDescriptorSetLayout();
+  }
+  return setLayouts;
+}
+
+VkPipelineLayout VseShaderReflection::buildPipelineLayout(
+    VseDescriptorLayoutCache &descriptorLayoutCache,
+    VsePipelineLayoutCache &pipelineLayoutCache,
+    const std::unordered_map<uint32_t, VkDescriptorSetLayout> &externalLayouts)
+    const {
+  std::vector<VkPushConstantRange> pushConstantRanges{};
+  if (hasPushConstants()) {
+    pushConstantRanges.push_back(pushConstantRange);
+  }
+  return pipelineLayoutCache.getLayout(
+      buildSetLayouts(descriptorLayoutCache, externalLayouts),
+      pushConstantRanges);
+}
+
+std::vector<VkVertexInputAttributeDescription>
+VseShaderReflection::matchVertexAttributes(
+    const std::vector<VkVertexInputAttributeDescription> &attributes) const {
+  std::vector<VkVertexInputAttributeDescription> matched{};
+  for (const auto &input : vertexInputs) {
+    auto it = std::find_if(attributes.begin(), attributes.end(),
+                           [&](const VkVertexInputAttributeDescription &a) {
+                             return a.location == input.location;
+                           });
+    if (it == attributes.end()) {
+      throw std::runtime_error("vertex shader input '" + input.name +
+                               "' at location " +
+                               std::to_string(input.location) +
+                               " has no vertex attribute!");
+    }
+    if (formatBaseType(it->format) != input.baseType) {
+      throw std::runtime_error("vertex attribute at location " +
+                               std::to_string(input.location) +
+                               " does not match the shader input type!");
+    }
+    matched.push_back(*it);
+  }
+  return matched;
+}
+
+std::shared_ptr<const VseShaderReflection> VseShaderReflectionCache::get(
+    const std::string &spvPath) {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = entries.find(spvPath);
+    if (it != entries.end()) {
+      return it->second;
+    }
+  }
+  // Parsed outside the lock; a racing parse of the same file is harmless
+  auto reflection = std::make_shared<const VseShaderReflection>(
+      VsePipeline::readFile(spvPath));
+  std::lock_guard<std::mutex> lock{mutex};
+  return entries.emplace(spvPath, std::move(reflection)).first->second;
+}
+
+VseShaderReflection VseShaderReflectionCache::reflect(
+    const std::string &vertFilepath, const std::string &fragFilepath) {
+  VseShaderReflection reflection = *get(vertFilepath);
+  if (!fragFilepath.empty()) {
+    reflection.merge(*get(fragFilepath));
+  }
+  return reflection;
+}
+
+void VseShaderReflectionCache::invalidate(const std::string &spvPath) {
+  std::lock_guard<std::mutex> lock{mutex};
+  entries.erase(spvPath);
+}
+
+}  // namespace vse
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "vse_descriptors.hpp"
+#include "vse_device.hpp"
+#include "vse_pipeline.hpp"
+
+// std
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vse {
+
+enum class ShaderBaseType { Float, SInt, UInt, Bool };
+
+struct ReflectedVertexInput {
+  uint32_t location;
+  VkFormat format;
+  ShaderBaseType baseType;
+  uint32_t componentCount;
+  std::string name;
+};
+
+struct ReflectedSpecConstant {
+  uint32_t constantId;
+  // Bytes the VkSpecializationMapEntry must cover, bools are VkBool32
+  uint32_t size;
+  ShaderBaseType baseType;
+  // Raw bits of the default value declared in the shader
+  uint32_t defaultValue;
+  VkShaderStageFlags stageFlags;
+  std::string name;
+};
+
+// Interface of one or more shader stages, read straight from SPIR-V.
+// Reflections of the stages in a pipeline are merged and then turned into
+// descriptor set and pipeline layouts through the layout caches, so systems
+// no longer restate what their shaders already declare.
+class VseShaderReflection {
+ public:
+  using SetBindings = std::map<uint32_t, VkDescriptorSetLayoutBinding>;
+
+  // Parses a SPIR-V module as returned by VsePipeline::readFile
+  explicit VseShaderReflection(const std::vector<char> &code);
+
+  // Folds another stage's interface into this one
+  void merge(const VseShaderReflection &other);
+
+  VkShaderStageFlags getStageFlags() const { return stageFlags; }
+  const std::string &getEntryPoint() const { return entryPoint; }
+  bool hasPushConstants() const { return pushConstantRange.size > 0; }
+  // All stages share one range covering every push constant they read
+  const VkPushConstantRange &getPushConstantRange() const {
+    return pushConstantRange;
+  }
+  const std::map<uint32_t, SetBindings> &getDescriptorSets() const {
+    return descriptorSets;
+  }
+  const std::vector<ReflectedVertexInput> &getVertexInputs() const {
+    return vertexInputs;
+  }
+  const std::vector<ReflectedSpecConstant> &getSpecConstants() const {
+    return specConstants;
+  }
+  const ReflectedSpecConstant *findSpecConstant(uint32_t constantId) const;
+
+  // Sets listed in externalLayouts (e.g. the bindless table) are used as-is,
+  // every other set is built from the reflected bindings. Unused sets below
+  // the highest one get an empty layout.
+  std::vector<VkDescriptorSetLayout> buildSetLayouts(
+      VseDescriptorLayoutCache &descriptorLayoutCache,
+      const std::unordered_map<uint32_t, VkDescriptorSetLayout>
+          &externalLayouts = {}) const;
+  VkPipelineLayout buildPipelineLayout(
+      VseDescriptorLayoutCache &descriptorLayoutCache,
+      VsePipelineLayoutCache &pipelineLayoutCache,
+      const std::unordered_map<uint32_t, VkDescriptorSetLayout>
+          &externalLayouts = {}) const;
+
+  // Checks every vertex input has an attribute of a compatible format and
+  // returns only the attributes the shader reads
+  std::vector<VkVertexInputAttributeDescription> matchVertexAttributes(
+      const std::vector<VkVertexInputAttributeDescription> &attributes) const;
+
+ private:
+  VkShaderStageFlags stageFlags = 0;
+  std::string entryPoint;
+  VkPushConstantRange pushConstantRange{};
+  std::map<uint32_t, SetBindings> descriptorSets;
+  std::vector<ReflectedVertexInput> vertexInputs;
+  std::vector<ReflectedSpecConstant> specConstants;
+};
+
+// Parsed modules keyed by SPIR-V path. Entries live until the file is
+// rewritten, see VsePipelineRegistry::reloadShader. Thread safe.
+class VseShaderReflectionCache {
+ public:
+  std::shared_ptr<const VseShaderReflection> get(const std::string &spvPath);
+  // Merged interface of both stages, fragFilepath may be empty
+  VseShaderReflection reflect(const std::string &vertFilepath,
+                              const std::string &fragFilepath);
+  void invalidate(const std::string &spvPath);
+
+ private:
+  std::mutex mutex;
+  std::unordered_map<std::string, std::shared_ptr<const VseShaderReflection>>
+      entries;
+};
+
+}  // namespace vse
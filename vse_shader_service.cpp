@@ -0,0 +1,222 @@
+#include "vse_shader_service.hpp"
+
+// std
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Set from GLSLC_COMPILER_PATH in .env by the Makefile
+#ifndef VSE_GLSLC_PATH
+#define VSE_GLSLC_PATH "glslc"
+#endif
+
+namespace vse {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int POLL_INTERVAL_MS = 250;
+
+std::string normalizePath(const std::string &path) {
+  return fs::path{path}.lexically_normal().string();
+}
+
+}  // namespace
+
+VseShaderService::VseShaderService(VseJobSystem &jobSystem,
+                                   std::string shaderDirectory)
+    : jobSystem{jobSystem}, shaderDirectory{std::move(shaderDirectory)} {
+  watcher = std::thread{[this]() { watchLoop(); }};
+}
+
+VseShaderService::~VseShaderService() {
+  stopping = true;
+  watcher.join();
+
+  // Compile jobs call back into the service, so they may not outlive it
+  std::deque<std::future<void>> pendingCompiles;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    pendingCompiles.swap(compileJobs);
+  }
+  for (auto &job : pendingCompiles) {
+    job.wait();
+  }
+}
+
+void VseShaderService::addListener(Listener listener) {
+  std::lock_guard<std::mutex> lock{mutex};
+  listeners.push_back(std::move(listener));
+}
+
+std::string VseShaderService::glslcPath() {
+  const char *path = std::getenv("GLSLC_COMPILER_PATH");
+  if (path != nullptr && path[0] != '\0') {
+    return path;
+  }
+  std::string builtIn = VSE_GLSLC_PATH;
+  return builtIn.empty() ? "glslc" : builtIn;
+}
+
+void VseShaderService::watchLoop() {
+#ifdef __linux__
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd >= 0 && inotify_add_watch(fd, shaderDirectory.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO) >= 0) {
+    alignas(inotify_event) char buffer[4096];
+    while (!stopping) {
+      pollfd pollFd{fd, POLLIN, 0};
+      if (poll(&pollFd, 1, POLL_INTERVAL_MS) <= 0) {
+        continue;
+      }
+      ssize_t length;
+      while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + length;) {
+          auto *event = reinterpret_cast<inotify_event *>(ptr);
+          if (event->len > 0) {
+            fs::path path = fs::path{shaderDirectory} / event->name;
+            if (isShaderSource(path)) {
+              compile(normalizePath(path.string()));
+            }
+          }
+          ptr += sizeof(inotify_event) + event->len;
+        }
+      }
+    }
+    close(fd);
+    return;
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  std::cerr << "inotify unavailable, polling " << shaderDirectory
+            << " for shader changes" << std::endl;
+#endif
+
+  // Portable fallback: compare modification times on an interval
+  std::unordered_map<std::string, fs::file_time_type> writeTimes;
+  bool initialScan = true;
+  while (!stopping) {
+    std::error_code error;
+    for (const auto &entry : fs::directory_iterator{shaderDirectory, error}) {
+      if (!isShaderSource(entry.path())) {
+        continue;
+      }
+      auto writeTime = fs::last_write_time(entry.path(), error);
+      if (error) {
+        continue;
+      }
+      std::string path = normalizePath(entry.path().string());
+      auto it = writeTimes.find(path);
+      if (it == writeTimes.end() || it->second != writeTime) {
+        writeTimes[path] = writeTime;
+        // Sources present at startup were compiled by the build
+        if (!initialScan) {
+          compile(path);
+        }
+      }
+    }
+    initialScan = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds{POLL_INTERVAL_MS});
+  }
+}
+
+void VseShaderService::compile(const std::string &sourcePath) {
+  std::lock_guard<std::mutex> lock{mutex};
+  // Saves landing during a compile are picked up by one more run of the same
+  // job, so an older compile can never overwrite a newer result
+  auto compiling = recompile.find(sourcePath);
+  if (compiling != recompile.end()) {
+    compiling->second = true;
+    return;
+  }
+  recompile[sourcePath] = false;
+
+  for (auto it = compileJobs.begin(); it != compileJobs.end();) {
+    if (it->wait_for(std::chrono::seconds{0}) == std::future_status::ready) {
+      it = compileJobs.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  compileJobs.push_back(jobSystem.submit([this, sourcePath]() {
+    while (true) {
+      if (runGlslc(sourcePath)) {
+        onSpirvChanged(normalizePath(sourcePath + ".spv"));
+      }
+      std::lock_guard<std::mutex> lock{mutex};
+      auto it = recompile.find(sourcePath);
+      if (!it->second) {
+        recompile.erase(it);
+        return;
+      }
+      it->second = false;
+    }
+  }));
+}
+
+bool VseShaderService::runGlslc(const std::string &sourcePath) {
+  std::string spvPath = sourcePath + ".spv";
+  // Written next to the target and renamed so a pipeline rebuild never
+  // reads a half-written module
+  std::string tempPath = spvPath + ".tmp";
+  std::string command = "\"" + glslcPath() + "\" \"" + sourcePath +
+                        "\" -o \"" + tempPath + "\" 2>&1";
+
+  FILE *pipe = popen(command.c_str(), "r");
+  if (pipe == nullptr) {
+    std::cerr << "failed to run glslc for " << sourcePath << std::endl;
+    return false;
+  }
+  std::string output;
+  std::array<char, 256> chunk;
+  while (fgets(chunk.data(), static_cast<int>(chunk.size()), pipe) !=
+         nullptr) {
+    output += chunk.data();
+  }
+  int status = pclose(pipe);
+
+  std::error_code error;
+  if (status != 0) {
+    std::cerr << "failed to compile " << sourcePath << ":\n"
+              << output << std::endl;
+    fs::remove(tempPath, error);
+    return false;
+  }
+  fs::rename(tempPath, spvPath, error);
+  if (error) {
+    std::cerr << "failed to replace " << spvPath << ": " << error.message()
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void VseShaderService::onSpirvChanged(const std::string &spvPath) {
+  std::vector<Listener> notify;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    notify = listeners;
+  }
+  for (auto &listener : notify) {
+    listener(spvPath);
+  }
+}
+
+bool VseShaderService::isShaderSource(const fs::path &path) {
+  auto extension = path.extension();
+  return extension == ".vert" || extension == ".frag" || extension == ".comp";
+}
+
+}  // namespace vse
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "vse_job_system.hpp"
+
+// std
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace vse {
+
+// Watches the shader sources and recompiles changed GLSL with glslc in the
+// background. Listeners hear about each rebuilt .spv file; the pipeline
+// registry uses this to recompile and swap affected pipelines.
+class VseShaderService {
+ public:
+  // Called on a worker thread with the path of the rewritten SPIR-V module
+  using Listener = std::function<void(const std::string &spvPath)>;
+
+  VseShaderService(VseJobSystem &jobSystem,
+                   std::string shaderDirectory = "shaders");
+  ~VseShaderService();
+
+  VseShaderService(const VseShaderService &) = delete;
+  VseShaderService &operator=(const VseShaderService &) = delete;
+
+  void addListener(Listener listener);
+
+  static std::string glslcPath();
+
+ private:
+  void watchLoop();
+  void compile(const std::string &sourcePath);
+  static bool runGlslc(const std::string &sourcePath);
+  void onSpirvChanged(const std::string &spvPath);
+
+  static bool isShaderSource(const std::filesystem::path &path);
+
+  VseJobSystem &jobSystem;
+  std::string shaderDirectory;
+
+  std::mutex mutex;
+  std::vector<Listener> listeners;
+  std::deque<std::future<void>> compileJobs;
+  // Sources with a compile job running, true if saved again since it began
+  std::unordered_map<std::string, bool> recompile;
+
+  std::atomic<bool> stopping{false};
+  std::thread watcher;
+};
+
+}  // namespace vse
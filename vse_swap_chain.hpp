@@ -16,22 +16,26 @@ class VseSwapChain {
  public:
   static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
-  VseSwapChain(VseDevice &deviceRef, VkExtent2D windowExtent);
+  // Only the presentable images are created here; the render graph owns
+  // depth and every other attachment. presentMode falls back to FIFO when
+  // the surface doesn't support it.
   VseSwapChain(VseDevice &deviceRef, VkExtent2D windowExtent,
-               std::shared_ptr<VseSwapChain> previous);
+               VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR);
+  VseSwapChain(VseDevice &deviceRef, VkExtent2D windowExtent,
+               std::shared_ptr<VseSwapChain> previous,
+               VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR);
   ~VseSwapChain();
 
   VseSwapChain(const VseSwapChain &) = delete;
   VseSwapChain &operator=(const VseSwapChain &) = delete;
 
-  VkFramebuffer getFrameBuffer(int index) {
-    return swapChainFramebuffers[index];
-  }
-  VkRenderPass getRenderPass() { return renderPass; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+  VkImage getImage(int index) { return swapChainImages[index]; }
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
+  VkFormat getSwapChainDepthFormat() { return swapChainDepthFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
+  VkPresentModeKHR getPresentMode() { return presentMode; }
   uint32_t width() { return swapChainExtent.width; }
   uint32_t height() { return swapChainExtent.height; }
 
@@ -45,6 +49,13 @@ class VseSwapChain {
   VkResult submitCommandBuffers(const VkCommandBuffer *buffers,
                                 uint32_t *imageIndex);
 
+  // Id of the last present, only assigned when the device has present wait
+  uint64_t getLastPresentId() { return presentId; }
+  // VK_SUCCESS once the present with this id or a later one is on screen
+  VkResult waitForPresent(uint64_t presentId, uint64_t timeout) {
+    return device.waitForPresent(swapChain, presentId, timeout);
+  }
+
   bool compareSwapChainFormats(const VseSwapChain &swapChain) const {
     return swapChain.swapChainDepthFormat == swapChainDepthFormat &&
            swapChain.swapChainImageFormat == swapChainImageFormat;
@@ -54,9 +65,6 @@ class VseSwapChain {
   void init();
   void createSwapChain();
   void createImageViews();
-  void createDepthResources();
-  void createRenderPass();
-  void createFramebuffers();
   void createSyncObjects();
 
   // Helper functions
@@ -69,13 +77,8 @@ class VseSwapChain {
   VkFormat swapChainImageFormat;
   VkFormat swapChainDepthFormat;
   VkExtent2D swapChainExtent;
+  VkPresentModeKHR presentMode;
 
-  std::vector<VkFramebuffer> swapChainFramebuffers;
-  VkRenderPass renderPass;
-
-  std::vector<VkImage> depthImages;
-  std::vector<VkDeviceMemory> depthImageMemorys;
-  std::vector<VkImageView> depthImageViews;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
 
@@ -90,6 +93,7 @@ class VseSwapChain {
   std::vector<VkFence> inFlightFences;
   std::vector<VkFence> imagesInFlight;
   size_t currentFrame = 0;
+  uint64_t presentId = 0;
 };
 
 }  // namespace vse
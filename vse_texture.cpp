@@ -0,0 +1,323 @@
+#include "vse_texture.hpp"
+
+#include "vse_buffer.hpp"
+#include "vse_utils.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace vse {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+float millisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<float, std::milli>(Clock::now() - start)
+      .count();
+}
+
+VkImageMemoryBarrier imageBarrier(VkImage image, uint32_t baseMipLevel,
+                                  uint32_t levelCount, VkImageLayout oldLayout,
+                                  VkImageLayout newLayout,
+                                  VkAccessFlags srcAccessMask,
+                                  VkAccessFlags dstAccessMask) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = srcAccessMask;
+  barrier.dstAccessMask = dstAccessMask;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = baseMipLevel;
+  barrier.subresourceRange.levelCount = levelCount;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  return barrier;
+}
+
+}  // namespace
+
+VseSamplerCache::~VseSamplerCache() {
+  for (auto &kv : samplers) {
+    vkDestroySampler(vseDevice.device(), kv.second, nullptr);
+  }
+}
+
+VkSampler VseSamplerCache::getSampler(const VkSamplerCreateInfo &samplerInfo) {
+  assert(samplerInfo.pNext == nullptr &&
+         "Cached samplers can't have a pNext chain");
+  auto it = samplers.find(samplerInfo);
+  if (it != samplers.end()) {
+    return it->second;
+  }
+
+  VkSampler sampler;
+  if (vkCreateSampler(vseDevice.device(), &samplerInfo, nullptr, &sampler) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create texture sampler!");
+  }
+  samplers.emplace(samplerInfo, sampler);
+  return sampler;
+}
+
+bool VseSamplerCache::SamplerInfoEqual::operator()(
+    const VkSamplerCreateInfo &a, const VkSamplerCreateInfo &b) const {
+  return a.flags == b.flags && a.magFilter == b.magFilter &&
+         a.minFilter == b.minFilter && a.mipmapMode == b.mipmapMode &&
+         a.addressModeU == b.addressModeU &&
+         a.addressModeV == b.addressModeV &&
+         a.addressModeW == b.addressModeW && a.mipLodBias == b.mipLodBias &&
+         a.anisotropyEnable == b.anisotropyEnable &&
+         a.maxAnisotropy == b.maxAnisotropy &&
+         a.compareEnable == b.compareEnable && a.compareOp == b.compareOp &&
+         a.minLod == b.minLod && a.maxLod == b.maxLod &&
+         a.borderColor == b.borderColor &&
+         a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
+size_t VseSamplerCache::SamplerInfoHash::operator()(
+    const VkSamplerCreateInfo &samplerInfo) const {
+  size_t seed = 0;
+  hashCombine(seed, samplerInfo.flags, samplerInfo.magFilter,
+              samplerInfo.minFilter, samplerInfo.mipmapMode,
+              samplerInfo.addressModeU, samplerInfo.addressModeV,
+              samplerInfo.addressModeW, samplerInfo.mipLodBias,
+              samplerInfo.anisotropyEnable, samplerInfo.maxAnisotropy,
+              samplerInfo.compareEnable, samplerInfo.compareOp,
+              samplerInfo.minLod, samplerInfo.maxLod, samplerInfo.borderColor,
+              samplerInfo.unnormalizedCoordinates);
+  return seed;
+}
+
+VseTexture::VseTexture(VseDevice &device, VseSamplerCache &samplerCache,
+                       const VseImageData &imageData)
+    : vseDevice{device},
+      samplerCache{samplerCache},
+      format{imageData.format},
+      extent{imageData.width(), imageData.height()} {
+  assert(!imageData.levels.empty() && "Image data has no levels");
+  auto start = Clock::now();
+
+  bool generate = imageData.levels.size() == 1 && canGenerateMips(format);
+  mipLevels = generate ? static_cast<uint32_t>(std::floor(std::log2(
+                             std::max(extent.width, extent.height)))) + 1
+                       : static_cast<uint32_t>(imageData.levels.size());
+
+  VkImageUsageFlags usage =
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  if (generate) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  createImage(usage);
+  upload(imageData, generate);
+  createImageView();
+  setSampler(defaultSamplerInfo(device));
+
+  stats.fileBytes = imageData.fileSize;
+  stats.uploadMs = millisecondsSince(start);
+}
+
+VseTexture::~VseTexture() {
+  vkDestroyImageView(vseDevice.device(), imageView, nullptr);
+  vkDestroyImage(vseDevice.device(), image, nullptr);
+  vkFreeMemory(vseDevice.device(), imageMemory, nullptr);
+}
+
+std::unique_ptr<VseTexture> VseTexture::createTextureFromFile(
+    VseDevice &device, VseSamplerCache &samplerCache,
+    const std::string &filepath, bool srgb) {
+  auto start = Clock::now();
+  VseImageData imageData = loadImageFile(filepath, srgb);
+  float decodeMs = millisecondsSince(start);
+
+  auto texture =
+      std::make_unique<VseTexture>(device, samplerCache, imageData);
+  texture->stats.decodeMs = decodeMs;
+  return texture;
+}
+
+VkSamplerCreateInfo VseTexture::defaultSamplerInfo(VseDevice &device) {
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.anisotropyEnable = VK_TRUE;
+  samplerInfo.maxAnisotropy = device.properties.limits.maxSamplerAnisotropy;
+  samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+  samplerInfo.minLod = 0.f;
+  // Not clamped to the texture's mip count, so every texture shares it
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+  return samplerInfo;
+}
+
+void VseTexture::setSampler(const VkSamplerCreateInfo &samplerInfo) {
+  sampler = samplerCache.getSampler(samplerInfo);
+}
+
+bool VseTexture::canGenerateMips(VkFormat format) {
+  if (formatBlock(format).isCompressed()) {
+    return false;
+  }
+  VkFormatFeatureFlags required =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (vseDevice.getFormatProperties(format).optimalTilingFeatures &
+          required) == required;
+}
+
+void VseTexture::createImage(VkImageUsageFlags usage) {
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = extent.width;
+  imageInfo.extent.height = extent.height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = mipLevels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = format;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = usage;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  vseDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                image, imageMemory);
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(vseDevice.device(), image, &memRequirements);
+  stats.memoryBytes = memRequirements.size;
+}
+
+void VseTexture::upload(const VseImageData &imageData, bool generateMips) {
+  VseBuffer stagingBuffer{
+      vseDevice,
+      1,
+      static_cast<uint32_t>(imageData.pixels.size()),
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+  };
+  stagingBuffer.map();
+  stagingBuffer.writeToBuffer(imageData.pixels.data());
+
+  std::vector<VkBufferImageCopy> regions(imageData.levels.size());
+  for (size_t i = 0; i < regions.size(); i++) {
+    const auto &level = imageData.levels[i];
+    regions[i].bufferOffset = level.offset;
+    regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    regions[i].imageSubresource.mipLevel = static_cast<uint32_t>(i);
+    regions[i].imageSubresource.baseArrayLayer = 0;
+    regions[i].imageSubresource.layerCount = 1;
+    regions[i].imageExtent = {level.width, level.height, 1};
+  }
+
+  VkCommandBuffer commandBuffer = vseDevice.beginSingleTimeCommands();
+
+  auto toTransfer =
+      imageBarrier(image, 0, mipLevels, VK_IMAGE_LAYOUT_UNDEFINED,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                   VK_ACCESS_TRANSFER_WRITE_BIT);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &toTransfer);
+
+  vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.getBuffer(), image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         static_cast<uint32_t>(regions.size()),
+                         regions.data());
+
+  if (generateMips) {
+    this->generateMips(commandBuffer);
+  } else {
+    auto toShader =
+        imageBarrier(image, 0, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                     VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &toShader);
+  }
+
+  // Waits for the queue, so the staging buffer can go out of scope
+  vseDevice.endSingleTimeCommands(commandBuffer);
+}
+
+void VseTexture::generateMips(VkCommandBuffer commandBuffer) {
+  int32_t width = static_cast<int32_t>(extent.width);
+  int32_t height = static_cast<int32_t>(extent.height);
+
+  for (uint32_t i = 1; i < mipLevels; i++) {
+    // The level above was just written, by the copy or the previous blit
+    auto toSource = imageBarrier(
+        image, i - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &toSource);
+
+    int32_t nextWidth = std::max(width / 2, 1);
+    int32_t nextHeight = std::max(height / 2, 1);
+    VkImageBlit blit{};
+    blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1};
+    blit.srcOffsets[1] = {width, height, 1};
+    blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+    blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+    vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    auto toShader = imageBarrier(
+        image, i - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+        VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &toShader);
+
+    width = nextWidth;
+    height = nextHeight;
+  }
+
+  auto lastToShader = imageBarrier(
+      image, mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_SHADER_READ_BIT);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &lastToShader);
+}
+
+void VseTexture::createImageView() {
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.baseMipLevel = 0;
+  viewInfo.subresourceRange.levelCount = mipLevels;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount = 1;
+
+  if (vkCreateImageView(vseDevice.device(), &viewInfo, nullptr, &imageView) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create texture image view!");
+  }
+}
+
+}  // namespace vse
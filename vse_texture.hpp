@@ -0,0 +1,112 @@
+#pragma once
+
+#include "vse_device.hpp"
+#include "vse_image_loader.hpp"
+
+// std
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace vse {
+
+// Shares VkSamplers between textures asking for the same sampler state.
+// Samplers live as long as the cache.
+class VseSamplerCache {
+ public:
+  VseSamplerCache(VseDevice &device) : vseDevice{device} {}
+  ~VseSamplerCache();
+
+  VseSamplerCache(const VseSamplerCache &) = delete;
+  VseSamplerCache &operator=(const VseSamplerCache &) = delete;
+
+  // pNext chains are not part of the key and must be null
+  VkSampler getSampler(const VkSamplerCreateInfo &samplerInfo);
+
+  size_t size() const { return samplers.size(); }
+
+ private:
+  struct SamplerInfoEqual {
+    bool operator()(const VkSamplerCreateInfo &a,
+                    const VkSamplerCreateInfo &b) const;
+  };
+  struct SamplerInfoHash {
+    size_t operator()(const VkSamplerCreateInfo &samplerInfo) const;
+  };
+
+  VseDevice &vseDevice;
+  std::unordered_map<VkSamplerCreateInfo, VkSampler, SamplerInfoHash,
+                     SamplerInfoEqual>
+      samplers;
+};
+
+// Sampled 2D image in device local memory. Pixels are uploaded through a
+// staging buffer; when the source has a single level and the format can be
+// blitted with linear filtering, the rest of the mip chain is generated on
+// the GPU by blitting each level down from the one above.
+class VseTexture {
+ public:
+  struct Stats {
+    VkDeviceSize fileBytes;
+    // Device memory backing the image, including mips and padding
+    VkDeviceSize memoryBytes;
+    float decodeMs;
+    // Staging copy, upload and mip generation, until the GPU finished
+    float uploadMs;
+
+    // File megabytes loaded per second of decode and upload
+    float throughputMBps() const {
+      float ms = decodeMs + uploadMs;
+      return ms > 0.f ? static_cast<float>(fileBytes) / (ms * 1000.f) : 0.f;
+    }
+  };
+
+  VseTexture(VseDevice &device, VseSamplerCache &samplerCache,
+             const VseImageData &image);
+  ~VseTexture();
+
+  VseTexture(const VseTexture &) = delete;
+  VseTexture &operator=(const VseTexture &) = delete;
+
+  // KTX2 or PNG, see loadImageFile
+  static std::unique_ptr<VseTexture> createTextureFromFile(
+      VseDevice &device, VseSamplerCache &samplerCache,
+      const std::string &filepath, bool srgb = true);
+
+  // Trilinear, repeating, with the highest anisotropy the GPU allows
+  static VkSamplerCreateInfo defaultSamplerInfo(VseDevice &device);
+  void setSampler(const VkSamplerCreateInfo &samplerInfo);
+
+  VkImage getImage() const { return image; }
+  VkImageView getImageView() const { return imageView; }
+  VkSampler getSampler() const { return sampler; }
+  VkFormat getFormat() const { return format; }
+  VkExtent2D getExtent() const { return extent; }
+  uint32_t getMipLevels() const { return mipLevels; }
+  const Stats &getStats() const { return stats; }
+
+  VkDescriptorImageInfo descriptorInfo() const {
+    return {sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  }
+
+ private:
+  bool canGenerateMips(VkFormat format);
+  void createImage(VkImageUsageFlags usage);
+  void upload(const VseImageData &imageData, bool generateMips);
+  void generateMips(VkCommandBuffer commandBuffer);
+  void createImageView();
+
+  VseDevice &vseDevice;
+  VseSamplerCache &samplerCache;
+  VkImage image = VK_NULL_HANDLE;
+  VkDeviceMemory imageMemory = VK_NULL_HANDLE;
+  VkImageView imageView = VK_NULL_HANDLE;
+  VkSampler sampler = VK_NULL_HANDLE;
+
+  VkFormat format;
+  VkExtent2D extent;
+  uint32_t mipLevels;
+  Stats stats{};
+};
+
+}  // namespace vse
@@ -0,0 +1,419 @@
+#include "vse_texture_streamer.hpp"
+
+#include "vse_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+namespace vse {
+
+namespace {
+
+// Satisfies the copy offset alignment of every format formatBlock accepts
+constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+VkImageMemoryBarrier levelsBarrier(VkImage image, uint32_t levelCount,
+                                   VkImageLayout oldLayout,
+                                   VkImageLayout newLayout,
+                                   VkAccessFlags srcAccessMask,
+                                   VkAccessFlags dstAccessMask) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = srcAccessMask;
+  barrier.dstAccessMask = dstAccessMask;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = levelCount;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  return barrier;
+}
+
+}  // namespace
+
+VseTextureStreamer::VseTextureStreamer(VseDevice &device,
+                                       VseSamplerCache &samplerCache,
+                                       VseBindlessTable &bindlessTable)
+    : vseDevice{device},
+      bindlessTable{bindlessTable},
+      stagingBuffers(VseSwapChain::MAX_FRAMES_IN_FLIGHT) {
+  sampler = samplerCache.getSampler(VseTexture::defaultSamplerInfo(device));
+}
+
+VseTextureStreamer::~VseTextureStreamer() {
+  deletionQueue.flushAll();
+  for (auto &texture : textures) {
+    vkDestroyImageView(vseDevice.device(), texture->view, nullptr);
+    vkDestroyImage(vseDevice.device(), texture->image, nullptr);
+    vkFreeMemory(vseDevice.device(), texture->memory, nullptr);
+  }
+}
+
+VseBindlessTable::Handle VseTextureStreamer::addTexture(
+    const std::string &filepath, bool srgb) {
+  auto texture = std::make_unique<StreamedTexture>();
+  texture->data = loadImageFile(filepath, srgb);
+  buildMipChain(texture->data);
+
+  const auto &levels = texture->data.levels;
+  uint32_t tailLevel = static_cast<uint32_t>(levels.size()) - 1;
+  for (uint32_t i = 0; i < levels.size(); i++) {
+    if (std::max(levels[i].width, levels[i].height) <=
+        config.residentTailSize) {
+      tailLevel = i;
+      break;
+    }
+  }
+  texture->tailLevel = tailLevel;
+  texture->residentLevel = tailLevel;
+  texture->desiredLevel = tailLevel;
+
+  VseBuffer staging{
+      vseDevice,
+      1,
+      static_cast<uint32_t>(levelBytes(*texture, tailLevel)),
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+  };
+  staging.map();
+  VkDeviceSize stagingOffset = 0;
+  VkCommandBuffer commandBuffer = vseDevice.beginSingleTimeCommands();
+  setResidentLevel(*texture, tailLevel, commandBuffer, &staging,
+                   stagingOffset);
+  vseDevice.endSingleTimeCommands(commandBuffer);
+
+  texture->handle = bindlessTable.addTexture(
+      {sampler, texture->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+  byHandle[texture->handle] = texture.get();
+  textures.push_back(std::move(texture));
+  return textures.back()->handle;
+}
+
+void VseTextureStreamer::reportUsage(VseBindlessTable::Handle handle,
+                                     float screenFraction) {
+  auto it = byHandle.find(handle);
+  if (it == byHandle.end()) {
+    return;
+  }
+  StreamedTexture &texture = *it->second;
+  texture.screenFraction = std::max(texture.screenFraction, screenFraction);
+  texture.lastUsedFrame = frameCounter;
+}
+
+void VseTextureStreamer::update(VkCommandBuffer commandBuffer, int frameIndex,
+                                uint32_t viewportHeight) {
+  frameCounter++;
+  if (frameCounter >= VseSwapChain::MAX_FRAMES_IN_FLIGHT) {
+    deletionQueue.flush(frameCounter - VseSwapChain::MAX_FRAMES_IN_FLIGHT);
+  }
+  stats.uploadBytes = 0;
+  stats.levelsUploaded = 0;
+  stats.levelsEvicted = 0;
+
+  // Reports from the previous frame pick the level whose texels roughly
+  // match screen pixels; textures not drawn could drop to their tail
+  std::vector<StreamedTexture *> upgrades;
+  for (auto &texture : textures) {
+    uint32_t desired = texture->tailLevel;
+    if (texture->screenFraction > 0.f) {
+      float pixels = texture->screenFraction * viewportHeight;
+      float size = static_cast<float>(
+          std::max(texture->data.width(), texture->data.height()));
+      float level =
+          size > pixels ? std::floor(std::log2(size / pixels)) : 0.f;
+      desired = std::min(static_cast<uint32_t>(level), texture->tailLevel);
+    }
+    texture->desiredLevel = desired;
+    texture->screenFraction = 0.f;
+    if (desired < texture->residentLevel) {
+      upgrades.push_back(texture.get());
+    }
+  }
+
+  VkDeviceSize budget = effectiveBudget();
+  stats.budgetBytes = budget;
+  // The budget may have shrunk since the last frame
+  makeRoom(0, budget, nullptr, commandBuffer);
+
+  // Textures missing the most levels first, one residency change each
+  std::sort(upgrades.begin(), upgrades.end(),
+            [](const StreamedTexture *a, const StreamedTexture *b) {
+              return a->residentLevel - a->desiredLevel >
+                     b->residentLevel - b->desiredLevel;
+            });
+  struct Upgrade {
+    StreamedTexture *texture;
+    uint32_t firstLevel;
+  };
+  std::vector<Upgrade> planned;
+  VkDeviceSize uploadBytes = 0;
+  VkDeviceSize plannedGrowth = 0;
+  for (StreamedTexture *texture : upgrades) {
+    // Take as many levels as the remaining upload budget allows, at least
+    // one in a frame that has uploaded nothing yet
+    uint32_t first = texture->residentLevel;
+    VkDeviceSize bytes = 0;
+    while (first > texture->desiredLevel) {
+      VkDeviceSize next =
+          bytes + alignUp(texture->data.levels[first - 1].size,
+                          STAGING_ALIGNMENT);
+      if (uploadBytes + next > config.uploadBudget &&
+          (uploadBytes > 0 || bytes > 0)) {
+        break;
+      }
+      bytes = next;
+      first--;
+    }
+    if (first == texture->residentLevel) {
+      break;
+    }
+
+    VkDeviceSize estimate = levelBytes(*texture, first);
+    VkDeviceSize growth = estimate > texture->memoryBytes
+                              ? estimate - texture->memoryBytes
+                              : 0;
+    if (!makeRoom(plannedGrowth + growth, budget, texture, commandBuffer)) {
+      continue;
+    }
+    planned.push_back({texture, first});
+    uploadBytes += bytes;
+    plannedGrowth += growth;
+  }
+  if (planned.empty()) {
+    return;
+  }
+
+  auto &staging = stagingBuffers[frameIndex];
+  if (!staging || staging->getBufferSize() < uploadBytes) {
+    // The previous buffer of this frame index is no longer in use
+    staging = std::make_unique<VseBuffer>(
+        vseDevice, 1,
+        static_cast<uint32_t>(std::max(uploadBytes, config.uploadBudget)),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    staging->map();
+  }
+
+  VkDeviceSize stagingOffset = 0;
+  for (const auto &upgrade : planned) {
+    stats.levelsUploaded +=
+        upgrade.texture->residentLevel - upgrade.firstLevel;
+    setResidentLevel(*upgrade.texture, upgrade.firstLevel, commandBuffer,
+                     staging.get(), stagingOffset);
+  }
+  stats.uploadBytes = stagingOffset;
+}
+
+VkDeviceSize VseTextureStreamer::effectiveBudget() {
+  VkDeviceSize budget = config.memoryBudget;
+  if (vseDevice.hasMemoryBudget()) {
+    // Reported usage includes the streamed textures themselves
+    auto heap = vseDevice.getDeviceLocalMemoryBudget();
+    VkDeviceSize others = heap.usage > stats.residentBytes
+                              ? heap.usage - stats.residentBytes
+                              : 0;
+    VkDeviceSize available = heap.budget > others ? heap.budget - others : 0;
+    budget = std::min(budget, static_cast<VkDeviceSize>(
+                                  available * config.budgetHeadroom));
+  }
+  return budget;
+}
+
+VkDeviceSize VseTextureStreamer::levelBytes(const StreamedTexture &texture,
+                                            uint32_t firstLevel) const {
+  VkDeviceSize bytes = 0;
+  for (size_t i = firstLevel; i < texture.data.levels.size(); i++) {
+    bytes += alignUp(texture.data.levels[i].size, STAGING_ALIGNMENT);
+  }
+  return bytes;
+}
+
+bool VseTextureStreamer::makeRoom(VkDeviceSize bytes, VkDeviceSize budget,
+                                  const StreamedTexture *keep,
+                                  VkCommandBuffer commandBuffer) {
+  if (stats.residentBytes + bytes <= budget) {
+    return true;
+  }
+
+  // Textures holding finer levels than they need, which includes every
+  // texture not drawn last frame that has more than its tail resident
+  std::vector<StreamedTexture *> victims;
+  for (auto &texture : textures) {
+    if (texture.get() != keep &&
+        texture->residentLevel < texture->desiredLevel) {
+      victims.push_back(texture.get());
+    }
+  }
+  std::sort(victims.begin(), victims.end(),
+            [](const StreamedTexture *a, const StreamedTexture *b) {
+              return a->lastUsedFrame < b->lastUsedFrame;
+            });
+
+  VkDeviceSize unusedOffset = 0;
+  for (StreamedTexture *victim : victims) {
+    if (stats.residentBytes + bytes <= budget) {
+      break;
+    }
+    stats.levelsEvicted += victim->desiredLevel - victim->residentLevel;
+    // Dropping levels only copies on the GPU, nothing is staged
+    setResidentLevel(*victim, victim->desiredLevel, commandBuffer, nullptr,
+                     unusedOffset);
+  }
+  return stats.residentBytes + bytes <= budget;
+}
+
+void VseTextureStreamer::setResidentLevel(StreamedTexture &texture,
+                                          uint32_t firstLevel,
+                                          VkCommandBuffer commandBuffer,
+                                          VseBuffer *staging,
+                                          VkDeviceSize &stagingOffset) {
+  const auto &levels = texture.data.levels;
+  uint32_t levelCount = static_cast<uint32_t>(levels.size());
+  uint32_t oldFirst = texture.residentLevel;
+  bool hasOldImage = texture.image != VK_NULL_HANDLE;
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = levels[firstLevel].width;
+  imageInfo.extent.height = levels[firstLevel].height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = levelCount - firstLevel;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = texture.data.format;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                    VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkImage image;
+  VkDeviceMemory memory;
+  vseDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                image, memory);
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(vseDevice.device(), image, &memRequirements);
+
+  auto toTransfer = levelsBarrier(image, imageInfo.mipLevels,
+                                  VK_IMAGE_LAYOUT_UNDEFINED,
+                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                                  VK_ACCESS_TRANSFER_WRITE_BIT);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &toTransfer);
+
+  if (hasOldImage) {
+    // Earlier frames may still sample the old image
+    auto toSource = levelsBarrier(texture.image, levelCount - oldFirst,
+                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                  VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 0,
+                                  VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &toSource);
+
+    std::vector<VkImageCopy> copies;
+    for (uint32_t level = std::max(firstLevel, oldFirst); level < levelCount;
+         level++) {
+      VkImageCopy copy{};
+      copy.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - oldFirst, 0,
+                             1};
+      copy.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - firstLevel, 0,
+                             1};
+      copy.extent = {levels[level].width, levels[level].height, 1};
+      copies.push_back(copy);
+    }
+    vkCmdCopyImage(commandBuffer, texture.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   static_cast<uint32_t>(copies.size()), copies.data());
+  }
+
+  uint32_t uploadEnd = hasOldImage ? oldFirst : levelCount;
+  std::vector<VkBufferImageCopy> uploads;
+  for (uint32_t level = firstLevel; level < uploadEnd; level++) {
+    const auto &source = levels[level];
+    assert(staging != nullptr && "Adding levels needs a staging buffer");
+    staging->writeToBuffer(texture.data.pixels.data() + source.offset,
+                           source.size, stagingOffset);
+    VkBufferImageCopy region{};
+    region.bufferOffset = stagingOffset;
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - firstLevel,
+                               0, 1};
+    region.imageExtent = {source.width, source.height, 1};
+    uploads.push_back(region);
+    stagingOffset += alignUp(source.size, STAGING_ALIGNMENT);
+  }
+  if (!uploads.empty()) {
+    vkCmdCopyBufferToImage(commandBuffer, staging->getBuffer(), image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(uploads.size()),
+                           uploads.data());
+  }
+
+  auto toShader = levelsBarrier(image, imageInfo.mipLevels,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                VK_ACCESS_TRANSFER_WRITE_BIT,
+                                VK_ACCESS_SHADER_READ_BIT);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &toShader);
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = texture.data.format;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.baseMipLevel = 0;
+  viewInfo.subresourceRange.levelCount = imageInfo.mipLevels;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount = 1;
+  VkImageView view;
+  if (vkCreateImageView(vseDevice.device(), &viewInfo, nullptr, &view) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create streamed texture view!");
+  }
+
+  if (hasOldImage) {
+    destroyImage(texture.image, texture.memory, texture.view);
+    bindlessTable.updateTexture(
+        texture.handle,
+        {sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+  }
+  stats.residentBytes += memRequirements.size - texture.memoryBytes;
+  texture.image = image;
+  texture.memory = memory;
+  texture.view = view;
+  texture.memoryBytes = memRequirements.size;
+  texture.residentLevel = firstLevel;
+}
+
+void VseTextureStreamer::destroyImage(VkImage image, VkDeviceMemory memory,
+                                      VkImageView view) {
+  VkDevice device = vseDevice.device();
+  deletionQueue.push(frameCounter, [device, image, memory, view]() {
+    vkDestroyImageView(device, view, nullptr);
+    vkDestroyImage(device, image, nullptr);
+    vkFreeMemory(device, memory, nullptr);
+  });
+}
+
+}  // namespace vse
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "vse_bindless_table.hpp"
+#include "vse_buffer.hpp"
+#include "vse_deletion_queue.hpp"
+#include "vse_device.hpp"
+#include "vse_image_loader.hpp"
+#include "vse_texture.hpp"
+
+// std
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vse {
+
+// Keeps textures partially resident on the GPU. A texture starts out with
+// only its smallest mips uploaded; finer levels are streamed in over the
+// following frames as draws report how large the texture appears on screen,
+// and levels of the least recently used textures are evicted to stay under
+// a memory budget. A residency change swaps the texture's image for one
+// holding the new range of levels: kept levels are copied on the GPU, new
+// ones come from a per-frame staging buffer, and the old image is destroyed
+// once the frames that used it have completed.
+class VseTextureStreamer {
+ public:
+  struct Config {
+    // Upper bound for streamed textures, lowered further to fit the
+    // VK_EXT_memory_budget headroom when the device reports it
+    VkDeviceSize memoryBudget = 256ull << 20;
+    // Share of the driver's remaining budget textures may grow into
+    float budgetHeadroom = 0.8f;
+    // Bytes of mip data uploaded per frame; a frame always uploads at least
+    // one level so large levels still make progress
+    VkDeviceSize uploadBudget = 4ull << 20;
+    // Levels no larger than this are uploaded on load and never evicted
+    uint32_t residentTailSize = 64;
+  };
+
+  struct Stats {
+    // Of the last update
+    VkDeviceSize uploadBytes;
+    uint32_t levelsUploaded;
+    uint32_t levelsEvicted;
+    VkDeviceSize budgetBytes;
+    // Device memory of all streamed images
+    VkDeviceSize residentBytes;
+  };
+
+  VseTextureStreamer(VseDevice &device, VseSamplerCache &samplerCache,
+                     VseBindlessTable &bindlessTable);
+  ~VseTextureStreamer();
+
+  VseTextureStreamer(const VseTextureStreamer &) = delete;
+  VseTextureStreamer &operator=(const VseTextureStreamer &) = delete;
+
+  void setConfig(const Config &newConfig) { config = newConfig; }
+  const Config &getConfig() const { return config; }
+
+  // Loads the whole file into memory and uploads its smallest mips right
+  // away. Returns the bindless handle shaders sample the texture with.
+  VseBindlessTable::Handle addTexture(const std::string &filepath,
+                                      bool srgb = true);
+
+  // Called for draws sampling the texture with the drawn object's projected
+  // size as a fraction of the viewport height; the largest report of a
+  // frame decides the mip level the texture needs
+  void reportUsage(VseBindlessTable::Handle handle, float screenFraction);
+
+  // Once per frame, after VseBindlessTable::nextFrame() and outside of any
+  // render pass. Evicts and uploads according to the previous frame's
+  // reports, recording the copies into commandBuffer.
+  void update(VkCommandBuffer commandBuffer, int frameIndex,
+              uint32_t viewportHeight);
+
+  const Stats &getStats() const { return stats; }
+  size_t getTextureCount() const { return textures.size(); }
+
+ private:
+  struct StreamedTexture {
+    VseBindlessTable::Handle handle;
+    // Every level, kept to upload finer ones on demand
+    VseImageData data;
+    // Levels from tailLevel on are always resident
+    uint32_t tailLevel;
+    // Finest level the image currently holds
+    uint32_t residentLevel;
+    uint32_t desiredLevel;
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkDeviceSize memoryBytes = 0;
+    // Largest report since the last update
+    float screenFraction = 0.f;
+    uint64_t lastUsedFrame = 0;
+  };
+
+  VkDeviceSize effectiveBudget();
+  VkDeviceSize levelBytes(const StreamedTexture &texture,
+                          uint32_t firstLevel) const;
+  // Replaces texture's image with one starting at firstLevel, uploading
+  // levels the old image lacks through staging, which may be null when
+  // only dropping levels
+  void setResidentLevel(StreamedTexture &texture, uint32_t firstLevel,
+                        VkCommandBuffer commandBuffer, VseBuffer *staging,
+                        VkDeviceSize &stagingOffset);
+  // Drops levels of least recently used textures other than keep until
+  // bytes more fit the budget, false when that is not possible
+  bool makeRoom(VkDeviceSize bytes, VkDeviceSize budget,
+                const StreamedTexture *keep, VkCommandBuffer commandBuffer);
+  void destroyImage(VkImage image, VkDeviceMemory memory, VkImageView view);
+
+  VseDevice &vseDevice;
+  VseBindlessTable &bindlessTable;
+  VkSampler sampler;
+  Config config{};
+
+  std::vector<std::unique_ptr<StreamedTexture>> textures;
+  std::unordered_map<VseBindlessTable::Handle, StreamedTexture *> byHandle;
+  // One per frame in flight, grown when a frame's uploads don't fit
+  std::vector<std::unique_ptr<VseBuffer>> stagingBuffers;
+  VseDeletionQueue deletionQueue;
+  uint64_t frameCounter = 0;
+  Stats stats{};
+};
+
+}  // namespace vse
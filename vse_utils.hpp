@@ -0,0 +1,52 @@
+#pragma once
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace vse {
+
+// from: https://stackoverflow.com/a/57595105
+template <typename T, typename... Rest>
+void hashCombine(std::size_t& seed, const T& v, const Rest&... rest) {
+  seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  (hashCombine(seed, rest), ...);
+};
+
+// 64-bit FNV-1a, used to fingerprint shader code
+inline uint64_t fnv1a64(const void* data, std::size_t size,
+                        uint64_t hash = 0xcbf29ce484222325ull) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+inline bool hasStencilComponent(VkFormat format) {
+  return format == VK_FORMAT_D16_UNORM_S8_UINT ||
+         format == VK_FORMAT_D24_UNORM_S8_UINT ||
+         format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+inline bool isDepthFormat(VkFormat format) {
+  return format == VK_FORMAT_D16_UNORM ||
+         format == VK_FORMAT_X8_D24_UNORM_PACK32 ||
+         format == VK_FORMAT_D32_SFLOAT || hasStencilComponent(format);
+}
+
+inline VkImageAspectFlags formatAspectMask(VkFormat format) {
+  if (!isDepthFormat(format)) {
+    return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+  return hasStencilComponent(format)
+             ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT
+             : VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
+}  // namespace vse
@@ -0,0 +1,107 @@
+#include "vse_vertex_format.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace vse {
+
+namespace {
+
+float signNotZero(float value) { return value >= 0.f ? 1.f : -1.f; }
+
+// SNORM decoding as the GPU does it, -32768 clamps to -1
+float unpackSnorm16(int16_t value) {
+  return std::max(static_cast<float>(value) / 32767.f, -1.f);
+}
+
+}  // namespace
+
+VkFormat VseVertexFormat::positionFormat() const {
+  // Three component 16 bit formats are optional for vertex buffers, the
+  // fourth component is padding
+  switch (position) {
+    case Position::Float16:
+      return VK_FORMAT_R16G16B16A16_SFLOAT;
+    case Position::Snorm16:
+      return VK_FORMAT_R16G16B16A16_SNORM;
+    default:
+      return VK_FORMAT_R32G32B32_SFLOAT;
+  }
+}
+
+VkFormat VseVertexFormat::colorFormat() const {
+  return color == Color::Unorm8 ? VK_FORMAT_R8G8B8A8_UNORM
+                                : VK_FORMAT_R32G32B32_SFLOAT;
+}
+
+VkFormat VseVertexFormat::normalFormat() const {
+  return normal == Normal::Octahedral16 ? VK_FORMAT_R16G16_SNORM
+                                        : VK_FORMAT_R32G32B32_SFLOAT;
+}
+
+uint32_t VseVertexFormat::positionSize() const {
+  return position == Position::Float32 ? 12 : 8;
+}
+
+uint32_t VseVertexFormat::colorSize() const {
+  return color == Color::Float32 ? 12 : 4;
+}
+
+uint32_t VseVertexFormat::normalSize() const {
+  return normal == Normal::Float32 ? 12 : 4;
+}
+
+std::string VseVertexFormat::name() const {
+  static const char *positionNames[] = {"float32", "float16", "snorm16"};
+  static const char *colorNames[] = {"float32", "unorm8"};
+  static const char *normalNames[] = {"float32", "oct16"};
+  return std::string{positionNames[static_cast<uint32_t>(position)]} + "/" +
+         colorNames[static_cast<uint32_t>(color)] + "/" +
+         normalNames[static_cast<uint32_t>(normal)];
+}
+
+glm::vec2 octahedralEncode(const glm::vec3 &normal) {
+  float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  glm::vec2 p{normal.x / l1, normal.y / l1};
+  if (normal.z < 0.f) {
+    // Fold the lower hemisphere over the diagonals
+    p = glm::vec2{(1.f - std::abs(p.y)) * signNotZero(p.x),
+                  (1.f - std::abs(p.x)) * signNotZero(p.y)};
+  }
+  return p;
+}
+
+glm::vec3 octahedralDecode(const glm::vec2 &encoded) {
+  glm::vec3 n{encoded.x, encoded.y,
+              1.f - std::abs(encoded.x) - std::abs(encoded.y)};
+  float t = std::max(-n.z, 0.f);
+  n.x += n.x >= 0.f ? -t : t;
+  n.y += n.y >= 0.f ? -t : t;
+  return glm::normalize(n);
+}
+
+void octahedralEncode16(const glm::vec3 &normal, int16_t out[2]) {
+  glm::vec2 p = octahedralEncode(normal);
+  float baseX = std::floor(std::clamp(p.x, -1.f, 1.f) * 32767.f);
+  float baseY = std::floor(std::clamp(p.y, -1.f, 1.f) * 32767.f);
+
+  // Rounding to nearest is not always closest once unfolded, so try the
+  // four neighbouring codes
+  float bestDot = -2.f;
+  for (int i = 0; i < 4; i++) {
+    int16_t x = static_cast<int16_t>(
+        std::clamp(baseX + (i & 1), -32767.f, 32767.f));
+    int16_t y = static_cast<int16_t>(
+        std::clamp(baseY + (i >> 1), -32767.f, 32767.f));
+    float d = glm::dot(
+        octahedralDecode({unpackSnorm16(x), unpackSnorm16(y)}), normal);
+    if (d > bestDot) {
+      bestDot = d;
+      out[0] = x;
+      out[1] = y;
+    }
+  }
+}
+
+}  // namespace vse
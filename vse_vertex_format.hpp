@@ -0,0 +1,73 @@
+#pragma once
+
+// libs
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <string>
+
+namespace vse {
+
+// How a VseModel stores its vertices on the GPU. Quantized positions are
+// stored relative to the mesh bounds and rescaled in the vertex shader,
+// octahedral normals are two components unfolded back onto the sphere.
+// Every attribute stays 4 byte aligned.
+struct VseVertexFormat {
+  enum class Position : uint32_t { Float32, Float16, Snorm16 };
+  enum class Color : uint32_t { Float32, Unorm8 };
+  enum class Normal : uint32_t { Float32, Octahedral16 };
+
+  Position position = Position::Float32;
+  Color color = Color::Float32;
+  Normal normal = Normal::Float32;
+
+  // snorm16 positions, unorm8 colors and 16 bit octahedral normals:
+  // 16 bytes per vertex against 36 for float32 everywhere
+  static constexpr VseVertexFormat compact() {
+    return {Position::Snorm16, Color::Unorm8, Normal::Octahedral16};
+  }
+
+  VkFormat positionFormat() const;
+  VkFormat colorFormat() const;
+  VkFormat normalFormat() const;
+
+  uint32_t positionSize() const;
+  uint32_t colorSize() const;
+  uint32_t normalSize() const;
+  uint32_t stride() const {
+    return positionSize() + colorSize() + normalSize();
+  }
+
+  // Whether positions go through the per-mesh scale and offset
+  bool isPositionQuantized() const { return position != Position::Float32; }
+  bool isNormalOctahedral() const { return normal == Normal::Octahedral16; }
+
+  // Distinct for every combination, usable as a map key
+  uint32_t id() const {
+    return static_cast<uint32_t>(position) |
+           static_cast<uint32_t>(color) << 4 |
+           static_cast<uint32_t>(normal) << 8;
+  }
+  bool operator==(const VseVertexFormat &other) const {
+    return id() == other.id();
+  }
+  bool operator!=(const VseVertexFormat &other) const {
+    return !(*this == other);
+  }
+
+  // e.g. "snorm16/unorm8/oct16", for logs
+  std::string name() const;
+};
+
+// Maps a unit vector onto the [-1, 1] square. octahedralEncode16 picks the
+// rounding of each component that decodes closest to the input.
+glm::vec2 octahedralEncode(const glm::vec3 &normal);
+glm::vec3 octahedralDecode(const glm::vec2 &encoded);
+void octahedralEncode16(const glm::vec3 &normal, int16_t out[2]);
+
+}  // namespace vse
@@ -22,6 +22,7 @@ class VseWindow {
   }
   bool wasWindowResized() { return frameBufferResized; }
   void resetWindowResizedFlag() { frameBufferResized = false; }
+  GLFWwindow *getGLFWwindow() const { return window; }
 
   void createWindowSurface(VkInstance instance, VkSurfaceKHR *surface);
 